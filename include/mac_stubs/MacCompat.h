@@ -74,6 +74,222 @@ typedef void* TimerUPP;
 #define DisposeTimerUPP(upp) /* no-op */
 #endif
 
+/* ============================================================
+ * HFS Plus fork APIs (Mac OS 9.0+, Files.h) - not in Multiverse.h.
+ * Check Gestalt(gestaltFSAttr) for gestaltHasHFSPlusAPIs before use.
+ * ============================================================ */
+#ifndef gestaltHasHFSPlusAPIs
+#define gestaltFSAttr           'fs  '
+#define gestaltHasHFSPlusAPIs   12
+
+#define notAFileErr             -1302   /* Expected a file, got a folder */
+#define fsDataTooBigErr         -1310   /* File or volume too big for system */
+#define errFSForkNotFound       -1409   /* Named fork does not exist */
+
+pascal OSErr Gestalt(OSType selector, long *response);
+
+typedef struct FSRef {
+    UInt8           hidden[80];
+} FSRef;
+
+typedef struct HFSUniStr255 {
+    UInt16          length;
+    UniChar         unicode[255];
+} HFSUniStr255;
+
+typedef struct CatPositionRec {
+    long            initialize;
+    short           priv[6];
+} CatPositionRec;
+
+typedef struct FSForkIOParam {
+    void *          qLink;
+    short           qType;
+    short           ioTrap;
+    Ptr             ioCmdAddr;
+    void *          ioCompletion;
+    volatile OSErr  ioResult;
+    void *          reserved1;
+    SInt16          reserved2;
+    SInt16          forkRefNum;
+    UInt8           reserved3;
+    SInt8           permissions;
+    const FSRef *   ref;
+    Ptr             buffer;
+    UInt32          requestCount;
+    UInt32          actualCount;
+    UInt16          positionMode;
+    SInt64          positionOffset;
+    UInt16          allocationFlags;
+    UInt64          allocationAmount;
+    UniCharCount    forkNameLength;
+    const UniChar * forkName;
+    CatPositionRec  forkIterator;
+    HFSUniStr255 *  outForkName;
+} FSForkIOParam;
+
+pascal OSErr FSpMakeFSRef(const FSSpec *source, FSRef *newRef);
+pascal OSErr FSGetDataForkName(HFSUniStr255 *dataForkName);
+pascal OSErr FSOpenFork(const FSRef *ref, UniCharCount forkNameLength,
+                        const UniChar *forkName, SInt8 permissions, SInt16 *forkRefNum);
+pascal OSErr FSCloseFork(SInt16 forkRefNum);
+pascal OSErr FSGetForkSize(SInt16 forkRefNum, SInt64 *forkSize);
+pascal OSErr FSSetForkSize(SInt16 forkRefNum, UInt16 positionMode, SInt64 positionOffset);
+pascal OSErr PBReadForkSync(FSForkIOParam *paramBlock);
+pascal OSErr PBWriteForkSync(FSForkIOParam *paramBlock);
+
+/* Catalog iteration: many directory entries per call */
+#define errFSNoMoreItems        -1417   /* Iteration ran off the end */
+
+enum {
+    kFSIterateFlat          = 0,        /* Immediate children only */
+    kFSIterateSubtree       = 1
+};
+
+enum {
+    kFSCatInfoNone          = 0x00000000,
+    kFSCatInfoTextEncoding  = 0x00000001,
+    kFSCatInfoNodeFlags     = 0x00000002,
+    kFSCatInfoVolume        = 0x00000004,
+    kFSCatInfoParentDirID   = 0x00000008,
+    kFSCatInfoNodeID        = 0x00000010,
+    kFSCatInfoCreateDate    = 0x00000020,
+    kFSCatInfoContentMod    = 0x00000040,
+    kFSCatInfoAttrMod       = 0x00000080,
+    kFSCatInfoAccessDate    = 0x00000100,
+    kFSCatInfoBackupDate    = 0x00000200,
+    kFSCatInfoPermissions   = 0x00000400,
+    kFSCatInfoFinderInfo    = 0x00000800,
+    kFSCatInfoFinderXInfo   = 0x00001000,
+    kFSCatInfoValence       = 0x00002000,
+    kFSCatInfoDataSizes     = 0x00004000,
+    kFSCatInfoRsrcSizes     = 0x00008000
+};
+
+enum {
+    kFSNodeLockedMask       = 0x0001,
+    kFSNodeIsDirectoryMask  = 0x0010
+};
+
+typedef UInt32 FSIteratorFlags;
+typedef UInt32 FSCatalogInfoBitmap;
+typedef struct OpaqueFSIterator *FSIterator;
+
+#pragma pack(push, 2)
+typedef struct UTCDateTime {
+    UInt16          highSeconds;
+    UInt32          lowSeconds;         /* Seconds since 1904, UTC */
+    UInt16          fraction;
+} UTCDateTime;
+
+typedef struct FSCatalogInfo {
+    UInt16          nodeFlags;
+    SInt16          volume;
+    UInt32          parentDirID;
+    UInt32          nodeID;
+    UInt8           sharingFlags;
+    UInt8           userPrivileges;
+    UInt8           reserved1;
+    UInt8           reserved2;
+    UTCDateTime     createDate;
+    UTCDateTime     contentModDate;
+    UTCDateTime     attributeModDate;
+    UTCDateTime     accessDate;
+    UTCDateTime     backupDate;
+    UInt32          permissions[4];
+    UInt8           finderInfo[16];
+    UInt8           extFinderInfo[16];
+    UInt64          dataLogicalSize;
+    UInt64          dataPhysicalSize;
+    UInt64          rsrcLogicalSize;
+    UInt64          rsrcPhysicalSize;
+    UInt32          valence;
+    TextEncoding    textEncodingHint;
+} FSCatalogInfo;
+#pragma pack(pop)
+
+pascal OSErr FSOpenIterator(const FSRef *container, FSIteratorFlags iteratorFlags,
+                            FSIterator *iterator);
+pascal OSErr FSCloseIterator(FSIterator iterator);
+pascal OSErr FSGetCatalogInfoBulk(FSIterator iterator, ItemCount maximumObjects,
+                                  ItemCount *actualObjects, Boolean *containerChanged,
+                                  FSCatalogInfoBitmap whichInfo, FSCatalogInfo *catalogInfos,
+                                  FSRef *refs, FSSpec *specs, HFSUniStr255 *names);
+#endif
+
+/* ============================================================
+ * Catalog search (System 7, Files.h) - not in Multiverse.h.
+ * Check PBHGetVolParms for bHasCatSearch before use; not every
+ * volume format (or AppleShare server) supports it.
+ * ============================================================ */
+#ifndef bHasCatSearch
+#define bHasCatSearch           7       /* vMAttrib bit */
+#define catChangedErr           -1304   /* Catalog changed; position is stale */
+
+#define fsSBPartialName         1
+#define fsSBFullName            2
+#define fsSBFlAttrib            4
+#define fsSBFlFndrInfo          8
+#define fsSBFlLgLen             32
+#define fsSBFlMdDat             1024
+#define fsSBNegate              16384   /* Reverse the name criteria */
+
+typedef struct HIOParam {
+    void *          qLink;
+    short           qType;
+    short           ioTrap;
+    Ptr             ioCmdAddr;
+    void *          ioCompletion;
+    volatile OSErr  ioResult;
+    StringPtr       ioNamePtr;
+    short           ioVRefNum;
+    short           ioRefNum;
+    SInt8           ioVersNum;
+    SInt8           ioPermssn;
+    Ptr             ioMisc;
+    Ptr             ioBuffer;
+    long            ioReqCount;
+    long            ioActCount;
+    short           ioPosMode;
+    long            ioPosOffset;
+} HIOParam;
+
+typedef union HParamBlockRec {
+    HIOParam        ioParam;
+} HParamBlockRec, *HParmBlkPtr;
+
+typedef struct GetVolParmsInfoBuffer {
+    short           vMVersion;
+    long            vMAttrib;
+    Handle          vMLocalHand;
+    long            vMServerAdr;
+} GetVolParmsInfoBuffer;
+
+typedef struct CSParam {
+    void *          qLink;
+    short           qType;
+    short           ioTrap;
+    Ptr             ioCmdAddr;
+    void *          ioCompletion;
+    volatile OSErr  ioResult;
+    StringPtr       ioNamePtr;
+    short           ioVRefNum;
+    FSSpec *        ioMatchPtr;
+    long            ioReqMatchCount;
+    long            ioActMatchCount;
+    long            ioSearchBits;
+    CInfoPBPtr      ioSearchInfo1;      /* Values, or lower bounds */
+    CInfoPBPtr      ioSearchInfo2;      /* Masks, or upper bounds */
+    long            ioSearchTime;       /* Ticks; 0 for no limit */
+    CatPositionRec  ioCatPosition;      /* initialize 0 to start */
+    Ptr             ioOptBuffer;
+    long            ioOptBufSize;
+} CSParam, *CSParamPtr;
+
+pascal OSErr PBHGetVolParmsSync(HParmBlkPtr paramBlock);
+pascal OSErr PBCatSearchSync(CSParamPtr paramBlock);
+#endif
+
 /* OSStatus - may not be defined */
 #ifndef OSStatus
 typedef SInt32 OSStatus;
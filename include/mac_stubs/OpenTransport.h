@@ -51,6 +51,57 @@ typedef struct TNetbuf {
     UInt8  *buf;        /* Buffer pointer */
 } TNetbuf;
 
+/*
+ * OTData - one piece of a no-copy send. Pass the first as the buffer
+ * and kNetbufDataIsOTData as the length to OTSnd to send the chain.
+ */
+typedef struct OTData {
+    void *      fNext;      /* Next OTData in the chain, or NULL */
+    void *      fData;      /* Bytes to send */
+    OTByteCount fLen;
+} OTData;
+
+#define kNetbufDataIsOTData     ((OTByteCount)0xFFFFFFFE)
+
+/*
+ * OTBuffer - one piece of a no-copy receive. Pass a pointer to an
+ * OTBuffer* and kOTNetbufDataIsOTBufferStar as the length to OTRcv to
+ * take OT's own buffers; give them back with OTReleaseBuffer.
+ */
+typedef struct OTBuffer {
+    void *          fLink;
+    void *          fLink2;
+    struct OTBuffer *fNext;     /* Next piece, or NULL */
+    UInt8 *         fData;      /* Received bytes */
+    OTByteCount     fLen;
+    void *          fSave;
+    UInt8           fBand;
+    UInt8           fType;
+    UInt8           fPad1;
+    UInt8           fFlags;
+} OTBuffer;
+
+/* A position in an OTBuffer chain, for OTReadBuffer */
+typedef struct OTBufferInfo {
+    OTBuffer *      fBuffer;
+    OTByteCount     fOffset;
+    UInt8           fPad;
+} OTBufferInfo;
+
+#define kOTNetbufDataIsOTBufferStar ((OTByteCount)0xFFFFFFFD)
+
+/*
+ * OTLink/OTLIFO - atomic singly linked lists. Enqueueing and stealing
+ * the whole list are safe from notifiers and from the main thread.
+ */
+typedef struct OTLink {
+    struct OTLink * fNext;
+} OTLink;
+
+typedef struct OTLIFO {
+    OTLink * volatile fHead;
+} OTLIFO;
+
 /* ============================================================
  * OT Address
  * ============================================================ */
@@ -122,7 +173,11 @@ enum {
     T_ORDREL        = 0x0080,
     T_GODATA        = 0x0100,
     T_PASSCON       = 0x0200,
-    T_UDERR         = 0x0400
+    T_UDERR         = 0x0400,
+    T_BINDCOMPLETE  = 0x20000001,   /* Asynchronous calls finished */
+    T_UNBINDCOMPLETE = 0x20000002,
+    T_ACCEPTCOMPLETE = 0x20000003,
+    T_MEMORYRELEASED = 0x2000000C   /* OTAckSends: cookie is the buffer sent */
 };
 
 /* OT flags */
@@ -298,12 +353,14 @@ OSStatus OTUnbind(EndpointRef ref);
 
 /* Connection */
 OSStatus OTConnect(EndpointRef ref, TCall* sndCall, TCall* rcvCall);
+OSStatus OTRcvConnect(EndpointRef ref, TCall* call);
 OSStatus OTListen(EndpointRef ref, TCall* call);
 OSStatus OTAccept(EndpointRef ref, EndpointRef resRef, TCall* call);
 
 /* Data transfer (TCP) */
 OTResult OTSnd(EndpointRef ref, void* buf, OTByteCount nbytes, OTFlags flags);
 OTResult OTRcv(EndpointRef ref, void* buf, OTByteCount nbytes, OTFlags* flags);
+OSStatus OTCountDataBytes(EndpointRef ref, OTByteCount* countPtr);
 
 /* Data transfer (UDP) */
 OSStatus OTSndUData(EndpointRef ref, TUnitData* udata);
@@ -313,6 +370,7 @@ OSStatus OTRcvUData(EndpointRef ref, TUnitData* udata, OTFlags* flags);
 OSStatus OTSndDisconnect(EndpointRef ref, TCall* call);
 OSStatus OTRcvDisconnect(EndpointRef ref, TDiscon* discon);
 OSStatus OTSndOrderlyDisconnect(EndpointRef ref);
+OSStatus OTRcvOrderlyDisconnect(EndpointRef ref);
 
 /* Mode setting */
 OSStatus OTSetNonBlocking(EndpointRef ref);
@@ -320,12 +378,32 @@ OSStatus OTSetBlocking(EndpointRef ref);
 OSStatus OTSetSynchronous(EndpointRef ref);
 OSStatus OTSetAsynchronous(EndpointRef ref);
 
+/* No-copy sends: OT keeps the caller's buffer until T_MEMORYRELEASED */
+OSStatus OTAckSends(EndpointRef ref);
+OSStatus OTDontAckSends(EndpointRef ref);
+
+/* Memory OT may touch at deferred task time */
+void *   OTAllocMem(OTByteCount size);
+void     OTFreeMem(void* mem);
+
+/* No-copy receives: copy out from a position, give the chain back */
+Boolean  OTReadBuffer(OTBufferInfo* buffer, void* dest, OTByteCount* len);
+void     OTReleaseBuffer(OTBuffer* buffer);
+
 /* Event polling */
 OTResult OTLook(EndpointRef ref);
 
+/* Atomic lists (OTUtilityLib) */
+void     OTLIFOEnqueue(OTLIFO* list, OTLink* link);
+OTLink * OTLIFOStealList(OTLIFO* list);
+
 /* Notification */
 OSStatus OTInstallNotifier(ProviderRef ref, OTNotifyUPP proc, void* context);
 
+/* Hold off ref's notifier while the main thread changes what it reads */
+Boolean  OTEnterNotifier(ProviderRef ref);
+void     OTLeaveNotifier(ProviderRef ref);
+
 /* ============================================================
  * DNS / Address Functions
  * ============================================================ */
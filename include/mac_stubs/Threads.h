@@ -20,6 +20,20 @@ typedef UInt32 ThreadID;
 #define kCurrentThreadID    1
 #endif
 
+/* Thread Manager result codes */
+#ifndef threadTooManyReqsErr
+#define threadTooManyReqsErr    -617
+#endif
+#ifndef threadNotFoundErr
+#define threadNotFoundErr       -618
+#endif
+#ifndef threadProtocolErr
+#define threadProtocolErr       -619
+#endif
+
+/* Opaque handle that lets interrupt-level code ready a stopped thread */
+typedef void* ThreadTaskRef;
+
 /* Thread state */
 typedef UInt16 ThreadState;
 enum {
@@ -84,6 +98,20 @@ OSErr SetThreadTerminator(ThreadID thread, ThreadTerminationProcPtr terminationP
 OSErr SetThreadSwitcher(ThreadID thread, ThreadSwitchProcPtr threadSwitcher,
                         void* switchProcParam, Boolean inOrOut);
 
+/* Critical sections - the scheduler will not switch threads inside one */
+OSErr ThreadBeginCritical(void);
+
+OSErr ThreadEndCritical(void);
+
+/* Change a thread's state and leave the critical section atomically */
+OSErr SetThreadStateEndCritical(ThreadID threadToSet, ThreadState newState,
+                                ThreadID suggestedThread);
+
+/* Interrupt-safe wake-up for completion routines and Time Manager tasks */
+OSErr GetThreadCurrentTaskRef(ThreadTaskRef* threadTRef);
+
+OSErr SetThreadReadyGivenTaskRef(ThreadTaskRef threadTRef, ThreadID threadToSet);
+
 OSErr GetFreeThreadCount(ThreadStyle threadStyle, SInt16* freeCount);
 
 OSErr GetSpecificFreeThreadCount(ThreadStyle threadStyle, Size stackSize,
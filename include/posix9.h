@@ -8,6 +8,12 @@
 #ifndef POSIX9_H
 #define POSIX9_H
 
+/* Size fd_set to cover the whole descriptor table (POSIX9_OPEN_MAX).
+ * Must come before newlib's <sys/select.h>, which defaults to 64. */
+#ifndef FD_SETSIZE
+#define FD_SETSIZE  256
+#endif
+
 /* When building with Retro68/newlib, include system headers first
  * to get their type definitions. We only provide what's missing. */
 #ifdef __NEWLIB__
@@ -29,6 +35,12 @@
 #include "posix9/time.h"
 #endif
 #include "posix9/unistd.h"
+#include "posix9/aio.h"
+#include "posix9/mman.h"
+#include "posix9/fts.h"
+#include "posix9/ftw.h"
+#include "posix9/poll.h"
+#include "posix9/epoll.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +59,13 @@ extern "C" {
 #define O_TRUNC     0x0400      /* truncate to zero length */
 #define O_EXCL      0x0800      /* error if already exists */
 #define O_NONBLOCK  0x0004      /* non-blocking I/O */
+#define O_LARGEFILE 0x0000      /* accepted; every open is large-file capable */
+#define O_DIRECTORY 0x200000    /* fail unless the path is a directory */
+
+/* *at() directory and flag values */
+#define AT_FDCWD            -2  /* resolve relative to the current directory */
+#define AT_SYMLINK_NOFOLLOW 2   /* accepted; there are no symlinks */
+#define AT_REMOVEDIR        8   /* unlinkat() removes a directory */
 
 /* lseek() whence values */
 #define SEEK_SET    0           /* from beginning */
@@ -69,6 +88,80 @@ int     ftruncate(int fd, off_t length);
 int     dup(int oldfd);
 int     dup2(int oldfd, int newfd);
 
+/* Positional and vectored I/O - pread/pwrite leave the file offset alone */
+ssize_t pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+
+/*
+ * Directory-relative calls. dirfd is a descriptor from open(dir,
+ * O_RDONLY) or dirfd(), or AT_FDCWD. A single name is looked up in the
+ * directory's own catalog entry - one catalog search however deep the
+ * directory is - instead of walking the whole path again.
+ */
+int     openat(int dirfd, const char *path, int flags, ...);
+int     fstatat(int dirfd, const char *path, struct stat *buf, int flags);
+int     unlinkat(int dirfd, const char *path, int flags);
+int     renameat(int olddirfd, const char *oldpath, int newdirfd, const char *newpath);
+
+/*
+ * Large files (over 2 GB). Offsets and sizes are 64-bit throughout;
+ * when the File Manager has the HFS Plus APIs (Mac OS 9) files are
+ * opened with FSOpenFork and moved with the fork calls. On older
+ * systems these fall back to the classic calls, and anything past
+ * 2 GB - 1 fails with EFBIG. The off_t calls above fail with EOVERFLOW
+ * when a result does not fit. Define POSIX9_LARGEFILE before including
+ * posix9.h to make off_t, struct stat and the calls taking them 64-bit.
+ */
+off64_t lseek64(int fd, off64_t offset, int whence);
+ssize_t pread64(int fd, void *buf, size_t count, off64_t offset);
+ssize_t pwrite64(int fd, const void *buf, size_t count, off64_t offset);
+int     ftruncate64(int fd, off64_t length);
+int     fstat64(int fd, struct stat64 *buf);
+int     stat64(const char *path, struct stat64 *buf);
+int     lstat64(const char *path, struct stat64 *buf);
+int     fstatat64(int dirfd, const char *path, struct stat64 *buf, int flags);
+
+/*
+ * Set the per-descriptor read-ahead block size (default 4096 for
+ * readable files, 0 disables). Small reads are served from this block
+ * so sequential line-oriented parsing costs one File Manager call per
+ * block instead of one per read().
+ */
+int     posix9_set_readahead(int fd, long size);
+
+/*
+ * Set the per-descriptor write-behind buffer size (default 4096 for
+ * writable files, 0 disables). Small contiguous writes are coalesced
+ * and issued when the buffer fills or on fsync/lseek/read/close; a
+ * failure in a deferred write is reported by the call that flushes it.
+ * O_APPEND descriptors track EOF locally instead of seeking per write.
+ */
+int     posix9_set_writebehind(int fd, long size);
+
+/* ============================================================
+ * Metadata Caches (posix9_statcache.c, posix9_pathcache.c)
+ * ============================================================ */
+
+/*
+ * stat() and fstat() keep the last POSIX9_STATCACHE_SIZE catalog
+ * lookups. Calls made through POSIX9 that change a file drop its entry;
+ * flush after other applications may have changed the disk.
+ */
+void    posix9_statcache_stats(posix9_cache_stats *stats);
+void    posix9_statcache_flush(void);
+
+/*
+ * Path resolution keeps the last POSIX9_PATHCACHE_SIZE directories it
+ * walked through, so a warm lookup of a deep path only asks the catalog
+ * about its leaf. rmdir() and rename() drop what they make stale; flush
+ * after other applications may have moved or deleted directories (this
+ * also makes getcwd() rebuild its cached path).
+ */
+void    posix9_pathcache_stats(posix9_cache_stats *stats);
+void    posix9_pathcache_flush(void);
+
 /* ============================================================
  * Directory Operations (posix9_dir.c)
  * ============================================================ */
@@ -77,11 +170,67 @@ DIR *   opendir(const char *name);
 struct dirent *readdir(DIR *dirp);
 int     closedir(DIR *dirp);
 void    rewinddir(DIR *dirp);
+int     dirfd(DIR *dirp);          /* descriptor shared with files/sockets */
 int     mkdir(const char *path, mode_t mode);
 int     rmdir(const char *path);
+int     mkdirat(int dirfd, const char *path, mode_t mode);
+DIR *   fdopendir(int fd);          /* takes over a directory descriptor */
 int     chdir(const char *path);
 char *  getcwd(char *buf, size_t size);
 
+/*
+ * Streams come from blocks of POSIX9_DIR_BLOCK that are allocated as
+ * needed and given back when all of theirs are closed, so only the
+ * descriptor table limits how many are open.
+ */
+void    posix9_dir_stats(posix9_dir_usage *stats);
+
+/*
+ * readdir() plus the entry's stat(), from the catalog info the listing
+ * already fetched - no File Manager call of its own. A stat() or
+ * fstatat() of the entry readdir() just returned is free as well.
+ */
+struct dirent *posix9_readdir_plus(DIR *dirp, struct stat *buf);
+struct dirent *posix9_readdir_plus64(DIR *dirp, struct stat64 *buf);
+
+/* ============================================================
+ * Catalog Search (posix9_find.c)
+ * ============================================================ */
+
+/*
+ * Find the entries below path that match spec with the File Manager's
+ * PBCatSearch, which scans the volume's catalog B-tree in order instead
+ * of listing every directory: a search costs a handful of calls however
+ * many folders the volume has, plus one per match for its stat() and
+ * any of its folders the directory cache has not seen. Names match
+ * without regard to the case of ASCII letters. Size, Finder type and
+ * creator only match files. On volumes without CatSearch (some servers)
+ * the tree below path is walked instead, with the same results.
+ *
+ * A search that sees the catalog change part way starts over, so it may
+ * return an entry twice. Matches come in catalog order, not by path.
+ */
+POSIX9_FIND *posix9_find_open(const char *path, const posix9_find_spec *spec);
+
+/*
+ * The path of the next match - path as given plus the names below it,
+ * valid until the next call - and its stat() in buf unless that is
+ * NULL. NULL with errno 0 after the last.
+ */
+const char *posix9_find_next(POSIX9_FIND *f, struct stat *buf);
+const char *posix9_find_next64(POSIX9_FIND *f, struct stat64 *buf);
+
+int     posix9_find_close(POSIX9_FIND *f);
+
+/* Call fn for each match, stopping at the first non-zero result, which
+ * comes back; -1 with errno set if the search fails */
+int     posix9_find(const char *path, const posix9_find_spec *spec,
+                    int (*fn)(const char *path, const struct stat *sb, void *arg),
+                    void *arg);
+int     posix9_find64(const char *path, const posix9_find_spec *spec,
+                      int (*fn)(const char *path, const struct stat64 *sb, void *arg),
+                      void *arg);
+
 /* ============================================================
  * Path Translation (posix9_path.c)
  * ============================================================ */
@@ -102,6 +251,27 @@ char *  posix9_path_to_mac(const char *posix_path, char *dst, size_t dst_size);
  */
 char *  posix9_path_from_mac(const char *mac_path, char *dst, size_t dst_size);
 
+/*
+ * Filename encoding. POSIX names are UTF-8 and HFS names are in a Mac
+ * encoding - by default the system script's, from the Script Manager.
+ * The path conversions above and every path taken by the POSIX calls
+ * convert between the two; getcwd() and readdir() return UTF-8. A
+ * character the encoding lacks makes a name invalid (EINVAL). Values
+ * are the Text Encoding Converter's base encodings.
+ */
+#define POSIX9_ENCODING_SYSTEM          (-1)
+#define POSIX9_ENCODING_MACROMAN        0
+#define POSIX9_ENCODING_MACGREEK        6
+#define POSIX9_ENCODING_MACCYRILLIC     7
+#define POSIX9_ENCODING_MACCENTRALEUR   29
+#define POSIX9_ENCODING_MACTURKISH      35
+#define POSIX9_ENCODING_MACCROATIAN     36
+#define POSIX9_ENCODING_MACICELANDIC    37
+#define POSIX9_ENCODING_MACROMANIAN     38
+
+int     posix9_set_filename_encoding(int encoding);    /* -1, EINVAL if unknown */
+int     posix9_get_filename_encoding(void);
+
 /*
  * Get FSSpec from POSIX path
  */
@@ -154,4 +324,24 @@ void    posix9_cleanup(void);
 }
 #endif
 
+/* Large-file mode: the application sees a 64-bit off_t everywhere */
+#ifdef POSIX9_LARGEFILE
+#define off_t       off64_t
+#define lseek       lseek64
+#define pread       pread64
+#define pwrite      pwrite64
+#define ftruncate   ftruncate64
+#define fstat       fstat64
+#define stat        stat64          /* struct stat too */
+#define lstat       lstat64
+#define fstatat     fstatat64
+#define posix9_readdir_plus posix9_readdir_plus64
+#define fts_open    fts_open64      /* FTSENT's fts_statp is a struct stat64 */
+#define nftw        nftw64
+#define posix9_find_next posix9_find_next64
+#define posix9_find posix9_find64
+#define sendfile    sendfile64
+#define mmap        mmap64
+#endif
+
 #endif /* POSIX9_H */
@@ -0,0 +1,74 @@
+/*
+ * posix9/aio.h - POSIX asynchronous I/O for Mac OS 9
+ * Maps to PBReadAsync/PBWriteAsync with an ioCompletion routine
+ */
+
+#ifndef POSIX9_AIO_H
+#define POSIX9_AIO_H
+
+#include "types.h"
+
+/* struct timespec: newlib's <time.h> has it, else posix9/time.h */
+#ifdef __NEWLIB__
+#include <time.h>
+#else
+#include "time.h"
+#endif
+
+/* Maximum requests in flight at once */
+#define AIO_MAX             32
+
+/* aio_cancel() results */
+#define AIO_CANCELED        0
+#define AIO_NOTCANCELED     1
+#define AIO_ALLDONE         2
+
+/* aio_lio_opcode values */
+#define LIO_NOP             0
+#define LIO_READ            1
+#define LIO_WRITE           2
+
+/*
+ * Asynchronous I/O control block. Fill in the aio_ fields and leave
+ * the __aio_ fields alone - they belong to the engine until the
+ * request has been reaped with aio_return().
+ */
+struct aiocb {
+    int             aio_fildes;     /* File descriptor */
+    off_t           aio_offset;     /* File offset */
+    volatile void * aio_buf;        /* Buffer */
+    size_t          aio_nbytes;     /* Transfer length */
+    int             aio_reqprio;    /* Ignored - the File Manager queues FIFO */
+    int             aio_lio_opcode; /* LIO_READ / LIO_WRITE */
+
+    int             __aio_slot;     /* Engine request slot, -1 once reaped */
+    int             __aio_error;    /* errno result once complete */
+    ssize_t         __aio_return;   /* Byte count once complete */
+};
+
+/* ============================================================
+ * Asynchronous I/O Functions
+ * ============================================================ */
+
+/* Queue a read/write; returns 0 once the parameter block is issued */
+int     aio_read(struct aiocb *aiocbp);
+int     aio_write(struct aiocb *aiocbp);
+
+/* EINPROGRESS while queued, then 0 or the request's errno */
+int     aio_error(const struct aiocb *aiocbp);
+
+/* Byte count of a finished request; releases the request */
+ssize_t aio_return(struct aiocb *aiocbp);
+
+/*
+ * Park the calling thread until one of the listed requests finishes.
+ * Other Thread Manager threads run meanwhile; the completion routine
+ * readies this thread. timeout NULL waits forever.
+ */
+int     aio_suspend(const struct aiocb *const list[], int nent,
+                    const struct timespec *timeout);
+
+/* The File Manager cannot withdraw a queued call: AIO_ALLDONE or AIO_NOTCANCELED */
+int     aio_cancel(int fd, struct aiocb *aiocbp);
+
+#endif /* POSIX9_AIO_H */
@@ -0,0 +1,73 @@
+/*
+ * posix9/epoll.h - Persistent socket interest sets for Mac OS 9
+ * Sockets stay registered between waits; the Open Transport notifier
+ * queues each event on the set that watches the socket, so a wait
+ * costs one step per event, not one per socket registered
+ */
+
+#ifndef POSIX9_EPOLL_H
+#define POSIX9_EPOLL_H
+
+#include "types.h"
+
+/* posix9_epoll_ctl() operations */
+#ifndef EPOLL_CTL_ADD
+#define EPOLL_CTL_ADD       1
+#define EPOLL_CTL_DEL       2
+#define EPOLL_CTL_MOD       3
+#endif
+
+/* Event bits */
+#ifndef EPOLLIN
+#define EPOLLIN             0x00000001U     /* Data, a connection to accept, or EOF */
+#define EPOLLPRI            0x00000002U     /* Expedited (OOB) data */
+#define EPOLLOUT            0x00000004U     /* Room to write */
+#define EPOLLERR            0x00000008U     /* Always reported */
+#define EPOLLHUP            0x00000010U     /* Always reported: connection broken */
+#define EPOLLONESHOT        0x40000000U     /* Report once, then wait for EPOLL_CTL_MOD */
+#define EPOLLET             0x80000000U     /* Edge-triggered: once per notifier event */
+#endif
+
+typedef union epoll_data {
+    void *              ptr;
+    int                 fd;
+    unsigned int        u32;
+    unsigned long long  u64;
+} epoll_data_t;
+
+struct epoll_event {
+    unsigned int        events;             /* EPOLL* bits */
+    epoll_data_t        data;               /* Given back as registered */
+};
+
+/* ============================================================
+ * Interest Set Functions
+ * ============================================================ */
+
+/*
+ * A new, empty interest set, as a descriptor; close() it when done.
+ * size must be positive and is otherwise ignored.
+ */
+int     posix9_epoll_create(int size);
+
+/*
+ * Add, change or remove socket fd in set epfd. A socket may be in
+ * several sets; it leaves them all when its last descriptor closes.
+ * Fails with EBADF for a closed descriptor, EPERM for one that is not
+ * a socket, EEXIST when adding one already there, ENOENT when changing
+ * or removing one that is not, and EINVAL when epfd is not a set.
+ */
+int     posix9_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+
+/*
+ * Wait up to timeout milliseconds (-1: forever, 0: just look) for a
+ * registered socket to be ready, and return up to maxevents of them.
+ * Level-triggered sockets are reported on every call while ready, in
+ * turn when more are ready than maxevents; EPOLLET ones once for each
+ * event. Other threads and applications run while it waits.
+ * poll() and select() on the set's descriptor see it readable when a
+ * wait here would report something, and wake when an event arrives.
+ */
+int     posix9_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+#endif /* POSIX9_EPOLL_H */
@@ -51,6 +51,7 @@ extern int posix9_errno;
 #define ENOSYS          38      /* Function not implemented */
 #define ENOTEMPTY       39      /* Directory not empty */
 #define ELOOP           40      /* Too many symbolic links */
+#define EOVERFLOW       75      /* Value too large for defined data type */
 #define EWOULDBLOCK     EAGAIN  /* Operation would block */
 
 /* Socket errors (for Open Transport mapping) */
@@ -0,0 +1,109 @@
+/*
+ * posix9/fts.h - File hierarchy traversal for Mac OS 9
+ * A subset of BSD fts: the walk goes by directory ID from an explicit
+ * stack, never chdir()s, and takes each entry's stat data from the
+ * catalog record that listed it
+ */
+
+#ifndef POSIX9_FTS_H
+#define POSIX9_FTS_H
+
+#include "types.h"
+
+/* fts_open() options - every walk is physical and never chdir()s, and
+ * never leaves the volume it starts on, so most of these change nothing */
+#ifndef FTS_COMFOLLOW
+#define FTS_COMFOLLOW       0x001
+#define FTS_LOGICAL         0x002
+#define FTS_NOCHDIR         0x004
+#define FTS_NOSTAT          0x008
+#define FTS_PHYSICAL        0x010
+#define FTS_SEEDOT          0x020   /* There are no "." or ".." entries */
+#define FTS_XDEV            0x040
+#endif
+
+#define FTS_ROOTPARENTLEVEL -1
+#define FTS_ROOTLEVEL       0
+
+/* fts_info values */
+#ifndef FTS_D
+#define FTS_D               1       /* Directory, before its contents */
+#define FTS_DC              2       /* Directory cycle - never returned */
+#define FTS_DEFAULT         3
+#define FTS_DNR             4       /* Directory that could not be read */
+#define FTS_DOT             5
+#define FTS_DP              6       /* Directory, after its contents */
+#define FTS_ERR             7
+#define FTS_F               8       /* File */
+#define FTS_INIT            9
+#define FTS_NS              10      /* No stat data; see fts_errno */
+#define FTS_NSOK            11
+#define FTS_SL              12
+#define FTS_SLNONE          13
+#endif
+
+/* fts_set() instructions */
+#ifndef FTS_SKIP
+#define FTS_AGAIN           1       /* Not supported - EINVAL */
+#define FTS_FOLLOW          2       /* Nothing to follow */
+#define FTS_NOINSTR         3
+#define FTS_SKIP            4       /* Do not descend into this directory */
+#endif
+
+typedef struct _ftsent {
+    struct _ftsent *fts_parent;     /* Directory it is in */
+    char *          fts_path;       /* Root path plus the names below it */
+    char *          fts_accpath;    /* Same as fts_path */
+    char *          fts_name;       /* Last component of fts_path */
+    size_t          fts_pathlen;
+    size_t          fts_namelen;
+    short           fts_level;      /* FTS_ROOTLEVEL for the paths given */
+    unsigned short  fts_info;       /* FTS_D, FTS_DP, FTS_F, ... */
+    int             fts_errno;      /* Why FTS_DNR or FTS_NS */
+    long            fts_number;     /* For the caller */
+    void *          fts_pointer;    /* For the caller */
+    ino_t           fts_ino;        /* dirID or file ID, as readdir() gives */
+    dev_t           fts_dev;        /* vRefNum */
+    nlink_t         fts_nlink;
+#ifdef POSIX9_LARGEFILE
+    struct stat64 * fts_statp;      /* From fts_open64() */
+#else
+    struct stat *   fts_statp;
+#endif
+} FTSENT;
+
+typedef struct posix9_fts FTS;
+
+/* ============================================================
+ * Traversal Functions
+ * ============================================================ */
+
+/*
+ * Start a walk of each path in the NULL-terminated paths. Entries come
+ * in catalog order, which HFS keeps sorted by name, so compar must be
+ * NULL (EINVAL otherwise). Directories are listed FSGetCatalogInfoBulk
+ * batches at a time on Mac OS 9, so a walk costs about one File Manager
+ * call per directory plus one per POSIX9_READDIR_BULK entries, and
+ * holds one bulk buffer per level it is deep.
+ */
+FTS *   fts_open(char * const *paths, int options,
+                 int (*compar)(const FTSENT **, const FTSENT **));
+
+/* The same, with fts_statp pointing at a struct stat64 */
+FTS *   fts_open64(char * const *paths, int options,
+                   int (*compar)(const FTSENT **, const FTSENT **));
+
+/*
+ * The next entry: every directory twice, as FTS_D before and FTS_DP
+ * after its contents. Returns NULL with errno 0 at the end. An entry
+ * is valid until the next call; a directory's stays valid, for
+ * fts_parent, until its FTS_DP.
+ */
+FTSENT *fts_read(FTS *ftsp);
+
+/* FTS_SKIP on the FTS_D just returned prunes it: FTS_DP comes next */
+int     fts_set(FTS *ftsp, FTSENT *f, int instr);
+
+int     fts_close(FTS *ftsp);
+
+#endif /* POSIX9_FTS_H */
@@ -0,0 +1,66 @@
+/*
+ * posix9/ftw.h - File tree walk for Mac OS 9
+ * nftw() runs on the fts walker in posix9_dir.c, so it uses no
+ * descriptors and makes no stat() call of its own
+ */
+
+#ifndef POSIX9_FTW_H
+#define POSIX9_FTW_H
+
+#include "types.h"
+
+/* Type flags passed to the callback */
+#ifndef FTW_F
+#define FTW_F               0       /* File */
+#define FTW_D               1       /* Directory, before its contents */
+#define FTW_DNR             2       /* Directory that could not be read */
+#define FTW_NS              3       /* No stat data */
+#define FTW_SL              4
+#define FTW_DP              5       /* Directory, after its contents (FTW_DEPTH) */
+#define FTW_SLN             6
+#endif
+
+/* nftw() flags */
+#ifndef FTW_PHYS
+#define FTW_PHYS            0x01    /* Always - there are no symlinks */
+#define FTW_MOUNT           0x02    /* Always - a walk stays on its volume */
+#define FTW_CHDIR           0x04    /* Not supported - EINVAL */
+#define FTW_DEPTH           0x08    /* Directories after their contents */
+#define FTW_ACTIONRETVAL    0x10    /* Callback returns one of the below */
+#endif
+
+/* Callback results with FTW_ACTIONRETVAL */
+#ifndef FTW_CONTINUE
+#define FTW_CONTINUE        0
+#define FTW_STOP            1
+#define FTW_SKIP_SUBTREE    2       /* From an FTW_D: do not descend */
+#define FTW_SKIP_SIBLINGS   3       /* Nothing more from this directory */
+#endif
+
+struct FTW {
+    int     base;                   /* Offset of the name in the path */
+    int     level;                  /* 0 for the path given */
+};
+
+/* ============================================================
+ * Tree Walk Functions
+ * ============================================================ */
+
+/*
+ * Call fn for path and everything below it, stopping at the first
+ * non-zero result, which nftw() returns (with FTW_ACTIONRETVAL, only
+ * FTW_STOP stops). nopenfd is ignored: the walk holds no descriptors.
+ * Returns -1 with errno set if path cannot be found or the walk fails.
+ */
+int     nftw(const char *path,
+             int (*fn)(const char *fpath, const struct stat *sb, int typeflag,
+                       struct FTW *ftwbuf),
+             int nopenfd, int flags);
+
+/* The same, passing fn a struct stat64 */
+int     nftw64(const char *path,
+               int (*fn)(const char *fpath, const struct stat64 *sb, int typeflag,
+                         struct FTW *ftwbuf),
+               int nopenfd, int flags);
+
+#endif /* POSIX9_FTW_H */
@@ -0,0 +1,83 @@
+/*
+ * posix9/mman.h - File mappings for Mac OS 9
+ * Mapped ranges are heap blocks filled with pread64() and written back
+ * with pwrite64() - there is no MMU paging for applications
+ */
+
+#ifndef POSIX9_MMAN_H
+#define POSIX9_MMAN_H
+
+#include "types.h"
+
+/* Mappings open at once */
+#define POSIX9_MMAP_MAX     32
+
+/* Unit of lazy paging and write-back; offsets must be multiples of it */
+#define POSIX9_PAGE_SIZE    4096
+
+#ifndef PROT_READ
+#define PROT_NONE           0x0
+#define PROT_READ           0x1
+#define PROT_WRITE          0x2
+#define PROT_EXEC           0x4
+#endif
+
+#ifndef MAP_SHARED
+#define MAP_SHARED          0x01    /* msync()/munmap() write changes back */
+#define MAP_PRIVATE         0x02    /* Changes stay in memory */
+#define MAP_FIXED           0x10    /* Not supported - EINVAL */
+#define MAP_ANONYMOUS       0x20
+#define MAP_ANON            MAP_ANONYMOUS
+#endif
+
+/*
+ * POSIX9 extension: leave the range unread until posix9_mmap_access()
+ * asks for it. Large read-mostly files then cost only the reads of the
+ * pages used. This defers I/O, not allocation: the pointer must be
+ * usable for the whole range, so the heap block for all of it is still
+ * taken up front.
+ */
+#define MAP_POSIX9_LAZY     0x1000
+
+#define MAP_FAILED          ((void *)-1)
+
+/* msync() flags */
+#ifndef MS_ASYNC
+#define MS_ASYNC            0x1     /* Written before return, volume not flushed */
+#define MS_INVALIDATE       0x2     /* Re-read clean pages of lazy mappings */
+#define MS_SYNC             0x4     /* Written and flushed with fsync() */
+#endif
+
+/* ============================================================
+ * Memory Mapping Functions
+ * ============================================================ */
+
+/*
+ * Map length bytes of fd from offset. The whole range is read in one
+ * File Manager call unless MAP_POSIX9_LAZY is given. The mapping keeps
+ * its own reference to the open file, so fd may be closed afterwards.
+ * addr is only a hint; MAP_FIXED is not supported. mmap64() takes a
+ * 64-bit offset.
+ */
+void *  mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+void *  mmap64(void *addr, size_t length, int prot, int flags, int fd, off64_t offset);
+
+/*
+ * Write back a MAP_SHARED range: dirty pages of a lazy mapping, every
+ * page of an eagerly read one (writes through the pointer cannot be
+ * seen). Contiguous pages go out in one call; nothing past the EOF the
+ * file had when mapped is written.
+ */
+int     msync(void *addr, size_t length, int flags);
+
+/* Write back (MAP_SHARED) and free a whole mapping; addr must be its start */
+int     munmap(void *addr, size_t length);
+
+/*
+ * Make [addr, addr + length) of a lazy mapping resident, reading missing
+ * pages with one call per contiguous run, and with PROT_WRITE mark them
+ * dirty for msync(). A no-op on eagerly read mappings. Returns 0 or -1.
+ */
+int     posix9_mmap_access(void *addr, size_t length, int prot);
+
+#endif /* POSIX9_MMAN_H */
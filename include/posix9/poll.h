@@ -0,0 +1,49 @@
+/*
+ * posix9/poll.h - Descriptor readiness for Mac OS 9
+ * Sockets report events from their Open Transport notifiers, so a
+ * waiting poll() or select() looks again only at the descriptors
+ * something happened to, however many it was given
+ */
+
+#ifndef POSIX9_POLL_H
+#define POSIX9_POLL_H
+
+#include "types.h"
+
+/* events and revents bits */
+#ifndef POLLIN
+#define POLLIN              0x0001  /* Data to read, a connection to accept, or EOF */
+#define POLLPRI             0x0002  /* Expedited (OOB) data */
+#define POLLOUT             0x0004  /* Room to write */
+#define POLLERR             0x0008  /* revents only */
+#define POLLHUP             0x0010  /* revents only: the connection was broken */
+#define POLLNVAL            0x0020  /* revents only: fd is not open */
+#define POLLRDNORM          0x0040
+#define POLLRDBAND          0x0080
+#define POLLWRNORM          0x0100
+#define POLLWRBAND          0x0200
+#endif
+
+typedef unsigned int nfds_t;
+
+struct pollfd {
+    int     fd;                     /* Ignored if negative */
+    short   events;                 /* Conditions wanted */
+    short   revents;                /* Conditions found */
+};
+
+/* ============================================================
+ * Readiness Functions
+ * ============================================================ */
+
+/*
+ * Wait until one of the nfds descriptors in fds is ready for what its
+ * events ask, or for timeout milliseconds (-1: forever, 0: just look).
+ * Files and directories are always ready. Returns the number of
+ * entries with a non-zero revents, 0 on timeout, or -1 with EINVAL if
+ * nfds exceeds POSIX9_OPEN_MAX. Other threads and applications run
+ * while it waits.
+ */
+int     poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+#endif /* POSIX9_POLL_H */
@@ -63,6 +63,8 @@
 #define MSG_OOB         0x01
 #define MSG_PEEK        0x02
 #define MSG_DONTROUTE   0x04
+#define MSG_CTRUNC      0x08
+#define MSG_TRUNC       0x20
 #define MSG_DONTWAIT    0x40
 #define MSG_NOSIGNAL    0x4000
 
@@ -118,6 +120,17 @@ struct hostent {
 };
 #define h_addr h_addr_list[0]   /* First address */
 
+/* Message for sendmsg() and recvmsg() */
+struct msghdr {
+    void            *msg_name;      /* Datagram address, or NULL */
+    socklen_t       msg_namelen;
+    struct iovec    *msg_iov;       /* Pieces to gather or scatter */
+    int             msg_iovlen;
+    void            *msg_control;   /* Ancillary data: none on OT */
+    socklen_t       msg_controllen;
+    int             msg_flags;      /* Flags of the message received */
+};
+
 /* Linger structure */
 struct linger {
     int l_onoff;
@@ -178,6 +191,57 @@ ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags,
                  struct sockaddr *src_addr, socklen_t *addrlen);
 
+/*
+ * sendmsg() hands all the pieces of msg_iov to Open Transport in one
+ * call, as a chain, without copying them together first; so does
+ * writev() on a socket. recvmsg() and readv() fill the pieces in turn,
+ * waiting only for the first.
+ */
+ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags);
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags);
+
+/*
+ * Send count bytes of in_fd, from *offset (which is advanced) or from
+ * its file position (which is advanced instead) when offset is NULL.
+ * Blocking TCP sockets send without OT copying the data; any other
+ * descriptor gets a read/write copy. sendfile64() takes a 64-bit offset.
+ */
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+ssize_t sendfile64(int out_fd, int in_fd, off64_t *offset, size_t count);
+
+/*
+ * Run the socket's endpoint in Open Transport's asynchronous mode (1)
+ * or its synchronous mode (0, unless POSIX9_SOCKET_ASYNC says
+ * otherwise). An asynchronous endpoint's bind(), listen() and accept()
+ * park the calling thread while OT finishes them rather than holding
+ * the whole application, and its notifier completes a connect() or the
+ * peer's orderly release without another call. accept() gives the new
+ * socket the listener's mode. Set it before the socket is in use.
+ */
+int     posix9_set_socket_async(int sockfd, int async);
+
+/*
+ * Zero-copy receive. posix9_recv_zc() waits as recv() does, then hands
+ * over all the data that has arrived, in Open Transport's own buffers,
+ * as *chain; it returns the length (0, with a NULL chain, at the end of
+ * the stream). Read the bytes in place a piece at a time with
+ * posix9_zc_next(), or copy a range that spans pieces with
+ * posix9_zc_read(). OT cannot reuse the memory until the chain goes
+ * back with posix9_zc_release(): do that soon, and before closing the
+ * socket. Stream sockets only.
+ */
+typedef struct posix9_zc_chain posix9_zc_chain;
+
+ssize_t posix9_recv_zc(int sockfd, posix9_zc_chain **chain, int flags);
+
+/* The piece at *cursor and its length; moves *cursor on. NULL at the end */
+const void *posix9_zc_next(const posix9_zc_chain **cursor, size_t *len);
+
+/* Copy up to len bytes from offset in the chain; returns the bytes copied */
+size_t  posix9_zc_read(const posix9_zc_chain *chain, size_t offset, void *dest, size_t len);
+
+void    posix9_zc_release(posix9_zc_chain *chain);
+
 int     shutdown(int sockfd, int how);
 int     getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optlen);
 int     setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen);
@@ -31,6 +31,12 @@ typedef long            off_t;
 #endif
 #endif
 
+/* 64-bit offset for the large-file calls (lseek64, pread64, ...) */
+#ifndef _OFF64_T_DECLARED
+typedef long long       off64_t;
+#define _OFF64_T_DECLARED 1
+#endif
+
 #ifndef _MODE_T_DECLARED
 #ifndef mode_t
 typedef unsigned long   mode_t;  /* Match newlib */
@@ -96,9 +102,50 @@ typedef short           posix9_fd_t;
 #define POSIX9_PATH_MAX     1024
 #define POSIX9_NAME_MAX     255
 
-/* Maximum open files */
+/* Maximum open descriptors - files, sockets and directory streams
+ * share this space, so it must not exceed FD_SETSIZE */
 #define POSIX9_OPEN_MAX     256
 
+/* Catalog entries remembered by the stat()/fstat() cache */
+#ifndef POSIX9_STATCACHE_SIZE
+#define POSIX9_STATCACHE_SIZE   64
+#endif
+
+/* Directories remembered by path resolution (about 90 bytes each) */
+#ifndef POSIX9_PATHCACHE_SIZE
+#define POSIX9_PATHCACHE_SIZE   64
+#endif
+
+/* Entries readdir() fetches per File Manager call (about 220 bytes
+ * each, allocated while a stream is open) */
+#ifndef POSIX9_READDIR_BULK
+#define POSIX9_READDIR_BULK     32
+#endif
+
+/* Directory streams allocated at a time; there is no limit on how many
+ * are open beyond POSIX9_OPEN_MAX */
+#ifndef POSIX9_DIR_BLOCK
+#define POSIX9_DIR_BLOCK        8
+#endif
+
+/* Matches posix9_find() takes from the catalog per PBCatSearch call
+ * (about 70 bytes each) */
+#ifndef POSIX9_FIND_BATCH
+#define POSIX9_FIND_BATCH       64
+#endif
+
+/* Ticks a PBCatSearch call may run before posix9_find() lets other
+ * applications have the machine */
+#ifndef POSIX9_FIND_TICKS
+#define POSIX9_FIND_TICKS       6
+#endif
+
+/* Whether new sockets run their endpoints in Open Transport's
+ * asynchronous mode (see posix9_set_socket_async()) */
+#ifndef POSIX9_SOCKET_ASYNC
+#define POSIX9_SOCKET_ASYNC     0
+#endif
+
 /* File type flags for mode_t */
 #define S_IFMT      0170000     /* file type mask */
 #define S_IFREG     0100000     /* regular file */
@@ -155,13 +202,95 @@ struct stat {
 #endif
 #endif
 
+/* struct stat64 - struct stat with a 64-bit size, for files over 2 GB */
+#ifndef _STRUCT_STAT64
+struct stat64 {
+    dev_t       st_dev;
+    ino_t       st_ino;
+    mode_t      st_mode;
+    nlink_t     st_nlink;
+    uid_t       st_uid;
+    gid_t       st_gid;
+    dev_t       st_rdev;
+    off64_t     st_size;        /* file size in bytes */
+    time_t      st_atime;
+    time_t      st_mtime;
+    time_t      st_ctime;
+    blksize_t   st_blksize;
+    long long   st_blocks;      /* number of 512-byte blocks */
+};
+#define _STRUCT_STAT64 1
+#endif
+
 /* struct dirent - directory entry */
 struct dirent {
     ino_t       d_ino;          /* inode number */
+    unsigned char d_type;       /* DT_DIR or DT_REG */
     char        d_name[POSIX9_NAME_MAX + 1];  /* filename */
 };
 
+/* d_type values */
+#define DT_UNKNOWN  0
+#define DT_FIFO     1
+#define DT_CHR      2
+#define DT_DIR      4
+#define DT_BLK      6
+#define DT_REG      8
+#define DT_LNK      10
+#define DT_SOCK     12
+
+/* Counters reported by the POSIX9 lookup caches */
+typedef struct posix9_cache_stats {
+    unsigned long   hits;
+    unsigned long   misses;
+    unsigned long   evictions;      /* Entries recycled to make room */
+    int             entries;        /* Entries in use now */
+    int             capacity;
+} posix9_cache_stats;
+
+/* Directory stream memory, reported by posix9_dir_stats() */
+typedef struct posix9_dir_usage {
+    int             streams;        /* Open now */
+    int             capacity;       /* Allocated, open or free */
+    long            streamBytes;    /* One stream */
+    long            bulkBytes;      /* Bulk buffer of a stream being read */
+    long            heapBytes;      /* Held now: stream blocks and bulk buffers */
+} posix9_dir_usage;
+
+/* struct iovec - scatter/gather I/O element for readv()/writev() */
+#ifndef _SYS_UIO_H_
+#ifndef _STRUCT_IOVEC
+struct iovec {
+    void *      iov_base;       /* start of buffer */
+    size_t      iov_len;        /* length of buffer */
+};
+#define _STRUCT_IOVEC 1
+#endif
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX     1024        /* maximum iovcnt for readv()/writev() */
+#endif
+
 /* DIR - directory stream (opaque) */
 typedef struct posix9_dir DIR;
 
+/* What posix9_find() looks for; zero fields match anything */
+#define POSIX9_FIND_FILES   0x1
+#define POSIX9_FIND_DIRS    0x2
+
+typedef struct posix9_find_spec {
+    const char *    name;           /* Glob of *, ? and [...]; NULL for any */
+    int             types;          /* POSIX9_FIND_FILES and/or _DIRS; 0 for both */
+    off_t           minSize;        /* Files of at least this many bytes */
+    off_t           maxSize;        /* ... and at most this many; 0 for no limit */
+    time_t          newerThan;      /* Modified after this */
+    time_t          olderThan;      /* Modified before this */
+    unsigned long   fileType;       /* Finder file type, e.g. 'TEXT' */
+    unsigned long   creator;        /* Finder creator, e.g. 'ttxt' */
+} posix9_find_spec;
+
+/* POSIX9_FIND - catalog search in progress (opaque) */
+typedef struct posix9_find POSIX9_FIND;
+
 #endif /* POSIX9_TYPES_H */
@@ -30,6 +30,8 @@ int     close(int fd);
 ssize_t read(int fd, void *buf, size_t count);
 ssize_t write(int fd, const void *buf, size_t count);
 off_t   lseek(int fd, off_t offset, int whence);
+ssize_t pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
 int     dup(int oldfd);
 int     dup2(int oldfd, int newfd);
 int     fsync(int fd);
@@ -0,0 +1,316 @@
+/*
+ * posix9_aio.c - POSIX asynchronous file I/O for Mac OS 9
+ *
+ * Maps POSIX aio onto the File Manager's asynchronous calls:
+ *   aio_read()    -> PBReadAsync with an ioCompletion routine
+ *   aio_write()   -> PBWriteAsync with an ioCompletion routine
+ *   aio_suspend() -> park the calling thread until a completion wakes it
+ *   aio_error() / aio_return() -> harvest ioResult / ioActCount
+ *
+ * The synchronous File Manager calls hold the whole application while
+ * the disk works, so a cooperative thread waiting on a read starves
+ * every other Thread Manager thread. Here the caller's thread is parked
+ * on a posix9_fd_waiter instead, and the completion routine - which runs
+ * at interrupt time - wakes it with posix9_fd_wake(), which is safe
+ * there. The completion routine touches nothing else but two fields of
+ * its own request slot.
+ */
+
+#include "posix9.h"
+#include "posix9/aio.h"
+#include "posix9_fd.h"
+
+/* Mac OS headers */
+#include <Multiverse.h>
+#include "MacCompat.h"      /* Missing definitions for Retro68 */
+#include "Threads.h"        /* Our stub for Thread Manager */
+#include <string.h>
+
+/* From posix9_file.c */
+extern int posix9_file_async_begin(int fd, Boolean forWrite, long offset, short *refNum);
+
+/* ============================================================
+ * Request Table
+ * ============================================================ */
+
+typedef struct {
+    ParamBlockRec       pb;         /* Must be first: ioCompletion gets &pb */
+    volatile Boolean    done;       /* Set by the completion routine */
+    posix9_fd_waiter * volatile waiter; /* aio_suspend() to wake on completion */
+    Boolean             inUse;
+    struct aiocb *      cb;         /* Owning control block */
+} posix9_aio_req;
+
+static posix9_aio_req   aio_table[AIO_MAX];
+static IOCompletionUPP  aio_completion_upp = NULL;
+static Boolean          aio_initialized = false;
+
+/* ============================================================
+ * Interrupt-Level Routines
+ * ============================================================ */
+
+/* Runs at interrupt time when the File Manager finishes a request */
+static pascal void aio_completion(ParmBlkPtr paramBlock)
+{
+    posix9_aio_req *req = (posix9_aio_req *)paramBlock;
+    posix9_fd_waiter *waiter = req->waiter;
+
+    req->done = true;
+    if (waiter) posix9_fd_wake(waiter);
+}
+
+/* ============================================================
+ * Internal Helpers
+ * ============================================================ */
+
+static void init_aio(void)
+{
+    int i;
+
+    if (aio_initialized) return;
+
+    for (i = 0; i < AIO_MAX; i++) {
+        aio_table[i].inUse = false;
+        aio_table[i].done = false;
+        aio_table[i].waiter = NULL;
+    }
+
+    aio_completion_upp = NewIOCompletionUPP(aio_completion);
+    aio_initialized = true;
+}
+
+static int alloc_req(void)
+{
+    int i;
+
+    for (i = 0; i < AIO_MAX; i++) {
+        if (!aio_table[i].inUse) {
+            memset(&aio_table[i].pb, 0, sizeof(ParamBlockRec));
+            aio_table[i].done = false;
+            aio_table[i].waiter = NULL;
+            aio_table[i].inUse = true;
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* Move a finished request's result into its aiocb and free the slot */
+static void reap(struct aiocb *cb)
+{
+    posix9_aio_req *req;
+    OSErr err;
+
+    if (cb->__aio_slot < 0) return;
+
+    req = &aio_table[cb->__aio_slot];
+    if (!req->done) return;
+
+    err = req->pb.ioParam.ioResult;
+    if (err == noErr || err == eofErr) {
+        cb->__aio_error = 0;
+        cb->__aio_return = req->pb.ioParam.ioActCount;
+    } else {
+        cb->__aio_error = posix9_macos_to_errno(err);
+        cb->__aio_return = -1;
+    }
+
+    req->inUse = false;
+    req->cb = NULL;
+    cb->__aio_slot = -1;
+}
+
+static Boolean request_pending(const struct aiocb *cb)
+{
+    return cb->__aio_slot >= 0 && !aio_table[cb->__aio_slot].done;
+}
+
+static Boolean any_finished(const struct aiocb *const list[], int nent)
+{
+    int i;
+
+    for (i = 0; i < nent; i++) {
+        if (list[i] && !request_pending(list[i])) return true;
+    }
+
+    return false;
+}
+
+/* Point the listed requests' completions at a waiter (or at nobody) */
+static void set_waiter(const struct aiocb *const list[], int nent, posix9_fd_waiter *waiter)
+{
+    int i;
+
+    for (i = 0; i < nent; i++) {
+        if (list[i] && list[i]->__aio_slot >= 0) {
+            aio_table[list[i]->__aio_slot].waiter = waiter;
+        }
+    }
+}
+
+static int submit(struct aiocb *cb, Boolean forWrite)
+{
+    posix9_aio_req *req;
+    short refNum;
+    int slot;
+
+    init_aio();
+
+    if (!cb) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (posix9_file_async_begin(cb->aio_fildes, forWrite,
+                                (long)cb->aio_offset, &refNum) != 0) {
+        return -1;
+    }
+
+    slot = alloc_req();
+    if (slot < 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    req = &aio_table[slot];
+    req->cb = cb;
+    req->pb.ioParam.ioCompletion = aio_completion_upp;
+    req->pb.ioParam.ioRefNum = refNum;
+    req->pb.ioParam.ioBuffer = (Ptr)cb->aio_buf;
+    req->pb.ioParam.ioReqCount = cb->aio_nbytes;
+    req->pb.ioParam.ioPosMode = fsFromStart;
+    req->pb.ioParam.ioPosOffset = cb->aio_offset;
+
+    cb->__aio_slot = slot;
+    cb->__aio_error = EINPROGRESS;
+    cb->__aio_return = -1;
+
+    /* The result also arrives in ioResult; the completion routine is what counts */
+    if (forWrite) {
+        PBWriteAsync(&req->pb);
+    } else {
+        PBReadAsync(&req->pb);
+    }
+
+    return 0;
+}
+
+/* ============================================================
+ * Asynchronous I/O Functions
+ * ============================================================ */
+
+int aio_read(struct aiocb *aiocbp)
+{
+    return submit(aiocbp, false);
+}
+
+int aio_write(struct aiocb *aiocbp)
+{
+    return submit(aiocbp, true);
+}
+
+int aio_error(const struct aiocb *aiocbp)
+{
+    if (!aiocbp) return EINVAL;
+
+    reap((struct aiocb *)aiocbp);
+    return aiocbp->__aio_error;
+}
+
+ssize_t aio_return(struct aiocb *aiocbp)
+{
+    ssize_t result;
+
+    if (!aiocbp) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    reap(aiocbp);
+    if (aiocbp->__aio_slot >= 0) {
+        errno = EINPROGRESS;
+        return -1;
+    }
+
+    result = aiocbp->__aio_return;
+    if (result < 0) {
+        errno = aiocbp->__aio_error;
+    }
+
+    /* A second aio_return() on the same block is an error */
+    aiocbp->__aio_error = EINVAL;
+    aiocbp->__aio_return = -1;
+
+    return result;
+}
+
+int aio_suspend(const struct aiocb *const list[], int nent,
+                const struct timespec *timeout)
+{
+    posix9_fd_waiter wait;
+    struct timeval tv;
+
+    init_aio();
+
+    if (!list || nent <= 0 || nent > AIO_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (any_finished(list, nent)) return 0;
+
+    if (timeout && timeout->tv_sec == 0 && timeout->tv_nsec == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    /* The wait clamps a deadline too long for the Time Manager */
+    if (timeout) {
+        tv.tv_sec = timeout->tv_sec;
+        tv.tv_usec = (timeout->tv_nsec + 999) / 1000;
+    }
+
+    /*
+     * Publish the waiter before looking again, so a completion from here
+     * on wakes it; one before was seen by any_finished(). Parking
+     * yields instead when there is no Thread Manager to stop in.
+     */
+    posix9_fd_wait_begin(&wait, timeout ? &tv : NULL);
+    set_waiter(list, nent, &wait);
+    while (!any_finished(list, nent)) {
+        if (!posix9_fd_park(&wait)) break;
+    }
+    set_waiter(list, nent, NULL);
+    posix9_fd_wait_end(&wait);
+
+    if (any_finished(list, nent)) return 0;
+
+    errno = EAGAIN;
+    return -1;
+}
+
+int aio_cancel(int fd, struct aiocb *aiocbp)
+{
+    int i;
+
+    init_aio();
+
+    if (aiocbp) {
+        if (aiocbp->aio_fildes != fd) {
+            errno = EINVAL;
+            return -1;
+        }
+        return request_pending(aiocbp) ? AIO_NOTCANCELED : AIO_ALLDONE;
+    }
+
+    /* A queued File Manager call can't be withdrawn, only waited for */
+    for (i = 0; i < AIO_MAX; i++) {
+        if (aio_table[i].inUse && !aio_table[i].done &&
+            aio_table[i].cb && aio_table[i].cb->aio_fildes == fd) {
+            return AIO_NOTCANCELED;
+        }
+    }
+
+    return AIO_ALLDONE;
+}
@@ -3,97 +3,280 @@
  *
  * Maps POSIX directory operations to Mac OS File Manager:
  *   opendir()  -> Get FSSpec, store iteration state
- *   readdir()  -> PBGetCatInfoSync with index
+ *   readdir()  -> FSGetCatalogInfoBulk, POSIX9_READDIR_BULK entries per
+ *                 call; PBGetCatInfoSync with index before Mac OS 9
  *   closedir() -> Free state
+ *   dirfd()    -> descriptor from the shared table (posix9_fd.c)
  *   mkdir()    -> DirCreate
  *   rmdir()    -> FSpDelete
+ *
+ * A stream is a (vRefNum, dirID) pair, so its descriptor doubles as the
+ * directory handle for the *at() calls: names are looked up under the
+ * stored dirID without walking the directory's path again.
+ *
+ * Streams are carved out of blocks of POSIX9_DIR_BLOCK, allocated with
+ * NewPtr when every stream is busy and disposed of once all of theirs
+ * are closed again, except the last block. Only the descriptor table
+ * limits how many are open, and an application that never opens a
+ * directory holds no stream memory at all.
  */
 
 #include "posix9.h"
+#include "posix9_fd.h"
 
 /* Mac OS headers - Retro68 provides everything via Multiverse.h */
 #include <Multiverse.h>
 #include "MacCompat.h"      /* Missing definitions for Retro68 */
 #include <string.h>
 
+/* From posix9_statcache.c */
+extern OSErr posix9_statcache_getcatinfo(short vRefNum, long dirID, ConstStr255Param name,
+                                         CInfoPBRec *pb);
+extern void posix9_statcache_invalidate(short vRefNum, long dirID, ConstStr255Param name);
+extern void posix9_statcache_invalidate_dir(short vRefNum, long dirID);
+extern void posix9_statcache_enter(short vRefNum, long dirID, ConstStr255Param name,
+                                   const CInfoPBRec *pb);
+
+/* From posix9_path.c */
+extern OSErr posix9_path_walk(short vRefNum, long dirID, const char *path, FSSpec *spec);
+extern void posix9_path_cwd(short *vRefNum, long *dirID);
+extern int posix9_name_from_mac(ConstStr255Param name, char *out, size_t size);
+
+/* From posix9_pathcache.c */
+extern void posix9_pathcache_invalidate(short vRefNum, long parID, ConstStr255Param name);
+
+/* From posix9_file.c */
+extern Boolean posix9_has_hfsplus_apis(void);
+extern void posix9_file_stat_entry(short vRefNum, long dirID, ConstStr255Param name,
+                                   const CInfoPBRec *pb, struct stat64 *buf);
+extern int posix9_file_stat_narrow(const struct stat64 *st64, struct stat *buf);
+
 /* ============================================================
  * Directory Stream Structure
  * ============================================================ */
 
-struct posix9_dir {
+/* Where a listing of one directory is; streams and tree walks both use it */
+typedef struct dir_iter {
     short       vRefNum;        /* Volume reference */
     long        dirID;          /* Directory ID */
     short       index;          /* Current iteration index (1-based) */
+    Boolean     indexed;        /* No bulk calls: one indexed lookup per entry */
+    FSIterator  iterator;       /* Bulk iteration, opened by the first read */
+    Ptr         bulk;           /* POSIX9_READDIR_BULK catalog infos, then specs */
+    short       bulkCount;      /* Entries the last bulk call returned */
+    short       bulkNext;       /* Next of them to return */
+} dir_iter;
+
+struct posix9_dir {
+    posix9_fd_desc desc;        /* Shared by dup()ed dirfds - must be first */
+    dir_iter    it;             /* Position in the listing */
     Boolean     inUse;          /* Is this stream in use? */
-    char        path[POSIX9_PATH_MAX];  /* Directory path (for debugging) */
+    int         fd;             /* Descriptor for dirfd() */
+    struct dir_block *block;    /* Block it was carved from */
+    struct posix9_dir *nextFree; /* Free list of its block */
     struct dirent entry;        /* Current directory entry */
 };
 
-/* Pool of directory streams */
-#define MAX_DIR_STREAMS 32
-static struct posix9_dir dir_pool[MAX_DIR_STREAMS];
-static Boolean dir_pool_initialized = false;
+/* A block of streams from NewPtr */
+typedef struct dir_block {
+    struct dir_block *  next;
+    struct posix9_dir * freeList;   /* Streams not in use */
+    short               used;       /* Streams in use */
+    struct posix9_dir   streams[POSIX9_DIR_BLOCK];
+} dir_block;
+
+static dir_block *  dir_blocks = NULL;
+static int          dir_block_count = 0;
+static int          dir_open_count = 0;
+static int          dir_bulk_count = 0;     /* Listings holding a bulk buffer */
+
+/* Descriptor operations, defined below */
+static const posix9_fd_ops dir_fd_ops;
+
+int posix9_dir_resolve(int dirfd, const char *path, FSSpec *spec, OSErr *err);
+int posix9_dir_remove(const FSSpec *spec);
 
 /* ============================================================
  * Internal Helpers
  * ============================================================ */
 
-static void init_dir_pool(void)
+static dir_block *new_block(void)
 {
+    dir_block *block;
     int i;
 
-    if (dir_pool_initialized) return;
+    block = (dir_block *)NewPtr(sizeof(dir_block));
+    if (!block) return NULL;
 
-    for (i = 0; i < MAX_DIR_STREAMS; i++) {
-        dir_pool[i].inUse = false;
+    block->freeList = NULL;
+    for (i = POSIX9_DIR_BLOCK - 1; i >= 0; i--) {
+        block->streams[i].inUse = false;
+        block->streams[i].block = block;
+        block->streams[i].nextFree = block->freeList;
+        block->freeList = &block->streams[i];
     }
+    block->used = 0;
+    block->next = dir_blocks;
+    dir_blocks = block;
+    dir_block_count++;
 
-    dir_pool_initialized = true;
+    return block;
 }
 
-static struct posix9_dir *alloc_dir(void)
+/* Put a stream back; an empty block goes unless it is the last one */
+static void free_dir(struct posix9_dir *dir)
 {
-    int i;
+    dir_block *block = dir->block;
+    dir_block **link;
+
+    dir->inUse = false;
+    dir->nextFree = block->freeList;
+    block->freeList = dir;
+    block->used--;
+    dir_open_count--;
+
+    if (block->used == 0 && dir_block_count > 1) {
+        for (link = &dir_blocks; *link != block; link = &(*link)->next) {}
+        *link = block->next;
+        dir_block_count--;
+        DisposePtr((Ptr)block);
+    }
+}
 
-    init_dir_pool();
+static struct posix9_dir *alloc_dir(void)
+{
+    struct posix9_dir *dir;
+    dir_block *block;
 
-    for (i = 0; i < MAX_DIR_STREAMS; i++) {
-        if (!dir_pool[i].inUse) {
-            dir_pool[i].inUse = true;
-            dir_pool[i].index = 1;  /* Mac indexes start at 1 */
-            return &dir_pool[i];
+    for (block = dir_blocks; block && !block->freeList; block = block->next) {}
+    if (!block) {
+        block = new_block();
+        if (!block) {
+            errno = ENOMEM;
+            return NULL;
         }
     }
 
-    errno = EMFILE;
-    return NULL;
+    dir = block->freeList;
+    block->freeList = dir->nextFree;
+    block->used++;
+    dir_open_count++;
+
+    dir->inUse = true;
+    dir->desc.refCount = 0;
+    dir->it.bulk = NULL;
+    dir->fd = posix9_fd_alloc(0, &dir_fd_ops, dir);
+    if (dir->fd < 0) {
+        free_dir(dir);
+        return NULL;
+    }
+
+    return dir;
 }
 
-static void free_dir(struct posix9_dir *dir)
+/* Start listing a directory; a bulk buffer left from the last one is kept */
+static void begin_iter(dir_iter *it, short vRefNum, long dirID)
+{
+    it->vRefNum = vRefNum;
+    it->dirID = dirID;
+    it->index = 1;          /* Mac indexes start at 1 */
+    it->indexed = false;
+    it->iterator = NULL;
+    it->bulkCount = it->bulkNext = 0;
+}
+
+/* Drop the bulk iteration; the next read starts a new one */
+static void end_bulk(dir_iter *it)
 {
-    if (dir) {
-        dir->inUse = false;
+    if (it->iterator) {
+        FSCloseIterator(it->iterator);
+        it->iterator = NULL;
     }
+    it->bulkCount = it->bulkNext = 0;
 }
 
-/* Convert Pascal string to C string */
-static void pstr_to_cstr(const Str255 pstr, char *cstr, size_t maxlen)
+static void free_bulk(dir_iter *it)
 {
-    size_t len = pstr[0];
-    if (len >= maxlen) len = maxlen - 1;
-    memcpy(cstr, &pstr[1], len);
-    cstr[len] = '\0';
+    if (it->bulk) {
+        DisposePtr(it->bulk);
+        it->bulk = NULL;
+        dir_bulk_count--;
+    }
 }
 
-/* Convert C string to Pascal string */
-static void cstr_to_pstr(const char *cstr, Str255 pstr)
+/* close() on a dirfd() descriptor ends the stream */
+static int dir_fd_close(void *obj)
 {
-    size_t len = strlen(cstr);
-    if (len > 255) len = 255;
-    pstr[0] = (unsigned char)len;
-    memcpy(&pstr[1], cstr, len);
+    struct posix9_dir *dir = (struct posix9_dir *)obj;
+
+    end_bulk(&dir->it);
+    free_bulk(&dir->it);
+    free_dir(dir);
+    return 0;
 }
 
+/*
+ * Fetch the next POSIX9_READDIR_BULK entries in one call. The first
+ * call opens the iterator; if the File Manager has no bulk calls, or
+ * they fail to start, the listing falls back to indexed lookups.
+ */
+static OSErr fill_bulk(dir_iter *it)
+{
+    FSCatalogInfo *infos;
+    FSSpec container;
+    FSRef ref;
+    ItemCount count;
+    OSErr err;
+
+    if (!it->iterator) {
+        if (!posix9_has_hfsplus_apis()) {
+            it->indexed = true;
+            return noErr;
+        }
+        if (!it->bulk) {
+            it->bulk = NewPtr(POSIX9_READDIR_BULK * (sizeof(FSCatalogInfo) + sizeof(FSSpec)));
+            if (!it->bulk) {
+                it->indexed = true;
+                return noErr;
+            }
+            dir_bulk_count++;
+        }
+
+        /* An empty name makes the FSRef the directory itself */
+        container.vRefNum = it->vRefNum;
+        container.parID = it->dirID;
+        container.name[0] = 0;
+        if (FSpMakeFSRef(&container, &ref) != noErr ||
+            FSOpenIterator(&ref, kFSIterateFlat, &it->iterator) != noErr) {
+            it->iterator = NULL;
+            it->indexed = true;
+            free_bulk(it);
+            return noErr;
+        }
+    }
+
+    infos = (FSCatalogInfo *)it->bulk;
+    err = FSGetCatalogInfoBulk(it->iterator, POSIX9_READDIR_BULK, &count, NULL,
+                               kFSCatInfoNodeFlags | kFSCatInfoVolume | kFSCatInfoParentDirID |
+                               kFSCatInfoNodeID | kFSCatInfoCreateDate | kFSCatInfoContentMod |
+                               kFSCatInfoFinderInfo | kFSCatInfoValence | kFSCatInfoDataSizes |
+                               kFSCatInfoRsrcSizes, infos, NULL,
+                               (FSSpec *)(infos + POSIX9_READDIR_BULK), NULL);
+    if (err != noErr && err != errFSNoMoreItems) return err;
+
+    it->bulkCount = (short)count;
+    it->bulkNext = 0;
+    return count ? noErr : errFSNoMoreItems;
+}
+
+static const posix9_fd_ops dir_fd_ops = {
+    S_IFDIR,
+    NULL,                   /* read() -> EISDIR */
+    NULL,                   /* write() -> EBADF */
+    dir_fd_close,
+    NULL
+};
+
 /* ============================================================
  * POSIX Directory Operations
  * ============================================================ */
@@ -113,13 +296,7 @@ DIR *opendir(const char *name)
     }
 
     /* Get catalog info to verify it's a directory and get dirID */
-    memset(&catInfo, 0, sizeof(catInfo));
-    catInfo.hFileInfo.ioVRefNum = spec.vRefNum;
-    catInfo.hFileInfo.ioDirID = spec.parID;
-    catInfo.hFileInfo.ioNamePtr = spec.name;
-    catInfo.hFileInfo.ioFDirIndex = 0;
-
-    err = PBGetCatInfoSync(&catInfo);
+    err = posix9_statcache_getcatinfo(spec.vRefNum, spec.parID, spec.name, &catInfo);
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return NULL;
@@ -135,16 +312,119 @@ DIR *opendir(const char *name)
     dir = alloc_dir();
     if (!dir) return NULL;
 
-    /* Store directory info */
-    dir->vRefNum = spec.vRefNum;
-    dir->dirID = catInfo.dirInfo.ioDrDirID;
-    dir->index = 1;
-    strncpy(dir->path, name, sizeof(dir->path) - 1);
-    dir->path[sizeof(dir->path) - 1] = '\0';
+    begin_iter(&dir->it, spec.vRefNum, catInfo.dirInfo.ioDrDirID);
 
     return (DIR *)dir;
 }
 
+/* Seconds to add to UTC for local time, as the classic calls report it */
+static long gmt_delta(void)
+{
+    static Boolean read = false;
+    static long delta = 0;
+    MachineLocation loc;
+
+    if (!read) {
+        ReadLocation(&loc);
+        delta = loc.u.gmtDelta & 0x00FFFFFFL;
+        if (delta & 0x00800000L) delta |= ~0x00FFFFFFL;     /* Sign-extend */
+        read = true;
+    }
+
+    return delta;
+}
+
+/* The PBGetCatInfoSync result a bulk entry stands for */
+static void catinfo_from_bulk(const FSCatalogInfo *info, CInfoPBRec *pb)
+{
+    memset(pb, 0, sizeof(*pb));
+    pb->hFileInfo.ioVRefNum = info->volume;
+    pb->hFileInfo.ioFlAttrib = (info->nodeFlags & kFSNodeLockedMask) ? 0x01 : 0;
+
+    if (info->nodeFlags & kFSNodeIsDirectoryMask) {
+        pb->dirInfo.ioFlAttrib |= ioDirMask;
+        memcpy(&pb->dirInfo.ioDrUsrWds, info->finderInfo, sizeof(pb->dirInfo.ioDrUsrWds));
+        pb->dirInfo.ioDrDirID = info->nodeID;
+        pb->dirInfo.ioDrNmFls = (unsigned short)info->valence;
+        pb->dirInfo.ioDrCrDat = info->createDate.lowSeconds + gmt_delta();
+        pb->dirInfo.ioDrMdDat = info->contentModDate.lowSeconds + gmt_delta();
+        pb->dirInfo.ioDrParID = info->parentDirID;
+    } else {
+        memcpy(&pb->hFileInfo.ioFlFndrInfo, info->finderInfo, sizeof(pb->hFileInfo.ioFlFndrInfo));
+        pb->hFileInfo.ioDirID = info->nodeID;
+        /* The classic calls pin lengths past 2 GB */
+        pb->hFileInfo.ioFlLgLen = (long)(info->dataLogicalSize > 0x7FFFFFFFUL ?
+                                         0x7FFFFFFFUL : info->dataLogicalSize);
+        pb->hFileInfo.ioFlPyLen = (long)(info->dataPhysicalSize > 0x7FFFFFFFUL ?
+                                         0x7FFFFFFFUL : info->dataPhysicalSize);
+        pb->hFileInfo.ioFlRLgLen = (long)info->rsrcLogicalSize;
+        pb->hFileInfo.ioFlRPyLen = (long)info->rsrcPhysicalSize;
+        pb->hFileInfo.ioFlCrDat = info->createDate.lowSeconds + gmt_delta();
+        pb->hFileInfo.ioFlMdDat = info->contentModDate.lowSeconds + gmt_delta();
+        pb->hFileInfo.ioFlParID = info->parentDirID;
+    }
+}
+
+/*
+ * The next entry's name and catalog info, from the bulk buffer or one
+ * indexed lookup. Returns fnfErr at the end.
+ */
+static OSErr next_entry(dir_iter *it, CInfoPBRec *pb, StringPtr name)
+{
+    FSSpec *spec;
+    OSErr err;
+
+    if (!it->indexed) {
+        if (it->bulkNext == it->bulkCount) {
+            err = fill_bulk(it);
+            if (err == errFSNoMoreItems) return fnfErr;
+            if (err != noErr) return err;
+        }
+    }
+
+    /* fill_bulk() may have found no bulk calls */
+    if (!it->indexed) {
+        catinfo_from_bulk((FSCatalogInfo *)it->bulk + it->bulkNext, pb);
+        spec = (FSSpec *)((FSCatalogInfo *)it->bulk + POSIX9_READDIR_BULK) + it->bulkNext;
+        memcpy(name, spec->name, spec->name[0] + 1);
+        it->bulkNext++;
+    } else {
+        memset(pb, 0, sizeof(*pb));
+        pb->hFileInfo.ioVRefNum = it->vRefNum;
+        pb->hFileInfo.ioDirID = it->dirID;
+        pb->hFileInfo.ioNamePtr = name;
+        pb->hFileInfo.ioFDirIndex = it->index;
+
+        err = PBGetCatInfoSync(pb);
+        if (err != noErr) return err;
+    }
+    it->index++;
+
+    return noErr;
+}
+
+/* Fill the stream's dirent from an entry */
+static struct dirent *fill_entry(struct posix9_dir *dir, const CInfoPBRec *pb,
+                                 ConstStr255Param name)
+{
+    /* Names are UTF-8 */
+    if (posix9_name_from_mac(name, dir->entry.d_name, sizeof(dir->entry.d_name)) < 0) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    /* Use dirID or file ID as inode */
+    if (pb->hFileInfo.ioFlAttrib & ioDirMask) {
+        dir->entry.d_ino = pb->dirInfo.ioDrDirID;
+        dir->entry.d_type = DT_DIR;
+    } else {
+        dir->entry.d_ino = pb->hFileInfo.ioDirID;
+        dir->entry.d_type = DT_REG;
+    }
+
+    return &dir->entry;
+}
+
 struct dirent *readdir(DIR *dirp)
 {
     struct posix9_dir *dir = (struct posix9_dir *)dirp;
@@ -157,15 +437,7 @@ struct dirent *readdir(DIR *dirp)
         return NULL;
     }
 
-    /* Get next entry */
-    memset(&catInfo, 0, sizeof(catInfo));
-    catInfo.hFileInfo.ioVRefNum = dir->vRefNum;
-    catInfo.hFileInfo.ioDirID = dir->dirID;
-    catInfo.hFileInfo.ioNamePtr = name;
-    catInfo.hFileInfo.ioFDirIndex = dir->index;
-
-    err = PBGetCatInfoSync(&catInfo);
-
+    err = next_entry(&dir->it, &catInfo, name);
     if (err == fnfErr) {
         /* No more entries */
         return NULL;
@@ -176,20 +448,45 @@ struct dirent *readdir(DIR *dirp)
         return NULL;
     }
 
-    /* Fill in dirent */
-    pstr_to_cstr(name, dir->entry.d_name, sizeof(dir->entry.d_name));
+    /* A stat() of the entry right after costs nothing */
+    posix9_statcache_enter(dir->it.vRefNum, dir->it.dirID, name, &catInfo);
 
-    /* Use dirID or file ID as inode */
-    if (catInfo.hFileInfo.ioFlAttrib & ioDirMask) {
-        dir->entry.d_ino = catInfo.dirInfo.ioDrDirID;
-    } else {
-        dir->entry.d_ino = catInfo.hFileInfo.ioDirID;
+    return fill_entry(dir, &catInfo, name);
+}
+
+struct dirent *posix9_readdir_plus64(DIR *dirp, struct stat64 *buf)
+{
+    struct posix9_dir *dir = (struct posix9_dir *)dirp;
+    CInfoPBRec catInfo;
+    Str255 name;
+    OSErr err;
+
+    if (!dir || !dir->inUse) {
+        errno = EBADF;
+        return NULL;
+    }
+
+    err = next_entry(&dir->it, &catInfo, name);
+    if (err == fnfErr) return NULL;
+    if (err != noErr) {
+        errno = posix9_macos_to_errno(err);
+        return NULL;
     }
 
-    /* Advance index for next call */
-    dir->index++;
+    posix9_statcache_enter(dir->it.vRefNum, dir->it.dirID, name, &catInfo);
+    posix9_file_stat_entry(dir->it.vRefNum, dir->it.dirID, name, &catInfo, buf);
 
-    return &dir->entry;
+    return fill_entry(dir, &catInfo, name);
+}
+
+struct dirent *posix9_readdir_plus(DIR *dirp, struct stat *buf)
+{
+    struct stat64 st64;
+    struct dirent *ent;
+
+    ent = posix9_readdir_plus64(dirp, &st64);
+    if (!ent || posix9_file_stat_narrow(&st64, buf) != 0) return NULL;
+    return ent;
 }
 
 int closedir(DIR *dirp)
@@ -201,8 +498,20 @@ int closedir(DIR *dirp)
         return -1;
     }
 
-    free_dir(dir);
-    return 0;
+    /* The stream lives on while a dup() of its dirfd is open */
+    return close(dir->fd);
+}
+
+int dirfd(DIR *dirp)
+{
+    struct posix9_dir *dir = (struct posix9_dir *)dirp;
+
+    if (!dir || !dir->inUse) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return dir->fd;
 }
 
 void rewinddir(DIR *dirp)
@@ -210,75 +519,28 @@ void rewinddir(DIR *dirp)
     struct posix9_dir *dir = (struct posix9_dir *)dirp;
 
     if (dir && dir->inUse) {
-        dir->index = 1;
+        end_bulk(&dir->it);
+        dir->it.index = 1;
     }
 }
 
-int mkdir(const char *path, mode_t mode)
+/* DirCreate() at spec; err is what resolving it returned */
+static int mkdir_fsspec(const FSSpec *spec, OSErr err)
 {
-    char mac_path[POSIX9_PATH_MAX];
-    char parent_path[POSIX9_PATH_MAX];
-    char *last_sep;
-    Str255 dirname;
-    FSSpec parentSpec;
-    CInfoPBRec catInfo;
     long newDirID;
-    OSErr err;
-
-    (void)mode;  /* Mode is ignored on Mac OS 9 */
-
-    /* Convert to Mac path */
-    posix9_path_to_mac(path, mac_path, sizeof(mac_path));
-
-    /* Find parent directory */
-    strncpy(parent_path, mac_path, sizeof(parent_path) - 1);
-    parent_path[sizeof(parent_path) - 1] = '\0';
-
-    last_sep = strrchr(parent_path, ':');
-    if (last_sep) {
-        /* Extract directory name */
-        cstr_to_pstr(last_sep + 1, dirname);
-        *last_sep = '\0';  /* Truncate to parent */
-    } else {
-        /* No separator - create in current directory */
-        cstr_to_pstr(mac_path, dirname);
-        parent_path[0] = '\0';
-    }
-
-    /* Get parent FSSpec */
-    if (parent_path[0]) {
-        Str255 ppath;
-        cstr_to_pstr(parent_path, ppath);
-        err = FSMakeFSSpec(0, 0, ppath, &parentSpec);
-        if (err != noErr && err != fnfErr) {
-            errno = posix9_macos_to_errno(err);
-            return -1;
-        }
 
-        /* Get parent's dirID */
-        memset(&catInfo, 0, sizeof(catInfo));
-        catInfo.hFileInfo.ioVRefNum = parentSpec.vRefNum;
-        catInfo.hFileInfo.ioDirID = parentSpec.parID;
-        catInfo.hFileInfo.ioNamePtr = parentSpec.name;
-        catInfo.hFileInfo.ioFDirIndex = 0;
-
-        err = PBGetCatInfoSync(&catInfo);
-        if (err != noErr) {
-            errno = posix9_macos_to_errno(err);
-            return -1;
-        }
-
-        /* Create directory */
-        err = DirCreate(parentSpec.vRefNum, catInfo.dirInfo.ioDrDirID,
-                       dirname, &newDirID);
-    } else {
-        /* Create in current directory */
-        short vRefNum;
-        long dirID;
-        HGetVol(NULL, &vRefNum, &dirID);
-        err = DirCreate(vRefNum, dirID, dirname, &newDirID);
+    if (err == noErr) {
+        errno = EEXIST;
+        return -1;
+    }
+    if (err != fnfErr) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
     }
 
+    /* A missing leaf still resolves to its parent's dirID and name */
+    err = DirCreate(spec->vRefNum, spec->parID, spec->name, &newDirID);
+    posix9_statcache_invalidate_dir(spec->vRefNum, spec->parID);
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
@@ -287,10 +549,21 @@ int mkdir(const char *path, mode_t mode)
     return 0;
 }
 
+int mkdir(const char *path, mode_t mode)
+{
+    FSSpec spec;
+    OSErr err;
+
+    (void)mode;  /* Mode is ignored on Mac OS 9 */
+
+    err = posix9_path_to_fsspec(path, &spec);
+
+    return mkdir_fsspec(&spec, err);
+}
+
 int rmdir(const char *path)
 {
     FSSpec spec;
-    CInfoPBRec catInfo;
     OSErr err;
 
     /* Get FSSpec */
@@ -300,11 +573,104 @@ int rmdir(const char *path)
         return -1;
     }
 
+    return posix9_dir_remove(&spec);
+}
+
+DIR *fdopendir(int fd)
+{
+    struct posix9_dir *dir;
+
+    dir = (struct posix9_dir *)posix9_fd_object(fd, &dir_fd_ops);
+    if (!dir) {
+        errno = posix9_fd_ops_of(fd) ? ENOTDIR : EBADF;
+        return NULL;
+    }
+
+    /* closedir() closes the descriptor it was opened from */
+    dir->fd = fd;
+
+    return (DIR *)dir;
+}
+
+int mkdirat(int dirfd, const char *path, mode_t mode)
+{
+    FSSpec spec;
+    OSErr err;
+
+    (void)mode;  /* Mode is ignored on Mac OS 9 */
+
+    if (posix9_dir_resolve(dirfd, path, &spec, &err) != 0) return -1;
+
+    return mkdir_fsspec(&spec, err);
+}
+
+/* ============================================================
+ * Directory Descriptors (posix9_file.c *at() calls)
+ * ============================================================ */
+
+/* Where a *at() call's names are looked up: dirfd's directory, or the cwd */
+int posix9_dir_location(int dirfd, short *vRefNum, long *dirID)
+{
+    struct posix9_dir *dir;
+
+    if (dirfd == AT_FDCWD) {
+        posix9_path_cwd(vRefNum, dirID);
+        return 0;
+    }
+
+    dir = (struct posix9_dir *)posix9_fd_object(dirfd, &dir_fd_ops);
+    if (!dir) {
+        errno = posix9_fd_ops_of(dirfd) ? ENOTDIR : EBADF;
+        return -1;
+    }
+
+    *vRefNum = dir->it.vRefNum;
+    *dirID = dir->it.dirID;
+    return 0;
+}
+
+/*
+ * Resolve a path relative to dirfd's directory (an absolute path ignores
+ * it). Returns -1 with errno set if dirfd is unusable; otherwise *err is the lookup's result, and
+ * on fnfErr spec still names the missing leaf in its parent.
+ */
+int posix9_dir_resolve(int dirfd, const char *path, FSSpec *spec, OSErr *err)
+{
+    short vRefNum;
+    long dirID;
+
+    if (posix9_dir_location(dirfd, &vRefNum, &dirID) != 0) return -1;
+
+    *err = posix9_path_walk(vRefNum, dirID, path, spec);
+    return 0;
+}
+
+/* A stream and descriptor for a directory open()ed by posix9_file.c */
+int posix9_dir_open_fd(short vRefNum, long dirID)
+{
+    struct posix9_dir *dir;
+
+    dir = alloc_dir();
+    if (!dir) return -1;
+
+    begin_iter(&dir->it, vRefNum, dirID);
+
+    return dir->fd;
+}
+
+/* rmdir() of a resolved spec, shared with unlinkat(AT_REMOVEDIR) */
+int posix9_dir_remove(const FSSpec *spec)
+{
+    CInfoPBRec catInfo;
+    Str255 name;
+    OSErr err;
+
     /* Verify it's a directory */
+    memcpy(name, spec->name, spec->name[0] + 1);
     memset(&catInfo, 0, sizeof(catInfo));
-    catInfo.hFileInfo.ioVRefNum = spec.vRefNum;
-    catInfo.hFileInfo.ioDirID = spec.parID;
-    catInfo.hFileInfo.ioNamePtr = spec.name;
+    catInfo.hFileInfo.ioVRefNum = spec->vRefNum;
+    catInfo.hFileInfo.ioDirID = spec->parID;
+    catInfo.hFileInfo.ioNamePtr = name;
     catInfo.hFileInfo.ioFDirIndex = 0;
 
     err = PBGetCatInfoSync(&catInfo);
@@ -325,7 +691,10 @@ int rmdir(const char *path)
     }
 
     /* Delete the directory */
-    err = FSpDelete(&spec);
+    err = FSpDelete(spec);
+    posix9_statcache_invalidate(spec->vRefNum, spec->parID, spec->name);
+    posix9_statcache_invalidate_dir(spec->vRefNum, spec->parID);
+    posix9_pathcache_invalidate(spec->vRefNum, spec->parID, spec->name);
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
@@ -333,3 +702,470 @@ int rmdir(const char *path)
 
     return 0;
 }
+
+/* ============================================================
+ * Tree Walking (fts, nftw)
+ * ============================================================ */
+
+/*
+ * A walk keeps one frame per directory level it is in - the listing's
+ * position and the directory's FTSENT - and extends a single path
+ * buffer by a name per level. Frames are kept for reuse when the walk
+ * climbs back out, bulk buffer and all, until fts_close().
+ */
+typedef struct walk_frame {
+    dir_iter    it;             /* Position in the directory's listing */
+    FTSENT      ent;            /* The directory, for FTS_D and FTS_DP */
+    struct stat64 st;           /* Or a struct stat, unless fts_open64() */
+    Boolean     skipRest;       /* FTW_SKIP_SIBLINGS: list nothing more */
+} walk_frame;
+
+#define WALK_FRAMES     16      /* Initial depth; doubled as needed */
+
+struct posix9_fts {
+    char *      roots;          /* The paths given, each '\0' terminated */
+    char *      nextRoot;       /* Next of them, "" after the last */
+    walk_frame **frames;        /* frames[i] is the directory at level i */
+    short       depth;          /* Frames in use */
+    short       frameCap;       /* Entries in frames; NULL until needed */
+    Boolean     popTop;         /* The top frame's FTS_DP went out */
+    Boolean     skipLast;       /* fts_set(FTS_SKIP) on the last FTS_D */
+    Boolean     large;          /* fts_open64(): fts_statp is a struct stat64 */
+    FTSENT *    last;           /* Entry the last fts_read() returned */
+    FTSENT      rootParent;     /* fts_parent of the roots */
+    FTSENT      file;           /* The last non-directory returned */
+    struct stat64 fileStat;
+    CInfoPBRec  catInfo;        /* Catalog info of the last entry visited */
+    char        path[POSIX9_PATH_MAX];
+};
+
+/* The next frame up, growing the stack if it is full */
+static walk_frame *push_frame(FTS *fts)
+{
+    walk_frame **grown;
+
+    if (fts->depth == fts->frameCap) {
+        grown = (walk_frame **)NewPtrClear(2 * fts->frameCap * sizeof(walk_frame *));
+        if (!grown) return NULL;
+        memcpy(grown, fts->frames, fts->frameCap * sizeof(walk_frame *));
+        DisposePtr((Ptr)fts->frames);
+        fts->frames = grown;
+        fts->frameCap *= 2;
+    }
+
+    if (!fts->frames[fts->depth]) {
+        fts->frames[fts->depth] = (walk_frame *)NewPtrClear(sizeof(walk_frame));
+        if (!fts->frames[fts->depth]) return NULL;
+    }
+
+    return fts->frames[fts->depth++];
+}
+
+/*
+ * Return name in parID, whose catalog info is pb and whose path is
+ * fts->path with the name at nameAt. A directory goes on the stack.
+ */
+static FTSENT *visit(FTS *fts, FTSENT *parent, short vRefNum, long parID,
+                     ConstStr255Param name, const CInfoPBRec *pb,
+                     size_t nameAt, size_t pathLen)
+{
+    struct stat64 st64;
+    walk_frame *frame;
+    FTSENT *ent;
+
+    if (pb->hFileInfo.ioFlAttrib & ioDirMask) {
+        frame = push_frame(fts);
+        if (!frame) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        begin_iter(&frame->it, vRefNum, pb->dirInfo.ioDrDirID);
+        frame->skipRest = false;
+        ent = &frame->ent;
+        ent->fts_statp = (struct stat *)&frame->st;
+        ent->fts_info = FTS_D;
+        ent->fts_ino = pb->dirInfo.ioDrDirID;
+    } else {
+        ent = &fts->file;
+        ent->fts_statp = (struct stat *)&fts->fileStat;
+        ent->fts_info = FTS_F;
+        ent->fts_ino = pb->hFileInfo.ioDirID;
+    }
+
+    ent->fts_parent = parent;
+    ent->fts_path = ent->fts_accpath = fts->path;
+    ent->fts_name = fts->path + nameAt;
+    ent->fts_pathlen = pathLen;
+    ent->fts_namelen = pathLen - nameAt;
+    ent->fts_level = parent->fts_level + 1;
+    ent->fts_errno = 0;
+    ent->fts_number = 0;
+    ent->fts_pointer = NULL;
+    ent->fts_dev = vRefNum;
+    ent->fts_nlink = 1;
+
+    /* The listing already read everything stat() needs */
+    if (fts->large) {
+        posix9_file_stat_entry(vRefNum, parID, name, pb, (struct stat64 *)ent->fts_statp);
+    } else {
+        posix9_file_stat_entry(vRefNum, parID, name, pb, &st64);
+        if (posix9_file_stat_narrow(&st64, ent->fts_statp) != 0) {
+            ent->fts_info = FTS_NS;
+            ent->fts_errno = errno;
+        }
+    }
+
+    fts->catInfo = *pb;
+    fts->last = ent;
+    return ent;
+}
+
+/* An entry that has no catalog info: FTS_NS or FTS_ERR */
+static FTSENT *visit_error(FTS *fts, FTSENT *parent, size_t pathLen, int info, int err)
+{
+    FTSENT *ent = &fts->file;
+
+    memset(ent, 0, sizeof(*ent));
+    memset(&fts->fileStat, 0, sizeof(fts->fileStat));
+    ent->fts_parent = parent;
+    ent->fts_path = ent->fts_accpath = ent->fts_name = fts->path;
+    ent->fts_pathlen = ent->fts_namelen = pathLen;
+    ent->fts_level = parent->fts_level + 1;
+    ent->fts_info = info;
+    ent->fts_errno = err;
+    ent->fts_statp = (struct stat *)&fts->fileStat;
+
+    fts->last = ent;
+    return ent;
+}
+
+/* Start on the next path given; NULL with errno 0 after the last */
+static FTSENT *next_root(FTS *fts)
+{
+    CInfoPBRec catInfo;
+    FSSpec spec;
+    size_t len;
+    OSErr err;
+
+    if (*fts->nextRoot == '\0') {
+        fts->last = NULL;
+        errno = 0;
+        return NULL;
+    }
+
+    len = strlen(fts->nextRoot);
+    memcpy(fts->path, fts->nextRoot, len + 1);
+    fts->nextRoot += len + 1;
+
+    err = posix9_path_to_fsspec(fts->path, &spec);
+    if (err == noErr) {
+        err = posix9_statcache_getcatinfo(spec.vRefNum, spec.parID, spec.name, &catInfo);
+    }
+    if (err != noErr) {
+        return visit_error(fts, &fts->rootParent, len, FTS_NS, posix9_macos_to_errno(err));
+    }
+
+    /* A root's fts_name is the path as given */
+    return visit(fts, &fts->rootParent, spec.vRefNum, spec.parID, spec.name, &catInfo, 0, len);
+}
+
+static FTS *open_walk(char * const *paths, int (*compar)(const FTSENT **, const FTSENT **),
+                      Boolean large)
+{
+    FTS *fts;
+    size_t total = 0, len;
+    int i;
+
+    if (!paths || compar) {
+        errno = EINVAL;
+        return NULL;
+    }
+    for (i = 0; paths[i]; i++) {
+        len = strlen(paths[i]);
+        if (len == 0) {
+            errno = ENOENT;
+            return NULL;
+        }
+        if (len >= POSIX9_PATH_MAX) {
+            errno = ENAMETOOLONG;
+            return NULL;
+        }
+        total += len + 1;
+    }
+
+    fts = (FTS *)NewPtrClear(sizeof(FTS));
+    if (!fts) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    fts->roots = NewPtr(total + 1);
+    fts->frames = (walk_frame **)NewPtrClear(WALK_FRAMES * sizeof(walk_frame *));
+    if (!fts->roots || !fts->frames) {
+        fts_close(fts);
+        errno = ENOMEM;
+        return NULL;
+    }
+    fts->frameCap = WALK_FRAMES;
+    fts->large = large;
+
+    fts->nextRoot = fts->roots;
+    for (i = 0; paths[i]; i++) {
+        len = strlen(paths[i]);
+        memcpy(fts->nextRoot, paths[i], len + 1);
+        fts->nextRoot += len + 1;
+    }
+    *fts->nextRoot = '\0';
+    fts->rootParent.fts_path = fts->rootParent.fts_accpath = fts->rootParent.fts_name =
+        fts->nextRoot;
+    fts->rootParent.fts_level = FTS_ROOTPARENTLEVEL;
+    fts->nextRoot = fts->roots;
+
+    return fts;
+}
+
+/* Every walk is physical, stays put and stats, whatever options say */
+FTS *fts_open(char * const *paths, int options,
+              int (*compar)(const FTSENT **, const FTSENT **))
+{
+    (void)options;
+    return open_walk(paths, compar, false);
+}
+
+FTS *fts_open64(char * const *paths, int options,
+                int (*compar)(const FTSENT **, const FTSENT **))
+{
+    (void)options;
+    return open_walk(paths, compar, true);
+}
+
+FTSENT *fts_read(FTS *ftsp)
+{
+    walk_frame *top;
+    CInfoPBRec catInfo;
+    Str255 name;
+    size_t at;
+    int len;
+    OSErr err;
+
+    if (!ftsp) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (ftsp->popTop) {
+        ftsp->popTop = false;
+        end_bulk(&ftsp->frames[--ftsp->depth]->it);
+    }
+    if (ftsp->depth == 0) {
+        ftsp->skipLast = false;
+        return next_root(ftsp);
+    }
+
+    top = ftsp->frames[ftsp->depth - 1];
+    ftsp->path[top->ent.fts_pathlen] = '\0';
+
+    /* Pruned: straight to its FTS_DP */
+    if (ftsp->skipLast) {
+        ftsp->skipLast = false;
+        top->ent.fts_info = FTS_DP;
+        ftsp->popTop = true;
+        ftsp->last = &top->ent;
+        return &top->ent;
+    }
+
+    err = top->skipRest ? fnfErr : next_entry(&top->it, &catInfo, name);
+    if (err != noErr) {
+        if (err == fnfErr) {
+            top->ent.fts_info = FTS_DP;
+        } else {
+            top->ent.fts_info = FTS_DNR;
+            top->ent.fts_errno = posix9_macos_to_errno(err);
+        }
+        ftsp->popTop = true;
+        ftsp->last = &top->ent;
+        return &top->ent;
+    }
+
+    /* The directory's path, a '/' and the name in UTF-8 */
+    at = top->ent.fts_pathlen;
+    if (at > 0 && ftsp->path[at - 1] != '/') ftsp->path[at++] = '/';
+    len = posix9_name_from_mac(name, ftsp->path + at, sizeof(ftsp->path) - at);
+    if (len < 0) {
+        ftsp->path[at] = '\0';
+        return visit_error(ftsp, &top->ent, at, FTS_ERR, ENAMETOOLONG);
+    }
+
+    return visit(ftsp, &top->ent, top->it.vRefNum, top->it.dirID, name, &catInfo,
+                 at, at + len);
+}
+
+int fts_set(FTS *ftsp, FTSENT *f, int instr)
+{
+    if (!ftsp || !f) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    switch (instr) {
+    case FTS_SKIP:
+        if (f == ftsp->last && f->fts_info == FTS_D) ftsp->skipLast = true;
+        return 0;
+    case FTS_NOINSTR:
+    case FTS_FOLLOW:
+        return 0;
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+int fts_close(FTS *ftsp)
+{
+    int i;
+
+    if (!ftsp) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ftsp->frames) {
+        for (i = 0; i < ftsp->frameCap && ftsp->frames[i]; i++) {
+            end_bulk(&ftsp->frames[i]->it);
+            free_bulk(&ftsp->frames[i]->it);
+            DisposePtr((Ptr)ftsp->frames[i]);
+        }
+        DisposePtr((Ptr)ftsp->frames);
+    }
+    if (ftsp->roots) DisposePtr(ftsp->roots);
+    DisposePtr((Ptr)ftsp);
+
+    return 0;
+}
+
+/* The catalog info of the FTS_D or FTS_F fts_read() just returned,
+ * for the Finder info struct stat has no room for */
+const CInfoPBRec *posix9_fts_catinfo(FTS *ftsp)
+{
+    return &ftsp->catInfo;
+}
+
+/* List nothing more from the directory f is in */
+static void walk_skip_rest(FTS *fts, const FTSENT *f)
+{
+    if (f->fts_level > FTS_ROOTLEVEL) {
+        fts->frames[f->fts_level - 1]->skipRest = true;
+    }
+}
+
+/* nftw() with fn, or nftw64() with fn64 */
+static int walk_tree(const char *path,
+                     int (*fn)(const char *fpath, const struct stat *sb, int typeflag,
+                               struct FTW *ftwbuf),
+                     int (*fn64)(const char *fpath, const struct stat64 *sb, int typeflag,
+                                 struct FTW *ftwbuf),
+                     int flags)
+{
+    char *paths[2];
+    const char *slash;
+    struct FTW ftw;
+    FTSENT *ent;
+    FTS *fts;
+    int type, result = 0, err;
+
+    if (flags & FTW_CHDIR) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    paths[0] = (char *)path;
+    paths[1] = NULL;
+    fts = open_walk(paths, NULL, fn64 != NULL);
+    if (!fts) return -1;
+
+    while ((ent = fts_read(fts)) != NULL) {
+        if (ent->fts_info == FTS_D) {
+            if (flags & FTW_DEPTH) continue;
+            type = FTW_D;
+        } else if (ent->fts_info == FTS_DP) {
+            if (!(flags & FTW_DEPTH)) continue;
+            type = FTW_DP;
+        } else if (ent->fts_info == FTS_DNR) {
+            type = FTW_DNR;
+        } else if (ent->fts_info == FTS_NS && ent->fts_level > FTS_ROOTLEVEL) {
+            type = FTW_NS;
+        } else if (ent->fts_info == FTS_F) {
+            type = FTW_F;
+        } else {
+            /* The path itself is missing, or a name did not fit */
+            errno = ent->fts_errno;
+            result = -1;
+            break;
+        }
+
+        if (ent->fts_level == FTS_ROOTLEVEL) {
+            slash = strrchr(ent->fts_path, '/');
+            ftw.base = (slash && slash[1]) ? (int)(slash + 1 - ent->fts_path) : 0;
+        } else {
+            ftw.base = (int)(ent->fts_name - ent->fts_path);
+        }
+        ftw.level = ent->fts_level;
+
+        if (fn64) {
+            result = fn64(ent->fts_path, (const struct stat64 *)ent->fts_statp, type, &ftw);
+        } else {
+            result = fn(ent->fts_path, ent->fts_statp, type, &ftw);
+        }
+        if (flags & FTW_ACTIONRETVAL) {
+            if (result == FTW_STOP) break;
+            if (result == FTW_SKIP_SUBTREE || result == FTW_SKIP_SIBLINGS) {
+                if (type == FTW_D) fts_set(fts, ent, FTS_SKIP);
+                if (result == FTW_SKIP_SIBLINGS) walk_skip_rest(fts, ent);
+            }
+            result = 0;
+        } else if (result != 0) {
+            break;
+        }
+    }
+    if (!ent && errno != 0) result = -1;
+
+    err = errno;
+    fts_close(fts);
+    errno = err;
+
+    return result;
+}
+
+/* nopenfd is ignored: the walk holds no descriptors */
+int nftw(const char *path,
+         int (*fn)(const char *fpath, const struct stat *sb, int typeflag,
+                   struct FTW *ftwbuf),
+         int nopenfd, int flags)
+{
+    (void)nopenfd;
+    return walk_tree(path, fn, NULL, flags);
+}
+
+int nftw64(const char *path,
+           int (*fn)(const char *fpath, const struct stat64 *sb, int typeflag,
+                     struct FTW *ftwbuf),
+           int nopenfd, int flags)
+{
+    (void)nopenfd;
+    return walk_tree(path, NULL, fn, flags);
+}
+
+/* ============================================================
+ * Stream Statistics
+ * ============================================================ */
+
+void posix9_dir_stats(posix9_dir_usage *stats)
+{
+    if (!stats) return;
+
+    stats->streams = dir_open_count;
+    stats->capacity = dir_block_count * POSIX9_DIR_BLOCK;
+    stats->streamBytes = sizeof(struct posix9_dir);
+    stats->bulkBytes = POSIX9_READDIR_BULK * (sizeof(FSCatalogInfo) + sizeof(FSSpec));
+    stats->heapBytes = dir_block_count * (long)sizeof(dir_block) +
+                       dir_bulk_count * stats->bulkBytes;
+}
@@ -0,0 +1,520 @@
+/*
+ * posix9_epoll.c - Persistent socket interest sets for Mac OS 9
+ *
+ * select() and poll() are handed the whole set of descriptors on every
+ * call. An epoll set keeps its sockets registered instead:
+ *   posix9_epoll_create() -> a set behind a descriptor
+ *   posix9_epoll_ctl()    -> one item per socket in the set, linked
+ *                            into the socket's list of watchers
+ *   socket notifier       -> posix9_epoll_notify(): each item of the
+ *                            socket onto its set's OTLIFO queue
+ *   posix9_epoll_wait()   -> steal the queue, report what is ready
+ *
+ * Items are allocated by posix9_epoll_ctl(), so the notifier only links
+ * them: O(1) per set watching the socket, no allocation, safe at
+ * deferred task time. Level-triggered items stay on the set's ready
+ * list while their socket is ready and are looked at again on each
+ * wait; edge-triggered ones leave it when reported and come back with
+ * the next event. A wait with nothing queued and nothing ready costs
+ * the same whatever the number of sockets registered, and the thread
+ * waiting on a set is stopped until the notifier queues something on
+ * it or its timeout runs out.
+ *
+ * Items removed or closed while queued or on the ready list are only
+ * marked; the wait that finds them there disposes of them.
+ *
+ * A set is itself a descriptor that poll() and select() can wait on.
+ * The notifier lists each set it queues an item on for them, as the
+ * socket module lists sockets, so a poll() parked on a set looks at it
+ * again when an event arrives.
+ */
+
+#include "posix9.h"
+#include "posix9_fd.h"
+
+/* Mac OS headers */
+#include <Multiverse.h>
+#include "MacCompat.h"              /* Missing definitions for Retro68 */
+#include "OpenTransport.h"          /* Our stub for cross-compilation */
+#include "Threads.h"
+#include <string.h>
+#include <stddef.h>
+
+/* From posix9_socket.c */
+extern struct posix9_epoll_item **posix9_socket_interest(int fd, EndpointRef *ep);
+
+/* ============================================================
+ * Sets and Items
+ * ============================================================ */
+
+typedef struct posix9_epoll_item posix9_epoll_item;
+
+typedef struct {
+    posix9_fd_desc      desc;           /* Shared by dup()ed descriptors - must be first */
+    OTLIFO              queue;          /* Items with events, from the notifier */
+    posix9_epoll_item * readyHead;      /* Items to look at on the next wait */
+    posix9_epoll_item * readyTail;
+    int                 readyCount;
+    posix9_fd_waiter * volatile waiter;  /* posix9_epoll_wait() parked on it */
+    OTLink              eventLink;      /* On set_events */
+    volatile Boolean    listed;         /* eventLink is on set_events */
+    posix9_epoll_item * byFd[POSIX9_OPEN_MAX];  /* Registered items */
+} posix9_epoll_set;
+
+struct posix9_epoll_item {
+    OTLink              link;           /* On set->queue - must be first */
+    volatile Boolean    queued;         /* link is on set->queue */
+    Boolean             ready;          /* On the set's ready list */
+    Boolean             dead;           /* Removed: dispose when off both */
+    Boolean             disabled;       /* EPOLLONESHOT reported */
+    posix9_epoll_set *  set;
+    posix9_epoll_item * sockNext;       /* Next item watching the socket */
+    posix9_epoll_item * readyNext;
+    posix9_epoll_item **interest;       /* The socket's list of items */
+    EndpointRef         ep;
+    const posix9_fd_ops *ops;
+    void *              obj;            /* The socket */
+    int                 fd;
+    unsigned int        events;
+    epoll_data_t        data;
+};
+
+static const posix9_fd_ops epoll_fd_ops;
+static OTLIFO set_events;           /* Sets queued on since the last drain */
+
+static posix9_epoll_set *get_set(int epfd)
+{
+    const posix9_fd_ops *ops = posix9_fd_ops_of(epfd);
+
+    if (!ops) return NULL;
+    if (ops != &epoll_fd_ops) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return (posix9_epoll_set *)posix9_fd_object(epfd, ops);
+}
+
+/* Look at item on the next wait */
+static void make_ready(posix9_epoll_set *set, posix9_epoll_item *item)
+{
+    if (item->ready || item->disabled) return;
+
+    item->ready = true;
+    item->readyNext = NULL;
+    if (set->readyTail) set->readyTail->readyNext = item;
+    else set->readyHead = item;
+    set->readyTail = item;
+    set->readyCount++;
+}
+
+static posix9_epoll_item *take_ready(posix9_epoll_set *set)
+{
+    posix9_epoll_item *item = set->readyHead;
+
+    set->readyHead = item->readyNext;
+    if (!set->readyHead) set->readyTail = NULL;
+    set->readyCount--;
+    item->ready = false;
+
+    return item;
+}
+
+/* Take item off its socket's list, with the socket's notifier held off */
+static void unlink_interest(posix9_epoll_item *item)
+{
+    posix9_epoll_item **p;
+    Boolean entered;
+
+    entered = OTEnterNotifier(item->ep);
+    for (p = item->interest; *p != NULL; p = &(*p)->sockNext) {
+        if (*p == item) {
+            *p = item->sockNext;
+            break;
+        }
+    }
+    if (entered) OTLeaveNotifier(item->ep);
+}
+
+/* Out of the set; disposed of now, or by the wait that next meets it */
+static void retire(posix9_epoll_item *item)
+{
+    posix9_epoll_set *set = item->set;
+
+    if (set->byFd[item->fd] == item) set->byFd[item->fd] = NULL;
+    item->dead = true;
+    if (!item->queued && !item->ready) DisposePtr((Ptr)item);
+}
+
+/* Move the items the notifier queued onto the ready list */
+static void collect(posix9_epoll_set *set)
+{
+    OTLink *link, *next;
+    posix9_epoll_item *item;
+
+    for (link = OTLIFOStealList(&set->queue); link != NULL; link = next) {
+        next = link->fNext;
+        item = (posix9_epoll_item *)link;
+        item->queued = false;
+        if (!item->dead) {
+            make_ready(set, item);
+        } else if (!item->ready) {
+            DisposePtr((Ptr)item);
+        }
+    }
+}
+
+/* EPOLL* bits item's socket is ready for */
+static unsigned int item_events(posix9_epoll_item *item)
+{
+    int ready = item->ops->poll(item->obj);
+    unsigned int events = 0;
+
+    if (ready & POSIX9_FD_READABLE) events |= EPOLLIN;
+    if (ready & POSIX9_FD_WRITABLE) events |= EPOLLOUT;
+    if (ready & POSIX9_FD_EXCEPT)   events |= EPOLLPRI;
+    events &= item->events;
+    if (ready & POSIX9_FD_HANGUP)   events |= EPOLLHUP;
+
+    return events;
+}
+
+/*
+ * Report up to maxevents ready items, looking at each on the ready
+ * list at most once. Level-triggered items still ready go to the back,
+ * so the next wait starts with those not reported this time.
+ */
+static int harvest(posix9_epoll_set *set, struct epoll_event *events, int maxevents)
+{
+    posix9_epoll_item *item;
+    unsigned int ready;
+    int budget = set->readyCount;
+    int count = 0;
+
+    while (count < maxevents && budget-- > 0) {
+        item = take_ready(set);
+        if (item->dead) {
+            if (!item->queued) DisposePtr((Ptr)item);
+            continue;
+        }
+        if (item->disabled) continue;
+
+        ready = item_events(item);
+        if (ready == 0) continue;       /* Back on when the notifier says */
+
+        events[count].events = ready;
+        events[count].data = item->data;
+        count++;
+
+        if (item->events & EPOLLONESHOT) {
+            item->disabled = true;
+        } else if (!(item->events & EPOLLET)) {
+            make_ready(set, item);
+        }
+    }
+
+    return count;
+}
+
+/* ============================================================
+ * Notifier and Socket Hooks (called from posix9_socket.c)
+ * ============================================================ */
+
+/*
+ * An event on a socket: queue each item watching it on its set, list
+ * the set for poll() and select(), and wake the thread waiting on it
+ * either way. Runs in the socket's notifier, at deferred task time.
+ */
+void posix9_epoll_notify(posix9_epoll_item *interest)
+{
+    posix9_epoll_item *item;
+    posix9_epoll_set *set;
+    posix9_fd_waiter *waiter;
+
+    for (item = interest; item != NULL; item = item->sockNext) {
+        set = item->set;
+        if (!item->queued) {
+            item->queued = true;
+            OTLIFOEnqueue(&set->queue, &item->link);
+        }
+        if (!set->listed) {
+            set->listed = true;
+            OTLIFOEnqueue(&set_events, &set->eventLink);
+        }
+        posix9_fd_notify(&set->desc);
+        waiter = set->waiter;
+        if (waiter) posix9_fd_wake(waiter);
+    }
+}
+
+/*
+ * Take the sets listed since the last call, oldest first, linked
+ * through desc.readyNext. Each is unmarked before poll() looks at it,
+ * so an event from here on lists it again.
+ */
+static posix9_fd_desc *drain_sets(void)
+{
+    OTLink *link, *next;
+    posix9_epoll_set *set;
+    posix9_fd_desc *list = NULL;
+
+    for (link = OTLIFOStealList(&set_events); link != NULL; link = next) {
+        next = link->fNext;
+        set = (posix9_epoll_set *)((char *)link - offsetof(posix9_epoll_set, eventLink));
+        set->listed = false;
+        set->desc.readyNext = list;
+        list = &set->desc;
+    }
+
+    return list;
+}
+
+/* The socket's last descriptor is closed and its endpoint with it */
+void posix9_epoll_forget(posix9_epoll_item **interest)
+{
+    posix9_epoll_item *item, *next;
+
+    for (item = *interest; item != NULL; item = next) {
+        next = item->sockNext;
+        retire(item);
+    }
+    *interest = NULL;
+}
+
+/* ============================================================
+ * Interest Set Functions
+ * ============================================================ */
+
+int posix9_epoll_create(int size)
+{
+    posix9_epoll_set *set;
+    int fd;
+
+    if (size <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    set = (posix9_epoll_set *)NewPtrClear(sizeof(posix9_epoll_set));
+    if (!set) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    fd = posix9_fd_alloc(0, &epoll_fd_ops, set);
+    if (fd < 0) DisposePtr((Ptr)set);
+    else posix9_fd_event_source(drain_sets);
+
+    return fd;
+}
+
+int posix9_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+    posix9_epoll_set *set;
+    posix9_epoll_item *item;
+    posix9_epoll_item **interest;
+    const posix9_fd_ops *ops;
+    EndpointRef ep;
+    Boolean entered;
+
+    set = get_set(epfd);
+    if (!set) return -1;
+    ops = posix9_fd_ops_of(fd);
+    if (!ops) return -1;
+    if (fd == epfd || (op != EPOLL_CTL_DEL && !event)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    item = set->byFd[fd];
+
+    switch (op) {
+    case EPOLL_CTL_ADD:
+        if (item) {
+            errno = EEXIST;
+            return -1;
+        }
+        interest = posix9_socket_interest(fd, &ep);
+        if (!interest) {
+            errno = EPERM;
+            return -1;
+        }
+
+        item = (posix9_epoll_item *)NewPtrClear(sizeof(posix9_epoll_item));
+        if (!item) {
+            errno = ENOMEM;
+            return -1;
+        }
+        item->set = set;
+        item->interest = interest;
+        item->ep = ep;
+        item->ops = ops;
+        item->obj = posix9_fd_object(fd, ops);
+        item->fd = fd;
+        item->events = event->events;
+        item->data = event->data;
+
+        entered = OTEnterNotifier(ep);
+        item->sockNext = *interest;
+        *interest = item;
+        if (entered) OTLeaveNotifier(ep);
+
+        /* It may be ready already: look on the next wait */
+        set->byFd[fd] = item;
+        make_ready(set, item);
+        return 0;
+
+    case EPOLL_CTL_MOD:
+        if (!item) {
+            errno = ENOENT;
+            return -1;
+        }
+        item->events = event->events;
+        item->data = event->data;
+        item->disabled = false;
+        make_ready(set, item);
+        return 0;
+
+    case EPOLL_CTL_DEL:
+        if (!item) {
+            errno = ENOENT;
+            return -1;
+        }
+        unlink_interest(item);
+        retire(item);
+        return 0;
+
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+}
+
+int posix9_epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    posix9_epoll_set *set;
+    posix9_fd_waiter wait;
+    struct timeval tv;
+    Boolean blind = false;
+    int count;
+
+    set = get_set(epfd);
+    if (!set) return -1;
+    if (!events || maxevents <= 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    collect(set);
+    count = harvest(set, events, maxevents);
+    if (count > 0 || timeout == 0) return count;
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000L;
+    posix9_fd_wait_begin(&wait, timeout < 0 ? NULL : &tv);
+
+    /* One thread parks on a set; others waiting there too yield */
+    if (set->waiter) blind = true;
+    else set->waiter = &wait;
+
+    for (;;) {
+        if (blind) {
+            SystemTask();
+            YieldToAnyThread();
+            if (wait.expired) break;
+        } else if (!posix9_fd_park(&wait)) {
+            break;
+        }
+
+        /* Another thread may have closed the set meanwhile */
+        if (get_set(epfd) != set) {
+            posix9_fd_wait_end(&wait);
+            errno = EBADF;
+            return -1;
+        }
+
+        collect(set);
+        count = harvest(set, events, maxevents);
+        if (count > 0) break;
+    }
+
+    if (!blind) set->waiter = NULL;
+    posix9_fd_wait_end(&wait);
+
+    return count;
+}
+
+/* ============================================================
+ * Descriptor Operations (dispatched from posix9_fd.c)
+ * ============================================================ */
+
+static int epoll_fd_close(void *obj)
+{
+    posix9_epoll_set *set = (posix9_epoll_set *)obj;
+    posix9_epoll_item *item, *next;
+    OTLink *link, *nextLink, *others = NULL;
+    int fd;
+
+    /* A thread parked on the set finds it gone */
+    if (set->waiter) posix9_fd_wake(set->waiter);
+
+    /* No notifier can queue anything once every item is unlinked */
+    for (fd = 0; fd < POSIX9_OPEN_MAX; fd++) {
+        if (set->byFd[fd]) unlink_interest(set->byFd[fd]);
+    }
+
+    /* Take the set off set_events; the other sets go back in order */
+    if (set->listed) {
+        for (link = OTLIFOStealList(&set_events); link != NULL; link = nextLink) {
+            nextLink = link->fNext;
+            if (link == &set->eventLink) continue;
+            link->fNext = others;
+            others = link;
+        }
+        for (link = others; link != NULL; link = nextLink) {
+            nextLink = link->fNext;
+            OTLIFOEnqueue(&set_events, link);
+        }
+    }
+
+    for (link = OTLIFOStealList(&set->queue); link != NULL; link = nextLink) {
+        nextLink = link->fNext;
+        item = (posix9_epoll_item *)link;
+        item->queued = false;
+        if (item->dead && !item->ready) DisposePtr((Ptr)item);
+    }
+    for (item = set->readyHead; item != NULL; item = next) {
+        next = item->readyNext;
+        if (item->dead) DisposePtr((Ptr)item);
+    }
+    for (fd = 0; fd < POSIX9_OPEN_MAX; fd++) {
+        if (set->byFd[fd]) DisposePtr((Ptr)set->byFd[fd]);
+    }
+
+    DisposePtr((Ptr)set);
+    return 0;
+}
+
+/* Readable when a wait would report something */
+static int epoll_fd_poll(void *obj)
+{
+    posix9_epoll_set *set = (posix9_epoll_set *)obj;
+    posix9_epoll_item *item;
+
+    collect(set);
+    for (item = set->readyHead; item != NULL; item = item->readyNext) {
+        if (!item->dead && !item->disabled && item_events(item) != 0) {
+            return POSIX9_FD_READABLE;
+        }
+    }
+
+    return 0;
+}
+
+static const posix9_fd_ops epoll_fd_ops = {
+    0,                      /* Anonymous - no file type */
+    NULL,                   /* read() -> EBADF */
+    NULL,                   /* write() -> EBADF */
+    epoll_fd_close,
+    epoll_fd_poll
+};
@@ -0,0 +1,715 @@
+/*
+ * posix9_fd.c - Unified descriptor table for Mac OS 9
+ *
+ * One descriptor space for every kind of open object:
+ *   posix9_file.c   -> files and stdio (File Manager refNums)
+ *   posix9_socket.c -> sockets (Open Transport endpoints)
+ *   posix9_dir.c    -> directory streams (dirfd)
+ *
+ * Free descriptors are tracked in a bitmap so allocation finds the
+ * lowest free number - which POSIX requires of open(), socket() and
+ * dup() - in a handful of word tests. read(), write(), close(), poll()
+ * and select() index the slot and call through its ops vtable. dup() and
+ * dup2() make another slot point at the same object; the object's
+ * reference count decides when its module really closes it, so a file
+ * duplicated onto several descriptors shares one refNum, offset and
+ * buffer set, and FSClose runs once.
+ *
+ * poll() and select() are event driven: a pass over every descriptor
+ * given finds what is ready now, and while nothing is, the wait looks
+ * again only at objects the socket notifier has listed since the last
+ * look. An idle connection costs nothing per pass however many there
+ * are. Between looks the thread is stopped, not spinning: the notifier
+ * readies it when one of its objects has an event, and a Time Manager
+ * task when the timeout - kept to the microsecond - runs out.
+ */
+
+#include "posix9.h"
+#include "posix9_fd.h"
+
+/* Mac OS headers */
+#include <Multiverse.h>
+#include "MacCompat.h"      /* Missing definitions for Retro68 */
+#include "Threads.h"
+#include <string.h>
+#include <limits.h>
+
+/* Every descriptor must be representable in an fd_set */
+#if POSIX9_OPEN_MAX > FD_SETSIZE
+#error "POSIX9_OPEN_MAX must not exceed FD_SETSIZE"
+#endif
+
+/* ============================================================
+ * Descriptor Table
+ * ============================================================ */
+
+typedef struct {
+    const posix9_fd_ops *   ops;        /* NULL when free or reserved */
+    void *                  obj;        /* Owned by the ops' module */
+} posix9_fd_slot;
+
+#define FD_WORDS    ((POSIX9_OPEN_MAX + 31) / 32)
+
+static posix9_fd_slot   fd_slots[POSIX9_OPEN_MAX];
+static unsigned long    fd_free_map[FD_WORDS];     /* 1 bit = free */
+static Boolean          fd_slots_initialized = false;
+
+/* ============================================================
+ * Internal Helpers
+ * ============================================================ */
+
+static void init_fd_slots(void)
+{
+    int i;
+
+    if (fd_slots_initialized) return;
+
+    for (i = 0; i < POSIX9_OPEN_MAX; i++) {
+        fd_slots[i].ops = NULL;
+        fd_slots[i].obj = NULL;
+        fd_free_map[i / 32] |= 1UL << (i % 32);
+    }
+
+    /* stdin/stdout/stderr are installed by posix9_file.c */
+    for (i = 0; i <= STDERR_FILENO; i++) {
+        fd_free_map[i / 32] &= ~(1UL << (i % 32));
+    }
+
+    fd_slots_initialized = true;
+}
+
+/* Index of the lowest set bit of a non-zero word */
+static int lowest_bit(unsigned long word)
+{
+#ifdef __GNUC__
+    return __builtin_ctzl(word);
+#else
+    int bit = 0;
+
+    if ((word & 0xFFFF) == 0) { word >>= 16; bit += 16; }
+    if ((word & 0xFF) == 0)   { word >>= 8;  bit += 8; }
+    if ((word & 0xF) == 0)    { word >>= 4;  bit += 4; }
+    if ((word & 0x3) == 0)    { word >>= 2;  bit += 2; }
+    if ((word & 0x1) == 0)    { bit += 1; }
+    return bit;
+#endif
+}
+
+static posix9_fd_slot *get_slot(int fd)
+{
+    if (fd < 0 || fd >= POSIX9_OPEN_MAX || !fd_slots_initialized ||
+        fd_slots[fd].ops == NULL) {
+        errno = EBADF;
+        return NULL;
+    }
+
+    return &fd_slots[fd];
+}
+
+/* Point a slot at obj; a new object starts with no poll() watching it */
+static void bind_slot(int fd, const posix9_fd_ops *ops, void *obj)
+{
+    posix9_fd_desc *desc = (posix9_fd_desc *)obj;
+
+    if (desc->refCount == 0) {
+        desc->watch = NULL;
+        desc->hit = 0;
+    }
+    desc->refCount++;
+
+    fd_slots[fd].ops = ops;
+    fd_slots[fd].obj = obj;
+}
+
+/* ============================================================
+ * Descriptor Allocation
+ * ============================================================ */
+
+int posix9_fd_alloc(int minfd, const posix9_fd_ops *ops, void *obj)
+{
+    unsigned long word;
+    int w, fd;
+
+    init_fd_slots();
+
+    if (minfd < 0) minfd = 0;
+    if (minfd >= POSIX9_OPEN_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Mask off the bits below minfd in its word, then scan whole words */
+    w = minfd / 32;
+    word = fd_free_map[w] & (~0UL << (minfd % 32));
+    while (word == 0) {
+        if (++w >= FD_WORDS) {
+            errno = EMFILE;
+            return -1;
+        }
+        word = fd_free_map[w];
+    }
+
+    fd = w * 32 + lowest_bit(word);
+    if (fd >= POSIX9_OPEN_MAX) {
+        errno = EMFILE;
+        return -1;
+    }
+
+    fd_free_map[w] &= ~(1UL << (fd % 32));
+    bind_slot(fd, ops, obj);
+
+    return fd;
+}
+
+int posix9_fd_install(int fd, const posix9_fd_ops *ops, void *obj)
+{
+    init_fd_slots();
+
+    if (fd < 0 || fd >= POSIX9_OPEN_MAX || fd_slots[fd].ops != NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    fd_free_map[fd / 32] &= ~(1UL << (fd % 32));
+    bind_slot(fd, ops, obj);
+
+    return fd;
+}
+
+void posix9_fd_release(int fd)
+{
+    if (fd < 0 || fd >= POSIX9_OPEN_MAX || !fd_slots_initialized ||
+        fd_slots[fd].ops == NULL) return;
+
+    ((posix9_fd_desc *)fd_slots[fd].obj)->refCount--;
+    fd_slots[fd].ops = NULL;
+    fd_slots[fd].obj = NULL;
+
+    /* stdio numbers stay reserved for posix9_fd_install() */
+    if (fd > STDERR_FILENO) {
+        fd_free_map[fd / 32] |= 1UL << (fd % 32);
+    }
+}
+
+void *posix9_fd_object(int fd, const posix9_fd_ops *ops)
+{
+    posix9_fd_slot *slot;
+
+    slot = get_slot(fd);
+    if (!slot) return NULL;
+
+    if (slot->ops != ops) {
+        errno = EBADF;
+        return NULL;
+    }
+
+    return slot->obj;
+}
+
+const posix9_fd_ops *posix9_fd_ops_of(int fd)
+{
+    posix9_fd_slot *slot;
+
+    slot = get_slot(fd);
+    return slot ? slot->ops : NULL;
+}
+
+/* ============================================================
+ * Generic Descriptor Operations
+ * ============================================================ */
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+    posix9_fd_slot *slot;
+
+    slot = get_slot(fd);
+    if (!slot) return -1;
+
+    if (!slot->ops->read) {
+        errno = (slot->ops->type == S_IFDIR) ? EISDIR : EBADF;
+        return -1;
+    }
+
+    return slot->ops->read(slot->obj, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+    posix9_fd_slot *slot;
+
+    slot = get_slot(fd);
+    if (!slot) return -1;
+
+    if (!slot->ops->write) {
+        errno = EBADF;
+        return -1;
+    }
+
+    return slot->ops->write(slot->obj, buf, count);
+}
+
+int close(int fd)
+{
+    posix9_fd_slot *slot;
+    const posix9_fd_ops *ops;
+    void *obj;
+
+    slot = get_slot(fd);
+    if (!slot) return -1;
+
+    ops = slot->ops;
+    obj = slot->obj;
+    posix9_fd_release(fd);
+
+    /* Other descriptors still share the description */
+    if (((posix9_fd_desc *)obj)->refCount > 0) return 0;
+
+    /* The descriptor is gone even if the object reports an error */
+    return ops->close ? ops->close(obj) : 0;
+}
+
+int dup(int oldfd)
+{
+    posix9_fd_slot *slot;
+
+    slot = get_slot(oldfd);
+    if (!slot) return -1;
+
+    return posix9_fd_alloc(0, slot->ops, slot->obj);
+}
+
+int dup2(int oldfd, int newfd)
+{
+    posix9_fd_slot *slot;
+
+    slot = get_slot(oldfd);
+    if (!slot) return -1;
+
+    if (newfd < 0 || newfd >= POSIX9_OPEN_MAX) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (newfd == oldfd) return newfd;
+
+    /* Close newfd if open - whatever kind of descriptor it is */
+    if (fd_slots[newfd].ops != NULL) {
+        close(newfd);
+    }
+
+    return posix9_fd_install(newfd, slot->ops, slot->obj);
+}
+
+/*
+ * Close every descriptor above stdio. Called from posix9_cleanup().
+ */
+void posix9_fd_close_all(void)
+{
+    int fd;
+
+    if (!fd_slots_initialized) return;
+
+    for (fd = STDERR_FILENO + 1; fd < POSIX9_OPEN_MAX; fd++) {
+        if (fd_slots[fd].ops != NULL) {
+            close(fd);
+        }
+    }
+}
+
+/* ============================================================
+ * Waiting
+ * ============================================================ */
+
+static ThreadTaskRef    fd_task_ref = NULL;
+static TimerUPP         fd_timer_upp = NULL;
+static Boolean          fd_wait_initialized = false;
+
+/* Runs at interrupt time when a wait's deadline passes */
+static pascal void wait_timer_fired(TMTaskPtr task)
+{
+    posix9_fd_waiter *w = (posix9_fd_waiter *)task;
+
+    w->expired = true;
+    posix9_fd_wake(w);
+}
+
+void posix9_fd_wait_begin(posix9_fd_waiter *w, const struct timeval *timeout)
+{
+    long count;
+
+    if (!fd_wait_initialized) {
+        /* Without a task ref nobody can be woken; parking yields instead */
+        if (GetThreadCurrentTaskRef(&fd_task_ref) != noErr) {
+            fd_task_ref = NULL;
+        }
+        fd_timer_upp = NewTimerUPP(wait_timer_fired);
+        fd_wait_initialized = true;
+    }
+
+    GetCurrentThread(&w->owner);
+    w->thread = kNoThreadID;
+    w->woken = false;
+    w->expired = false;
+    w->timed = timeout != NULL;
+    if (!timeout) return;
+
+    /* Negative PrimeTime counts are microseconds, positive milliseconds */
+    if (timeout->tv_sec < 2000) {
+        count = -(long)(timeout->tv_sec * 1000000L + timeout->tv_usec);
+        if (count > -1) count = -1;
+    } else if (timeout->tv_sec < LONG_MAX / 1000 - 1) {
+        count = (long)(timeout->tv_sec * 1000L + timeout->tv_usec / 1000);
+    } else {
+        count = LONG_MAX;
+    }
+
+    memset(&w->timer, 0, sizeof(w->timer));
+    w->timer.tmAddr = fd_timer_upp;
+    InsXTime((QElemPtr)&w->timer);
+    PrimeTime((QElemPtr)&w->timer, count);
+}
+
+/*
+ * Publish the thread and check for a wake-up inside a critical section,
+ * then stop and leave the section in one call, so no other thread runs
+ * between the check and the stop.
+ */
+Boolean posix9_fd_park(posix9_fd_waiter *w)
+{
+    OSErr err = threadProtocolErr;
+
+    if (fd_task_ref != NULL) {
+        ThreadBeginCritical();
+        w->thread = w->owner;
+        if (w->woken || w->expired) {
+            ThreadEndCritical();
+            err = noErr;
+        } else {
+            err = SetThreadStateEndCritical(kCurrentThreadID, kStoppedThreadState, kNoThreadID);
+        }
+        w->thread = kNoThreadID;
+    }
+
+    /* Could not stop (no Thread Manager, or nobody else to run) */
+    if (err != noErr) {
+        SystemTask();
+        YieldToAnyThread();
+    }
+
+    w->woken = false;
+    return !w->expired;
+}
+
+void posix9_fd_wake(posix9_fd_waiter *w)
+{
+    ThreadID thread = w->thread;
+
+    w->woken = true;
+    if (thread != kNoThreadID && fd_task_ref != NULL) {
+        SetThreadReadyGivenTaskRef(fd_task_ref, thread);
+    }
+}
+
+void posix9_fd_wait_end(posix9_fd_waiter *w)
+{
+    if (w->timed) {
+        RmvTime((QElemPtr)&w->timer);
+        w->timed = false;
+    }
+}
+
+/* ============================================================
+ * poll() and select()
+ * ============================================================ */
+
+/*
+ * A poll() that is waiting. Objects it found not ready point at it;
+ * events drained for them are moved onto its hits, so each look while
+ * it waits costs one step per event rather than one per descriptor.
+ * The notifier wakes its thread through the objects' watch.
+ */
+typedef struct posix9_fd_watch {
+    posix9_fd_desc *hits;       /* Linked through readyNext */
+    Boolean         rescan;     /* An object listed twice: look at every entry */
+    Boolean         blind;      /* An object another poll() watches: yield, not park */
+    posix9_fd_waiter wait;
+} posix9_fd_watch;
+
+/* Sockets and epoll sets */
+#define FD_EVENT_SOURCES    2
+
+static posix9_fd_desc *(*fd_drain[FD_EVENT_SOURCES])(void);
+
+void posix9_fd_event_source(posix9_fd_desc *(*drain)(void))
+{
+    int i;
+
+    for (i = 0; i < FD_EVENT_SOURCES; i++) {
+        if (fd_drain[i] == drain) return;
+        if (fd_drain[i] == NULL) {
+            fd_drain[i] = drain;
+            return;
+        }
+    }
+}
+
+void posix9_fd_notify(posix9_fd_desc *desc)
+{
+    posix9_fd_watch *watch = desc->watch;
+
+    if (watch) posix9_fd_wake(&watch->wait);
+}
+
+/* Hand each object with events to the poll() waiting for it, if any */
+static void route_events(void)
+{
+    posix9_fd_desc *desc, *next;
+    posix9_fd_watch *watch;
+    int i;
+
+    for (i = 0; i < FD_EVENT_SOURCES && fd_drain[i]; i++) {
+        for (desc = fd_drain[i](); desc != NULL; desc = next) {
+            next = desc->readyNext;
+            watch = desc->watch;
+            if (watch && !desc->hit) {
+                desc->hit = 1;
+                desc->readyNext = watch->hits;
+                watch->hits = desc;
+            }
+        }
+    }
+}
+
+/* revents for one entry */
+static short poll_entry(struct pollfd *p)
+{
+    posix9_fd_slot *slot;
+    short revents = 0;
+    int ready;
+
+    if (p->fd < 0) return 0;
+    if (p->fd >= POSIX9_OPEN_MAX || !fd_slots_initialized ||
+        fd_slots[p->fd].ops == NULL) return POLLNVAL;
+
+    slot = &fd_slots[p->fd];
+    ready = slot->ops->poll ? slot->ops->poll(slot->obj)
+                            : (POSIX9_FD_READABLE | POSIX9_FD_WRITABLE);
+
+    if (ready & POSIX9_FD_READABLE) revents |= POLLIN | POLLRDNORM;
+    if (ready & POSIX9_FD_WRITABLE) revents |= POLLOUT | POLLWRNORM;
+    if (ready & POSIX9_FD_EXCEPT)   revents |= POLLPRI | POLLRDBAND;
+    revents &= p->events;
+    if (ready & POSIX9_FD_HANGUP)   revents |= POLLHUP;
+
+    return revents;
+}
+
+/*
+ * Fill in every revents and count the ready entries. With watch, each
+ * object that can become ready by itself is pointed at it first, so an
+ * event after its entry is looked at still reaches the wait.
+ */
+static int poll_all(struct pollfd *fds, nfds_t nfds, posix9_fd_watch *watch)
+{
+    posix9_fd_desc *desc;
+    nfds_t i;
+    int count = 0;
+
+    for (i = 0; i < nfds; i++) {
+        if (watch && fds[i].fd >= 0 && fds[i].fd < POSIX9_OPEN_MAX &&
+            fd_slots_initialized && fd_slots[fds[i].fd].ops != NULL &&
+            fd_slots[fds[i].fd].ops->poll != NULL) {
+            desc = (posix9_fd_desc *)fd_slots[fds[i].fd].obj;
+            if (desc->watch == NULL) {
+                desc->watch = watch;
+                desc->watchIndex = (int)i;
+            } else {
+                /* Listed twice, or another thread's poll() has it */
+                watch->rescan = true;
+                if (desc->watch != watch) watch->blind = true;
+            }
+        }
+
+        fds[i].revents = poll_entry(&fds[i]);
+        if (fds[i].revents != 0) count++;
+    }
+
+    return count;
+}
+
+/* Look again at the entries of the objects with events */
+static int poll_hits(struct pollfd *fds, posix9_fd_watch *watch)
+{
+    posix9_fd_desc *desc;
+    struct pollfd *p;
+    int count = 0;
+
+    while ((desc = watch->hits) != NULL) {
+        watch->hits = desc->readyNext;
+        desc->hit = 0;
+
+        p = &fds[desc->watchIndex];
+        p->revents = poll_entry(p);
+        if (p->revents != 0) count++;
+    }
+
+    return count;
+}
+
+/* Stop the objects still open pointing at watch */
+static void unwatch(struct pollfd *fds, nfds_t nfds, posix9_fd_watch *watch)
+{
+    posix9_fd_desc *desc;
+    nfds_t i;
+
+    for (i = 0; i < nfds; i++) {
+        if (fds[i].fd < 0 || fds[i].fd >= POSIX9_OPEN_MAX ||
+            fd_slots[fds[i].fd].ops == NULL) continue;
+
+        desc = (posix9_fd_desc *)fd_slots[fds[i].fd].obj;
+        if (desc->watch == watch) {
+            desc->watch = NULL;
+            desc->hit = 0;
+        }
+    }
+}
+
+/* poll() with a select() timeout: NULL waits forever, zero just looks */
+static int poll_wait(struct pollfd *fds, nfds_t nfds, const struct timeval *timeout)
+{
+    posix9_fd_watch watch;
+    Boolean wait;
+    int count;
+
+    wait = !timeout || timeout->tv_sec > 0 || timeout->tv_usec > 0;
+
+    /* Events so far are in the objects' state; start with an empty list */
+    route_events();
+
+    watch.hits = NULL;
+    watch.rescan = false;
+    watch.blind = false;
+    if (wait) posix9_fd_wait_begin(&watch.wait, timeout);
+    count = poll_all(fds, nfds, wait ? &watch : NULL);
+
+    while (count == 0 && wait) {
+        if (watch.blind) {
+            /* Events for a shared object wake the other poll() only */
+            SystemTask();
+            YieldToAnyThread();
+            if (watch.wait.expired) break;
+        } else if (!posix9_fd_park(&watch.wait)) {
+            break;
+        }
+
+        route_events();
+        if (watch.rescan) {
+            watch.hits = NULL;
+            count = poll_all(fds, nfds, NULL);
+        } else {
+            count = poll_hits(fds, &watch);
+        }
+    }
+
+    if (wait) {
+        unwatch(fds, nfds, &watch);
+        posix9_fd_wait_end(&watch.wait);
+    }
+
+    return count;
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    struct timeval tv;
+
+    if (nfds > POSIX9_OPEN_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (timeout < 0) return poll_wait(fds, nfds, NULL);
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000L;
+    return poll_wait(fds, nfds, &tv);
+}
+
+/*
+ * select() on poll(): one entry per descriptor in any of the sets,
+ * found a word at a time.
+ */
+int select(int nfds, fd_set *readfds, fd_set *writefds,
+           fd_set *exceptfds, struct timeval *timeout)
+{
+    struct pollfd fds[POSIX9_OPEN_MAX];
+    unsigned long want, rbits, wbits, ebits, bit;
+    nfds_t n = 0, i;
+    int fd, w, count;
+    short revents;
+
+    if (nfds < 0 || (timeout && (timeout->tv_sec < 0 || timeout->tv_usec < 0 ||
+                                 timeout->tv_usec >= 1000000))) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (nfds > POSIX9_OPEN_MAX) nfds = POSIX9_OPEN_MAX;
+
+    for (w = 0; w * 32 < nfds; w++) {
+        rbits = readfds ? readfds->fds_bits[w] : 0;
+        wbits = writefds ? writefds->fds_bits[w] : 0;
+        ebits = exceptfds ? exceptfds->fds_bits[w] : 0;
+        want = rbits | wbits | ebits;
+        if (nfds - w * 32 < 32) want &= (1UL << (nfds - w * 32)) - 1;
+
+        while (want != 0) {
+            fd = w * 32 + lowest_bit(want);
+            bit = 1UL << (fd % 32);
+            want &= want - 1;
+
+            fds[n].fd = fd;
+            fds[n].events = ((rbits & bit) ? POLLIN : 0) |
+                            ((wbits & bit) ? POLLOUT : 0) |
+                            ((ebits & bit) ? POLLPRI : 0);
+            n++;
+        }
+    }
+
+    /* The timeout is kept to the microsecond, not rounded to ms */
+    if (poll_wait(fds, n, timeout) < 0) return -1;
+
+    /* A closed descriptor fails the call and leaves the sets alone */
+    for (i = 0; i < n; i++) {
+        if (fds[i].revents & POLLNVAL) {
+            errno = EBADF;
+            return -1;
+        }
+    }
+
+    if (readfds) FD_ZERO(readfds);
+    if (writefds) FD_ZERO(writefds);
+    if (exceptfds) FD_ZERO(exceptfds);
+
+    /* A broken connection is ready for reading and writing: both fail */
+    count = 0;
+    for (i = 0; i < n; i++) {
+        revents = fds[i].revents;
+        if (revents & (POLLHUP | POLLERR)) {
+            revents |= fds[i].events & (POLLIN | POLLOUT);
+        }
+        if (revents & POLLIN) {
+            FD_SET(fds[i].fd, readfds);
+            count++;
+        }
+        if (revents & POLLOUT) {
+            FD_SET(fds[i].fd, writefds);
+            count++;
+        }
+        if (revents & POLLPRI) {
+            FD_SET(fds[i].fd, exceptfds);
+            count++;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,127 @@
+/*
+ * posix9_fd.h - Descriptor table shared by the POSIX9 modules
+ *
+ * Files, sockets and directory streams draw their descriptors from one
+ * table of POSIX9_OPEN_MAX slots. Each open slot holds an ops vtable
+ * and an object owned by the module that opened it, so read(), write(),
+ * close(), poll() and select() reach the right module with one array index
+ * instead of asking each module in turn. Several slots may share one
+ * object (an open file description) after dup()/dup2().
+ *
+ * Calls that wait for an event - poll(), select(), epoll, blocking
+ * socket calls - stop their thread with a posix9_fd_waiter, and the
+ * notifier readies exactly that thread.
+ *
+ * Internal to the library - not installed with the public headers.
+ */
+
+#ifndef POSIX9_FD_H
+#define POSIX9_FD_H
+
+#include "posix9.h"
+
+/* Mac OS headers */
+#include <Multiverse.h>
+#include "Threads.h"
+
+/* Readiness bits returned by an ops->poll routine */
+#define POSIX9_FD_READABLE  0x01
+#define POSIX9_FD_WRITABLE  0x02
+#define POSIX9_FD_EXCEPT    0x04
+#define POSIX9_FD_HANGUP    0x08    /* Connection broken */
+
+/*
+ * Open file description header. Every object bound to a descriptor
+ * starts with one: dup() and dup2() point more descriptors at the same
+ * object and bump refCount, and ops->close runs only when the last
+ * descriptor referring to it is closed. Owners leave refCount at 0
+ * when they hand a new object to posix9_fd_alloc()/posix9_fd_install();
+ * the rest belongs to posix9_fd.c.
+ */
+typedef struct posix9_fd_desc {
+    int         refCount;       /* Descriptors pointing here */
+    struct posix9_fd_desc *readyNext;   /* Link in a drained event list */
+    struct posix9_fd_watch *watch;      /* poll() waiting for it, if any */
+    int         watchIndex;     /* Its entry in that poll()'s array */
+    int         hit;            /* On that poll()'s list of events */
+} posix9_fd_desc;
+
+typedef struct posix9_fd_ops {
+    mode_t      type;                               /* S_IFREG, S_IFSOCK, S_IFDIR */
+    ssize_t     (*read)(void *obj, void *buf, size_t count);
+    ssize_t     (*write)(void *obj, const void *buf, size_t count);
+    int         (*close)(void *obj);
+    int         (*poll)(void *obj);                 /* POSIX9_FD_* bits ready now */
+} posix9_fd_ops;
+
+/*
+ * Objects that become ready by themselves (sockets, epoll sets) are not
+ * polled in a loop. Their module lists each one it has had an event
+ * for - from its notifier - and registers drain, which takes the list
+ * and returns those objects linked through readyNext; there is room for
+ * one drain per such module. A waiting poll() or select()
+ * looks again only at what drain returns, so ops->poll must report
+ * state the module already holds rather than ask the system for it.
+ * An object with no ops->poll is always ready.
+ */
+void    posix9_fd_event_source(posix9_fd_desc *(*drain)(void));
+
+/*
+ * A thread waiting for an event or a deadline. The deadline is a Time
+ * Manager task, so it is kept to the microsecond rather than the tick.
+ * The waiting thread stops in posix9_fd_park(); posix9_fd_wake(), the
+ * one call here that is safe from notifiers and other interrupt-level
+ * code, readies it. Without the Thread Manager, or with no other
+ * thread to run, parking yields instead.
+ */
+typedef struct posix9_fd_waiter {
+    TMTask              timer;      /* Must be first */
+    ThreadID            owner;      /* Thread that began the wait */
+    volatile ThreadID   thread;     /* owner while it is stopped */
+    volatile Boolean    woken;      /* posix9_fd_wake() since the last park */
+    volatile Boolean    expired;    /* The deadline passed */
+    Boolean             timed;      /* timer is installed */
+} posix9_fd_waiter;
+
+/* Start a wait that ends after timeout, or never if timeout is NULL */
+void    posix9_fd_wait_begin(posix9_fd_waiter *w, const struct timeval *timeout);
+
+/*
+ * Stop until posix9_fd_wake() or the deadline; at once if either came
+ * since the last park. Callers check what they wait for between parks.
+ * Returns false once the deadline has passed.
+ */
+Boolean posix9_fd_park(posix9_fd_waiter *w);
+
+/* Ready w's thread if it is parked, or keep its next park from stopping */
+void    posix9_fd_wake(posix9_fd_waiter *w);
+
+/* Remove the deadline; w may go out of scope after this */
+void    posix9_fd_wait_end(posix9_fd_waiter *w);
+
+/* From a notifier: wake the poll() or select() waiting for desc, if any */
+void    posix9_fd_notify(posix9_fd_desc *desc);
+
+/*
+ * Take the lowest free descriptor >= minfd and bind it to ops/obj.
+ * Returns -1 with EMFILE when the table is full. Descriptors 0-2 are
+ * reserved for stdio and only handed out by posix9_fd_install().
+ */
+int     posix9_fd_alloc(int minfd, const posix9_fd_ops *ops, void *obj);
+
+/* Bind a specific descriptor, which must be free (dup2, stdio) */
+int     posix9_fd_install(int fd, const posix9_fd_ops *ops, void *obj);
+
+/* Drop a descriptor without calling ops->close (open() error paths) */
+void    posix9_fd_release(int fd);
+
+/* Object behind fd if it was opened with ops, else NULL with EBADF */
+void *  posix9_fd_object(int fd, const posix9_fd_ops *ops);
+
+/* ops of an open descriptor, else NULL with EBADF */
+const posix9_fd_ops *posix9_fd_ops_of(int fd);
+
+/* close() every descriptor above stdio (posix9_cleanup) */
+void    posix9_fd_close_all(void);
+
+#endif /* POSIX9_FD_H */
@@ -2,21 +2,42 @@
  * posix9_file.c - POSIX file I/O implementation for Mac OS 9
  *
  * Maps POSIX file operations to Mac OS File Manager calls:
- *   open()  -> FSpOpenDF / FSpCreate + FSpOpenDF
- *   read()  -> FSRead
- *   write() -> FSWrite
- *   close() -> FSClose
- *   lseek() -> SetFPos
- *   stat()  -> FSpGetFInfo + FSpGetCatInfo
+ *   open()  -> FSOpenFork, or FSpOpenDF without the HFS Plus APIs
+ *   read()  -> PBReadForkSync/PBReadSync at the tracked offset, via a read-ahead buffer
+ *   write() -> PBWriteForkSync/PBWriteSync at the tracked offset, via a write-behind buffer
+ *   close() -> FSCloseFork / FSClose
+ *   lseek() -> updates the tracked offset (FSGetForkSize/GetEOF for SEEK_END)
+ *   pread() / pwrite() -> one PBReadSync/PBWriteSync with ioPosOffset
+ *   aio_read() / aio_write() -> PBReadAsync/PBWriteAsync (posix9_aio.c)
+ *   stat()  -> PBGetCatInfoSync through the metadata cache (posix9_statcache.c)
+ *
+ * An open file is one entry here however many descriptors refer to it
+ * (dup/dup2 share it through posix9_fd.c), so duplicates share the
+ * refNum, offset and buffers, and FSClose runs when the last one is
+ * closed. Each entry keeps its own file position rather than relying on
+ * the File Manager's mark, so every transfer is a single positioned
+ * parameter-block call. Small sequential reads are served from a
+ * per-descriptor read-ahead block, and small contiguous writes are
+ * coalesced in a write-behind buffer that is flushed by fsync(),
+ * lseek(), read(), close() and posix9_cleanup(). Errors from a deferred
+ * write are reported by the call that flushes it.
+ *
+ * Offsets are 64-bit inside. Where Gestalt reports the HFS Plus APIs
+ * (Mac OS 9) files are opened with FSOpenFork and every transfer and
+ * size change uses the fork calls, so the ...64 entry points reach past
+ * 2 GB. Older systems get the classic calls, whose 32-bit offsets stop
+ * at 2 GB - 1; going beyond that fails with EFBIG.
  */
 
 #include "posix9.h"
+#include "posix9_fd.h"
 
 /* Mac OS headers - Retro68 provides everything via Multiverse.h */
 #include <Multiverse.h>
 #include "MacCompat.h"      /* Missing definitions for Retro68 */
 #include <string.h>
 #include <stdarg.h>
+#include <limits.h>
 
 /* ============================================================
  * File Descriptor Table
@@ -24,19 +45,79 @@
 
 /* Internal file descriptor structure */
 typedef struct {
+    posix9_fd_desc desc;        /* Shared by dup()ed descriptors - must be first */
     short       refNum;         /* Mac OS file reference number */
     short       vRefNum;        /* Volume reference number */
     long        dirID;          /* Directory ID */
     int         flags;          /* Open flags (O_RDONLY, etc.) */
     Boolean     inUse;          /* Is this slot in use? */
     Boolean     isStdio;        /* Is this stdin/stdout/stderr? */
+    Boolean     isFork;         /* Opened with FSOpenFork - use the fork calls */
     char        name[64];       /* Filename (Pascal string converted) */
+    SInt64      pos;            /* Current file offset */
+    Ptr         raBuf;          /* Read-ahead block (allocated on first use) */
+    long        raSize;         /* Read-ahead block size, 0 = disabled */
+    SInt64      raStart;        /* File offset of raBuf[0] */
+    long        raLen;          /* Valid bytes in raBuf */
+    Ptr         wbBuf;          /* Write-behind buffer (allocated on first use) */
+    long        wbSize;         /* Write-behind buffer size, 0 = disabled */
+    SInt64      wbStart;        /* File offset of wbBuf[0] */
+    long        wbLen;          /* Pending bytes in wbBuf */
+    SInt64      eof;            /* Logical EOF including pending writes */
+    Boolean     eofKnown;       /* eof is valid (writable descriptors only) */
+    int         nextFree;       /* Free list link while unused */
 } posix9_fd_entry;
 
-/* Global file descriptor table */
+/* Default read-ahead block size for readable descriptors. Reads at least
+ * this large bypass the buffer and go straight into the caller's memory. */
+#define POSIX9_READAHEAD_SIZE   4096
+#define POSIX9_READAHEAD_MAX    65536
+
+/* Default write-behind buffer size for writable descriptors. Writes at
+ * least this large are issued directly after flushing the buffer. */
+#define POSIX9_WRITEBEHIND_SIZE 4096
+#define POSIX9_WRITEBEHIND_MAX  65536
+
+/* Last offset the classic File Manager calls can address */
+#define POSIX9_CLASSIC_MAX      0x7FFFFFFFL
+
+/* Largest result the off_t (long) and off64_t calls can return */
+#define POSIX9_OFF_MAX          LONG_MAX
+#define POSIX9_OFF64_MAX        0x7FFFFFFFFFFFFFFFLL
+
+/* Open files; descriptors map to these through posix9_fd.c */
 static posix9_fd_entry  fd_table[POSIX9_OPEN_MAX];
+static int              fd_free_head = -1;
 static Boolean          fd_table_initialized = false;
 
+/* HFS Plus fork APIs, looked up once with Gestalt */
+static Boolean          fork_apis_checked = false;
+static Boolean          fork_apis = false;
+static HFSUniStr255     data_fork_name;
+
+/* Descriptor operations, defined below */
+static const posix9_fd_ops file_fd_ops;
+static void c_to_pstr(const char *cstr, Str255 pstr);
+
+/* From posix9_statcache.c */
+extern OSErr posix9_statcache_getcatinfo(short vRefNum, long dirID, ConstStr255Param name,
+                                         CInfoPBRec *pb);
+extern void posix9_statcache_invalidate(short vRefNum, long dirID, ConstStr255Param name);
+extern void posix9_statcache_invalidate_dir(short vRefNum, long dirID);
+
+/* From posix9_pathcache.c */
+extern void posix9_pathcache_invalidate(short vRefNum, long parID, ConstStr255Param name);
+
+/* From posix9_socket.c */
+extern Boolean posix9_is_socket(int fd);
+extern ssize_t posix9_socket_readv(int fd, const struct iovec *iov, int iovcnt);
+extern ssize_t posix9_socket_writev(int fd, const struct iovec *iov, int iovcnt);
+
+/* From posix9_dir.c */
+extern int posix9_dir_resolve(int dirfd, const char *path, FSSpec *spec, OSErr *err);
+extern int posix9_dir_open_fd(short vRefNum, long dirID);
+extern int posix9_dir_remove(const FSSpec *spec);
+
 /* Global errno */
 int posix9_errno = 0;
 
@@ -71,6 +152,7 @@ int posix9_macos_to_errno(OSErr err)
         case dirFulErr:         return ENOSPC;      /* Directory full */
         case memFullErr:        return ENOMEM;      /* Memory full */
         case paramErr:          return EINVAL;      /* Parameter error */
+        case fsDataTooBigErr:   return EFBIG;       /* Past the 2 GB classic limit */
         default:                return EIO;         /* Generic I/O error */
     }
 }
@@ -90,62 +172,331 @@ static void init_fd_table(void)
         fd_table[i].inUse = false;
         fd_table[i].refNum = 0;
         fd_table[i].isStdio = false;
+        fd_table[i].desc.refCount = 0;
+        fd_table[i].nextFree = i + 1 < POSIX9_OPEN_MAX ? i + 1 : -1;
     }
+    fd_free_head = STDERR_FILENO + 1;
 
     /* Reserve stdin/stdout/stderr */
     /* These map to console I/O - for now just mark as in use */
-    fd_table[STDIN_FILENO].inUse = true;
-    fd_table[STDIN_FILENO].isStdio = true;
-    fd_table[STDOUT_FILENO].inUse = true;
-    fd_table[STDOUT_FILENO].isStdio = true;
-    fd_table[STDERR_FILENO].inUse = true;
-    fd_table[STDERR_FILENO].isStdio = true;
+    for (i = STDIN_FILENO; i <= STDERR_FILENO; i++) {
+        fd_table[i].inUse = true;
+        fd_table[i].isStdio = true;
+        fd_table[i].flags = (i == STDIN_FILENO) ? O_RDONLY : O_WRONLY;
+        posix9_fd_install(i, &file_fd_ops, &fd_table[i]);
+    }
 
     fd_table_initialized = true;
 }
 
-/* Allocate a file descriptor slot */
-static int alloc_fd(void)
+/* Take a file entry off the free list */
+static posix9_fd_entry *alloc_entry(void)
 {
-    int i;
+    posix9_fd_entry *entry;
 
     init_fd_table();
 
-    /* Start at 3 to skip stdin/stdout/stderr */
-    for (i = 3; i < POSIX9_OPEN_MAX; i++) {
-        if (!fd_table[i].inUse) {
-            fd_table[i].inUse = true;
-            return i;
-        }
+    /* There is an entry for every descriptor, so this is EMFILE too */
+    if (fd_free_head < 0) {
+        errno = EMFILE;
+        return NULL;
     }
 
-    errno = EMFILE;
-    return -1;
+    entry = &fd_table[fd_free_head];
+    fd_free_head = entry->nextFree;
+    entry->desc.refCount = 0;
+    entry->inUse = true;
+    entry->nextFree = -1;
+
+    return entry;
 }
 
-/* Free a file descriptor slot */
-static void free_fd(int fd)
+/* Release a file entry's buffers and put it back on the free list.
+ * The three console entries are permanent. */
+static void free_entry(posix9_fd_entry *entry)
+{
+    if (entry - fd_table <= STDERR_FILENO) return;
+
+    if (entry->raBuf) {
+        DisposePtr(entry->raBuf);
+    }
+    if (entry->wbBuf) {
+        DisposePtr(entry->wbBuf);
+    }
+    entry->raBuf = NULL;
+    entry->raLen = 0;
+    entry->wbBuf = NULL;
+    entry->wbLen = 0;
+    entry->inUse = false;
+    entry->isStdio = false;
+    entry->refNum = 0;
+    entry->nextFree = fd_free_head;
+    fd_free_head = entry - fd_table;
+}
+
+/* Allocate a file entry and the lowest free descriptor for it */
+static int alloc_fd(void)
 {
-    if (fd >= 0 && fd < POSIX9_OPEN_MAX && !fd_table[fd].isStdio) {
-        fd_table[fd].inUse = false;
-        fd_table[fd].refNum = 0;
+    posix9_fd_entry *entry;
+    int fd;
+
+    entry = alloc_entry();
+    if (!entry) return -1;
+
+    fd = posix9_fd_alloc(0, &file_fd_ops, entry);
+    if (fd < 0) {
+        free_entry(entry);
+        return -1;
     }
+
+    return fd;
 }
 
 /* Validate file descriptor */
 static posix9_fd_entry *get_fd_entry(int fd)
 {
-    if (fd < 0 || fd >= POSIX9_OPEN_MAX) {
-        errno = EBADF;
-        return NULL;
+    return (posix9_fd_entry *)posix9_fd_object(fd, &file_fd_ops);
+}
+
+/* Does the File Manager have FSOpenFork and the 64-bit fork calls? */
+static Boolean has_fork_apis(void)
+{
+    long response;
+
+    if (!fork_apis_checked) {
+        fork_apis = Gestalt(gestaltFSAttr, &response) == noErr &&
+                    (response & (1L << gestaltHasHFSPlusAPIs)) != 0 &&
+                    FSGetDataForkName(&data_fork_name) == noErr;
+        fork_apis_checked = true;
     }
 
-    if (!fd_table[fd].inUse) {
-        errno = EBADF;
-        return NULL;
+    return fork_apis;
+}
+
+/* The HFS Plus catalog calls come with the fork calls (posix9_dir.c) */
+Boolean posix9_has_hfsplus_apis(void)
+{
+    return has_fork_apis();
+}
+
+/* Open a file's data fork, through the HFS Plus calls when we have them */
+static OSErr open_data_fork(const FSSpec *spec, SInt8 permission,
+                            short *refNum, Boolean *isFork)
+{
+    FSRef ref;
+
+    if (has_fork_apis() && FSpMakeFSRef(spec, &ref) == noErr) {
+        *isFork = true;
+        return FSOpenFork(&ref, data_fork_name.length, data_fork_name.unicode,
+                          permission, refNum);
+    }
+
+    *isFork = false;
+    return FSpOpenDF(spec, permission, refNum);
+}
+
+static OSErr close_data_fork(short refNum, Boolean isFork)
+{
+    return isFork ? FSCloseFork(refNum) : FSClose(refNum);
+}
+
+/* Read count bytes at an absolute offset - one File Manager call */
+static OSErr fm_read_at(posix9_fd_entry *entry, SInt64 offset, void *buf, long *count)
+{
+    ParamBlockRec pb;
+    FSForkIOParam fpb;
+    OSErr err;
+
+    if (entry->isFork) {
+        memset(&fpb, 0, sizeof(fpb));
+        fpb.forkRefNum = entry->refNum;
+        fpb.buffer = (Ptr)buf;
+        fpb.requestCount = *count;
+        fpb.positionMode = fsFromStart;
+        fpb.positionOffset = offset;
+
+        err = PBReadForkSync(&fpb);
+        *count = fpb.actualCount;
+
+        return err;
+    }
+
+    /* Nothing past 2 GB - 1 is visible to the classic calls */
+    if (offset > POSIX9_CLASSIC_MAX) {
+        *count = 0;
+        return eofErr;
+    }
+
+    memset(&pb, 0, sizeof(pb));
+    pb.ioParam.ioRefNum = entry->refNum;
+    pb.ioParam.ioBuffer = (Ptr)buf;
+    pb.ioParam.ioReqCount = *count;
+    pb.ioParam.ioPosMode = fsFromStart;
+    pb.ioParam.ioPosOffset = (long)offset;
+
+    err = PBReadSync(&pb);
+    *count = pb.ioParam.ioActCount;
+
+    return err;
+}
+
+/* Write count bytes at an absolute offset - one File Manager call */
+static OSErr fm_write_at(posix9_fd_entry *entry, SInt64 offset,
+                         const void *buf, long *count)
+{
+    ParamBlockRec pb;
+    FSForkIOParam fpb;
+    OSErr err;
+
+    if (entry->isFork) {
+        memset(&fpb, 0, sizeof(fpb));
+        fpb.forkRefNum = entry->refNum;
+        fpb.buffer = (Ptr)buf;
+        fpb.requestCount = *count;
+        fpb.positionMode = fsFromStart;
+        fpb.positionOffset = offset;
+
+        err = PBWriteForkSync(&fpb);
+        *count = fpb.actualCount;
+
+        return err;
+    }
+
+    /* The classic EOF is a long too: 2 GB - 1 bytes at most */
+    if (offset + *count > POSIX9_CLASSIC_MAX) {
+        *count = 0;
+        return fsDataTooBigErr;
+    }
+
+    memset(&pb, 0, sizeof(pb));
+    pb.ioParam.ioRefNum = entry->refNum;
+    pb.ioParam.ioBuffer = (Ptr)buf;
+    pb.ioParam.ioReqCount = *count;
+    pb.ioParam.ioPosMode = fsFromStart;
+    pb.ioParam.ioPosOffset = (long)offset;
+
+    err = PBWriteSync(&pb);
+    *count = pb.ioParam.ioActCount;
+
+    return err;
+}
+
+/* Set the logical EOF of an open file */
+static OSErr set_eof(posix9_fd_entry *entry, SInt64 length)
+{
+    if (entry->isFork) {
+        return FSSetForkSize(entry->refNum, fsFromStart, length);
+    }
+
+    if (length > POSIX9_CLASSIC_MAX) return fsDataTooBigErr;
+    return SetEOF(entry->refNum, (long)length);
+}
+
+/* The file's size or dates are about to change - drop its cached metadata */
+static void stat_invalidate(posix9_fd_entry *entry)
+{
+    Str255 name;
+
+    c_to_pstr(entry->name, name);
+    posix9_statcache_invalidate(entry->vRefNum, entry->dirID, name);
+}
+
+/* Write at an absolute offset, extending the file if the offset is past EOF */
+static OSErr write_through(posix9_fd_entry *entry, SInt64 offset,
+                           const void *buf, long *count)
+{
+    OSErr err;
+    long bytes = *count;
+
+    stat_invalidate(entry);
+    err = fm_write_at(entry, offset, buf, &bytes);
+
+    /* POSIX lets the offset sit past EOF; extend the file to meet it */
+    if (err == eofErr || err == posErr) {
+        err = set_eof(entry, offset);
+        if (err == noErr) {
+            bytes = *count;
+            err = fm_write_at(entry, offset, buf, &bytes);
+        }
     }
 
-    return &fd_table[fd];
+    *count = bytes;
+    return err;
+}
+
+/* Issue any pending write-behind data as one File Manager call */
+static OSErr wb_flush(posix9_fd_entry *entry)
+{
+    OSErr err;
+    long bytes;
+
+    if (entry->wbLen == 0) return noErr;
+
+    bytes = entry->wbLen;
+    err = write_through(entry, entry->wbStart, entry->wbBuf, &bytes);
+
+    /* The data is gone either way - the error goes to this caller */
+    entry->wbLen = 0;
+
+    return err;
+}
+
+/* Logical EOF of a descriptor, flushing pending writes first */
+static OSErr get_eof(posix9_fd_entry *entry, SInt64 *eof)
+{
+    OSErr err;
+    long classicEOF;
+
+    err = wb_flush(entry);
+    if (err != noErr) return err;
+
+    if (entry->eofKnown) {
+        *eof = entry->eof;
+        return noErr;
+    }
+
+    if (entry->isFork) {
+        err = FSGetForkSize(entry->refNum, eof);
+    } else {
+        err = GetEOF(entry->refNum, &classicEOF);
+        *eof = classicEOF;
+    }
+    if (err != noErr) return err;
+
+    /* Only a writer's own view of EOF stays valid without asking */
+    if (entry->flags & (O_WRONLY | O_RDWR)) {
+        entry->eof = *eof;
+        entry->eofKnown = true;
+    }
+
+    return noErr;
+}
+
+/* Patch any part of [offset, offset+count) that is in the read-ahead block */
+static void ra_update(posix9_fd_entry *entry, SInt64 offset, const void *buf, long count)
+{
+    SInt64 lo, hi;
+
+    if (entry->raLen == 0) return;
+
+    lo = offset > entry->raStart ? offset : entry->raStart;
+    hi = offset + count;
+    if (hi > entry->raStart + entry->raLen) hi = entry->raStart + entry->raLen;
+
+    if (lo < hi) {
+        BlockMoveData((const char *)buf + (lo - offset),
+                      entry->raBuf + (lo - entry->raStart), hi - lo);
+    }
+}
+
+/* Drop cached bytes at or beyond a new logical EOF */
+static void ra_truncate(posix9_fd_entry *entry, SInt64 length)
+{
+    if (length <= entry->raStart) {
+        entry->raLen = 0;
+    } else if (length < entry->raStart + entry->raLen) {
+        entry->raLen = length - entry->raStart;
+    }
 }
 
 /* Convert C string to Pascal string */
@@ -158,7 +509,7 @@ static void c_to_pstr(const char *cstr, Str255 pstr)
 }
 
 /* Convert Pascal string to C string */
-static void p_to_cstr(const Str255 pstr, char *cstr, size_t maxlen)
+static void p_to_cstr(ConstStr255Param pstr, char *cstr, size_t maxlen)
 {
     size_t len = pstr[0];
     if (len >= maxlen) len = maxlen - 1;
@@ -167,127 +518,90 @@ static void p_to_cstr(const Str255 pstr, char *cstr, size_t maxlen)
 }
 
 /* ============================================================
- * Path Translation (basic implementation)
- * Full implementation in posix9_path.c
+ * Path Translation
+ * POSIX paths are resolved by posix9_path.c
  * ============================================================ */
 
 /* Forward declaration */
 OSErr posix9_path_to_fsspec(const char *path, FSSpec *spec);
 
-/* Basic path to FSSpec - handles common cases */
+/* Path to FSSpec - POSIX paths, or Mac paths with ':' handed over as they are */
 static OSErr path_to_fsspec_basic(const char *path, FSSpec *spec)
 {
     Str255 ppath;
-    OSErr err;
-    char mac_path[POSIX9_PATH_MAX];
-    const char *p;
-    char *m;
-    short vRefNum;
-    long dirID;
-
-    /* Handle absolute POSIX paths */
-    if (path[0] == '/') {
-        /* Skip leading / */
-        p = path + 1;
-
-        /* Check for /Volumes/ prefix */
-        if (strncmp(p, "Volumes/", 8) == 0) {
-            p += 8;
-        }
 
-        /* Convert / to : */
-        m = mac_path;
-        while (*p && m < mac_path + sizeof(mac_path) - 1) {
-            if (*p == '/') {
-                *m++ = ':';
-            } else {
-                *m++ = *p;
-            }
-            p++;
-        }
-        *m = '\0';
-    }
-    /* Handle relative paths (already use : in Mac OS) */
-    else if (path[0] == ':' || strchr(path, ':') != NULL) {
-        /* Already a Mac path */
-        strncpy(mac_path, path, sizeof(mac_path) - 1);
-        mac_path[sizeof(mac_path) - 1] = '\0';
-    }
-    /* Handle relative POSIX paths */
-    else {
-        /* Prepend : for relative path, convert / to : */
-        m = mac_path;
-        *m++ = ':';
-        p = path;
-        while (*p && m < mac_path + sizeof(mac_path) - 1) {
-            if (*p == '/') {
-                *m++ = ':';
-            } else {
-                *m++ = *p;
-            }
-            p++;
-        }
-        *m = '\0';
+    if (path[0] != '/' && strchr(path, ':') != NULL) {
+        if (strlen(path) > 255) return bdNamErr;
+        c_to_pstr(path, ppath);
+        return FSMakeFSSpec(0, 0, ppath, spec);
     }
 
-    /* Convert to Pascal string and make FSSpec */
-    c_to_pstr(mac_path, ppath);
-
-    err = FSMakeFSSpec(0, 0, ppath, spec);
-
-    return err;
+    return posix9_path_to_fsspec(path, spec);
 }
 
 /* ============================================================
  * POSIX File Operations
  * ============================================================ */
 
-int open(const char *path, int flags, ...)
+/*
+ * A directory opened for reading gets a directory stream's descriptor,
+ * usable with the *at() calls and fdopendir()
+ */
+static int open_directory(const FSSpec *spec, int flags)
 {
-    FSSpec spec;
+    CInfoPBRec catInfo;
     OSErr err;
-    short refNum;
-    int fd;
-    SInt8 permission;
-    va_list ap;
-    mode_t mode = 0644;  /* Default mode, ignored on Mac OS */
-
-    init_fd_table();
 
-    /* Get mode if O_CREAT */
-    if (flags & O_CREAT) {
-        va_start(ap, flags);
-        mode = va_arg(ap, int);  /* mode_t promoted to int */
-        va_end(ap);
+    err = posix9_statcache_getcatinfo(spec->vRefNum, spec->parID, spec->name, &catInfo);
+    if (err != noErr) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
     }
 
-    /* Convert path to FSSpec */
-    err = path_to_fsspec_basic(path, &spec);
+    if (!(catInfo.hFileInfo.ioFlAttrib & ioDirMask)) {
+        errno = ENOTDIR;
+        return -1;
+    }
 
-    /* Handle O_CREAT - create file if it doesn't exist */
-    if (err == fnfErr && (flags & O_CREAT)) {
-        /* File doesn't exist, create it */
-        err = FSpCreate(&spec, 'TEXT', 'TEXT', smSystemScript);
-        if (err != noErr && err != dupFNErr) {
-            errno = posix9_macos_to_errno(err);
-            return -1;
-        }
-        /* Re-get FSSpec after creation */
-        err = path_to_fsspec_basic(path, &spec);
+    if (flags & (O_WRONLY | O_RDWR)) {
+        errno = EISDIR;
+        return -1;
     }
 
+    return posix9_dir_open_fd(spec->vRefNum, catInfo.dirInfo.ioDrDirID);
+}
+
+/* Open the file spec names; err is what resolving it returned */
+static int open_fsspec(FSSpec *spec, OSErr err, int flags)
+{
+    posix9_fd_entry *entry;
+    short refNum;
+    Boolean isFork;
+    int fd;
+    SInt8 permission;
+
     /* O_EXCL - fail if file exists */
     if ((flags & O_CREAT) && (flags & O_EXCL) && err == noErr) {
-        /* This means file already existed */
         errno = EEXIST;
         return -1;
     }
 
+    /* Handle O_CREAT - create file if it doesn't exist */
+    if (err == fnfErr && (flags & O_CREAT)) {
+        err = FSpCreate(spec, 'TEXT', 'TEXT', smSystemScript);
+        posix9_statcache_invalidate_dir(spec->vRefNum, spec->parID);
+        if (err == dupFNErr && !(flags & O_EXCL)) err = noErr;
+    }
+
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
     }
 
+    if (flags & O_DIRECTORY) {
+        return open_directory(spec, flags);
+    }
+
     /* Determine permission */
     if ((flags & O_RDWR) == O_RDWR) {
         permission = fsRdWrPerm;
@@ -298,64 +612,131 @@ int open(const char *path, int flags, ...)
     }
 
     /* Open the data fork */
-    err = FSpOpenDF(&spec, permission, &refNum);
+    err = open_data_fork(spec, permission, &refNum, &isFork);
+    if (err == fnfErr || err == notAFileErr) {
+        /* Directories have no data fork */
+        return open_directory(spec, flags);
+    }
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
     }
 
-    /* Handle O_TRUNC - truncate file */
-    if (flags & O_TRUNC) {
-        SetEOF(refNum, 0);
-    }
-
-    /* Handle O_APPEND - seek to end */
-    if (flags & O_APPEND) {
-        SetFPos(refNum, fsFromLEOF, 0);
-    }
-
     /* Allocate file descriptor */
     fd = alloc_fd();
     if (fd < 0) {
-        FSClose(refNum);
+        close_data_fork(refNum, isFork);
         return -1;
     }
 
     /* Store in table */
-    fd_table[fd].refNum = refNum;
-    fd_table[fd].vRefNum = spec.vRefNum;
-    fd_table[fd].dirID = spec.parID;
-    fd_table[fd].flags = flags;
-    p_to_cstr(spec.name, fd_table[fd].name, sizeof(fd_table[fd].name));
+    entry = get_fd_entry(fd);
+    entry->refNum = refNum;
+    entry->isFork = isFork;
+    entry->vRefNum = spec->vRefNum;
+    entry->dirID = spec->parID;
+    entry->flags = flags;
+    p_to_cstr(spec->name, entry->name, sizeof(entry->name));
+    entry->pos = 0;
+    entry->raBuf = NULL;
+    entry->raStart = 0;
+    entry->raLen = 0;
+    entry->raSize = (flags & O_WRONLY) ? 0 : POSIX9_READAHEAD_SIZE;
+    entry->wbBuf = NULL;
+    entry->wbStart = 0;
+    entry->wbLen = 0;
+    entry->wbSize = (flags & (O_WRONLY | O_RDWR)) ? POSIX9_WRITEBEHIND_SIZE : 0;
+    entry->eof = 0;
+    entry->eofKnown = false;
+
+    /* Handle O_TRUNC - truncate file */
+    if (flags & O_TRUNC) {
+        stat_invalidate(entry);
+        set_eof(entry, 0);
+    }
 
     return fd;
 }
 
-/* Socket close - implemented in posix9_socket.c */
-extern Boolean posix9_is_socket(int fd);
-extern int posix9_close_socket(int fd);
+int open(const char *path, int flags, ...)
+{
+    FSSpec spec;
+    OSErr err;
+    va_list ap;
+    mode_t mode = 0644;  /* Default mode, ignored on Mac OS */
+
+    init_fd_table();
 
-int close(int fd)
+    /* Get mode if O_CREAT */
+    if (flags & O_CREAT) {
+        va_start(ap, flags);
+        mode = va_arg(ap, int);  /* mode_t promoted to int */
+        va_end(ap);
+    }
+    (void)mode;
+
+    /* Convert path to FSSpec */
+    err = path_to_fsspec_basic(path, &spec);
+
+    return open_fsspec(&spec, err, flags);
+}
+
+/*
+ * Resolve a *at() path. Absolute paths and AT_FDCWD go the way open()
+ * does; anything else is looked up under dirfd's directory. Returns -1
+ * with errno set for a bad dirfd, else 0 with the lookup result in *err.
+ */
+static int at_fsspec(int dirfd, const char *path, FSSpec *spec, OSErr *err)
 {
-    posix9_fd_entry *entry;
+    if (dirfd == AT_FDCWD || path[0] == '/') {
+        *err = path_to_fsspec_basic(path, spec);
+        return 0;
+    }
+
+    return posix9_dir_resolve(dirfd, path, spec, err);
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+    FSSpec spec;
     OSErr err;
+    va_list ap;
+    mode_t mode = 0644;  /* Default mode, ignored on Mac OS */
 
-    /* Delegate socket FDs to the socket layer */
-    if (posix9_is_socket(fd)) {
-        return posix9_close_socket(fd);
+    init_fd_table();
+
+    if (flags & O_CREAT) {
+        va_start(ap, flags);
+        mode = va_arg(ap, int);  /* mode_t promoted to int */
+        va_end(ap);
     }
+    (void)mode;
 
-    entry = get_fd_entry(fd);
-    if (!entry) return -1;
+    if (at_fsspec(dirfd, path, &spec, &err) != 0) return -1;
+
+    return open_fsspec(&spec, err, flags);
+}
+
+static int file_close(void *obj)
+{
+    posix9_fd_entry *entry = (posix9_fd_entry *)obj;
+    OSErr err, flushErr;
 
-    /* Don't close stdio */
+    /* Console entries are permanent */
     if (entry->isStdio) {
         return 0;
     }
 
-    err = FSClose(entry->refNum);
-    free_fd(fd);
+    flushErr = wb_flush(entry);
+    err = close_data_fork(entry->refNum, entry->isFork);
 
+    /* FSClose writes the FCB's length and dates back to the catalog */
+    if (entry->flags & (O_WRONLY | O_RDWR)) {
+        stat_invalidate(entry);
+    }
+    free_entry(entry);
+
+    if (err == noErr) err = flushErr;
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
@@ -364,18 +745,18 @@ int close(int fd)
     return 0;
 }
 
-ssize_t read(int fd, void *buf, size_t count)
+static ssize_t file_read(void *obj, void *buf, size_t count)
 {
-    posix9_fd_entry *entry;
-    OSErr err;
-    long bytes = count;
-
-    entry = get_fd_entry(fd);
-    if (!entry) return -1;
+    posix9_fd_entry *entry = (posix9_fd_entry *)obj;
+    OSErr err = noErr;
+    char *dst = (char *)buf;
+    long remaining = count;
+    long total = 0;
+    long bytes;
 
     /* Handle stdio - TODO: implement console input */
     if (entry->isStdio) {
-        if (fd == STDIN_FILENO) {
+        if (!(entry->flags & (O_WRONLY | O_RDWR))) {
             /* Console input not yet implemented */
             errno = ENOSYS;
             return -1;
@@ -384,102 +765,507 @@ ssize_t read(int fd, void *buf, size_t count)
         return -1;
     }
 
-    err = FSRead(entry->refNum, &bytes, buf);
+    /* Pending writes must reach the file before we read it */
+    err = wb_flush(entry);
+    if (err != noErr) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
+    }
+
+    while (remaining > 0) {
+        /* Serve what we can from the read-ahead block */
+        if (entry->pos >= entry->raStart &&
+            entry->pos < entry->raStart + entry->raLen) {
+            bytes = entry->raStart + entry->raLen - entry->pos;
+            if (bytes > remaining) bytes = remaining;
+            BlockMoveData(entry->raBuf + (entry->pos - entry->raStart), dst, bytes);
+            entry->pos += bytes;
+            dst += bytes;
+            total += bytes;
+            remaining -= bytes;
+            continue;
+        }
+
+        /* Large reads (or no read-ahead) go straight to the caller */
+        if (entry->raSize == 0 || remaining >= entry->raSize) {
+            bytes = remaining;
+            err = fm_read_at(entry, entry->pos, dst, &bytes);
+            entry->pos += bytes;
+            total += bytes;
+            break;
+        }
+
+        /* Refill the block containing the current offset */
+        if (!entry->raBuf) {
+            entry->raBuf = NewPtr(entry->raSize);
+            if (!entry->raBuf) {
+                /* No memory for a buffer - read directly from now on */
+                entry->raSize = 0;
+                continue;
+            }
+        }
+
+        entry->raStart = entry->pos - (entry->pos % entry->raSize);
+        bytes = entry->raSize;
+        err = fm_read_at(entry, entry->raStart, entry->raBuf, &bytes);
+        entry->raLen = bytes;
+
+        if (entry->pos >= entry->raStart + entry->raLen) {
+            break;  /* At or past EOF */
+        }
+        if (err != noErr && err != eofErr) {
+            break;
+        }
+    }
 
     /* EOF is not an error for read() */
-    if (err == eofErr) {
-        return bytes;  /* Return bytes read before EOF */
+    if (err != noErr && err != eofErr && total == 0) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
+    }
+
+    return (ssize_t)total;
+}
+
+static ssize_t file_write(void *obj, const void *buf, size_t count)
+{
+    posix9_fd_entry *entry = (posix9_fd_entry *)obj;
+    OSErr err;
+    long bytes = count;
+    SInt64 offset;
+    Boolean buffered = false;
+
+    /* Handle stdio - TODO: implement console output */
+    if (entry->isStdio) {
+        if (entry->flags & O_WRONLY) {
+            /* For now, use DebugStr or just succeed silently */
+            /* Real implementation would write to console window */
+            return count;
+        }
+        errno = EBADF;
+        return -1;
+    }
+
+    /* O_APPEND: learn EOF once, then track it locally */
+    if (entry->flags & O_APPEND) {
+        if (entry->eofKnown) {
+            entry->pos = entry->eof;
+        } else {
+            err = get_eof(entry, &entry->pos);
+            if (err != noErr) {
+                errno = posix9_macos_to_errno(err);
+                return -1;
+            }
+        }
+    }
+    offset = entry->pos;
+
+    /* Coalesce small writes that continue the pending run */
+    if (entry->wbSize > 0 && bytes < entry->wbSize) {
+        if (entry->wbLen > 0 &&
+            (entry->wbStart + entry->wbLen != offset ||
+             entry->wbLen + bytes > entry->wbSize)) {
+            err = wb_flush(entry);
+            if (err != noErr) {
+                errno = posix9_macos_to_errno(err);
+                return -1;
+            }
+        }
+
+        if (!entry->wbBuf) {
+            entry->wbBuf = NewPtr(entry->wbSize);
+            if (!entry->wbBuf) {
+                entry->wbSize = 0;  /* No memory - write through */
+            }
+        }
+
+        if (entry->wbBuf) {
+            if (entry->wbLen == 0) entry->wbStart = offset;
+            BlockMoveData(buf, entry->wbBuf + entry->wbLen, bytes);
+            entry->wbLen += bytes;
+            buffered = true;
+        }
+    }
+
+    if (!buffered) {
+        err = wb_flush(entry);
+        if (err == noErr) {
+            err = write_through(entry, offset, buf, &bytes);
+        }
+        if (err != noErr) {
+            errno = posix9_macos_to_errno(err);
+            return -1;
+        }
+    }
+
+    ra_update(entry, offset, buf, bytes);
+    entry->pos = offset + bytes;
+    if (entry->eofKnown && entry->pos > entry->eof) {
+        entry->eof = entry->pos;
+    }
+
+    return (ssize_t)bytes;
+}
+
+static const posix9_fd_ops file_fd_ops = {
+    S_IFREG,
+    file_read,
+    file_write,
+    file_close,
+    NULL                    /* Regular files are always ready */
+};
+
+/* Move a descriptor's offset; results above limit fail with EOVERFLOW */
+static off64_t file_seek(int fd, off64_t offset, int whence, off64_t limit)
+{
+    posix9_fd_entry *entry;
+    OSErr err;
+    SInt64 base;
+
+    entry = get_fd_entry(fd);
+    if (!entry) return -1;
+
+    if (entry->isStdio) {
+        errno = ESPIPE;  /* Can't seek on stdio */
+        return -1;
+    }
+
+    err = wb_flush(entry);
+    if (err != noErr) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
+    }
+
+    /* The offset is ours; only SEEK_END may need the File Manager */
+    switch (whence) {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = entry->pos;
+            break;
+        case SEEK_END:
+            err = get_eof(entry, &base);
+            if (err != noErr) {
+                errno = posix9_macos_to_errno(err);
+                return -1;
+            }
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+
+    if (base + offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (offset > limit - base) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    entry->pos = base + offset;
+
+    return (off64_t)entry->pos;
+}
+
+off_t lseek(int fd, off_t offset, int whence)
+{
+    return (off_t)file_seek(fd, offset, whence, POSIX9_OFF_MAX);
+}
+
+off64_t lseek64(int fd, off64_t offset, int whence)
+{
+    return file_seek(fd, offset, whence, POSIX9_OFF64_MAX);
+}
+
+/* ============================================================
+ * Positional and Vectored I/O
+ * ============================================================ */
+
+/* Stack scratch for gathering small vectored transfers */
+#define POSIX9_IOV_SCRATCH  512
+
+/* Largest heap bounce buffer; longer vectored transfers go through it in pieces */
+#define POSIX9_IOV_BOUNCE_MAX   65536
+
+ssize_t pread64(int fd, void *buf, size_t count, off64_t offset)
+{
+    posix9_fd_entry *entry;
+    OSErr err;
+    long bytes = count;
+
+    entry = get_fd_entry(fd);
+    if (!entry) return -1;
+
+    if (entry->isStdio) {
+        errno = ESPIPE;
+        return -1;
+    }
+
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
     }
 
+    err = wb_flush(entry);
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
     }
 
+    /* Entirely inside the read-ahead block: no trap at all */
+    if (offset >= entry->raStart &&
+        offset + bytes <= entry->raStart + entry->raLen) {
+        BlockMoveData(entry->raBuf + (offset - entry->raStart), buf, bytes);
+        return (ssize_t)bytes;
+    }
+
+    /* Otherwise one positioned read; the offset rides in the param block */
+    err = fm_read_at(entry, offset, buf, &bytes);
+    if (err != noErr && err != eofErr) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
+    }
+
     return (ssize_t)bytes;
 }
 
-ssize_t write(int fd, const void *buf, size_t count)
+ssize_t pwrite64(int fd, const void *buf, size_t count, off64_t offset)
 {
     posix9_fd_entry *entry;
     OSErr err;
     long bytes = count;
 
-    entry = get_fd_entry(fd);
-    if (!entry) return -1;
+    entry = get_fd_entry(fd);
+    if (!entry) return -1;
+
+    if (entry->isStdio) {
+        errno = ESPIPE;
+        return -1;
+    }
+
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    err = wb_flush(entry);
+    if (err == noErr) {
+        err = write_through(entry, offset, buf, &bytes);
+    }
+    if (err != noErr) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
+    }
+
+    ra_update(entry, offset, buf, bytes);
+    if (entry->eofKnown && offset + bytes > entry->eof) {
+        entry->eof = offset + bytes;
+    }
+
+    return (ssize_t)bytes;
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+    return pread64(fd, buf, count, offset);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+    return pwrite64(fd, buf, count, offset);
+}
+
+/* Total length of an iovec array, or -1 if it is invalid (also used by
+ * posix9_socket.c) */
+long posix9_iov_total(const struct iovec *iov, int iovcnt)
+{
+    long total = 0;
+    int i;
+
+    if (!iov || iovcnt <= 0 || iovcnt > IOV_MAX) return -1;
+
+    for (i = 0; i < iovcnt; i++) {
+        total += iov[i].iov_len;
+        if (total < 0) return -1;
+    }
+
+    return total;
+}
+
+/* Move len bytes between buf and the iovecs from byte *off of element
+ * *i on, into them if scatter; the position moves past them */
+static void iov_move(const struct iovec *iov, int *i, size_t *off,
+                     char *buf, long len, Boolean scatter)
+{
+    long chunk;
+
+    while (len > 0) {
+        chunk = iov[*i].iov_len - *off;
+        if (chunk > len) chunk = len;
+        if (scatter) {
+            BlockMoveData(buf, (char *)iov[*i].iov_base + *off, chunk);
+        } else {
+            BlockMoveData((char *)iov[*i].iov_base + *off, buf, chunk);
+        }
+        buf += chunk;
+        len -= chunk;
+        *off += chunk;
+        if (*off == iov[*i].iov_len) {
+            (*i)++;
+            *off = 0;
+        }
+    }
+}
+
+/* A bounce buffer for want bytes, no larger than POSIX9_IOV_BOUNCE_MAX */
+static char *iov_bounce(char *scratch, long want, long *size)
+{
+    *size = want < POSIX9_IOV_BOUNCE_MAX ? want : POSIX9_IOV_BOUNCE_MAX;
+    return *size <= POSIX9_IOV_SCRATCH ? scratch : NewPtr(*size);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    char scratch[POSIX9_IOV_SCRATCH];
+    char *gather;
+    ssize_t n, total;
+    long want, size, chunk;
+    size_t off;
+    int i;
 
-    /* Handle stdio - TODO: implement console output */
-    if (entry->isStdio) {
-        if (fd == STDOUT_FILENO || fd == STDERR_FILENO) {
-            /* For now, use DebugStr or just succeed silently */
-            /* Real implementation would write to console window */
-            return count;
-        }
-        errno = EBADF;
+    want = posix9_iov_total(iov, iovcnt);
+    if (want < 0) {
+        errno = EINVAL;
         return -1;
     }
 
-    /* Handle O_APPEND */
-    if (entry->flags & O_APPEND) {
-        SetFPos(entry->refNum, fsFromLEOF, 0);
+    /* Straight into the pieces, one OTRcv each */
+    if (posix9_is_socket(fd)) {
+        return posix9_socket_readv(fd, iov, iovcnt);
     }
 
-    err = FSWrite(entry->refNum, &bytes, buf);
-    if (err != noErr) {
-        errno = posix9_macos_to_errno(err);
-        return -1;
+    if (iovcnt == 1) {
+        return read(fd, iov[0].iov_base, iov[0].iov_len);
     }
 
-    return (ssize_t)bytes;
+    /* Read the range a bounce buffer at a time and scatter it from memory */
+    gather = iov_bounce(scratch, want, &size);
+    if (gather) {
+        total = 0;
+        i = 0;
+        off = 0;
+        while (total < want) {
+            chunk = want - total < size ? want - total : size;
+            n = read(fd, gather, chunk);
+            if (n < 0) {
+                if (total == 0) total = -1;
+                break;
+            }
+            iov_move(iov, &i, &off, gather, n, true);
+            total += n;
+            if (n < chunk) break;
+        }
+        if (gather != scratch) DisposePtr(gather);
+        return total;
+    }
+
+    /* No memory for a bounce buffer - one read() per element */
+    total = 0;
+    for (i = 0; i < iovcnt; i++) {
+        n = read(fd, iov[i].iov_base, iov[i].iov_len);
+        if (n < 0) return total > 0 ? total : -1;
+        total += n;
+        if ((size_t)n < iov[i].iov_len) break;
+    }
+
+    return total;
 }
 
-off_t lseek(int fd, off_t offset, int whence)
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
 {
+    const posix9_fd_ops *ops;
     posix9_fd_entry *entry;
-    OSErr err;
-    short posMode;
-    long pos;
-
-    entry = get_fd_entry(fd);
-    if (!entry) return -1;
+    long wbSize;
+    char scratch[POSIX9_IOV_SCRATCH];
+    char *gather;
+    ssize_t n, total;
+    long want, size, chunk;
+    size_t off;
+    int i;
 
-    if (entry->isStdio) {
-        errno = ESPIPE;  /* Can't seek on stdio */
+    want = posix9_iov_total(iov, iovcnt);
+    if (want < 0) {
+        errno = EINVAL;
         return -1;
     }
 
-    /* Map whence to Mac OS position mode */
-    switch (whence) {
-        case SEEK_SET:  posMode = fsFromStart; break;
-        case SEEK_CUR:  posMode = fsFromMark;  break;
-        case SEEK_END:  posMode = fsFromLEOF;  break;
-        default:
-            errno = EINVAL;
-            return -1;
+    /* One OTSnd of the pieces as they are, with no gather copy */
+    if (posix9_is_socket(fd)) {
+        return posix9_socket_writev(fd, iov, iovcnt);
     }
 
-    err = SetFPos(entry->refNum, posMode, offset);
-    if (err != noErr) {
-        errno = posix9_macos_to_errno(err);
-        return -1;
+    ops = posix9_fd_ops_of(fd);
+    if (!ops) return -1;
+
+    /* Other descriptors have no write-behind buffer: always gather */
+    wbSize = 0;
+    if (ops == &file_fd_ops) {
+        entry = get_fd_entry(fd);
+        wbSize = entry->wbSize;
     }
 
-    /* Get current position */
-    err = GetFPos(entry->refNum, &pos);
-    if (err != noErr) {
-        errno = posix9_macos_to_errno(err);
-        return -1;
+    /* Fits in the write-behind buffer: the pieces coalesce there anyway */
+    if (iovcnt == 1 || want < wbSize) {
+        total = 0;
+        for (i = 0; i < iovcnt; i++) {
+            n = write(fd, iov[i].iov_base, iov[i].iov_len);
+            if (n < 0) return total > 0 ? total : -1;
+            total += n;
+        }
+        return total;
+    }
+
+    /* Gather a bounce buffer at a time, so the File Manager sees one
+     * write per buffer rather than per piece */
+    gather = iov_bounce(scratch, want, &size);
+    if (gather) {
+        total = 0;
+        i = 0;
+        off = 0;
+        while (total < want) {
+            chunk = want - total < size ? want - total : size;
+            iov_move(iov, &i, &off, gather, chunk, false);
+            n = write(fd, gather, chunk);
+            if (n < 0) {
+                if (total == 0) total = -1;
+                break;
+            }
+            total += n;
+            if (n < chunk) break;
+        }
+        if (gather != scratch) DisposePtr(gather);
+        return total;
+    }
+
+    /* No memory for a bounce buffer - one write() per element */
+    total = 0;
+    for (i = 0; i < iovcnt; i++) {
+        n = write(fd, iov[i].iov_base, iov[i].iov_len);
+        if (n < 0) return total > 0 ? total : -1;
+        total += n;
     }
 
-    return (off_t)pos;
+    return total;
 }
 
-int fstat(int fd, struct stat *buf)
+int fstat64(int fd, struct stat64 *buf)
 {
     posix9_fd_entry *entry;
     OSErr err;
-    long eof;
-    FCBPBRec fcbPB;
+    SInt64 eof;
     CInfoPBRec catInfo;
     Str255 name;
 
@@ -496,19 +1282,13 @@ int fstat(int fd, struct stat *buf)
         return 0;
     }
 
-    /* Get file size */
-    err = GetEOF(entry->refNum, &eof);
+    /* Get file size, including any pending writes */
+    err = get_eof(entry, &eof);
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
     }
 
-    /* Get FCB info for more details */
-    fcbPB.ioRefNum = entry->refNum;
-    fcbPB.ioFCBIndx = 0;
-    fcbPB.ioNamePtr = name;
-    err = PBGetFCBInfoSync(&fcbPB);
-
     /* Fill in stat structure */
     buf->st_dev = entry->vRefNum;
     buf->st_ino = entry->dirID;  /* Use dirID as inode */
@@ -521,14 +1301,8 @@ int fstat(int fd, struct stat *buf)
     buf->st_blocks = (eof + 511) / 512;
 
     /* Get modification time from catalog */
-    memset(&catInfo, 0, sizeof(catInfo));
-    catInfo.hFileInfo.ioVRefNum = entry->vRefNum;
-    catInfo.hFileInfo.ioDirID = entry->dirID;
     c_to_pstr(entry->name, name);
-    catInfo.hFileInfo.ioNamePtr = name;
-    catInfo.hFileInfo.ioFDirIndex = 0;
-
-    err = PBGetCatInfoSync(&catInfo);
+    err = posix9_statcache_getcatinfo(entry->vRefNum, entry->dirID, name, &catInfo);
     if (err == noErr) {
         /* Mac OS time is seconds since Jan 1, 1904
            Unix time is seconds since Jan 1, 1970
@@ -542,83 +1316,190 @@ int fstat(int fd, struct stat *buf)
     return 0;
 }
 
-int stat(const char *path, struct stat *buf)
+/*
+ * The catalog's ioFlLgLen stops at 2 GB - 1. When it is pinned there,
+ * ask the fork itself for the real length.
+ */
+static void stat_fork_size(const FSSpec *spec, struct stat64 *buf)
 {
-    FSSpec spec;
-    CInfoPBRec catInfo;
-    OSErr err;
+    FSRef ref;
+    SInt64 size;
+    short refNum;
 
-    /* Clear stat buffer */
-    memset(buf, 0, sizeof(*buf));
+    if (buf->st_size < POSIX9_CLASSIC_MAX || !has_fork_apis()) return;
+    if (FSpMakeFSRef(spec, &ref) != noErr) return;
 
-    /* Convert path to FSSpec */
-    err = path_to_fsspec_basic(path, &spec);
-    if (err != noErr) {
-        errno = posix9_macos_to_errno(err);
-        return -1;
+    if (FSOpenFork(&ref, data_fork_name.length, data_fork_name.unicode,
+                   fsRdPerm, &refNum) == noErr) {
+        if (FSGetForkSize(refNum, &size) == noErr) {
+            buf->st_size = size;
+            buf->st_blocks = (size + 511) / 512;
+        }
+        FSCloseFork(refNum);
     }
+}
 
-    /* Get catalog info */
-    memset(&catInfo, 0, sizeof(catInfo));
-    catInfo.hFileInfo.ioVRefNum = spec.vRefNum;
-    catInfo.hFileInfo.ioDirID = spec.parID;
-    catInfo.hFileInfo.ioNamePtr = spec.name;
-    catInfo.hFileInfo.ioFDirIndex = 0;
-
-    err = PBGetCatInfoSync(&catInfo);
-    if (err != noErr) {
-        errno = posix9_macos_to_errno(err);
-        return -1;
-    }
+/* Fill a stat buffer from the catalog info of spec */
+static void stat_catinfo(const FSSpec *spec, const CInfoPBRec *pb, struct stat64 *buf)
+{
+    memset(buf, 0, sizeof(*buf));
 
     /* Fill in stat structure */
-    buf->st_dev = spec.vRefNum;
-    buf->st_ino = spec.parID;  /* Use parID as inode */
+    buf->st_dev = spec->vRefNum;
+    buf->st_ino = spec->parID;  /* Use parID as inode */
     buf->st_nlink = 1;
     buf->st_uid = 0;
     buf->st_gid = 0;
     buf->st_blksize = 512;
 
     /* Check if directory */
-    if (catInfo.hFileInfo.ioFlAttrib & ioDirMask) {
+    if (pb->hFileInfo.ioFlAttrib & ioDirMask) {
         buf->st_mode = S_IFDIR | 0755;
         buf->st_size = 0;
         buf->st_blocks = 0;
     } else {
         buf->st_mode = S_IFREG | 0644;
-        buf->st_size = catInfo.hFileInfo.ioFlLgLen;  /* Logical length */
+        buf->st_size = pb->hFileInfo.ioFlLgLen;  /* Logical length */
         buf->st_blocks = (buf->st_size + 511) / 512;
+        stat_fork_size(spec, buf);
     }
 
     /* Convert Mac time to Unix time */
     {
-        unsigned long macTime = catInfo.hFileInfo.ioFlMdDat;
+        unsigned long macTime = pb->hFileInfo.ioFlMdDat;
         buf->st_mtime = macTime - 2082844800UL;
         buf->st_atime = buf->st_mtime;
         buf->st_ctime = buf->st_mtime;
     }
+}
+
+/* stat() of a resolved spec; err is what resolving it returned */
+static int stat_fsspec(const FSSpec *spec, OSErr err, struct stat64 *buf)
+{
+    CInfoPBRec catInfo;
+
+    if (err == noErr) {
+        err = posix9_statcache_getcatinfo(spec->vRefNum, spec->parID, spec->name, &catInfo);
+    }
+    if (err != noErr) {
+        memset(buf, 0, sizeof(*buf));
+        errno = posix9_macos_to_errno(err);
+        return -1;
+    }
 
+    stat_catinfo(spec, &catInfo, buf);
     return 0;
 }
 
+int stat64(const char *path, struct stat64 *buf)
+{
+    FSSpec spec;
+    OSErr err;
+
+    /* Convert path to FSSpec */
+    err = path_to_fsspec_basic(path, &spec);
+
+    return stat_fsspec(&spec, err, buf);
+}
+
 /* lstat - same as stat on Mac OS 9 (no symlinks) */
+int lstat64(const char *path, struct stat64 *buf)
+{
+    return stat64(path, buf);
+}
+
+/* Copy a stat64 result into a struct stat, whose off_t may be narrower
+ * (also used by posix9_dir.c and posix9_find.c) */
+int posix9_file_stat_narrow(const struct stat64 *st64, struct stat *buf)
+{
+    if (st64->st_size > POSIX9_OFF_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    memset(buf, 0, sizeof(*buf));
+    buf->st_dev = st64->st_dev;
+    buf->st_ino = st64->st_ino;
+    buf->st_mode = st64->st_mode;
+    buf->st_nlink = st64->st_nlink;
+    buf->st_uid = st64->st_uid;
+    buf->st_gid = st64->st_gid;
+    buf->st_rdev = st64->st_rdev;
+    buf->st_size = (off_t)st64->st_size;
+    buf->st_atime = st64->st_atime;
+    buf->st_mtime = st64->st_mtime;
+    buf->st_ctime = st64->st_ctime;
+    buf->st_blksize = st64->st_blksize;
+    buf->st_blocks = (blkcnt_t)st64->st_blocks;
+
+    return 0;
+}
+
+int fstat(int fd, struct stat *buf)
+{
+    struct stat64 st64;
+
+    if (fstat64(fd, &st64) != 0) return -1;
+    return posix9_file_stat_narrow(&st64, buf);
+}
+
+int stat(const char *path, struct stat *buf)
+{
+    struct stat64 st64;
+
+    if (stat64(path, &st64) != 0) return -1;
+    return posix9_file_stat_narrow(&st64, buf);
+}
+
 int lstat(const char *path, struct stat *buf)
 {
     return stat(path, buf);
 }
 
-int unlink(const char *path)
+/* stat64() of name in dirID from catalog info already read (posix9_dir.c) */
+void posix9_file_stat_entry(short vRefNum, long dirID, ConstStr255Param name,
+                            const CInfoPBRec *pb, struct stat64 *buf)
+{
+    FSSpec spec;
+
+    spec.vRefNum = vRefNum;
+    spec.parID = dirID;
+    memcpy(spec.name, name, name[0] + 1);
+
+    stat_catinfo(&spec, pb, buf);
+}
+
+/* AT_SYMLINK_NOFOLLOW needs nothing - there are no symlinks */
+int fstatat64(int dirfd, const char *path, struct stat64 *buf, int flags)
 {
     FSSpec spec;
     OSErr err;
 
-    err = path_to_fsspec_basic(path, &spec);
+    (void)flags;
+
+    if (at_fsspec(dirfd, path, &spec, &err) != 0) return -1;
+    return stat_fsspec(&spec, err, buf);
+}
+
+int fstatat(int dirfd, const char *path, struct stat *buf, int flags)
+{
+    struct stat64 st64;
+
+    if (fstatat64(dirfd, path, &st64, flags) != 0) return -1;
+    return posix9_file_stat_narrow(&st64, buf);
+}
+
+static int unlink_fsspec(const FSSpec *spec, OSErr err)
+{
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
     }
 
-    err = FSpDelete(&spec);
+    err = FSpDelete(spec);
+    posix9_statcache_invalidate(spec->vRefNum, spec->parID, spec->name);
+    posix9_statcache_invalidate_dir(spec->vRefNum, spec->parID);
+    posix9_pathcache_invalidate(spec->vRefNum, spec->parID, spec->name);
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
@@ -627,39 +1508,83 @@ int unlink(const char *path)
     return 0;
 }
 
-int rename(const char *oldpath, const char *newpath)
+int unlink(const char *path)
 {
-    FSSpec oldSpec, newSpec;
+    FSSpec spec;
     OSErr err;
-    Str255 newName;
-    char *lastSlash;
-    char newDir[POSIX9_PATH_MAX];
-    char newFile[POSIX9_NAME_MAX];
 
-    /* Get FSSpec for old path */
-    err = path_to_fsspec_basic(oldpath, &oldSpec);
-    if (err != noErr) {
-        errno = posix9_macos_to_errno(err);
+    err = path_to_fsspec_basic(path, &spec);
+
+    return unlink_fsspec(&spec, err);
+}
+
+int unlinkat(int dirfd, const char *path, int flags)
+{
+    FSSpec spec;
+    OSErr err;
+
+    if (at_fsspec(dirfd, path, &spec, &err) != 0) return -1;
+
+    if (flags & AT_REMOVEDIR) {
+        if (err != noErr) {
+            errno = posix9_macos_to_errno(err);
+            return -1;
+        }
+        return posix9_dir_remove(&spec);
+    }
+
+    return unlink_fsspec(&spec, err);
+}
+
+/*
+ * Move and rename oldSpec to newSpec's parent and name. A different
+ * parent is a CatMove to it first; the File Manager cannot move across
+ * volumes, and a name already taken is EEXIST, not a replacement.
+ */
+static int rename_fsspec(const FSSpec *oldSpec, const FSSpec *newSpec, OSErr newErr)
+{
+    FSSpec moved, destDir;
+    Boolean sameName;
+    OSErr err;
+
+    if (newErr != noErr && newErr != fnfErr) {
+        errno = posix9_macos_to_errno(newErr);
         return -1;
     }
 
-    /* Parse new path to get directory and filename */
-    /* For now, only support same-directory rename */
-    lastSlash = strrchr(newpath, '/');
-    if (lastSlash == NULL) {
-        lastSlash = strrchr(newpath, ':');
+    if (newSpec->vRefNum != oldSpec->vRefNum) {
+        errno = EXDEV;
+        return -1;
     }
 
-    if (lastSlash) {
-        strncpy(newFile, lastSlash + 1, sizeof(newFile) - 1);
-    } else {
-        strncpy(newFile, newpath, sizeof(newFile) - 1);
+    sameName = memcmp(oldSpec->name, newSpec->name, oldSpec->name[0] + 1) == 0;
+
+    moved = *oldSpec;
+    err = noErr;
+    if (newSpec->parID != oldSpec->parID) {
+        if (newErr == noErr) {
+            errno = EEXIST;
+            return -1;
+        }
+
+        /* An empty name makes the FSSpec the directory parID itself */
+        destDir.vRefNum = newSpec->vRefNum;
+        destDir.parID = newSpec->parID;
+        destDir.name[0] = 0;
+        err = FSpCatMove(oldSpec, &destDir);
+        moved.parID = newSpec->parID;
+    }
+
+    if (err == noErr && !sameName) {
+        err = FSpRename(&moved, newSpec->name);
     }
-    newFile[sizeof(newFile) - 1] = '\0';
 
-    /* Rename the file */
-    c_to_pstr(newFile, newName);
-    err = FSpRename(&oldSpec, newName);
+    posix9_statcache_invalidate(oldSpec->vRefNum, oldSpec->parID, oldSpec->name);
+    posix9_statcache_invalidate(newSpec->vRefNum, newSpec->parID, oldSpec->name);
+    posix9_statcache_invalidate(newSpec->vRefNum, newSpec->parID, newSpec->name);
+    posix9_statcache_invalidate_dir(oldSpec->vRefNum, oldSpec->parID);
+    posix9_statcache_invalidate_dir(newSpec->vRefNum, newSpec->parID);
+    posix9_pathcache_invalidate(oldSpec->vRefNum, oldSpec->parID, oldSpec->name);
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
@@ -668,6 +1593,28 @@ int rename(const char *oldpath, const char *newpath)
     return 0;
 }
 
+int rename(const char *oldpath, const char *newpath)
+{
+    return renameat(AT_FDCWD, oldpath, AT_FDCWD, newpath);
+}
+
+int renameat(int olddirfd, const char *oldpath, int newdirfd, const char *newpath)
+{
+    FSSpec oldSpec, newSpec;
+    OSErr err;
+
+    if (at_fsspec(olddirfd, oldpath, &oldSpec, &err) != 0) return -1;
+    if (err != noErr) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
+    }
+
+    /* A missing target still names its parent directory and leaf */
+    if (at_fsspec(newdirfd, newpath, &newSpec, &err) != 0) return -1;
+
+    return rename_fsspec(&oldSpec, &newSpec, err);
+}
+
 int fsync(int fd)
 {
     posix9_fd_entry *entry;
@@ -681,10 +1628,18 @@ int fsync(int fd)
         return 0;  /* No-op for stdio */
     }
 
-    /* Flush the file */
+    /* Push out the write-behind buffer */
+    err = wb_flush(entry);
+    if (err != noErr) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
+    }
+
+    /* Flush the file - this also brings the catalog up to date */
     memset(&pb, 0, sizeof(pb));
     pb.ioParam.ioRefNum = entry->refNum;
     err = PBFlushFileSync(&pb);
+    stat_invalidate(entry);
 
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
@@ -699,7 +1654,7 @@ int fsync(int fd)
     return 0;
 }
 
-int ftruncate(int fd, off_t length)
+int ftruncate64(int fd, off64_t length)
 {
     posix9_fd_entry *entry;
     OSErr err;
@@ -707,59 +1662,138 @@ int ftruncate(int fd, off_t length)
     entry = get_fd_entry(fd);
     if (!entry) return -1;
 
-    if (entry->isStdio) {
+    if (entry->isStdio || length < 0) {
         errno = EINVAL;
         return -1;
     }
 
-    err = SetEOF(entry->refNum, length);
+    err = wb_flush(entry);
+    if (err == noErr) {
+        stat_invalidate(entry);
+        err = set_eof(entry, length);
+    }
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
     }
 
+    ra_truncate(entry, length);
+    if (entry->eofKnown) {
+        entry->eof = length;
+    }
+
     return 0;
 }
 
-int dup(int oldfd)
+int ftruncate(int fd, off_t length)
+{
+    return ftruncate64(fd, length);
+}
+
+/*
+ * Set the read-ahead block size for a descriptor; 0 disables it.
+ * Any cached data is discarded.
+ */
+int posix9_set_readahead(int fd, long size)
 {
     posix9_fd_entry *entry;
-    int newfd;
 
-    entry = get_fd_entry(oldfd);
+    entry = get_fd_entry(fd);
     if (!entry) return -1;
 
-    newfd = alloc_fd();
-    if (newfd < 0) return -1;
+    if (entry->isStdio || size < 0 || size > POSIX9_READAHEAD_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
 
-    /* Copy entry */
-    memcpy(&fd_table[newfd], entry, sizeof(posix9_fd_entry));
+    if (entry->raBuf) {
+        DisposePtr(entry->raBuf);
+        entry->raBuf = NULL;
+    }
+    entry->raLen = 0;
+    entry->raSize = size;
 
-    return newfd;
+    return 0;
 }
 
-int dup2(int oldfd, int newfd)
+/*
+ * Set the write-behind buffer size for a descriptor; 0 disables it.
+ * Pending data is flushed first.
+ */
+int posix9_set_writebehind(int fd, long size)
 {
     posix9_fd_entry *entry;
+    OSErr err;
 
-    entry = get_fd_entry(oldfd);
+    entry = get_fd_entry(fd);
     if (!entry) return -1;
 
-    if (newfd < 0 || newfd >= POSIX9_OPEN_MAX) {
-        errno = EBADF;
+    if (entry->isStdio || size < 0 || size > POSIX9_WRITEBEHIND_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    err = wb_flush(entry);
+    if (entry->wbBuf) {
+        DisposePtr(entry->wbBuf);
+        entry->wbBuf = NULL;
+    }
+    entry->wbSize = size;
+
+    if (err != noErr) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Hand a descriptor's refNum to the asynchronous I/O engine
+ * (posix9_aio.c). Pending write-behind data is issued first so the
+ * queued call sees it; for writes the file is extended to the offset
+ * and the cached read-ahead block and EOF are dropped, since the
+ * async call changes the file behind this table's back. The queued
+ * calls are the classic ones, so aio stays below 2 GB.
+ */
+int posix9_file_async_begin(int fd, Boolean forWrite, long offset, short *refNum)
+{
+    posix9_fd_entry *entry;
+    OSErr err;
+    SInt64 eof;
+
+    entry = get_fd_entry(fd);
+    if (!entry) return -1;
+
+    if (entry->isStdio) {
+        errno = ESPIPE;
+        return -1;
+    }
+
+    if (offset < 0) {
+        errno = EINVAL;
         return -1;
     }
 
-    /* Close newfd if open */
-    if (fd_table[newfd].inUse && !fd_table[newfd].isStdio) {
-        close(newfd);
+    if (forWrite) {
+        err = get_eof(entry, &eof);
+        if (err == noErr && offset > eof) {
+            err = set_eof(entry, offset);
+        }
+        stat_invalidate(entry);
+        entry->raLen = 0;
+        entry->eofKnown = false;
+    } else {
+        err = wb_flush(entry);
     }
 
-    /* Copy entry */
-    memcpy(&fd_table[newfd], entry, sizeof(posix9_fd_entry));
-    fd_table[newfd].inUse = true;
+    if (err != noErr) {
+        errno = posix9_macos_to_errno(err);
+        return -1;
+    }
 
-    return newfd;
+    *refNum = entry->refNum;
+    return 0;
 }
 
 /* ============================================================
@@ -774,14 +1808,9 @@ int posix9_init(void)
 
 void posix9_cleanup(void)
 {
-    int i;
-
-    /* Close all open files */
-    for (i = 3; i < POSIX9_OPEN_MAX; i++) {
-        if (fd_table[i].inUse && !fd_table[i].isStdio) {
-            close(i);
-        }
-    }
+    /* Close every descriptor - close() flushes any write-behind data */
+    posix9_fd_close_all();
 
     fd_table_initialized = false;
+    fork_apis_checked = false;
 }
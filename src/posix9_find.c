@@ -0,0 +1,624 @@
+/*
+ * posix9_find.c - Catalog search for Mac OS 9
+ *
+ * find(1) on a POSIX system lists every directory under its start and
+ * stats what it finds. HFS keeps every file and folder of a volume in
+ * one catalog B-tree, and PBCatSearch scans it in order, checking
+ * name, attributes, Finder info, size and dates itself, so:
+ *   posix9_find_open()  -> PBHGetVolParms (bHasCatSearch?) + the criteria
+ *   posix9_find_next()  -> PBCatSearch for POSIX9_FIND_BATCH matches at a
+ *                          time, resumed through ioCatPosition, each call
+ *                          bounded by POSIX9_FIND_TICKS
+ *   match path          -> parents from the directory cache (posix9_path.c)
+ *
+ * CatSearch only matches names by substring, so it is given the longest
+ * literal run of the glob and the whole glob is checked here. It knows
+ * nothing of subtrees either: a match is kept if climbing its parents
+ * reaches the directory the search started from. Volumes without it
+ * get the same answers from the fts walker.
+ */
+
+#include "posix9.h"
+#include "posix9/fts.h"
+
+/* Mac OS headers */
+#include <Multiverse.h>
+#include "MacCompat.h"      /* Missing definitions for Retro68 */
+#include <string.h>
+
+/* From posix9_statcache.c */
+extern OSErr posix9_statcache_getcatinfo(short vRefNum, long dirID, ConstStr255Param name,
+                                         CInfoPBRec *pb);
+
+/* From posix9_path.c */
+extern OSErr posix9_path_parent(short vRefNum, long dirID, long *parID, Str255 name);
+extern int posix9_name_to_mac(const char *name, size_t len, StringPtr out, size_t max);
+extern int posix9_name_from_mac(ConstStr255Param name, char *out, size_t size);
+
+/* From posix9_file.c */
+extern void posix9_file_stat_entry(short vRefNum, long dirID, ConstStr255Param name,
+                                   const CInfoPBRec *pb, struct stat64 *buf);
+extern int posix9_file_stat_narrow(const struct stat64 *st64, struct stat *buf);
+
+/* From posix9_dir.c */
+extern const CInfoPBRec *posix9_fts_catinfo(FTS *ftsp);
+
+/* Catalog read buffer for PBCatSearch; it works without one, slower */
+#define FIND_BUFFER     16384
+
+#define CATALOG_LEN_MAX     0x7FFFFFFFL     /* Where ioFlLgLen stops */
+#define MAC_TO_UNIX_OFFSET  2082844800UL
+
+/* ============================================================
+ * Search State
+ * ============================================================ */
+
+struct posix9_find {
+    posix9_find_spec spec;          /* spec.name points at pattern */
+    char        pattern[POSIX9_NAME_MAX + 1];
+    short       vRefNum;            /* Where the search started */
+    long        dirID;
+    size_t      rootLen;            /* Bytes of path that are the start */
+
+    /* PBCatSearch */
+    CSParam     pb;                 /* ioCatPosition carries over between calls */
+    CInfoPBRec  info1;              /* Values and lower bounds */
+    CInfoPBRec  info2;              /* Masks and upper bounds */
+    Str63       literal;            /* For fsSBPartialName or fsSBFullName */
+    Boolean     done;               /* eofErr: nothing more in the catalog */
+    Boolean     seeking;            /* Restarted: skip up to last */
+    Boolean     started;            /* last is valid */
+    short       count;              /* Matches in the batch */
+    short       next;               /* Next of them to check */
+    FSSpec      last;               /* The last match taken from a batch */
+    FSSpec      batch[POSIX9_FIND_BATCH];
+
+    FTS *       fts;                /* Walk instead, without CatSearch */
+    char        path[POSIX9_PATH_MAX];
+};
+
+/* ============================================================
+ * Name Matching
+ * ============================================================ */
+
+static unsigned char fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/* Bytes in the UTF-8 character at s */
+static int char_len(const char *s)
+{
+    int n = 1;
+
+    while ((s[n] & 0xC0) == 0x80) n++;
+    return n;
+}
+
+/* The ']' closing the class at p, or NULL if it is a plain '[' */
+static const char *class_end(const char *p)
+{
+    p++;
+    if (*p == '!' || *p == '^') p++;
+    if (*p == ']') p++;
+    while (*p && *p != ']') p++;
+
+    return *p ? p : NULL;
+}
+
+/* Whether the n byte character at s is in the class from p to end */
+static Boolean class_has(const char *p, const char *end, const char *s, int n)
+{
+    Boolean negate = false, in = false;
+    unsigned char c = fold(*s);
+
+    p++;
+    if (*p == '!' || *p == '^') {
+        negate = true;
+        p++;
+    }
+
+    /* Members are ASCII, so other characters are never in it */
+    while (n == 1 && p < end) {
+        if (p + 2 < end && p[1] == '-') {
+            if (c >= fold(p[0]) && c <= fold(p[2])) in = true;
+            p += 3;
+        } else {
+            if (c == fold(*p)) in = true;
+            p++;
+        }
+    }
+
+    return in != negate;
+}
+
+/* Shell-style match of s against the glob p, '?' taking a whole character */
+static Boolean glob_match(const char *p, const char *s)
+{
+    const char *starP = NULL, *starS = NULL;
+    const char *end;
+    int n;
+
+    while (*s) {
+        n = char_len(s);
+        if (*p == '*') {
+            while (*p == '*') p++;
+            if (*p == '\0') return true;
+            starP = p;
+            starS = s;
+            continue;
+        }
+        if (*p == '?') {
+            p++;
+            s += n;
+            continue;
+        }
+        if (*p == '[' && (end = class_end(p)) != NULL) {
+            if (class_has(p, end, s, n)) {
+                p = end + 1;
+                s += n;
+                continue;
+            }
+        } else if (*p && fold(*p) == fold(*s)) {
+            p++;
+            s++;
+            continue;
+        }
+
+        /* No match here: the last '*' takes one more character */
+        if (!starP) return false;
+        starS += char_len(starS);
+        p = starP;
+        s = starS;
+    }
+
+    while (*p == '*') p++;
+    return *p == '\0';
+}
+
+/*
+ * The longest run of pattern with no glob characters, in the filename
+ * encoding. Returns whether that is the whole pattern, or -1 if it has
+ * a character the encoding lacks, so nothing can match.
+ */
+static int literal_run(const char *pattern, Str63 literal)
+{
+    const char *p = pattern, *run, *best = pattern, *end;
+    size_t bestLen = 0;
+
+    while (*p) {
+        run = p;
+        while (*p && *p != '*' && *p != '?' && !(*p == '[' && class_end(p))) p++;
+        if ((size_t)(p - run) > bestLen) {
+            best = run;
+            bestLen = p - run;
+        }
+        if (*p == '[') {
+            end = class_end(p);
+            p = end + 1;
+        } else if (*p) {
+            p++;
+        }
+    }
+
+    /* Too long for an HFS name, or unmappable: no name has it */
+    if (posix9_name_to_mac(best, bestLen, literal, sizeof(Str63)) < 0) return -1;
+
+    return bestLen == strlen(pattern);
+}
+
+/* ============================================================
+ * Matching
+ * ============================================================ */
+
+/*
+ * Whether an entry meets spec apart from its name. PBCatSearch checked
+ * this already, except for files past the 2 GB its sizes stop at.
+ */
+static Boolean matches(const POSIX9_FIND *f, const struct stat64 *st, const CInfoPBRec *pb)
+{
+    const posix9_find_spec *spec = &f->spec;
+    Boolean isDir = S_ISDIR(st->st_mode);
+
+    if (spec->types && !(spec->types & (isDir ? POSIX9_FIND_DIRS : POSIX9_FIND_FILES))) {
+        return false;
+    }
+    if (isDir && (spec->minSize || spec->maxSize || spec->fileType || spec->creator)) {
+        return false;
+    }
+    if (!isDir) {
+        if (st->st_size < spec->minSize) return false;
+        if (spec->maxSize && st->st_size > spec->maxSize) return false;
+        if (spec->fileType && pb->hFileInfo.ioFlFndrInfo.fdType != (OSType)spec->fileType) {
+            return false;
+        }
+        if (spec->creator && pb->hFileInfo.ioFlFndrInfo.fdCreator != (OSType)spec->creator) {
+            return false;
+        }
+    }
+    if (spec->newerThan && st->st_mtime <= spec->newerThan) return false;
+    if (spec->olderThan && st->st_mtime >= spec->olderThan) return false;
+
+    return true;
+}
+
+/*
+ * Put the path of match m in f->path: the path searched, then the names
+ * of the directories between, climbing from the directory cache.
+ * fnfErr if m is not below the directory searched.
+ */
+static OSErr match_path(POSIX9_FIND *f, const FSSpec *m)
+{
+    char utf8[3 * 255 + 1];
+    char *start, *lim;
+    Str255 name;
+    long dirID, parID;
+    int n;
+    OSErr err;
+
+    if (m->parID == fsRtParID) return fnfErr;       /* The volume itself */
+
+    /* Names are prepended, so build at the end of the buffer, clear of
+     * the path searched and a '/' */
+    start = f->path + sizeof(f->path) - 1;
+    *start = '\0';
+    lim = f->path + f->rootLen + 1;
+    memcpy(name, m->name, m->name[0] + 1);
+
+    for (dirID = m->parID; ; dirID = parID) {
+        n = posix9_name_from_mac(name, utf8, sizeof(utf8));
+        if (n < 0 || n + 1 > start - lim) return bdNamErr;
+        start -= n;
+        memcpy(start, utf8, n);
+        if (dirID == f->dirID) break;
+        if (dirID == fsRtDirID) return fnfErr;
+
+        err = posix9_path_parent(m->vRefNum, dirID, &parID, name);
+        if (err != noErr) return err;
+        *--start = '/';
+    }
+
+    if (f->rootLen > 0 && f->path[f->rootLen - 1] != '/') *--start = '/';
+    memmove(f->path + f->rootLen, start, f->path + sizeof(f->path) - start);
+    return noErr;
+}
+
+/*
+ * The next batch of matches from the catalog, or eofErr. A change to
+ * the catalog makes CatSearch start over; the matches up to the last
+ * one taken are skipped again, unless it has gone, when the search
+ * starts over from the top.
+ */
+static OSErr next_batch(POSIX9_FIND *f)
+{
+    OSErr err;
+    short i;
+
+    f->count = f->next = 0;
+    while (!f->done) {
+        err = PBCatSearchSync(&f->pb);
+        if (err == catChangedErr) {
+            f->pb.ioCatPosition.initialize = 0;
+            f->seeking = f->started;
+            continue;
+        }
+        if (err == eofErr) {
+            if (f->seeking) {
+                /* The last match is gone: all of them again */
+                f->seeking = false;
+                f->pb.ioCatPosition.initialize = 0;
+                continue;
+            }
+            f->done = true;
+        } else if (err != noErr) {
+            return err;
+        }
+
+        f->count = (short)f->pb.ioActMatchCount;
+        f->next = 0;
+        if (f->seeking) {
+            for (i = 0; i < f->count; i++) {
+                if (f->batch[i].parID == f->last.parID &&
+                    memcmp(f->batch[i].name, f->last.name, f->last.name[0] + 1) == 0) {
+                    f->seeking = false;
+                    f->next = i + 1;
+                    break;
+                }
+            }
+            if (f->seeking) f->next = f->count;
+        }
+        if (f->next < f->count) return noErr;
+
+        /* Out of time before a match: let other applications run */
+        SystemTask();
+    }
+
+    return eofErr;
+}
+
+/* The criteria spec gives PBCatSearch; false if nothing can match */
+static Boolean set_criteria(POSIX9_FIND *f)
+{
+    const posix9_find_spec *spec = &f->spec;
+    Boolean fileOnly = spec->minSize || spec->maxSize || spec->fileType || spec->creator;
+    long bits = fsSBFlAttrib;
+    int whole;
+
+    if (spec->name) {
+        whole = literal_run(spec->name, f->literal);
+        if (whole < 0) return false;
+        if (f->literal[0] > 0) {
+            bits |= whole ? fsSBFullName : fsSBPartialName;
+            f->info1.hFileInfo.ioNamePtr = f->literal;
+        }
+    }
+
+    /* The directory bit of the attributes tells files from folders */
+    if (fileOnly || spec->types == POSIX9_FIND_FILES) {
+        if (spec->types == POSIX9_FIND_DIRS) return false;
+        f->info2.hFileInfo.ioFlAttrib = ioDirMask;
+    } else if (spec->types == POSIX9_FIND_DIRS) {
+        f->info1.hFileInfo.ioFlAttrib = ioDirMask;
+        f->info2.hFileInfo.ioFlAttrib = ioDirMask;
+    }
+
+    /* The catalog's lengths stop at 2 GB - 1: longer files are checked later */
+    if (spec->minSize || spec->maxSize) {
+        bits |= fsSBFlLgLen;
+        f->info1.hFileInfo.ioFlLgLen = spec->minSize < CATALOG_LEN_MAX ?
+                                       (long)spec->minSize : CATALOG_LEN_MAX;
+        f->info2.hFileInfo.ioFlLgLen = (spec->maxSize && spec->maxSize < CATALOG_LEN_MAX) ?
+                                       (long)spec->maxSize : CATALOG_LEN_MAX;
+    }
+
+    if (spec->newerThan || spec->olderThan) {
+        bits |= fsSBFlMdDat;
+        f->info1.hFileInfo.ioFlMdDat = spec->newerThan ?
+                                       spec->newerThan + MAC_TO_UNIX_OFFSET + 1 : 0;
+        f->info2.hFileInfo.ioFlMdDat = spec->olderThan ?
+                                       spec->olderThan + MAC_TO_UNIX_OFFSET - 1 : 0xFFFFFFFFUL;
+    }
+
+    if (spec->fileType || spec->creator) {
+        bits |= fsSBFlFndrInfo;
+        f->info1.hFileInfo.ioFlFndrInfo.fdType = (OSType)spec->fileType;
+        f->info2.hFileInfo.ioFlFndrInfo.fdType = spec->fileType ? 0xFFFFFFFFUL : 0;
+        f->info1.hFileInfo.ioFlFndrInfo.fdCreator = (OSType)spec->creator;
+        f->info2.hFileInfo.ioFlFndrInfo.fdCreator = spec->creator ? 0xFFFFFFFFUL : 0;
+    }
+
+    f->pb.ioVRefNum = f->vRefNum;
+    f->pb.ioMatchPtr = f->batch;
+    f->pb.ioReqMatchCount = POSIX9_FIND_BATCH;
+    f->pb.ioSearchBits = bits;
+    f->pb.ioSearchInfo1 = &f->info1;
+    f->pb.ioSearchInfo2 = &f->info2;
+    f->pb.ioSearchTime = POSIX9_FIND_TICKS;
+    f->pb.ioCatPosition.initialize = 0;
+    return true;
+}
+
+/* Whether the volume can search its catalog; not every format can */
+static Boolean has_catsearch(short vRefNum)
+{
+    GetVolParmsInfoBuffer parms;
+    HParamBlockRec pb;
+
+    memset(&pb, 0, sizeof(pb));
+    memset(&parms, 0, sizeof(parms));
+    pb.ioParam.ioVRefNum = vRefNum;
+    pb.ioParam.ioBuffer = (Ptr)&parms;
+    pb.ioParam.ioReqCount = sizeof(parms);
+
+    return PBHGetVolParmsSync(&pb) == noErr && (parms.vMAttrib & (1L << bHasCatSearch));
+}
+
+/* ============================================================
+ * Search Functions
+ * ============================================================ */
+
+POSIX9_FIND *posix9_find_open(const char *path, const posix9_find_spec *spec)
+{
+    CInfoPBRec catInfo;
+    POSIX9_FIND *f;
+    FSSpec root;
+    char *paths[2];
+    size_t len;
+    OSErr err;
+    int saved;
+
+    if (!path || !spec) {
+        errno = EINVAL;
+        return NULL;
+    }
+    len = strlen(path);
+    if (len == 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+    if (len >= POSIX9_PATH_MAX || (spec->name && strlen(spec->name) > POSIX9_NAME_MAX)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    err = posix9_path_to_fsspec(path, &root);
+    if (err == noErr) {
+        err = posix9_statcache_getcatinfo(root.vRefNum, root.parID, root.name, &catInfo);
+    }
+    if (err != noErr) {
+        errno = posix9_macos_to_errno(err);
+        return NULL;
+    }
+    if (!(catInfo.hFileInfo.ioFlAttrib & ioDirMask)) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+
+    f = (POSIX9_FIND *)NewPtrClear(sizeof(POSIX9_FIND));
+    if (!f) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    f->spec = *spec;
+    if (spec->name) {
+        strcpy(f->pattern, spec->name);
+        f->spec.name = f->pattern;
+    }
+    f->vRefNum = root.vRefNum;
+    f->dirID = catInfo.dirInfo.ioDrDirID;
+    memcpy(f->path, path, len + 1);
+    f->rootLen = len;
+
+    if (!has_catsearch(f->vRefNum)) {
+        paths[0] = f->path;
+        paths[1] = NULL;
+        f->fts = fts_open64(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+        if (!f->fts) {
+            saved = errno;
+            DisposePtr((Ptr)f);
+            errno = saved;
+            return NULL;
+        }
+        return f;
+    }
+
+    if (!set_criteria(f)) {
+        f->done = true;
+    } else {
+        f->pb.ioOptBuffer = NewPtr(FIND_BUFFER);
+        f->pb.ioOptBufSize = f->pb.ioOptBuffer ? FIND_BUFFER : 0;
+    }
+
+    return f;
+}
+
+/* The walk's next entry below the path searched that matches */
+static const char *next_walked(POSIX9_FIND *f, struct stat64 *buf)
+{
+    const struct stat64 *st;
+    FTSENT *ent;
+
+    while ((ent = fts_read(f->fts)) != NULL) {
+        if (ent->fts_level == FTS_ROOTLEVEL) continue;
+        if (ent->fts_info != FTS_F && ent->fts_info != FTS_D) continue;
+        if (f->spec.name && !glob_match(f->spec.name, ent->fts_name)) continue;
+        st = (const struct stat64 *)ent->fts_statp;
+        if (!matches(f, st, posix9_fts_catinfo(f->fts))) continue;
+
+        if (buf) *buf = *st;
+        return ent->fts_path;
+    }
+
+    return NULL;
+}
+
+const char *posix9_find_next64(POSIX9_FIND *f, struct stat64 *buf)
+{
+    CInfoPBRec catInfo;
+    struct stat64 st;
+    const FSSpec *m;
+    OSErr err;
+
+    if (!f) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (f->fts) return next_walked(f, buf);
+    if (!buf) buf = &st;
+
+    for (;;) {
+        if (f->next == f->count) {
+            err = next_batch(f);
+            if (err != noErr) {
+                errno = (err == eofErr) ? 0 : posix9_macos_to_errno(err);
+                return NULL;
+            }
+        }
+        m = &f->batch[f->next++];
+        f->last = *m;
+        f->started = true;
+
+        /* Below the path searched, the glob, then the rest */
+        err = match_path(f, m);
+        if (err == fnfErr) continue;
+        if (err == noErr && f->spec.name &&
+            !glob_match(f->spec.name, strrchr(f->path, '/') + 1)) continue;
+        if (err == noErr) {
+            err = posix9_statcache_getcatinfo(m->vRefNum, m->parID, m->name, &catInfo);
+            if (err == fnfErr) continue;        /* Gone since */
+        }
+        if (err != noErr) {
+            errno = posix9_macos_to_errno(err);
+            return NULL;
+        }
+        posix9_file_stat_entry(m->vRefNum, m->parID, m->name, &catInfo, buf);
+        if (matches(f, buf, &catInfo)) return f->path;
+    }
+}
+
+/* A match too big for struct stat fails with EOVERFLOW, as stat() does */
+const char *posix9_find_next(POSIX9_FIND *f, struct stat *buf)
+{
+    struct stat64 st64;
+    const char *path;
+
+    path = posix9_find_next64(f, &st64);
+    if (path && buf && posix9_file_stat_narrow(&st64, buf) != 0) return NULL;
+    return path;
+}
+
+int posix9_find_close(POSIX9_FIND *f)
+{
+    if (!f) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (f->fts) fts_close(f->fts);
+    if (f->pb.ioOptBuffer) DisposePtr(f->pb.ioOptBuffer);
+    DisposePtr((Ptr)f);
+
+    return 0;
+}
+
+/* posix9_find() with fn, or posix9_find64() with fn64 */
+static int find_each(const char *path, const posix9_find_spec *spec,
+                     int (*fn)(const char *path, const struct stat *sb, void *arg),
+                     int (*fn64)(const char *path, const struct stat64 *sb, void *arg),
+                     void *arg)
+{
+    POSIX9_FIND *f;
+    const char *match;
+    struct stat64 st64;
+    struct stat st;
+    int result = 0, err;
+
+    f = posix9_find_open(path, spec);
+    if (!f) return -1;
+
+    while ((match = fn64 ? posix9_find_next64(f, &st64) : posix9_find_next(f, &st)) != NULL) {
+        result = fn64 ? fn64(match, &st64, arg) : fn(match, &st, arg);
+        if (result != 0) break;
+    }
+    if (!match && errno != 0) result = -1;
+
+    err = errno;
+    posix9_find_close(f);
+    errno = err;
+
+    return result;
+}
+
+int posix9_find(const char *path, const posix9_find_spec *spec,
+                int (*fn)(const char *path, const struct stat *sb, void *arg),
+                void *arg)
+{
+    return find_each(path, spec, fn, NULL, arg);
+}
+
+int posix9_find64(const char *path, const posix9_find_spec *spec,
+                  int (*fn)(const char *path, const struct stat64 *sb, void *arg),
+                  void *arg)
+{
+    return find_each(path, spec, NULL, fn, arg);
+}
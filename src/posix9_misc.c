@@ -730,47 +730,3 @@ void arc4random_buf(void *buf, size_t n)
     }
 }
 #endif /* !__NEWLIB__ */
-
-/* ============================================================
- * Memory Functions
- * ============================================================ */
-
-void *mmap(void *addr, size_t length, int prot, int flags,
-           int fd, off_t offset)
-{
-    /* No mmap on Mac OS 9 - allocate memory instead */
-    void *ptr;
-
-    (void)addr;
-    (void)prot;
-    (void)flags;
-    (void)fd;
-    (void)offset;
-
-    ptr = NewPtr(length);
-    if (!ptr) {
-        errno = ENOMEM;
-        return (void *)-1;
-    }
-
-    return ptr;
-}
-
-int munmap(void *addr, size_t length)
-{
-    (void)length;
-    DisposePtr((Ptr)addr);
-    return 0;
-}
-
-/* mmap constants */
-#define PROT_READ   0x1
-#define PROT_WRITE  0x2
-#define PROT_EXEC   0x4
-#define PROT_NONE   0x0
-
-#define MAP_SHARED      0x01
-#define MAP_PRIVATE     0x02
-#define MAP_ANONYMOUS   0x20
-#define MAP_ANON        MAP_ANONYMOUS
-#define MAP_FAILED      ((void *)-1)
@@ -0,0 +1,363 @@
+/*
+ * posix9_mmap.c - File-backed mmap() for Mac OS 9
+ *
+ * Applications get no page faults on Mac OS 9, so a mapping is a heap
+ * block that the File Manager fills and drains:
+ *   mmap() / mmap64()    -> NewPtr + one pread64() for the whole range
+ *   posix9_mmap_access() -> pread64() of missing pages (MAP_POSIX9_LAZY)
+ *   msync() / munmap()   -> pwrite64() of each contiguous run to write back
+ *
+ * Each mapping holds a dup() of its descriptor, so it shares the file's
+ * read-ahead and write-behind state and outlives close(fd). Lazy
+ * mappings keep a resident and a dirty bit per POSIX9_PAGE_SIZE page;
+ * code that uses posix9_mmap_access() reads only the pages it touches
+ * and writes back only the ones it changed. They still take their whole
+ * block at mmap(): with no page faults the pointer cannot be handed out
+ * first and backed later. Eagerly read mappings
+ * cannot see writes through the pointer, so msync() writes back their
+ * whole range.
+ */
+
+#include "posix9.h"
+#include "posix9/mman.h"
+
+/* Mac OS headers */
+#include <Multiverse.h>
+#include "MacCompat.h"      /* Missing definitions for Retro68 */
+#include <string.h>
+
+/* ============================================================
+ * Mapping Table
+ * ============================================================ */
+
+typedef struct {
+    char *          addr;       /* NULL when the slot is free */
+    size_t          length;
+    int             fd;         /* Our dup() of the file, -1 if anonymous */
+    off64_t         offset;     /* File offset of addr[0] */
+    off64_t         fileLen;    /* EOF when mapped - nothing past it is written */
+    int             prot;
+    int             flags;
+    long            pages;
+    unsigned char * resident;   /* Lazy mappings: page has been read */
+    unsigned char * dirty;      /* Lazy mappings: page changed since written */
+} posix9_mapping;
+
+static posix9_mapping   map_table[POSIX9_MMAP_MAX];
+
+#define PAGE_BIT(map, p)        ((map)[(p) >> 3] & (1 << ((p) & 7)))
+#define SET_PAGE_BIT(map, p)    ((map)[(p) >> 3] |= (1 << ((p) & 7)))
+#define CLEAR_PAGE_BIT(map, p)  ((map)[(p) >> 3] &= ~(1 << ((p) & 7)))
+
+/* ============================================================
+ * Internal Helpers
+ * ============================================================ */
+
+static posix9_mapping *alloc_mapping(void)
+{
+    int i;
+
+    for (i = 0; i < POSIX9_MMAP_MAX; i++) {
+        if (map_table[i].addr == NULL) {
+            memset(&map_table[i], 0, sizeof(map_table[i]));
+            map_table[i].fd = -1;
+            return &map_table[i];
+        }
+    }
+
+    errno = ENOMEM;
+    return NULL;
+}
+
+static void free_mapping(posix9_mapping *m)
+{
+    if (m->fd >= 0) close(m->fd);
+    if (m->resident) DisposePtr((Ptr)m->resident);
+    if (m->addr) DisposePtr((Ptr)m->addr);
+    m->addr = NULL;
+    m->resident = NULL;
+    m->dirty = NULL;
+    m->fd = -1;
+}
+
+/* Mapping containing [addr, addr + length), else NULL with ENOMEM */
+static posix9_mapping *find_mapping(const void *addr, size_t length)
+{
+    const char *p = (const char *)addr;
+    int i;
+
+    for (i = 0; i < POSIX9_MMAP_MAX; i++) {
+        posix9_mapping *m = &map_table[i];
+
+        if (m->addr && p >= m->addr && p < m->addr + m->length &&
+            length <= (size_t)(m->addr + m->length - p)) {
+            return m;
+        }
+    }
+
+    errno = ENOMEM;
+    return NULL;
+}
+
+/* Read pages [first, last) with one pread64(); the part past EOF reads as zeros */
+static int read_pages(posix9_mapping *m, long first, long last)
+{
+    long start = first * POSIX9_PAGE_SIZE;
+    long end = last * POSIX9_PAGE_SIZE;
+    ssize_t n;
+
+    if (end > (long)m->length) end = m->length;
+
+    n = pread64(m->fd, m->addr + start, end - start, m->offset + start);
+    if (n < 0) return -1;
+
+    if (n < end - start) {
+        memset(m->addr + start + n, 0, end - start - n);
+    }
+
+    return 0;
+}
+
+/* Write pages [first, last) back with one pwrite64(), stopping at the mapped EOF */
+static int write_pages(posix9_mapping *m, long first, long last)
+{
+    off64_t start = first * (off64_t)POSIX9_PAGE_SIZE;
+    off64_t end = last * (off64_t)POSIX9_PAGE_SIZE;
+    ssize_t n;
+
+    if (end > (off64_t)m->length) end = m->length;
+    if (end > m->fileLen - m->offset) end = m->fileLen - m->offset;
+    if (end <= start) return 0;
+
+    n = pwrite64(m->fd, m->addr + start, end - start, m->offset + start);
+    if (n < 0) return -1;
+    if (n < end - start) {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Page range [*first, *last) covering [addr, addr + length) of m */
+static void page_range(const posix9_mapping *m, const void *addr, size_t length,
+                       long *first, long *last)
+{
+    long start = (const char *)addr - m->addr;
+
+    *first = start / POSIX9_PAGE_SIZE;
+    *last = (start + length + POSIX9_PAGE_SIZE - 1) / POSIX9_PAGE_SIZE;
+    if (*last > m->pages) *last = m->pages;
+}
+
+/* Write back pages [first, last) of a shared mapping */
+static int sync_pages(posix9_mapping *m, long first, long last)
+{
+    long p, run;
+
+    if (!(m->flags & MAP_SHARED) || !(m->prot & PROT_WRITE) || m->fd < 0) {
+        return 0;
+    }
+
+    /* Without dirty bits every page may have changed */
+    if (!m->dirty) {
+        return write_pages(m, first, last);
+    }
+
+    for (p = first; p < last; p = run) {
+        if (!PAGE_BIT(m->dirty, p)) {
+            run = p + 1;
+            continue;
+        }
+        for (run = p; run < last && PAGE_BIT(m->dirty, run); run++) {
+            CLEAR_PAGE_BIT(m->dirty, run);
+        }
+        if (write_pages(m, p, run) != 0) return -1;
+    }
+
+    return 0;
+}
+
+/* ============================================================
+ * Memory Mapping Functions
+ * ============================================================ */
+
+void *mmap64(void *addr, size_t length, int prot, int flags, int fd, off64_t offset)
+{
+    posix9_mapping *m;
+    struct stat64 st;
+    long bitmapBytes;
+
+    (void)addr;     /* Only a hint */
+
+    if (length == 0 || (flags & MAP_FIXED) ||
+        ((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0)) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    m = alloc_mapping();
+    if (!m) return MAP_FAILED;
+
+    m->length = length;
+    m->prot = prot;
+    m->flags = flags;
+    m->pages = (length + POSIX9_PAGE_SIZE - 1) / POSIX9_PAGE_SIZE;
+
+    /* Anonymous memory is zero-filled and has nothing to write back */
+    if (flags & MAP_ANONYMOUS) {
+        m->addr = NewPtrClear(length);
+        if (!m->addr) {
+            errno = ENOMEM;
+            return MAP_FAILED;
+        }
+        m->flags &= ~MAP_POSIX9_LAZY;
+        return m->addr;
+    }
+
+    if (offset < 0 || offset % POSIX9_PAGE_SIZE != 0) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    if (fstat64(fd, &st) != 0) return MAP_FAILED;
+    if (!S_ISREG(st.st_mode)) {
+        errno = ENODEV;
+        return MAP_FAILED;
+    }
+
+    m->fd = dup(fd);
+    if (m->fd < 0) return MAP_FAILED;
+    m->offset = offset;
+    m->fileLen = st.st_size;
+
+    m->addr = NewPtr(length);
+    if (!m->addr) {
+        free_mapping(m);
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+
+    if (flags & MAP_POSIX9_LAZY) {
+        bitmapBytes = (m->pages + 7) / 8;
+        m->resident = (unsigned char *)NewPtrClear(2 * bitmapBytes);
+        if (!m->resident) {
+            free_mapping(m);
+            errno = ENOMEM;
+            return MAP_FAILED;
+        }
+        m->dirty = m->resident + bitmapBytes;
+        return m->addr;
+    }
+
+    if (read_pages(m, 0, m->pages) != 0) {
+        free_mapping(m);
+        if (errno == EBADF) errno = EACCES;     /* fd not open for reading */
+        return MAP_FAILED;
+    }
+
+    return m->addr;
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+    return mmap64(addr, length, prot, flags, fd, offset);
+}
+
+int posix9_mmap_access(void *addr, size_t length, int prot)
+{
+    posix9_mapping *m;
+    long first, last, p, run;
+
+    m = find_mapping(addr, length);
+    if (!m) return -1;
+
+    if ((prot & PROT_WRITE) && !(m->prot & PROT_WRITE)) {
+        errno = EACCES;
+        return -1;
+    }
+
+    if (!m->resident || length == 0) return 0;
+
+    page_range(m, addr, length, &first, &last);
+
+    /* One read per run of missing pages */
+    for (p = first; p < last; p = run) {
+        if (PAGE_BIT(m->resident, p)) {
+            run = p + 1;
+            continue;
+        }
+        for (run = p; run < last && !PAGE_BIT(m->resident, run); run++) {
+            SET_PAGE_BIT(m->resident, run);
+        }
+        if (read_pages(m, p, run) != 0) {
+            while (run-- > p) CLEAR_PAGE_BIT(m->resident, run);
+            return -1;
+        }
+    }
+
+    if (prot & PROT_WRITE) {
+        for (p = first; p < last; p++) {
+            SET_PAGE_BIT(m->dirty, p);
+        }
+    }
+
+    return 0;
+}
+
+int msync(void *addr, size_t length, int flags)
+{
+    posix9_mapping *m;
+    long first, last, p;
+
+    if ((flags & MS_ASYNC) && (flags & MS_SYNC)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    m = find_mapping(addr, length);
+    if (!m) return -1;
+
+    if (((char *)addr - m->addr) % POSIX9_PAGE_SIZE != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    page_range(m, addr, length, &first, &last);
+    if (sync_pages(m, first, last) != 0) return -1;
+
+    if ((flags & MS_INVALIDATE) && m->resident) {
+        for (p = first; p < last; p++) {
+            if (!PAGE_BIT(m->dirty, p)) CLEAR_PAGE_BIT(m->resident, p);
+        }
+    }
+
+    /* MS_SYNC: have the File Manager flush the file and volume too */
+    if ((flags & MS_SYNC) && m->fd >= 0 && (m->flags & MAP_SHARED) &&
+        (m->prot & PROT_WRITE)) {
+        return fsync(m->fd);
+    }
+
+    return 0;
+}
+
+/*
+ * Only whole mappings can be unmapped - the heap block cannot be split.
+ * The mapping is freed even if writing it back fails.
+ */
+int munmap(void *addr, size_t length)
+{
+    posix9_mapping *m;
+    int result;
+
+    m = find_mapping(addr, 0);
+    if (!m || m->addr != (char *)addr || length == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    result = sync_pages(m, 0, m->pages);
+    free_mapping(m);
+
+    return result;
+}
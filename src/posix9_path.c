@@ -8,6 +8,12 @@
  * - POSIX uses / as separator, Mac uses :
  * - POSIX uses / as root, Mac uses volume name
  * - POSIX relative paths start without /, Mac relative start with :
+ * - POSIX names are UTF-8, Mac names one byte per character in the
+ *   system script's encoding
+ *
+ * posix9_path_to_fsspec() does not build a Mac path at all: it walks
+ * the POSIX components itself against a cache of directories
+ * (posix9_pathcache.c), so paths may be up to POSIX9_PATH_MAX long.
  */
 
 #include "posix9.h"
@@ -20,62 +26,435 @@
 /* Default volume name if none specified */
 static char default_volume[64] = "Macintosh HD";
 
-/* Current working directory (Mac path) */
-static char cwd_mac[POSIX9_PATH_MAX] = "";
+/*
+ * Current working directory: a (vRefNum, dirID), and the POSIX path of
+ * its ancestry chain, built when getcwd() first needs it. cwd_ids[k] is
+ * the dirID of the chain's k'th name from the root, so a rename can be
+ * matched against the chain without touching the catalog.
+ */
+#define CWD_MAX_DEPTH   (POSIX9_PATH_MAX / 2)   /* "/x" per level */
+
 static short cwd_vRefNum = 0;
 static long cwd_dirID = 0;
 static Boolean cwd_initialized = false;
+static char cwd_posix[POSIX9_PATH_MAX];
+static size_t cwd_len = 0;
+static size_t cwd_prefix = 0;           /* Length of "/Volumes/Name", if any */
+static long cwd_ids[CWD_MAX_DEPTH];
+static short cwd_depth = 0;
+static Boolean cwd_valid = false;       /* cwd_posix and cwd_ids are current */
+
+/* From posix9_statcache.c */
+extern OSErr posix9_statcache_getcatinfo(short vRefNum, long dirID, ConstStr255Param name,
+                                         CInfoPBRec *pb);
+
+/* From posix9_pathcache.c */
+extern Boolean posix9_pathcache_lookup(short vRefNum, long parID, ConstStr255Param name,
+                                       long *dirID);
+extern Boolean posix9_pathcache_parent(short vRefNum, long dirID, long *parID, StringPtr name);
+extern void posix9_pathcache_enter(short vRefNum, long parID, ConstStr255Param name,
+                                   long dirID);
 
 /* ============================================================
  * Internal Helpers
  * ============================================================ */
 
-/* Forward declarations */
-static void p2cstr(const Str255 pstr, char *cstr, size_t maxlen);
-static void c2pstr(const char *cstr, Str255 pstr);
-
 /* Initialize current working directory */
 static void init_cwd(void)
 {
     OSErr err;
-    FSSpec spec;
-    CInfoPBRec catInfo;
-    Str255 name;
 
     if (cwd_initialized) return;
 
     /* Get the application's directory as initial CWD */
-    err = HGetVol(name, &cwd_vRefNum, &cwd_dirID);
-    if (err == noErr) {
-        /* Build path from volume root */
-        /* For now, just use the volume name */
-        p2cstr(name, cwd_mac, sizeof(cwd_mac));
-    } else {
+    err = HGetVol(NULL, &cwd_vRefNum, &cwd_dirID);
+    if (err != noErr) {
         /* Fallback to root of default volume */
-        strcpy(cwd_mac, default_volume);
         cwd_vRefNum = 0;
         cwd_dirID = fsRtDirID;
     }
 
+    cwd_valid = false;
     cwd_initialized = true;
 }
 
-/* Convert C string to Pascal string (local helper) */
-static void c2pstr(const char *cstr, Str255 pstr)
+/* HFS names compare case-insensitively */
+static unsigned char fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/* ============================================================
+ * Filename Encoding
+ * ============================================================ */
+
+/*
+ * POSIX names are UTF-8; HFS names are single bytes in the system
+ * script's Mac encoding. Both directions are table lookups fused into
+ * the path conversions below, so ASCII costs one load per byte:
+ *   mac_utf8[byte]            -> length and up to 3 UTF-8 bytes
+ *   uni_pages[cp >> 8][cp & 0xFF] -> Mac byte, 0 if it has none
+ * Unmapped pages share one page of zeros, so there is no NULL check.
+ * ':' and '/' swap places inside names, as Mac OS X shows them. Bytes
+ * that are not UTF-8 pass through unchanged, so names written by older
+ * clients in the Mac encoding still resolve.
+ *
+ * Upper halves (0x80-0xFF) of the Mac encodings, in Unicode.
+ */
+
+/* MacRoman */
+static const unsigned short macroman_high[128] = {
+    0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1,
+    0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
+    0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3,
+    0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
+    0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
+    0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8,
+    0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211,
+    0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8,
+    0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB,
+    0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
+    0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
+    0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0xFB01, 0xFB02,
+    0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1,
+    0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+    0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC,
+    0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7
+};
+
+/* Central European */
+static const unsigned short maccentraleur_high[128] = {
+    0x00C4, 0x0100, 0x0101, 0x00C9, 0x0104, 0x00D6, 0x00DC, 0x00E1,
+    0x0105, 0x010C, 0x00E4, 0x010D, 0x0106, 0x0107, 0x00E9, 0x0179,
+    0x017A, 0x010E, 0x00ED, 0x010F, 0x0112, 0x0113, 0x0116, 0x00F3,
+    0x0117, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x011A, 0x011B, 0x00FC,
+    0x2020, 0x00B0, 0x0118, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
+    0x00AE, 0x00A9, 0x2122, 0x0119, 0x00A8, 0x2260, 0x0123, 0x012E,
+    0x012F, 0x012A, 0x2264, 0x2265, 0x012B, 0x0136, 0x2202, 0x2211,
+    0x0142, 0x013B, 0x013C, 0x013D, 0x013E, 0x0139, 0x013A, 0x0145,
+    0x0146, 0x0143, 0x00AC, 0x221A, 0x0144, 0x0147, 0x2206, 0x00AB,
+    0x00BB, 0x2026, 0x00A0, 0x0148, 0x0150, 0x00D5, 0x0151, 0x014C,
+    0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
+    0x014D, 0x0154, 0x0155, 0x0158, 0x2039, 0x203A, 0x0159, 0x0156,
+    0x0157, 0x0160, 0x201A, 0x201E, 0x0161, 0x015A, 0x015B, 0x00C1,
+    0x0164, 0x0165, 0x00CD, 0x017D, 0x017E, 0x016A, 0x00D3, 0x00D4,
+    0x016B, 0x016E, 0x00DA, 0x016F, 0x0170, 0x0171, 0x0172, 0x0173,
+    0x00DD, 0x00FD, 0x0137, 0x017B, 0x0141, 0x017C, 0x0122, 0x02C7
+};
+
+/* Cyrillic */
+static const unsigned short maccyrillic_high[128] = {
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+    0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+    0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+    0x2020, 0x00B0, 0x0490, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x0406,
+    0x00AE, 0x00A9, 0x2122, 0x0402, 0x0452, 0x2260, 0x0403, 0x0453,
+    0x221E, 0x00B1, 0x2264, 0x2265, 0x0456, 0x00B5, 0x0491, 0x0408,
+    0x0404, 0x0454, 0x0407, 0x0457, 0x0409, 0x0459, 0x040A, 0x045A,
+    0x0458, 0x0405, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB,
+    0x00BB, 0x2026, 0x00A0, 0x040B, 0x045B, 0x040C, 0x045C, 0x0455,
+    0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x201E,
+    0x040E, 0x045E, 0x040F, 0x045F, 0x2116, 0x0401, 0x0451, 0x044F,
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+    0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+    0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x20AC
+};
+
+/* Greek */
+static const unsigned short macgreek_high[128] = {
+    0x00C4, 0x00B9, 0x00B2, 0x00C9, 0x00B3, 0x00D6, 0x00DC, 0x0385,
+    0x00E0, 0x00E2, 0x00E4, 0x0384, 0x00A8, 0x00E7, 0x00E9, 0x00E8,
+    0x00EA, 0x00EB, 0x00A3, 0x2122, 0x00EE, 0x00EF, 0x2022, 0x00BD,
+    0x2030, 0x00F4, 0x00F6, 0x00A6, 0x20AC, 0x00F9, 0x00FB, 0x00FC,
+    0x2020, 0x0393, 0x0394, 0x0398, 0x039B, 0x039E, 0x03A0, 0x00DF,
+    0x00AE, 0x00A9, 0x03A3, 0x03AA, 0x00A7, 0x2260, 0x00B0, 0x00B7,
+    0x0391, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x0392, 0x0395, 0x0396,
+    0x0397, 0x0399, 0x039A, 0x039C, 0x03A6, 0x03AB, 0x03A8, 0x03A9,
+    0x03AC, 0x039D, 0x00AC, 0x039F, 0x03A1, 0x2248, 0x03A4, 0x00AB,
+    0x00BB, 0x2026, 0x00A0, 0x03A5, 0x03A7, 0x0386, 0x0388, 0x0153,
+    0x2013, 0x2015, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x0389,
+    0x038A, 0x038C, 0x038E, 0x03AD, 0x03AE, 0x03AF, 0x03CC, 0x038F,
+    0x03CD, 0x03B1, 0x03B2, 0x03C8, 0x03B4, 0x03B5, 0x03C6, 0x03B3,
+    0x03B7, 0x03B9, 0x03BE, 0x03BA, 0x03BB, 0x03BC, 0x03BD, 0x03BF,
+    0x03C0, 0x03CE, 0x03C1, 0x03C3, 0x03C4, 0x03B8, 0x03C9, 0x03C2,
+    0x03C7, 0x03C5, 0x03B6, 0x03CA, 0x03CB, 0x0390, 0x03B0, 0x00AD
+};
+
+/* Turkish */
+static const unsigned short macturkish_high[128] = {
+    0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1,
+    0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
+    0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3,
+    0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
+    0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
+    0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8,
+    0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211,
+    0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8,
+    0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB,
+    0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
+    0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
+    0x00FF, 0x0178, 0x011E, 0x011F, 0x0130, 0x0131, 0x015E, 0x015F,
+    0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1,
+    0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+    0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0xF8A0, 0x02C6, 0x02DC,
+    0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7
+};
+
+/* Croatian */
+static const unsigned short maccroatian_high[128] = {
+    0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1,
+    0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
+    0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3,
+    0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
+    0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
+    0x00AE, 0x0160, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x017D, 0x00D8,
+    0x221E, 0x00B1, 0x2264, 0x2265, 0x2206, 0x00B5, 0x2202, 0x2211,
+    0x220F, 0x0161, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x017E, 0x00F8,
+    0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x0106, 0x00AB,
+    0x010C, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
+    0x0110, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
+    0xF8FF, 0x00A9, 0x2044, 0x20AC, 0x2039, 0x203A, 0x00C6, 0x00BB,
+    0x2013, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x0107, 0x00C1,
+    0x010D, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+    0x0111, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC,
+    0x00AF, 0x03C0, 0x00CB, 0x02DA, 0x00B8, 0x00CA, 0x00E6, 0x02C7
+};
+
+/* Icelandic */
+static const unsigned short macicelandic_high[128] = {
+    0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1,
+    0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
+    0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3,
+    0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
+    0x00DD, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
+    0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8,
+    0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211,
+    0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8,
+    0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB,
+    0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
+    0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
+    0x00FF, 0x0178, 0x2044, 0x20AC, 0x00D0, 0x00F0, 0x00DE, 0x00FE,
+    0x00FD, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1,
+    0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+    0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC,
+    0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7
+};
+
+/* Romanian */
+static const unsigned short macromanian_high[128] = {
+    0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1,
+    0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
+    0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3,
+    0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
+    0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
+    0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x0102, 0x0218,
+    0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211,
+    0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x0103, 0x0219,
+    0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB,
+    0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
+    0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
+    0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0x021A, 0x021B,
+    0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1,
+    0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+    0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC,
+    0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7
+};
+
+typedef struct {
+    int                     encoding;
+    const unsigned short    *high;
+} posix9_charset;
+
+static const posix9_charset charsets[] = {
+    { POSIX9_ENCODING_MACROMAN,      macroman_high },
+    { POSIX9_ENCODING_MACGREEK,      macgreek_high },
+    { POSIX9_ENCODING_MACCYRILLIC,   maccyrillic_high },
+    { POSIX9_ENCODING_MACCENTRALEUR, maccentraleur_high },
+    { POSIX9_ENCODING_MACTURKISH,    macturkish_high },
+    { POSIX9_ENCODING_MACCROATIAN,   maccroatian_high },
+    { POSIX9_ENCODING_MACICELANDIC,  macicelandic_high },
+    { POSIX9_ENCODING_MACROMANIAN,   macromanian_high }
+};
+
+#define NUM_CHARSETS    (int)(sizeof(charsets) / sizeof(charsets[0]))
+#define UNI_POOL_PAGES  12      /* MacRoman needs 10 */
+
+static unsigned char        mac_utf8[256][4];       /* [0] = length */
+static unsigned char        utf8_len[256];          /* Sequence length from the lead byte, 0 = invalid */
+static unsigned char        *uni_pages[256];
+static unsigned char        uni_pool[UNI_POOL_PAGES][256];
+static unsigned char        uni_zero_page[256];
+static int                  name_encoding = -1;     /* -1 = not chosen yet */
+
+/* The encoding of the system script, from the Script Manager */
+static int system_encoding(void)
+{
+    long region = GetScriptManagerVariable(smRegionCode);
+
+    switch (GetScriptManagerVariable(smSysScript)) {
+    case smGreek:               return POSIX9_ENCODING_MACGREEK;
+    case smCyrillic:            return POSIX9_ENCODING_MACCYRILLIC;
+    case smCentralEuroRoman:    return POSIX9_ENCODING_MACCENTRALEUR;
+    case smRoman:
+        /* Roman variants are told apart by region */
+        if (region == verTurkey) return POSIX9_ENCODING_MACTURKISH;
+        if (region == verIceland) return POSIX9_ENCODING_MACICELANDIC;
+        if (region == verCroatia || region == verYugoCroatian) return POSIX9_ENCODING_MACCROATIAN;
+        if (region == verRomania) return POSIX9_ENCODING_MACROMANIAN;
+        break;
+    }
+
+    return POSIX9_ENCODING_MACROMAN;
+}
+
+/* Build both directions' tables for a charset */
+static void build_tables(const posix9_charset *cs)
 {
-    size_t len = strlen(cstr);
-    if (len > 255) len = 255;
-    pstr[0] = (unsigned char)len;
-    memcpy(&pstr[1], cstr, len);
+    unsigned short cp;
+    unsigned char *page;
+    int c, pages = 1;
+
+    for (c = 0; c < 256; c++) {
+        uni_pages[c] = uni_zero_page;
+        utf8_len[c] = (c < 0x80) ? 1 : (c >= 0xC2 && c <= 0xDF) ? 2 :
+                      (c >= 0xE0 && c <= 0xEF) ? 3 : (c >= 0xF0 && c <= 0xF4) ? 4 : 0;
+    }
+    memset(uni_pool, 0, sizeof(uni_pool));
+    uni_pages[0] = uni_pool[0];
+
+    for (c = 0; c < 256; c++) {
+        cp = (c < 0x80) ? c : cs->high[c - 0x80];
+        if (c == ':') cp = '/';
+        else if (c == '/') cp = ':';
+
+        if (cp < 0x80) {
+            mac_utf8[c][0] = 1;
+            mac_utf8[c][1] = (unsigned char)cp;
+        } else if (cp < 0x800) {
+            mac_utf8[c][0] = 2;
+            mac_utf8[c][1] = (unsigned char)(0xC0 | (cp >> 6));
+            mac_utf8[c][2] = (unsigned char)(0x80 | (cp & 0x3F));
+        } else {
+            mac_utf8[c][0] = 3;
+            mac_utf8[c][1] = (unsigned char)(0xE0 | (cp >> 12));
+            mac_utf8[c][2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+            mac_utf8[c][3] = (unsigned char)(0x80 | (cp & 0x3F));
+        }
+
+        page = uni_pages[cp >> 8];
+        if (page == uni_zero_page) {
+            if (pages == UNI_POOL_PAGES) continue;
+            page = uni_pages[cp >> 8] = uni_pool[pages++];
+        }
+        if (c != 0) page[cp & 0xFF] = (unsigned char)c;
+    }
 }
 
-/* Convert Pascal string to C string (local helper) */
-static void p2cstr(const Str255 pstr, char *cstr, size_t maxlen)
+static void init_encoding(void)
 {
-    size_t len = pstr[0];
-    if (len >= maxlen) len = maxlen - 1;
-    memcpy(cstr, &pstr[1], len);
-    cstr[len] = '\0';
+    if (name_encoding < 0) posix9_set_filename_encoding(POSIX9_ENCODING_SYSTEM);
+}
+
+/*
+ * The Mac byte for the UTF-8 sequence at p (a non-ASCII lead byte), 0
+ * if the character has none, and where the next one starts. A byte
+ * that does not start a valid sequence stands for itself.
+ */
+static const unsigned char *decode_utf8(const unsigned char *p, const unsigned char *end,
+                                        unsigned char *mac)
+{
+    unsigned long cp;
+    int n = utf8_len[*p], i;
+
+    if (n == 0 || n > end - p) {
+        *mac = *p;
+        return p + 1;
+    }
+
+    cp = *p & (0x7F >> n);
+    for (i = 1; i < n; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            *mac = *p;
+            return p + 1;
+        }
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+
+    /* Overlong forms are not UTF-8; beyond the BMP has no Mac byte */
+    if ((n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000)) {
+        *mac = *p;
+        return p + 1;
+    }
+    *mac = (cp > 0xFFFF) ? 0 : uni_pages[cp >> 8][cp & 0xFF];
+    return p + n;
+}
+
+/* Append the UTF-8 for Mac byte c at d; NULL if it does not fit before lim */
+static char *put_utf8(char *d, const char *lim, unsigned char c)
+{
+    const unsigned char *s = mac_utf8[c];
+
+    if (s[0] > lim - d) return NULL;
+    if (lim - d >= 3) {
+        /* Room for the longest sequence: copy 3 bytes, keep s[0] */
+        d[0] = s[1];
+        d[1] = s[2];
+        d[2] = s[3];
+    } else {
+        memcpy(d, s + 1, s[0]);
+    }
+
+    return d + s[0];
+}
+
+/*
+ * Convert the UTF-8 name at name (len bytes) to a Pascal string in the
+ * filename encoding. Returns its length, or -1 if it would not fit in
+ * max bytes with the length or has a character the encoding lacks.
+ */
+int posix9_name_to_mac(const char *name, size_t len, StringPtr out, size_t max)
+{
+    const unsigned char *p = (const unsigned char *)name;
+    const unsigned char *end = p + len;
+    unsigned char *d = out + 1;
+    unsigned char *lim = out + max;
+
+    init_encoding();
+
+    while (p < end) {
+        if (d == lim) return -1;
+        if (*p < 0x80) {
+            *d++ = uni_pool[0][*p++];
+        } else {
+            p = decode_utf8(p, end, d);
+            if (*d++ == 0) return -1;
+        }
+    }
+
+    out[0] = (unsigned char)(d - out - 1);
+    return out[0];
+}
+
+/*
+ * Convert a Pascal string in the filename encoding to a UTF-8 C string.
+ * Returns its length, or -1 if it would not fit in size bytes.
+ */
+int posix9_name_from_mac(ConstStr255Param name, char *out, size_t size)
+{
+    char *d = out;
+    int i;
+
+    init_encoding();
+
+    for (i = 1; i <= name[0]; i++) {
+        d = put_utf8(d, out + size - 1, name[i]);
+        if (!d) return -1;
+    }
+    *d = '\0';
+
+    return (int)(d - out);
 }
 
 /* ============================================================
@@ -93,14 +472,19 @@ static void p2cstr(const Str255 pstr, char *cstr, size_t maxlen)
  *   ./foo/bar                   -> :foo:bar
  *   ../foo                      -> ::foo
  *   foo/bar                     -> :foo:bar
+ *   café/a:b                    -> :caf\216:a/b (MacRoman)
+ *
+ * Names are converted to the filename encoding on the way; a character
+ * the encoding lacks becomes '?'.
  */
 char *posix9_path_to_mac(const char *posix_path, char *dst, size_t dst_size)
 {
     static char static_buf[POSIX9_PATH_MAX];
     char *out;
     size_t out_size;
-    const char *p;
+    const char *p, *end;
     char *d;
+    unsigned char c;
 
     /* Use static buffer if no destination provided */
     if (dst == NULL) {
@@ -116,8 +500,10 @@ char *posix9_path_to_mac(const char *posix_path, char *dst, size_t dst_size)
         return out;
     }
 
+    init_encoding();
     d = out;
     p = posix_path;
+    end = p + strlen(p);
 
     /* Handle absolute paths */
     if (*p == '/') {
@@ -165,8 +551,12 @@ char *posix9_path_to_mac(const char *posix_path, char *dst, size_t dst_size)
                 p += 2;
                 if (*p == '/') p++;
             }
+        } else if ((unsigned char)*p < 0x80) {
+            *d++ = uni_pages[0][(unsigned char)*p++];
         } else {
-            *d++ = *p++;
+            p = (const char *)decode_utf8((const unsigned char *)p,
+                                          (const unsigned char *)end, &c);
+            *d++ = c ? c : '?';
         }
     }
 
@@ -188,6 +578,7 @@ char *posix9_path_to_mac(const char *posix_path, char *dst, size_t dst_size)
  *   Macintosh HD:foo        -> /Volumes/Macintosh HD/foo
  *   :foo:bar                -> ./foo/bar
  *   ::foo                   -> ../foo
+ *   :caf\216:a/b            -> ./café/a:b (MacRoman)
  */
 char *posix9_path_from_mac(const char *mac_path, char *dst, size_t dst_size)
 {
@@ -195,7 +586,7 @@ char *posix9_path_from_mac(const char *mac_path, char *dst, size_t dst_size)
     char *out;
     size_t out_size;
     const char *p;
-    char *d;
+    char *d, *next;
 
     /* Use static buffer if no destination provided */
     if (dst == NULL) {
@@ -211,6 +602,7 @@ char *posix9_path_from_mac(const char *mac_path, char *dst, size_t dst_size)
         return out;
     }
 
+    init_encoding();
     d = out;
     p = mac_path;
 
@@ -251,7 +643,9 @@ char *posix9_path_from_mac(const char *mac_path, char *dst, size_t dst_size)
             }
             p++;
         } else {
-            *d++ = *p++;
+            next = put_utf8(d, out + out_size - 1, (unsigned char)*p++);
+            if (!next) break;
+            d = next;
         }
     }
 
@@ -260,33 +654,308 @@ char *posix9_path_from_mac(const char *mac_path, char *dst, size_t dst_size)
     return out;
 }
 
+/* ============================================================
+ * Path Resolution
+ * ============================================================ */
+
+/* Last volume looked up by name, so absolute paths skip the lookup */
+static char root_volume[64] = "";
+static short root_vRefNum = 0;
+
+/* The volume a name refers to */
+static OSErr volume_ref(const char *name, size_t len, short *vRefNum)
+{
+    Str255 vpath;
+    FSSpec spec;
+    OSErr err;
+
+    if (len >= sizeof(root_volume)) return nsvErr;
+    if (strlen(root_volume) == len && memcmp(root_volume, name, len) == 0) {
+        *vRefNum = root_vRefNum;
+        return noErr;
+    }
+
+    /* "Name:" names the volume's root */
+    vpath[0] = (unsigned char)(len + 1);
+    memcpy(vpath + 1, name, len);
+    vpath[len + 1] = ':';
+    err = FSMakeFSSpec(0, 0, vpath, &spec);
+    if (err != noErr) return err;
+
+    memcpy(root_volume, name, len);
+    root_volume[len] = '\0';
+    root_vRefNum = spec.vRefNum;
+    *vRefNum = spec.vRefNum;
+    return noErr;
+}
+
+/* The directory a path component names, from the cache or one catalog lookup */
+static OSErr walk_child(short vRefNum, long parID, ConstStr255Param name, long *dirID)
+{
+    CInfoPBRec catInfo;
+    OSErr err;
+
+    if (posix9_pathcache_lookup(vRefNum, parID, name, dirID)) return noErr;
+
+    err = posix9_statcache_getcatinfo(vRefNum, parID, name, &catInfo);
+    if (err == fnfErr) return dirNFErr;
+    if (err != noErr) return err;
+    if (!(catInfo.hFileInfo.ioFlAttrib & ioDirMask)) return dirNFErr;
+
+    *dirID = catInfo.dirInfo.ioDrDirID;
+    posix9_pathcache_enter(vRefNum, parID, name, *dirID);
+    return noErr;
+}
+
+/* A directory's parent and name, from the cache or one catalog lookup */
+static OSErr walk_parent(short vRefNum, long dirID, long *parID, Str255 name)
+{
+    CInfoPBRec catInfo;
+    OSErr err;
+
+    if (posix9_pathcache_parent(vRefNum, dirID, parID, name)) return noErr;
+
+    memset(&catInfo, 0, sizeof(catInfo));
+    catInfo.dirInfo.ioVRefNum = vRefNum;
+    catInfo.dirInfo.ioDrDirID = dirID;
+    catInfo.dirInfo.ioNamePtr = name;
+    catInfo.dirInfo.ioFDirIndex = -1;   /* The directory itself */
+
+    err = PBGetCatInfoSync(&catInfo);
+    if (err != noErr) return err;
+
+    *parID = catInfo.dirInfo.ioDrParID;
+    posix9_pathcache_enter(vRefNum, *parID, name, dirID);
+    return noErr;
+}
+
 /*
- * Convert POSIX path to FSSpec
+ * Resolve a POSIX path one component at a time, starting from
+ * (vRefNum, dirID) unless it is absolute. Directories on the way come
+ * from the directory cache, ".." goes to the real parent, and only the
+ * leaf is looked up in the catalog, so paths are not limited to the 255
+ * bytes of a Mac pathname. Returns FSMakeFSSpec's results: noErr,
+ * fnfErr with spec naming the missing leaf in its parent, or dirNFErr
+ * if a directory on the way is missing.
  */
-OSErr posix9_path_to_fsspec(const char *path, FSSpec *spec)
+OSErr posix9_path_walk(short vRefNum, long dirID, const char *path, FSSpec *spec)
 {
-    char mac_path[POSIX9_PATH_MAX];
-    Str255 ppath;
+    const char *p, *end;
+    CInfoPBRec catInfo;
+    Str255 name;
+    size_t len;
     OSErr err;
 
-    /* Convert to Mac path */
-    posix9_path_to_mac(path, mac_path, sizeof(mac_path));
+    if (path == NULL || path[0] == '\0') return fnfErr;
+    if (strlen(path) >= POSIX9_PATH_MAX) return bdNamErr;
+
+    p = path;
+    if (*p == '/') {
+        while (*p == '/') p++;
+
+        /* /Volumes/Name/... names a volume; anything else is on the default one */
+        if (strncmp(p, "Volumes/", 8) == 0 && p[8] != '/' && p[8] != '\0') {
+            p += 8;
+            end = strchr(p, '/');
+            if (!end) end = p + strlen(p);
+            if (posix9_name_to_mac(p, end - p, name, sizeof(root_volume)) < 0) return nsvErr;
+            err = volume_ref((const char *)name + 1, name[0], &vRefNum);
+            p = end;
+        } else {
+            err = volume_ref(default_volume, strlen(default_volume), &vRefNum);
+        }
+        if (err != noErr) return err;
+        dirID = fsRtDirID;
+    }
+
+    for (;;) {
+        while (*p == '/') p++;
+        if (*p == '\0') break;
 
-    /* Convert to Pascal string */
-    c2pstr(mac_path, ppath);
+        end = strchr(p, '/');
+        if (!end) end = p + strlen(p);
+        len = end - p;
 
-    /* Make FSSpec */
-    err = FSMakeFSSpec(0, 0, ppath, spec);
+        if (len == 1 && p[0] == '.') {
+            p = end;
+            continue;
+        }
+        if (len == 2 && p[0] == '.' && p[1] == '.') {
+            /* ".." of the root is the root */
+            if (dirID != fsRtDirID) {
+                err = walk_parent(vRefNum, dirID, &dirID, name);
+                if (err != noErr) return err;
+            }
+            p = end;
+            continue;
+        }
 
-    return err;
+        if (posix9_name_to_mac(p, len, name, sizeof(spec->name)) < 0) return bdNamErr;
+
+        if (*end == '\0') {
+            /* The leaf: the only component that has to reach the catalog */
+            spec->vRefNum = vRefNum;
+            spec->parID = dirID;
+            memcpy(spec->name, name, name[0] + 1);
+            return posix9_statcache_getcatinfo(vRefNum, dirID, name, &catInfo);
+        }
+
+        err = walk_child(vRefNum, dirID, name, &dirID);
+        if (err != noErr) return err;
+        p = end;
+    }
+
+    /* The path ends at a directory ("/", "a/..", "a/"): name it in its parent */
+    err = walk_parent(vRefNum, dirID, &spec->parID, name);
+    if (err != noErr) return err;
+    if (name[0] >= sizeof(spec->name)) return bdNamErr;
+    spec->vRefNum = vRefNum;
+    memcpy(spec->name, name, name[0] + 1);
+    return noErr;
+}
+
+/* A directory's parent and name, for code that climbs the tree itself */
+OSErr posix9_path_parent(short vRefNum, long dirID, long *parID, Str255 name)
+{
+    return walk_parent(vRefNum, dirID, parID, name);
+}
+
+/* Where relative paths start */
+void posix9_path_cwd(short *vRefNum, long *dirID)
+{
+    init_cwd();
+
+    *vRefNum = cwd_vRefNum;
+    *dirID = cwd_dirID;
+}
+
+/*
+ * Convert POSIX path to FSSpec
+ */
+OSErr posix9_path_to_fsspec(const char *path, FSSpec *spec)
+{
+    init_cwd();
+
+    return posix9_path_walk(cwd_vRefNum, cwd_dirID, path, spec);
 }
 
 /* ============================================================
  * Current Working Directory
  * ============================================================ */
 
+/*
+ * Build the cwd's POSIX path and ancestry chain by walking parent
+ * dirIDs up to the root - from the directory cache, or one catalog
+ * lookup each - with a "/Volumes/Name" prefix off the default volume.
+ */
+static OSErr build_cwd(void)
+{
+    char *start, *end;
+    char utf8[3 * 255 + 1];
+    Str255 name;
+    long dirID, parID;
+    short depth = 0, k;
+    size_t len;
+    int n;
+    OSErr err;
+
+    /* Names are prepended, so build at the end of the buffer */
+    end = cwd_posix + sizeof(cwd_posix) - 1;
+    *end = '\0';
+    start = end;
+
+    for (dirID = cwd_dirID; dirID != fsRtDirID; dirID = parID) {
+        err = walk_parent(cwd_vRefNum, dirID, &parID, name);
+        if (err != noErr) return err;
+        n = posix9_name_from_mac(name, utf8, sizeof(utf8));
+        if (depth == CWD_MAX_DEPTH || n < 0 || n + 1 > start - cwd_posix) return bdNamErr;
+
+        start -= n;
+        memcpy(start, utf8, n);
+        *--start = '/';
+        cwd_ids[depth++] = dirID;
+    }
+
+    /* The root's name is the volume's */
+    err = walk_parent(cwd_vRefNum, fsRtDirID, &parID, name);
+    if (err != noErr) return err;
+    if (name[0] != strlen(default_volume) ||
+        memcmp(name + 1, default_volume, name[0]) != 0) {
+        n = posix9_name_from_mac(name, utf8, sizeof(utf8));
+        if (n < 0 || n + 9 > start - cwd_posix) return bdNamErr;
+        start -= n;
+        memcpy(start, utf8, n);
+        start -= 9;
+        memcpy(start, "/Volumes/", 9);
+    } else if (depth == 0) {
+        *--start = '/';
+    }
+
+    /* ids were gathered leaf first; the chain runs root first */
+    for (k = 0; k < depth / 2; k++) {
+        dirID = cwd_ids[k];
+        cwd_ids[k] = cwd_ids[depth - 1 - k];
+        cwd_ids[depth - 1 - k] = dirID;
+    }
+
+    len = end - start;
+    memmove(cwd_posix, start, len + 1);
+    cwd_len = len;
+    cwd_depth = depth;
+    cwd_prefix = len;
+    for (k = 0; k < depth; k++) {
+        /* Back up over the k'th name from the leaf */
+        do cwd_prefix--; while (cwd_posix[cwd_prefix] != '/');
+    }
+    cwd_valid = true;
+
+    return noErr;
+}
+
+/*
+ * A directory entry was renamed, moved or removed (NULL name: anything
+ * may have been). The chain is rebuilt only if the entry is one of the
+ * cwd's ancestors or the cwd itself.
+ */
+void posix9_path_dir_changed(short vRefNum, long parID, ConstStr255Param name)
+{
+    char utf8[3 * 255 + 1];
+    const char *p;
+    long parent;
+    short k;
+    int i, n;
+
+    if (!cwd_valid) return;
+    if (name == NULL) {
+        cwd_valid = false;
+        return;
+    }
+    if (vRefNum != cwd_vRefNum) return;
+
+    /* The chain holds UTF-8 */
+    n = posix9_name_from_mac(name, utf8, sizeof(utf8));
+    if (n < 0) return;
+
+    p = cwd_posix + cwd_prefix;
+    for (k = 0; k < cwd_depth; k++) {
+        parent = (k == 0) ? fsRtDirID : cwd_ids[k - 1];
+        p++;    /* Skip '/' */
+        if (parent == parID) {
+            for (i = 0; i < n && fold(p[i]) == fold(utf8[i]); i++) ;
+            if (i == n && (p[i] == '/' || p[i] == '\0')) {
+                cwd_valid = false;
+                return;
+            }
+        }
+        p = strchr(p, '/');
+        if (!p) return;
+    }
+}
+
 char *getcwd(char *buf, size_t size)
 {
+    OSErr err;
+
     init_cwd();
 
     if (buf == NULL) {
@@ -294,13 +963,20 @@ char *getcwd(char *buf, size_t size)
         return NULL;
     }
 
-    if (strlen(cwd_mac) >= size) {
+    if (!cwd_valid) {
+        err = build_cwd();
+        if (err != noErr) {
+            errno = (err == bdNamErr) ? ENAMETOOLONG : posix9_macos_to_errno(err);
+            return NULL;
+        }
+    }
+
+    if (cwd_len >= size) {
         errno = ERANGE;
         return NULL;
     }
 
-    /* Return as POSIX path */
-    posix9_path_from_mac(cwd_mac, buf, size);
+    memcpy(buf, cwd_posix, cwd_len + 1);
 
     return buf;
 }
@@ -310,26 +986,16 @@ int chdir(const char *path)
     FSSpec spec;
     CInfoPBRec catInfo;
     OSErr err;
-    char mac_path[POSIX9_PATH_MAX];
-
-    /* Convert to Mac path */
-    posix9_path_to_mac(path, mac_path, sizeof(mac_path));
 
     /* Get FSSpec */
     err = posix9_path_to_fsspec(path, &spec);
-    if (err != noErr && err != fnfErr) {
+    if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
     }
 
     /* Verify it's a directory */
-    memset(&catInfo, 0, sizeof(catInfo));
-    catInfo.hFileInfo.ioVRefNum = spec.vRefNum;
-    catInfo.hFileInfo.ioDirID = spec.parID;
-    catInfo.hFileInfo.ioNamePtr = spec.name;
-    catInfo.hFileInfo.ioFDirIndex = 0;
-
-    err = PBGetCatInfoSync(&catInfo);
+    err = posix9_statcache_getcatinfo(spec.vRefNum, spec.parID, spec.name, &catInfo);
     if (err != noErr) {
         errno = posix9_macos_to_errno(err);
         return -1;
@@ -340,11 +1006,10 @@ int chdir(const char *path)
         return -1;
     }
 
-    /* Update CWD */
-    strncpy(cwd_mac, mac_path, sizeof(cwd_mac) - 1);
-    cwd_mac[sizeof(cwd_mac) - 1] = '\0';
+    /* Update CWD; getcwd() builds the new chain when asked */
     cwd_vRefNum = spec.vRefNum;
     cwd_dirID = catInfo.dirInfo.ioDrDirID;
+    cwd_valid = false;
 
     /* Set Mac OS working directory */
     HSetVol(NULL, cwd_vRefNum, cwd_dirID);
@@ -372,3 +1037,40 @@ const char *posix9_get_default_volume(void)
 {
     return default_volume;
 }
+
+/* ============================================================
+ * Filename Encoding Configuration
+ * ============================================================ */
+
+/*
+ * Set the Mac encoding HFS names are in (POSIX9_ENCODING_SYSTEM: the
+ * system script's, which is what is used until this is called)
+ */
+int posix9_set_filename_encoding(int encoding)
+{
+    int i;
+
+    if (encoding == POSIX9_ENCODING_SYSTEM) encoding = system_encoding();
+
+    for (i = 0; i < NUM_CHARSETS; i++) {
+        if (charsets[i].encoding == encoding) {
+            build_tables(&charsets[i]);
+            name_encoding = encoding;
+            cwd_valid = false;      /* Its names were converted with the old tables */
+            return 0;
+        }
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+/*
+ * Get the Mac encoding HFS names are in
+ */
+int posix9_get_filename_encoding(void)
+{
+    init_encoding();
+
+    return name_encoding;
+}
@@ -0,0 +1,333 @@
+/*
+ * posix9_pathcache.c - Directory entry cache for path resolution
+ *
+ * posix9_path.c resolves a path one component at a time, and every
+ * directory on the way is a catalog lookup of (parent dirID, name).
+ * Servers resolve the same few paths over and over, so the directories
+ * found are kept in a small LRU table of (vRefNum, parent dirID, name)
+ * -> dirID entries:
+ *   name chains  -> the directory a component names, in one or two compares
+ *   dirID chains -> a directory's parent and name, for ".." and FSSpecs
+ *   LRU list     -> the least recently used entry is recycled when full
+ *
+ * A warm lookup of a deep path then reaches the File Manager only for
+ * its leaf. Directory IDs never change, so moving or renaming a
+ * directory only stales the one entry naming it: rename() and rmdir()
+ * drop it, and everything below it stays valid. posix9_path.c hears of
+ * each one too, in case it was on the cwd's ancestry chain. Only directories that
+ * exist are entered, and ASCII case is folded as HFS does.
+ */
+
+#include "posix9.h"
+
+/* Mac OS headers */
+#include <Multiverse.h>
+#include "MacCompat.h"      /* Missing definitions for Retro68 */
+#include <string.h>
+
+/* From posix9_path.c */
+extern void posix9_path_dir_changed(short vRefNum, long parID, ConstStr255Param name);
+
+/* ============================================================
+ * Cache Table
+ * ============================================================ */
+
+typedef struct {
+    short       vRefNum;        /* Key: volume */
+    long        parID;          /* Key: parent directory ID */
+    Str63       name;           /* Key: name in the parent (Pascal) */
+    long        dirID;          /* The directory it names */
+    unsigned long hash;         /* Hash of the key */
+    short       nameNext;       /* Next entry in the name bucket, -1 = end */
+    short       idNext;         /* Next entry in the dirID bucket, -1 = end */
+    short       lruPrev;        /* Towards most recently used, -1 = head */
+    short       lruNext;        /* Towards least recently used, -1 = tail */
+    Boolean     inUse;
+} posix9_dentry;
+
+#define PATHCACHE_BUCKETS   64      /* Power of two */
+
+static posix9_dentry        dentry_table[POSIX9_PATHCACHE_SIZE];
+static short                name_buckets[PATHCACHE_BUCKETS];
+static short                id_buckets[PATHCACHE_BUCKETS];
+static short                path_lru_head = -1;     /* Most recently used */
+static short                path_lru_tail = -1;     /* Next to recycle */
+static short                path_count = 0;
+static unsigned long        path_hits = 0;
+static unsigned long        path_misses = 0;
+static unsigned long        path_evictions = 0;
+static Boolean              path_initialized = false;
+
+/* ============================================================
+ * Internal Helpers
+ * ============================================================ */
+
+static void init_path_table(void)
+{
+    int i;
+
+    if (path_initialized) return;
+
+    for (i = 0; i < PATHCACHE_BUCKETS; i++) {
+        name_buckets[i] = -1;
+        id_buckets[i] = -1;
+    }
+    for (i = 0; i < POSIX9_PATHCACHE_SIZE; i++) {
+        dentry_table[i].inUse = false;
+    }
+    path_lru_head = path_lru_tail = -1;
+    path_count = 0;
+
+    path_initialized = true;
+}
+
+static unsigned char fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static unsigned long key_hash(short vRefNum, long parID, ConstStr255Param name)
+{
+    unsigned long h = 2166136261UL;     /* FNV-1a */
+    int i;
+
+    h = (h ^ (unsigned short)vRefNum) * 16777619UL;
+    h = (h ^ (unsigned long)parID) * 16777619UL;
+    for (i = 1; i <= name[0]; i++) {
+        h = (h ^ fold(name[i])) * 16777619UL;
+    }
+
+    return h;
+}
+
+static short *id_bucket(long dirID)
+{
+    return &id_buckets[(unsigned long)dirID & (PATHCACHE_BUCKETS - 1)];
+}
+
+static Boolean key_equal(const posix9_dentry *e, short vRefNum, long parID,
+                         ConstStr255Param name)
+{
+    int i;
+
+    if (e->vRefNum != vRefNum || e->parID != parID || e->name[0] != name[0]) {
+        return false;
+    }
+    for (i = 1; i <= name[0]; i++) {
+        if (fold(e->name[i]) != fold(name[i])) return false;
+    }
+
+    return true;
+}
+
+static int find_name(short vRefNum, long parID, ConstStr255Param name, unsigned long hash)
+{
+    int i;
+
+    for (i = name_buckets[hash & (PATHCACHE_BUCKETS - 1)]; i >= 0;
+         i = dentry_table[i].nameNext) {
+        if (dentry_table[i].hash == hash &&
+            key_equal(&dentry_table[i], vRefNum, parID, name)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int find_id(short vRefNum, long dirID)
+{
+    int i;
+
+    for (i = *id_bucket(dirID); i >= 0; i = dentry_table[i].idNext) {
+        if (dentry_table[i].dirID == dirID && dentry_table[i].vRefNum == vRefNum) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void lru_unlink(int i)
+{
+    posix9_dentry *e = &dentry_table[i];
+
+    if (e->lruPrev >= 0) dentry_table[e->lruPrev].lruNext = e->lruNext;
+    else path_lru_head = e->lruNext;
+    if (e->lruNext >= 0) dentry_table[e->lruNext].lruPrev = e->lruPrev;
+    else path_lru_tail = e->lruPrev;
+}
+
+static void lru_push_front(int i)
+{
+    posix9_dentry *e = &dentry_table[i];
+
+    e->lruPrev = -1;
+    e->lruNext = path_lru_head;
+    if (path_lru_head >= 0) dentry_table[path_lru_head].lruPrev = i;
+    path_lru_head = i;
+    if (path_lru_tail < 0) path_lru_tail = i;
+}
+
+static void touch(int i)
+{
+    if (path_lru_head == i) return;
+    lru_unlink(i);
+    lru_push_front(i);
+}
+
+static void remove_entry(int i)
+{
+    posix9_dentry *e = &dentry_table[i];
+    short *link;
+
+    link = &name_buckets[e->hash & (PATHCACHE_BUCKETS - 1)];
+    while (*link != i) {
+        link = &dentry_table[*link].nameNext;
+    }
+    *link = e->nameNext;
+
+    link = id_bucket(e->dirID);
+    while (*link != i) {
+        link = &dentry_table[*link].idNext;
+    }
+    *link = e->idNext;
+
+    lru_unlink(i);
+    e->inUse = false;
+    path_count--;
+}
+
+/* A free entry, recycling the least recently used one if the table is full */
+static int take_entry(void)
+{
+    int i;
+
+    if (path_count < POSIX9_PATHCACHE_SIZE) {
+        for (i = 0; i < POSIX9_PATHCACHE_SIZE; i++) {
+            if (!dentry_table[i].inUse) return i;
+        }
+    }
+
+    i = path_lru_tail;
+    remove_entry(i);
+    path_evictions++;
+    return i;
+}
+
+/* ============================================================
+ * Internal Interface (posix9_path.c, posix9_file.c, posix9_dir.c)
+ * ============================================================ */
+
+/* The dirID of directory name in parID, if cached */
+Boolean posix9_pathcache_lookup(short vRefNum, long parID, ConstStr255Param name,
+                                long *dirID)
+{
+    int i;
+
+    init_path_table();
+
+    i = find_name(vRefNum, parID, name, key_hash(vRefNum, parID, name));
+    if (i < 0) {
+        path_misses++;
+        return false;
+    }
+
+    path_hits++;
+    touch(i);
+    *dirID = dentry_table[i].dirID;
+    return true;
+}
+
+/* A directory's parent and name, if cached */
+Boolean posix9_pathcache_parent(short vRefNum, long dirID, long *parID, StringPtr name)
+{
+    int i;
+
+    init_path_table();
+
+    i = find_id(vRefNum, dirID);
+    if (i < 0) {
+        path_misses++;
+        return false;
+    }
+
+    path_hits++;
+    touch(i);
+    *parID = dentry_table[i].parID;
+    memcpy(name, dentry_table[i].name, dentry_table[i].name[0] + 1);
+    return true;
+}
+
+/* Remember that name in parID is directory dirID */
+void posix9_pathcache_enter(short vRefNum, long parID, ConstStr255Param name, long dirID)
+{
+    posix9_dentry *e;
+    unsigned long hash;
+    int i;
+
+    if (name[0] >= sizeof(e->name)) return;
+
+    init_path_table();
+
+    /* A directory has one name; drop any other entry for it */
+    i = find_id(vRefNum, dirID);
+    if (i >= 0) remove_entry(i);
+
+    hash = key_hash(vRefNum, parID, name);
+    i = find_name(vRefNum, parID, name, hash);
+    if (i >= 0) remove_entry(i);
+
+    i = take_entry();
+    e = &dentry_table[i];
+    e->vRefNum = vRefNum;
+    e->parID = parID;
+    memcpy(e->name, name, name[0] + 1);
+    e->dirID = dirID;
+    e->hash = hash;
+    e->inUse = true;
+
+    e->nameNext = name_buckets[hash & (PATHCACHE_BUCKETS - 1)];
+    name_buckets[hash & (PATHCACHE_BUCKETS - 1)] = i;
+    e->idNext = *id_bucket(dirID);
+    *id_bucket(dirID) = i;
+    lru_push_front(i);
+    path_count++;
+}
+
+/* Forget (vRefNum, parID, name) - it was renamed, moved or removed */
+void posix9_pathcache_invalidate(short vRefNum, long parID, ConstStr255Param name)
+{
+    int i;
+
+    /* The cwd's ancestry may run through it */
+    posix9_path_dir_changed(vRefNum, parID, name);
+
+    if (!path_initialized || path_count == 0) return;
+
+    i = find_name(vRefNum, parID, name, key_hash(vRefNum, parID, name));
+    if (i >= 0) remove_entry(i);
+}
+
+/* ============================================================
+ * Public Interface
+ * ============================================================ */
+
+void posix9_pathcache_stats(posix9_cache_stats *stats)
+{
+    if (!stats) return;
+
+    stats->hits = path_hits;
+    stats->misses = path_misses;
+    stats->evictions = path_evictions;
+    stats->entries = path_count;
+    stats->capacity = POSIX9_PATHCACHE_SIZE;
+}
+
+/* Drop every entry; the counters keep running */
+void posix9_pathcache_flush(void)
+{
+    posix9_path_dir_changed(0, 0, NULL);
+    path_initialized = false;
+    init_path_table();
+}
@@ -10,20 +10,50 @@
  *   send()     -> OTSnd
  *   recv()     -> OTRcv
  *   close()    -> OTCloseProvider
- *   select()   -> OTLook + polling
+ *   poll()     -> notifier flags + event list (posix9_fd.c)
+ *   select()   -> poll()
+ *   sendfile() -> pread64 into OTAllocMem blocks + OTSnd with OTAckSends
+ *   posix9_recv_zc() -> OTRcv with kOTNetbufDataIsOTBufferStar
+ *   sendmsg()  -> OTSnd of an OTData chain (kNetbufDataIsOTData)
+ *   recvmsg()  -> OTRcv per piece
  *
  * Open Transport is inherently async; we wrap it for blocking semantics.
+ * Endpoints are always in OT's non-blocking mode, so no OT call holds
+ * the whole application. A blocking recv(), send(), accept() or
+ * connect() that would have to wait stops the calling thread instead,
+ * and the notifier readies that thread when the socket's state changes,
+ * as aio_suspend() is readied from the File Manager completion routine.
+ * SO_RCVTIMEO and SO_SNDTIMEO bound the wait to the microsecond.
+ *
+ * Endpoints are synchronous unless posix9_set_socket_async() says
+ * otherwise. A synchronous OTBind, OTUnbind or OTAccept returns only
+ * once OT is done, which for OTAccept means the peer's handshake; an
+ * asynchronous one returns at once and the notifier passes on its
+ * completion event, for which the caller parks. The notifier also moves
+ * each socket through connect() and the peer's orderly release; on a
+ * synchronous endpoint it may not call OT, so OTRcvConnect and
+ * OTRcvOrderlyDisconnect wait for the next call on the socket.
+ *
+ * The notifier also puts each socket it changes on an OT atomic list,
+ * which poll() and select() drain: a wait looks only at the sockets on
+ * it, not at every socket it was given. Sockets in epoll sets are
+ * queued on each set as well (posix9_epoll.c).
  */
 
 #include "posix9.h"
 #include "posix9/socket.h"
+#include "posix9_fd.h"
 
 /* Mac OS headers - Multiverse for core, stubs for OT */
 #include <Multiverse.h>
 #include "MacCompat.h"              /* Missing definitions for Retro68 */
 #include "OpenTransport.h"          /* Our stub for cross-compilation */
 #include "OpenTransportProviders.h"
+#include "Threads.h"
 #include <string.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <limits.h>
 
 /* ECANCELED might not be defined in newlib */
 #ifndef ECANCELED
@@ -34,7 +64,15 @@
  * Socket Table
  * ============================================================ */
 
+/* Where a connect() stands; the notifier moves it along */
+enum {
+    CONNECT_NONE,                   /* None in progress */
+    CONNECT_SENT,                   /* OTConnect sent, no answer yet */
+    CONNECT_ANSWERED                /* T_CONNECT came; OTRcvConnect is owed */
+};
+
 typedef struct {
+    posix9_fd_desc  desc;           /* Shared by dup()ed descriptors - must be first */
     EndpointRef     ep;             /* Open Transport endpoint */
     int             domain;         /* AF_INET, etc. */
     int             type;           /* SOCK_STREAM, etc. */
@@ -44,21 +82,49 @@ typedef struct {
     Boolean         listening;      /* In listen mode */
     Boolean         connected;      /* Connection established */
     Boolean         nonblocking;    /* Non-blocking mode */
+    Boolean         async;          /* Endpoint in OT's asynchronous mode */
+    volatile short  connectState;   /* CONNECT_* */
+    volatile Boolean ordrelPending; /* T_ORDREL not yet acknowledged */
+    volatile OTEventCode completed; /* Last completion event (asynchronous) */
+    volatile OTResult completeResult; /* Its result */
     TEndpointInfo   info;           /* Endpoint info */
     InetAddress     localAddr;      /* Local address */
     InetAddress     peerAddr;       /* Remote address */
-    OTResult        asyncError;     /* Last async error */
+    int             asyncError;     /* Pending SO_ERROR, as an errno */
     Boolean         readable;       /* Data available */
     Boolean         writable;       /* Can write */
     Boolean         hasOOB;         /* OOB data available */
+    Boolean         hungUp;         /* Connection broken (T_DISCONNECT) */
+    OTLink          eventLink;      /* On socket_events */
+    volatile Boolean queued;        /* eventLink is on socket_events */
+    struct posix9_epoll_item *interest; /* epoll sets watching it */
+    posix9_fd_waiter * volatile waiter; /* Blocking call parked on it */
+    struct posix9_send_block * volatile ackBlocks; /* sendfile()'s, while OTAckSends is on */
+    struct timeval  rcvTimeout;     /* SO_RCVTIMEO; zero waits forever */
+    struct timeval  sndTimeout;     /* SO_SNDTIMEO */
+    int             nextFree;       /* Free list link while unused */
 } posix9_socket_entry;
 
 #define MAX_SOCKETS 128
-#define SOCKET_FD_BASE 1000         /* Socket FDs start at 1000 */
 
 static posix9_socket_entry socket_table[MAX_SOCKETS];
+static int socket_free_head = -1;
 static Boolean socket_table_initialized = false;
 static Boolean ot_initialized = false;
+static OTLIFO socket_events;        /* Sockets changed since the last drain */
+
+/* Descriptor operations, defined below */
+static const posix9_fd_ops socket_fd_ops;
+static void release_socket(posix9_socket_entry *sock);
+static posix9_fd_desc *drain_events(void);
+static int ot_error_to_errno(OTResult err);
+
+/* From posix9_epoll.c */
+extern void posix9_epoll_notify(struct posix9_epoll_item *interest);
+extern void posix9_epoll_forget(struct posix9_epoll_item **interest);
+
+/* From posix9_file.c */
+extern long posix9_iov_total(const struct iovec *iov, int iovcnt);
 
 /* DNS result storage */
 static struct hostent   dns_result;
@@ -80,19 +146,12 @@ static OSStatus init_open_transport(void)
     err = InitOpenTransportInContext(kInitOTForApplicationMask, NULL);
     if (err == noErr) {
         ot_initialized = true;
+        posix9_fd_event_source(drain_events);
     }
 
     return err;
 }
 
-static void cleanup_open_transport(void)
-{
-    if (ot_initialized) {
-        CloseOpenTransportInContext(NULL);
-        ot_initialized = false;
-    }
-}
-
 /* ============================================================
  * Socket Table Management
  * ============================================================ */
@@ -106,113 +165,428 @@ static void init_socket_table(void)
     for (i = 0; i < MAX_SOCKETS; i++) {
         socket_table[i].inUse = false;
         socket_table[i].ep = kOTInvalidEndpointRef;
+        socket_table[i].nextFree = i + 1 < MAX_SOCKETS ? i + 1 : -1;
     }
+    socket_free_head = 0;
 
     socket_table_initialized = true;
 }
 
+/* Take a socket entry off the free list and give it a descriptor */
 static int alloc_socket(void)
 {
-    int i;
+    posix9_socket_entry *sock;
+    OTLink eventLink;
+    Boolean queued;
+    int idx, fd;
 
     init_socket_table();
 
-    for (i = 0; i < MAX_SOCKETS; i++) {
-        if (!socket_table[i].inUse) {
-            memset(&socket_table[i], 0, sizeof(posix9_socket_entry));
-            socket_table[i].inUse = true;
-            socket_table[i].ep = kOTInvalidEndpointRef;
-            return SOCKET_FD_BASE + i;
-        }
+    idx = socket_free_head;
+    if (idx < 0) {
+        errno = EMFILE;
+        return -1;
     }
 
-    errno = EMFILE;
-    return -1;
+    /* Reset the entry first - binding the descriptor counts a reference.
+     * One closed while on socket_events is still linked there. */
+    sock = &socket_table[idx];
+    socket_free_head = sock->nextFree;
+    eventLink = sock->eventLink;
+    queued = sock->queued;
+    memset(sock, 0, sizeof(posix9_socket_entry));
+    sock->eventLink = eventLink;
+    sock->queued = queued;
+    sock->inUse = true;
+    sock->ep = kOTInvalidEndpointRef;
+    sock->nextFree = -1;
+
+    fd = posix9_fd_alloc(0, &socket_fd_ops, sock);
+    if (fd < 0) {
+        release_socket(sock);
+        return -1;
+    }
+
+    return fd;
 }
 
-static void free_socket(int fd)
+/* Put a socket entry back on the free list */
+static void release_socket(posix9_socket_entry *sock)
 {
-    int idx = fd - SOCKET_FD_BASE;
-    if (idx >= 0 && idx < MAX_SOCKETS) {
-        socket_table[idx].inUse = false;
-        socket_table[idx].ep = kOTInvalidEndpointRef;
-    }
+    sock->inUse = false;
+    sock->ep = kOTInvalidEndpointRef;
+    sock->nextFree = socket_free_head;
+    socket_free_head = sock - socket_table;
 }
 
-static posix9_socket_entry *get_socket(int fd)
+static void free_socket(int fd)
 {
-    int idx = fd - SOCKET_FD_BASE;
-
-    if (idx < 0 || idx >= MAX_SOCKETS) {
-        errno = EBADF;
-        return NULL;
-    }
+    posix9_socket_entry *sock;
 
-    if (!socket_table[idx].inUse) {
-        errno = EBADF;
-        return NULL;
+    sock = (posix9_socket_entry *)posix9_fd_object(fd, &socket_fd_ops);
+    if (sock) {
+        release_socket(sock);
+        posix9_fd_release(fd);
     }
+}
 
-    return &socket_table[idx];
+static posix9_socket_entry *get_socket(int fd)
+{
+    return (posix9_socket_entry *)posix9_fd_object(fd, &socket_fd_ops);
 }
 
 /* Check if fd is a socket */
 Boolean posix9_is_socket(int fd)
 {
-    int idx = fd - SOCKET_FD_BASE;
-    return (idx >= 0 && idx < MAX_SOCKETS && socket_table[idx].inUse);
+    return fd >= 0 && fd < POSIX9_OPEN_MAX &&
+           posix9_fd_ops_of(fd) == &socket_fd_ops;
+}
+
+/* The epoll sets watching socket fd, and its endpoint; NULL if fd is
+ * not a socket (posix9_epoll.c) */
+struct posix9_epoll_item **posix9_socket_interest(int fd, EndpointRef *ep)
+{
+    posix9_socket_entry *sock;
+
+    if (!posix9_is_socket(fd)) return NULL;
+
+    sock = get_socket(fd);
+    *ep = sock->ep;
+    return &sock->interest;
 }
 
 /* ============================================================
  * Open Transport Notifier (for async events)
  * ============================================================ */
 
+/*
+ * A block of a no-copy sendfile(). OT holds on to it from OTSnd until
+ * T_MEMORYRELEASED names it as the cookie; data must be first so the
+ * cookie (the buffer passed to OTSnd) is the block itself.
+ */
+typedef struct posix9_send_block {
+    OTData          data;           /* Must be first */
+    char *          buf;
+    volatile short  pending;        /* Sends OT has not released */
+} posix9_send_block;
+
+#define POSIX9_SENDFILE_BLOCK   16384   /* Bytes read and sent at a time */
+#define POSIX9_SENDFILE_BLOCKS  4       /* Blocks OT may hold at once */
+
+/*
+ * The sendfile() block a T_MEMORYRELEASED cookie names, or NULL. Other
+ * sends wait while OTAckSends is on, so there should be no other
+ * cookie, but a stray one must not be written through.
+ */
+static posix9_send_block *acked_block(posix9_socket_entry *sock, void *cookie)
+{
+    posix9_send_block *blocks = sock->ackBlocks;
+    int i;
+
+    if (!blocks) return NULL;
+    for (i = 0; i < POSIX9_SENDFILE_BLOCKS; i++) {
+        if (cookie == &blocks[i]) return &blocks[i];
+    }
+    return NULL;
+}
+
+/* Ready the thread parked in sock_wait(), if any */
+static void wake_waiter(posix9_socket_entry *sock)
+{
+    posix9_fd_waiter *waiter = sock->waiter;
+
+    if (waiter) posix9_fd_wake(waiter);
+}
+
+/*
+ * List sock for poll() and select(), once until they drain it, and
+ * for the epoll sets watching it; wake whichever thread waits on it
+ * in a blocking call, poll() or posix9_epoll_wait(), and no other.
+ */
+static void queue_event(posix9_socket_entry *sock)
+{
+    if (!sock->queued) {
+        sock->queued = true;
+        OTLIFOEnqueue(&socket_events, &sock->eventLink);
+    }
+    posix9_fd_notify(&sock->desc);
+    if (sock->interest) posix9_epoll_notify(sock->interest);
+    wake_waiter(sock);
+}
+
+/*
+ * Take the sockets listed since the last call, oldest first, linked
+ * through desc.readyNext. Each is unmarked before its state is looked
+ * at, so an event from here on lists it again.
+ */
+static posix9_fd_desc *drain_events(void)
+{
+    OTLink *link, *next;
+    posix9_socket_entry *sock;
+    posix9_fd_desc *list = NULL;
+
+    for (link = OTLIFOStealList(&socket_events); link != NULL; link = next) {
+        next = link->fNext;
+        sock = (posix9_socket_entry *)((char *)link - offsetof(posix9_socket_entry, eventLink));
+        sock->queued = false;
+        if (sock->inUse) {
+            sock->desc.readyNext = list;
+            list = &sock->desc;
+        }
+    }
+
+    return list;
+}
+
 static pascal void socket_notifier(void *context, OTEventCode event,
                                    OTResult result, void *cookie)
 {
     posix9_socket_entry *sock = (posix9_socket_entry *)context;
-
-    (void)cookie;
+    posix9_send_block *b;
 
     if (!sock) return;
 
     switch (event) {
         case T_DATA:
             sock->readable = true;
+            queue_event(sock);
             break;
 
         case T_GODATA:
             sock->writable = true;
+            queue_event(sock);
+            break;
+
+        case T_MEMORYRELEASED:
+            /* OT is done with a block sent under OTAckSends */
+            b = acked_block(sock, cookie);
+            if (b) {
+                b->pending--;
+                wake_waiter(sock);
+            }
             break;
 
         case T_EXDATA:
             sock->hasOOB = true;
+            queue_event(sock);
             break;
 
         case T_CONNECT:
-            sock->connected = true;
-            sock->asyncError = result;
+            /* An asynchronous endpoint collects the answer here; a
+             * synchronous one leaves it to finish_connect() */
+            if (result == kOTNoError && sock->async) result = OTRcvConnect(sock->ep, NULL);
+            if (result != kOTNoError) {
+                sock->asyncError = ot_error_to_errno(result);
+                sock->hungUp = true;
+                sock->connectState = CONNECT_NONE;
+            } else if (sock->async) {
+                sock->connected = true;
+                sock->connectState = CONNECT_NONE;
+            } else {
+                sock->connectState = CONNECT_ANSWERED;
+            }
+            queue_event(sock);
             break;
 
         case T_DISCONNECT:
+            /* A refused connect(), or a broken connection. A
+             * synchronous endpoint acknowledges it in the next read. */
+            if (sock->connectState == CONNECT_SENT) sock->asyncError = ECONNREFUSED;
+            if (sock->async) OTRcvDisconnect(sock->ep, NULL);
+            sock->connectState = CONNECT_NONE;
+            sock->hungUp = true;
+            sock->connected = false;
+            queue_event(sock);
+            break;
+
         case T_ORDREL:
+            /* The peer is done sending: a read sees the end. A
+             * synchronous endpoint acknowledges it in that read. */
+            if (sock->async) OTRcvOrderlyDisconnect(sock->ep);
+            else sock->ordrelPending = true;
+            sock->readable = true;
             sock->connected = false;
+            queue_event(sock);
             break;
 
         case T_LISTEN:
             /* Incoming connection available */
             sock->readable = true;
+            queue_event(sock);
             break;
 
         case T_PASSCON:
             /* Connection passed to new endpoint */
             break;
 
+        case T_BINDCOMPLETE:
+        case T_UNBINDCOMPLETE:
+        case T_ACCEPTCOMPLETE:
+            /* An asynchronous call is done: hand its result to ot_complete() */
+            sock->completeResult = result;
+            sock->completed = event;
+            wake_waiter(sock);
+            break;
+
         default:
             break;
     }
 }
 
+/*
+ * Wait until ready(sock, arg) holds, or for timeout (SO_RCVTIMEO or
+ * SO_SNDTIMEO; NULL or zero waits forever). The thread parks and the
+ * notifier readies it; it is published as the waiter before the first
+ * check, so an event between a check and the stop is not lost. A second
+ * thread waiting on the same socket (a send() while another thread's
+ * recv() is parked) yields instead, as poll() does on an object another
+ * poll() watches, and leaves the first one's wake-ups alone. Returns
+ * false if the time ran out first.
+ */
+static Boolean sock_wait(posix9_socket_entry *sock,
+                         Boolean (*ready)(posix9_socket_entry *, void *), void *arg,
+                         const struct timeval *timeout)
+{
+    posix9_fd_waiter wait;
+    Boolean blind, ok = true;
+
+    if (timeout && timeout->tv_sec == 0 && timeout->tv_usec == 0) timeout = NULL;
+
+    posix9_fd_wait_begin(&wait, timeout);
+    blind = sock->waiter != NULL;
+    if (!blind) sock->waiter = &wait;
+
+    while (!ready(sock, arg)) {
+        if (blind) {
+            SystemTask();
+            YieldToAnyThread();
+            if (wait.expired) {
+                ok = ready(sock, arg);
+                break;
+            }
+        } else if (!posix9_fd_park(&wait)) {
+            ok = ready(sock, arg);
+            break;
+        }
+    }
+
+    if (!blind) sock->waiter = NULL;
+    posix9_fd_wait_end(&wait);
+
+    return ok;
+}
+
+/* Whether a call on sock may wait: not if non-blocking, or asked not to */
+static Boolean may_wait(posix9_socket_entry *sock, int flags)
+{
+    return !sock->nonblocking && !(flags & MSG_DONTWAIT);
+}
+
+static Boolean sock_readable(posix9_socket_entry *sock, void *arg)
+{
+    (void)arg;
+    return sock->readable || sock->hungUp || !sock->connected;
+}
+
+static Boolean sock_writable(posix9_socket_entry *sock, void *arg)
+{
+    (void)arg;
+    return sock->writable || !sock->connected;
+}
+
+/* No sendfile() has OTAckSends on */
+static Boolean sock_acks_off(posix9_socket_entry *sock, void *arg)
+{
+    (void)arg;
+    return sock->ackBlocks == NULL || !sock->connected;
+}
+
+/*
+ * OTAckSends is for the whole endpoint, so while a sendfile() has it on
+ * OT would keep any other send's buffer rather than copy it. Other
+ * sends wait for it to go off, or fail with EAGAIN if they may not.
+ */
+static int await_acks_off(posix9_socket_entry *sock, int flags)
+{
+    if (!sock->ackBlocks) return 0;
+
+    if (!may_wait(sock, flags) ||
+        !sock_wait(sock, sock_acks_off, NULL, &sock->sndTimeout)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+/* A connection to accept (T_LISTEN) */
+static Boolean sock_incoming(posix9_socket_entry *sock, void *arg)
+{
+    (void)arg;
+    return sock->readable;
+}
+
+/* OTConnect's answer (T_CONNECT), or a refusal (T_DISCONNECT) */
+static Boolean sock_answered(posix9_socket_entry *sock, void *arg)
+{
+    (void)arg;
+    return sock->connectState != CONNECT_SENT;
+}
+
+/* The completion event *arg of an asynchronous call */
+static Boolean sock_completed(posix9_socket_entry *sock, void *arg)
+{
+    return sock->completed == *(OTEventCode *)arg;
+}
+
+/*
+ * The result of an OT call that finishes with event: err itself on a
+ * synchronous endpoint, or on an asynchronous one the result the
+ * notifier passes on, which the thread parks for. sock->completed must
+ * be cleared before the call, as the event may come before it returns.
+ */
+static OSStatus ot_complete(posix9_socket_entry *sock, OSStatus err, OTEventCode event)
+{
+    if (!sock->async || err != kOTNoError) return err;
+
+    sock_wait(sock, sock_completed, &event, NULL);
+    return sock->completeResult;
+}
+
+/* Collect the connection T_CONNECT announced on a synchronous endpoint,
+ * whose notifier may not */
+static void finish_connect(posix9_socket_entry *sock)
+{
+    OSStatus err;
+
+    if (sock->connectState != CONNECT_ANSWERED) return;
+
+    sock->connectState = CONNECT_NONE;
+    err = OTRcvConnect(sock->ep, NULL);
+    if (err == kOTNoError) {
+        sock->connected = true;
+    } else {
+        sock->asyncError = ot_error_to_errno(err);
+        sock->hungUp = true;
+    }
+}
+
+/*
+ * Let a connect() still in progress finish before data moves; fails
+ * with EAGAIN if the caller may not wait for it.
+ */
+static int await_connect(posix9_socket_entry *sock, int flags)
+{
+    if (sock->connectState == CONNECT_SENT) {
+        if (!may_wait(sock, flags)) {
+            errno = EAGAIN;
+            return -1;
+        }
+        sock_wait(sock, sock_answered, NULL, NULL);
+    }
+    finish_connect(sock);
+    return 0;
+}
+
 /* ============================================================
  * OT Error to POSIX errno mapping
  * ============================================================ */
@@ -304,6 +678,33 @@ static int ot_error_to_errno(OTResult err)
  * POSIX Socket Functions
  * ============================================================ */
 
+/* Put sock's endpoint in OT's asynchronous or synchronous mode */
+static OSStatus set_async(posix9_socket_entry *sock, Boolean async)
+{
+    OSStatus err;
+
+    err = async ? OTSetAsynchronous(sock->ep) : OTSetSynchronous(sock->ep);
+    if (err == noErr) sock->async = async;
+    return err;
+}
+
+int posix9_set_socket_async(int sockfd, int async)
+{
+    posix9_socket_entry *sock;
+    OSStatus err;
+
+    sock = get_socket(sockfd);
+    if (!sock) return -1;
+
+    err = set_async(sock, async != 0);
+    if (err != noErr) {
+        errno = ot_error_to_errno(err);
+        return -1;
+    }
+
+    return 0;
+}
+
 int socket(int domain, int type, int protocol)
 {
     int fd;
@@ -369,9 +770,9 @@ int socket(int domain, int type, int protocol)
         return -1;
     }
 
-    /* Set to synchronous mode by default */
-    OTSetSynchronous(sock->ep);
-    OTSetBlocking(sock->ep);
+    /* Never blocking inside OT: waits park (sock_wait) */
+    OTSetNonBlocking(sock->ep);
+    set_async(sock, POSIX9_SOCKET_ASYNC);
 
     /* Store socket info */
     sock->domain = domain;
@@ -408,7 +809,8 @@ int bind(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
     ret.addr.maxlen = sizeof(retAddr);
 
     /* Perform bind */
-    err = OTBind(sock->ep, &req, &ret);
+    sock->completed = 0;
+    err = ot_complete(sock, OTBind(sock->ep, &req, &ret), T_BINDCOMPLETE);
     if (err != noErr) {
         errno = ot_error_to_errno(err);
         return -1;
@@ -445,8 +847,10 @@ int listen(int sockfd, int backlog)
         ret.addr.buf = (UInt8 *)&sock->localAddr;
         ret.addr.maxlen = sizeof(sock->localAddr);
 
-        OTUnbind(sock->ep);
-        err = OTBind(sock->ep, &req, &ret);
+        sock->completed = 0;
+        ot_complete(sock, OTUnbind(sock->ep), T_UNBINDCOMPLETE);
+        sock->completed = 0;
+        err = ot_complete(sock, OTBind(sock->ep, &req, &ret), T_BINDCOMPLETE);
         if (err != noErr) {
             errno = ot_error_to_errno(err);
             return -1;
@@ -464,7 +868,6 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
     TCall call;
     InetAddress clientAddr;
     OSStatus err;
-    EndpointRef newep;
     struct sockaddr_in *sin;
 
     sock = get_socket(sockfd);
@@ -480,8 +883,22 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
     call.addr.buf = (UInt8 *)&clientAddr;
     call.addr.maxlen = sizeof(clientAddr);
 
-    /* Wait for connection */
-    err = OTListen(sock->ep, &call);
+    /* Wait for a connection; readable is cleared first so a T_LISTEN
+     * after kOTNoDataErr is not lost */
+    for (;;) {
+        sock->readable = false;
+        err = OTListen(sock->ep, &call);
+        if (err != kOTNoDataErr) break;
+
+        if (!may_wait(sock, 0)) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (!sock_wait(sock, sock_incoming, NULL, &sock->rcvTimeout)) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
     if (err != noErr) {
         errno = ot_error_to_errno(err);
         return -1;
@@ -508,8 +925,15 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
         return -1;
     }
 
-    /* Accept the connection on new endpoint */
-    err = OTAccept(sock->ep, newsock->ep, &call);
+    /* Notifier first, so no event of the new connection is missed */
+    OTInstallNotifier(newsock->ep, NewOTNotifyUPP(socket_notifier), newsock);
+    OTSetNonBlocking(newsock->ep);
+    set_async(newsock, sock->async);
+
+    /* Accept the connection on new endpoint; an asynchronous listener
+     * parks until the peer's handshake is done */
+    sock->completed = 0;
+    err = ot_complete(sock, OTAccept(sock->ep, newsock->ep, &call), T_ACCEPTCOMPLETE);
     if (err != noErr) {
         OTCloseProvider(newsock->ep);
         free_socket(newfd);
@@ -517,11 +941,6 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
         return -1;
     }
 
-    /* Install notifier */
-    OTInstallNotifier(newsock->ep, NewOTNotifyUPP(socket_notifier), newsock);
-    OTSetSynchronous(newsock->ep);
-    OTSetBlocking(newsock->ep);
-
     /* Copy socket properties */
     newsock->domain = sock->domain;
     newsock->type = sock->type;
@@ -557,6 +976,16 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
     sock = get_socket(sockfd);
     if (!sock) return -1;
 
+    finish_connect(sock);
+    if (sock->connectState == CONNECT_SENT) {
+        errno = EALREADY;
+        return -1;
+    }
+    if (sock->connected) {
+        errno = EISCONN;
+        return -1;
+    }
+
     sin = (const struct sockaddr_in *)addr;
 
     /* Set up destination address */
@@ -566,27 +995,50 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
     sndCall.addr.buf = (UInt8 *)&destAddr;
     sndCall.addr.len = sizeof(destAddr);
 
-    /* Connect */
+    /* Connect; the endpoint does not block, so the notifier carries it
+     * on from T_CONNECT or T_DISCONNECT while a blocking socket parks */
+    sock->peerAddr = destAddr;
+    sock->connectState = CONNECT_SENT;
     err = OTConnect(sock->ep, &sndCall, NULL);
+    if (err == kOTNoDataErr) {
+        if (!may_wait(sock, 0)) {
+            errno = EINPROGRESS;
+            return -1;
+        }
+        sock_wait(sock, sock_answered, NULL, NULL);
+        finish_connect(sock);
+        if (!sock->connected) {
+            errno = sock->asyncError ? sock->asyncError : ECONNREFUSED;
+            sock->asyncError = 0;
+            return -1;
+        }
+        return 0;
+    }
+
+    sock->connectState = CONNECT_NONE;
     if (err != noErr) {
         errno = ot_error_to_errno(err);
         return -1;
     }
 
     sock->connected = true;
-    sock->peerAddr = destAddr;
-
     return 0;
 }
 
-ssize_t send(int sockfd, const void *buf, size_t len, int flags)
+/*
+ * Send the OTData chain at first, len bytes in all. A chain of several
+ * pieces goes to OT in one call (kNetbufDataIsOTData); OT has copied
+ * whatever it took when OTSnd returns, so that is trimmed off the front
+ * of the chain. A blocking send takes everything, parking while the
+ * window is full.
+ */
+static ssize_t send_chain(posix9_socket_entry *sock, OTData *first, size_t len, int flags)
 {
-    posix9_socket_entry *sock;
     OTResult result;
     OTFlags otFlags = 0;
+    size_t sent = 0;
 
-    sock = get_socket(sockfd);
-    if (!sock) return -1;
+    if (await_connect(sock, flags) != 0) return -1;
 
     if (!sock->connected && sock->type == SOCK_STREAM) {
         errno = ENOTCONN;
@@ -595,63 +1047,148 @@ ssize_t send(int sockfd, const void *buf, size_t len, int flags)
 
     if (flags & MSG_OOB) otFlags |= T_EXPEDITED;
 
-    result = OTSnd(sock->ep, (void *)buf, len, otFlags);
+    while (sent < len) {
+        if (await_acks_off(sock, flags) != 0) break;
 
-    if (result < 0) {
-        errno = ot_error_to_errno(result);
-        return -1;
+        /* Cleared first so a T_GODATA after the flow error is not lost */
+        sock->writable = false;
+        if (first->fNext) {
+            result = OTSnd(sock->ep, first, kNetbufDataIsOTData, otFlags);
+        } else {
+            result = OTSnd(sock->ep, first->fData, first->fLen, otFlags);
+        }
+
+        if (result == kOTFlowErr) {
+            if (!may_wait(sock, flags) ||
+                !sock_wait(sock, sock_writable, NULL, &sock->sndTimeout)) {
+                errno = EAGAIN;
+                break;
+            }
+            if (!sock->connected) {
+                errno = EPIPE;
+                break;
+            }
+            continue;
+        }
+
+        sock->writable = true;
+
+        if (result < 0) {
+            errno = ot_error_to_errno(result);
+            break;
+        }
+
+        sent += result;
+
+        while (first && result >= (OTResult)first->fLen) {
+            result -= first->fLen;
+            first = (OTData *)first->fNext;
+        }
+        if (first) {
+            first->fData = (char *)first->fData + result;
+            first->fLen -= result;
+        }
     }
 
-    return (ssize_t)result;
+    return sent > 0 || len == 0 ? (ssize_t)sent : -1;
 }
 
-ssize_t recv(int sockfd, void *buf, size_t len, int flags)
+static ssize_t sock_send(posix9_socket_entry *sock, const void *buf, size_t len, int flags)
+{
+    OTData piece;
+
+    piece.fNext = NULL;
+    piece.fData = (void *)buf;
+    piece.fLen = len;
+    return send_chain(sock, &piece, len, flags);
+}
+
+static ssize_t sock_recv(posix9_socket_entry *sock, void *buf, size_t len, int flags)
 {
-    posix9_socket_entry *sock;
     OTResult result;
     OTFlags otFlags = 0;
+    OTByteCount more;
 
-    sock = get_socket(sockfd);
-    if (!sock) return -1;
+    if (await_connect(sock, flags) != 0) return -1;
 
-    result = OTRcv(sock->ep, buf, len, &otFlags);
+    /* readable is cleared first so a T_DATA after kOTNoDataErr is not
+     * lost; the notifier sets it again */
+    for (;;) {
+        sock->readable = false;
+        result = OTRcv(sock->ep, buf, len, &otFlags);
 
-    if (result < 0) {
-        if (result == kOTNoDataErr) {
-            if (sock->nonblocking) {
-                errno = EAGAIN;
-                return -1;
-            }
-            return 0;  /* EOF */
+        /* Past the last data, OT holds the peer's orderly release for a
+         * synchronous endpoint to acknowledge */
+        if (result == kOTLookErr && sock->ordrelPending) {
+            sock->ordrelPending = false;
+            OTRcvOrderlyDisconnect(sock->ep);
+            return 0;
+        }
+
+        /* So does a disconnect, before anything else; until then OTRcv
+         * answers nothing but kOTLookErr */
+        if (result == kOTLookErr && sock->hungUp) {
+            OTRcvDisconnect(sock->ep, NULL);
+            return 0;
+        }
+        if (result != kOTNoDataErr) break;
+
+        /* Nothing more will come */
+        if (sock->hungUp || !sock->connected) return 0;
+
+        if (!may_wait(sock, flags) ||
+            !sock_wait(sock, sock_readable, NULL, &sock->rcvTimeout)) {
+            errno = EAGAIN;
+            return -1;
         }
+    }
+
+    if (result < 0) {
         errno = ot_error_to_errno(result);
         return -1;
     }
 
-    sock->readable = false;  /* Will be set again by notifier */
+    /* OT sends no T_DATA for what a short read left behind, nor for a
+     * release waiting past it: it stays readable until drained */
+    if (sock->ordrelPending ||
+        (OTCountDataBytes(sock->ep, &more) == kOTNoError && more > 0)) {
+        sock->readable = true;
+    }
 
     return (ssize_t)result;
 }
 
-ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
-               const struct sockaddr *dest_addr, socklen_t addrlen)
+ssize_t send(int sockfd, const void *buf, size_t len, int flags)
 {
     posix9_socket_entry *sock;
-    const struct sockaddr_in *sin;
-    TUnitData udata;
-    InetAddress destAddr;
-    OSStatus err;
-
-    (void)flags;
-    (void)addrlen;
 
     sock = get_socket(sockfd);
     if (!sock) return -1;
 
-    if (sock->type != SOCK_DGRAM) {
-        /* For STREAM, just use send */
-        return send(sockfd, buf, len, flags);
-    }
+    return sock_send(sock, buf, len, flags);
+}
+
+ssize_t recv(int sockfd, void *buf, size_t len, int flags)
+{
+    posix9_socket_entry *sock;
+
+    sock = get_socket(sockfd);
+    if (!sock) return -1;
+
+    return sock_recv(sock, buf, len, flags);
+}
+
+/*
+ * Send a datagram of total bytes to dest_addr: the bytes at buf, or the
+ * OTData chain there when len is kNetbufDataIsOTData
+ */
+static ssize_t sock_sendto(posix9_socket_entry *sock, void *buf, OTByteCount len, size_t total,
+                           const struct sockaddr *dest_addr, int flags)
+{
+    const struct sockaddr_in *sin;
+    TUnitData udata;
+    InetAddress destAddr;
+    OSStatus err;
 
     sin = (const struct sockaddr_in *)dest_addr;
     OTInitInetAddress(&destAddr, ntohs(sin->sin_port), ntohl(sin->sin_addr.s_addr));
@@ -662,13 +1199,43 @@ ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
     udata.udata.buf = (UInt8 *)buf;
     udata.udata.len = len;
 
-    err = OTSndUData(sock->ep, &udata);
+    for (;;) {
+        sock->writable = false;
+        err = OTSndUData(sock->ep, &udata);
+        if (err != kOTFlowErr) break;
+
+        if (!may_wait(sock, flags) ||
+            !sock_wait(sock, sock_writable, NULL, &sock->sndTimeout)) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+    sock->writable = true;
+
     if (err != noErr) {
         errno = ot_error_to_errno(err);
         return -1;
     }
 
-    return (ssize_t)len;
+    return (ssize_t)total;
+}
+
+ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
+               const struct sockaddr *dest_addr, socklen_t addrlen)
+{
+    posix9_socket_entry *sock;
+
+    (void)addrlen;
+
+    sock = get_socket(sockfd);
+    if (!sock) return -1;
+
+    if (sock->type != SOCK_DGRAM) {
+        /* For STREAM, just use send */
+        return send(sockfd, buf, len, flags);
+    }
+
+    return sock_sendto(sock, (void *)buf, len, len, dest_addr, flags);
 }
 
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags,
@@ -678,11 +1245,10 @@ ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags,
     TUnitData udata;
     InetAddress srcAddr;
     OTFlags otFlags = 0;
+    OTByteCount more;
     OSStatus err;
     struct sockaddr_in *sin;
 
-    (void)flags;
-
     sock = get_socket(sockfd);
     if (!sock) return -1;
 
@@ -697,12 +1263,26 @@ ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags,
     udata.udata.buf = (UInt8 *)buf;
     udata.udata.maxlen = len;
 
-    err = OTRcvUData(sock->ep, &udata, &otFlags);
+    for (;;) {
+        sock->readable = false;
+        err = OTRcvUData(sock->ep, &udata, &otFlags);
+        if (err != kOTNoDataErr) break;
+
+        if (!may_wait(sock, flags) ||
+            !sock_wait(sock, sock_incoming, NULL, &sock->rcvTimeout)) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
     if (err != noErr) {
         errno = ot_error_to_errno(err);
         return -1;
     }
 
+    /* Datagrams queued behind this one bring no T_DATA of their own */
+    if (OTCountDataBytes(sock->ep, &more) == kOTNoError && more > 0) sock->readable = true;
+
     if (src_addr && addrlen) {
         sin = (struct sockaddr_in *)src_addr;
         sin->sin_len = sizeof(*sin);
@@ -715,6 +1295,483 @@ ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags,
     return (ssize_t)udata.udata.len;
 }
 
+/* ============================================================
+ * Scatter/Gather: sendmsg(), recvmsg(), and readv()/writev() on sockets
+ *
+ * A message built from several pieces - a header, a payload and a MAC -
+ * goes to OT as one OTData chain in one call, with no copy to gather it
+ * first. OT has no scatter mode for copying receives, so those make one
+ * OTRcv per piece, waiting only for the first.
+ * ============================================================ */
+
+#define POSIX9_SENDV_PIECES     16      /* OTData pieces kept on the stack */
+
+/* Link the non-empty pieces of iov into a chain in pieces; returns the
+ * first, or NULL if there is no data, and the bytes in all in *len */
+static OTData *iov_chain(const struct iovec *iov, int iovcnt, OTData *pieces, size_t *len)
+{
+    OTData *first = NULL, *last = NULL;
+    int i;
+
+    *len = 0;
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) continue;
+
+        pieces->fNext = NULL;
+        pieces->fData = iov[i].iov_base;
+        pieces->fLen = iov[i].iov_len;
+        if (last) last->fNext = pieces;
+        else first = pieces;
+        last = pieces++;
+        *len += iov[i].iov_len;
+    }
+
+    return first;
+}
+
+/* Send iov as one chain: a datagram to dest, or on the connection */
+static ssize_t sock_sendv(posix9_socket_entry *sock, const struct iovec *iov, int iovcnt,
+                          const struct sockaddr *dest, int flags)
+{
+    OTData local[POSIX9_SENDV_PIECES], *pieces, *first;
+    size_t len;
+    ssize_t n;
+
+    pieces = iovcnt <= POSIX9_SENDV_PIECES ? local : (OTData *)NewPtr(iovcnt * sizeof(OTData));
+    if (!pieces) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    first = iov_chain(iov, iovcnt, pieces, &len);
+    if (!first) {
+        /* Nothing to send: an empty datagram, or 0 */
+        local[0].fNext = NULL;
+        local[0].fData = (void *)"";
+        local[0].fLen = 0;
+        first = &local[0];
+    }
+
+    if (!dest) {
+        n = send_chain(sock, first, len, flags);
+    } else if (first->fNext) {
+        n = sock_sendto(sock, first, kNetbufDataIsOTData, len, dest, flags);
+    } else {
+        n = sock_sendto(sock, first->fData, first->fLen, len, dest, flags);
+    }
+
+    if (pieces != local) DisposePtr((Ptr)pieces);
+    return n;
+}
+
+/* Fill iov in order; only the first piece waits for data */
+static ssize_t sock_recvv(posix9_socket_entry *sock, const struct iovec *iov, int iovcnt, int flags)
+{
+    ssize_t n, total = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0) continue;
+
+        n = sock_recv(sock, iov[i].iov_base, iov[i].iov_len,
+                      total > 0 ? flags | MSG_DONTWAIT : flags);
+        if (n < 0) return total > 0 ? total : -1;
+        total += n;
+        if ((size_t)n < iov[i].iov_len) break;
+    }
+
+    return total;
+}
+
+ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags)
+{
+    posix9_socket_entry *sock;
+
+    sock = get_socket(sockfd);
+    if (!sock) return -1;
+
+    if (posix9_iov_total(msg->msg_iov, msg->msg_iovlen) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (sock->type != SOCK_DGRAM) {
+        return sock_sendv(sock, msg->msg_iov, msg->msg_iovlen, NULL, flags);
+    }
+
+    if (!msg->msg_name) {
+        errno = EDESTADDRREQ;
+        return -1;
+    }
+    return sock_sendv(sock, msg->msg_iov, msg->msg_iovlen,
+                      (const struct sockaddr *)msg->msg_name, flags);
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags)
+{
+    posix9_socket_entry *sock;
+    struct iovec *iov = msg->msg_iov;
+    char *gather;
+    long want, copied, chunk;
+    ssize_t n;
+    int i;
+
+    sock = get_socket(sockfd);
+    if (!sock) return -1;
+
+    want = posix9_iov_total(iov, msg->msg_iovlen);
+    if (want < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* No ancillary data on Open Transport */
+    msg->msg_controllen = 0;
+    msg->msg_flags = 0;
+
+    if (sock->type != SOCK_DGRAM) {
+        msg->msg_namelen = 0;
+        return sock_recvv(sock, iov, msg->msg_iovlen, flags);
+    }
+
+    /* A datagram comes in one OTRcvUData: scatter it from memory */
+    if (msg->msg_iovlen == 1) {
+        return recvfrom(sockfd, iov[0].iov_base, iov[0].iov_len, flags,
+                        (struct sockaddr *)msg->msg_name,
+                        msg->msg_name ? &msg->msg_namelen : NULL);
+    }
+
+    gather = NewPtr(want > 0 ? want : 1);
+    if (!gather) {
+        errno = ENOMEM;
+        return -1;
+    }
+    n = recvfrom(sockfd, gather, want, flags, (struct sockaddr *)msg->msg_name,
+                 msg->msg_name ? &msg->msg_namelen : NULL);
+    for (i = 0, copied = 0; i < msg->msg_iovlen && copied < n; i++) {
+        chunk = iov[i].iov_len;
+        if (chunk > n - copied) chunk = n - copied;
+        BlockMoveData(gather + copied, iov[i].iov_base, chunk);
+        copied += chunk;
+    }
+    DisposePtr(gather);
+
+    return n;
+}
+
+/* readv() and writev() on a socket (posix9_file.c) */
+ssize_t posix9_socket_readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    return sock_recvv(get_socket(fd), iov, iovcnt, 0);
+}
+
+ssize_t posix9_socket_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    return sock_sendv(get_socket(fd), iov, iovcnt, NULL, 0);
+}
+
+/* ============================================================
+ * sendfile()
+ *
+ * A read()/send() loop copies every byte twice: from the file into the
+ * caller's buffer and from there into OT's own. sendfile() reads each
+ * block straight into memory from OTAllocMem() and sends it with
+ * OTAckSends on, so OT transmits from that memory and hands it back
+ * with T_MEMORYRELEASED instead of copying it. When OT's send window
+ * fills, the thread parks until T_GODATA, as send() does.
+ * ============================================================ */
+
+static Boolean block_released(posix9_socket_entry *sock, void *arg)
+{
+    (void)sock;
+    return ((posix9_send_block *)arg)->pending == 0;
+}
+
+/*
+ * Send len bytes of block b. Returns the bytes sent, which is less than
+ * len only on a non-blocking socket whose window filled, or -1 with
+ * errno if nothing was sent.
+ */
+static long send_block(posix9_socket_entry *sock, posix9_send_block *b,
+                       long len, Boolean acked)
+{
+    OTResult result;
+    long sent = 0;
+
+    while (sent < len) {
+        /* OT may still be reading the OTData of an earlier partial send */
+        if (acked && b->pending > 0 && sent > 0) {
+            sock_wait(sock, block_released, b, NULL);
+        }
+
+        if (!sock->connected) {
+            errno = EPIPE;
+            return sent > 0 ? sent : -1;
+        }
+        if (!acked && await_acks_off(sock, 0) != 0) return sent > 0 ? sent : -1;
+
+        b->data.fNext = NULL;
+        b->data.fData = b->buf + sent;
+        b->data.fLen = len - sent;
+
+        /* Cleared first so a T_GODATA after the flow error is not lost */
+        sock->writable = false;
+        if (acked) b->pending++;
+
+        result = OTSnd(sock->ep, &b->data, kNetbufDataIsOTData, 0);
+
+        if (result == kOTFlowErr) {
+            if (acked) b->pending--;
+            if (sock->nonblocking) {
+                errno = EAGAIN;
+                return sent > 0 ? sent : -1;
+            }
+            sock_wait(sock, sock_writable, NULL, NULL);
+            continue;
+        }
+
+        sock->writable = true;
+
+        if (result < 0) {
+            if (acked) b->pending--;
+            errno = ot_error_to_errno(result);
+            return sent > 0 ? sent : -1;
+        }
+
+        sent += result;
+    }
+
+    return sent;
+}
+
+/* out_fd is not a socket: plain pread64()/write() copy */
+static ssize_t copy_file(int out_fd, int in_fd, off64_t *pos, size_t count)
+{
+    char *buf;
+    size_t total = 0;
+    ssize_t n = 0, written = 0;
+
+    buf = NewPtr(POSIX9_SENDFILE_BLOCK);
+    if (!buf) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    while (total < count) {
+        n = count - total;
+        if (n > POSIX9_SENDFILE_BLOCK) n = POSIX9_SENDFILE_BLOCK;
+
+        n = pread64(in_fd, buf, n, *pos);
+        if (n <= 0) break;
+
+        written = write(out_fd, buf, n);
+        if (written > 0) {
+            *pos += written;
+            total += written;
+        }
+        if (written != n) break;
+    }
+
+    DisposePtr(buf);
+
+    if (total == 0 && (n < 0 || written < 0)) return -1;
+    return (ssize_t)total;
+}
+
+ssize_t sendfile64(int out_fd, int in_fd, off64_t *offset, size_t count)
+{
+    posix9_socket_entry *sock;
+    posix9_send_block *blocks, *b;
+    Boolean acked;
+    off64_t pos;
+    size_t total = 0;
+    ssize_t n;
+    long sent;
+    int i, failed = 0;
+
+    pos = offset ? *offset : lseek64(in_fd, 0, SEEK_CUR);
+    if (pos < 0) {
+        if (offset) errno = EINVAL;
+        return -1;
+    }
+
+    if (!posix9_is_socket(out_fd)) {
+        n = copy_file(out_fd, in_fd, &pos, count);
+        goto done;
+    }
+
+    sock = get_socket(out_fd);
+    if (sock->type != SOCK_STREAM) {
+        errno = EINVAL;
+        return -1;
+    }
+    finish_connect(sock);
+    if (!sock->connected) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    if (count == 0) return 0;
+
+    /* Headers and buffers in one block OT may use at deferred task time */
+    blocks = (posix9_send_block *)OTAllocMem(POSIX9_SENDFILE_BLOCKS *
+                                             (sizeof(posix9_send_block) + POSIX9_SENDFILE_BLOCK));
+    if (!blocks) {
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < POSIX9_SENDFILE_BLOCKS; i++) {
+        blocks[i].buf = (char *)(blocks + POSIX9_SENDFILE_BLOCKS) + i * POSIX9_SENDFILE_BLOCK;
+        blocks[i].pending = 0;
+    }
+
+    /*
+     * A non-blocking caller cannot wait for T_MEMORYRELEASED, so only
+     * blocking sockets get no-copy sends, one sendfile() at a time.
+     */
+    if (await_acks_off(sock, 0) != 0) {
+        OTFreeMem(blocks);
+        return -1;
+    }
+    acked = !sock->nonblocking && OTAckSends(sock->ep) == kOTNoError;
+    if (acked) sock->ackBlocks = blocks;
+
+    for (i = 0; total < count; i = (i + 1) % POSIX9_SENDFILE_BLOCKS) {
+        b = &blocks[i];
+
+        /* Reuse a block only once OT has let go of it */
+        if (b->pending > 0) sock_wait(sock, block_released, b, NULL);
+
+        n = count - total;
+        if (n > POSIX9_SENDFILE_BLOCK) n = POSIX9_SENDFILE_BLOCK;
+
+        n = pread64(in_fd, b->buf, n, pos);
+        if (n < 0) failed = 1;
+        if (n <= 0) break;
+
+        sent = send_block(sock, b, n, acked);
+        if (sent < 0) {
+            failed = 1;
+            break;
+        }
+        pos += sent;
+        total += sent;
+        if (sent < n) break;
+    }
+
+    for (i = 0; i < POSIX9_SENDFILE_BLOCKS; i++) {
+        if (blocks[i].pending > 0) sock_wait(sock, block_released, &blocks[i], NULL);
+    }
+
+    if (acked) {
+        OTDontAckSends(sock->ep);
+        sock->ackBlocks = NULL;
+        wake_waiter(sock);      /* A send() waiting for OTAckSends to go off */
+    }
+    OTFreeMem(blocks);
+
+    n = (total == 0 && failed) ? -1 : (ssize_t)total;
+
+done:
+    if (n > 0) {
+        if (offset) *offset = pos;
+        else lseek64(in_fd, pos, SEEK_SET);
+    }
+    return n;
+}
+
+/* Stops short rather than move *offset past what an off_t holds */
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+    off64_t pos;
+    ssize_t n;
+
+    if (!offset) return sendfile64(out_fd, in_fd, NULL, count);
+
+    pos = *offset;
+    if (pos >= 0 && count > (size_t)(LONG_MAX - pos)) count = (size_t)(LONG_MAX - pos);
+    n = sendfile64(out_fd, in_fd, &pos, count);
+    if (n > 0) *offset = (off_t)pos;
+    return n;
+}
+
+/* ============================================================
+ * Zero-copy Receive
+ *
+ * recv() has OTRcv copy into the caller's buffer, and a parser that
+ * keeps its own record buffer copies once more. OTRcv given
+ * kOTNetbufDataIsOTBufferStar lends out the OTBuffer chain the data
+ * arrived in instead; a posix9_zc_chain is that chain, read in place
+ * and given back with OTReleaseBuffer.
+ * ============================================================ */
+
+ssize_t posix9_recv_zc(int sockfd, posix9_zc_chain **chain, int flags)
+{
+    posix9_socket_entry *sock;
+    OTBuffer *buffer = NULL;
+    ssize_t n;
+
+    *chain = NULL;
+
+    sock = get_socket(sockfd);
+    if (!sock) return -1;
+
+    if (sock->type != SOCK_STREAM) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    /* Waits, EOF and errors as for recv(); only the data differs */
+    n = sock_recv(sock, &buffer, kOTNetbufDataIsOTBufferStar, flags);
+    if (n > 0) *chain = (posix9_zc_chain *)buffer;
+
+    return n;
+}
+
+const void *posix9_zc_next(const posix9_zc_chain **cursor, size_t *len)
+{
+    const OTBuffer *b = (const OTBuffer *)*cursor;
+
+    /* OT may leave empty pieces in a chain */
+    while (b && b->fLen == 0) b = b->fNext;
+
+    if (!b) {
+        *cursor = NULL;
+        *len = 0;
+        return NULL;
+    }
+
+    *cursor = (const posix9_zc_chain *)b->fNext;
+    *len = b->fLen;
+    return b->fData;
+}
+
+size_t posix9_zc_read(const posix9_zc_chain *chain, size_t offset, void *dest, size_t len)
+{
+    OTBufferInfo info;
+    OTByteCount n;
+    OTBuffer *b = (OTBuffer *)chain;
+
+    /* Find the piece offset falls in; OTReadBuffer carries on across */
+    while (b && offset >= b->fLen) {
+        offset -= b->fLen;
+        b = b->fNext;
+    }
+    if (!b) return 0;
+
+    info.fBuffer = b;
+    info.fOffset = offset;
+    info.fPad = 0;
+    n = len;
+    OTReadBuffer(&info, dest, &n);
+
+    return n;
+}
+
+void posix9_zc_release(posix9_zc_chain *chain)
+{
+    if (chain) OTReleaseBuffer((OTBuffer *)chain);
+}
+
 int shutdown(int sockfd, int how)
 {
     posix9_socket_entry *sock;
@@ -766,6 +1823,7 @@ int getpeername(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
     sock = get_socket(sockfd);
     if (!sock) return -1;
 
+    finish_connect(sock);
     if (!sock->connected) {
         errno = ENOTCONN;
         return -1;
@@ -798,10 +1856,22 @@ int getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optl
                 return 0;
 
             case SO_ERROR:
+                /* A connect() that failed since it returned EINPROGRESS */
+                finish_connect(sock);
                 *(int *)optval = sock->asyncError;
                 sock->asyncError = 0;
                 *optlen = sizeof(int);
                 return 0;
+            case SO_RCVTIMEO:
+            case SO_SNDTIMEO:
+                if (*optlen < sizeof(struct timeval)) {
+                    errno = EINVAL;
+                    return -1;
+                }
+                *(struct timeval *)optval = optname == SO_RCVTIMEO ? sock->rcvTimeout
+                                                                   : sock->sndTimeout;
+                *optlen = sizeof(struct timeval);
+                return 0;
 
             default:
                 errno = ENOPROTOOPT;
@@ -816,9 +1886,7 @@ int getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optl
 int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen)
 {
     posix9_socket_entry *sock;
-
-    (void)optval;
-    (void)optlen;
+    const struct timeval *tv;
 
     sock = get_socket(sockfd);
     if (!sock) return -1;
@@ -831,6 +1899,18 @@ int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t
             case SO_BROADCAST:
                 /* Accept these, OT handles automatically */
                 return 0;
+            case SO_RCVTIMEO:
+            case SO_SNDTIMEO:
+                /* Kept to the microsecond by the wait's Time Manager task */
+                tv = (const struct timeval *)optval;
+                if (optlen < sizeof(struct timeval) || tv->tv_sec < 0 ||
+                    tv->tv_usec < 0 || tv->tv_usec >= 1000000) {
+                    errno = EINVAL;
+                    return -1;
+                }
+                if (optname == SO_RCVTIMEO) sock->rcvTimeout = *tv;
+                else sock->sndTimeout = *tv;
+                return 0;
 
             default:
                 errno = ENOPROTOOPT;
@@ -847,80 +1927,6 @@ int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t
     return -1;
 }
 
-/* ============================================================
- * select() implementation
- * ============================================================ */
-
-int select(int nfds, fd_set *readfds, fd_set *writefds,
-           fd_set *exceptfds, struct timeval *timeout)
-{
-    int count = 0;
-    int fd;
-    posix9_socket_entry *sock;
-    unsigned long endTime;
-    unsigned long now;
-    fd_set readResult, writeResult, exceptResult;
-
-    FD_ZERO(&readResult);
-    FD_ZERO(&writeResult);
-    FD_ZERO(&exceptResult);
-
-    /* Calculate end time */
-    if (timeout) {
-        endTime = TickCount() + (timeout->tv_sec * 60) +
-                  (timeout->tv_usec * 60 / 1000000);
-    } else {
-        endTime = 0xFFFFFFFF;  /* Forever */
-    }
-
-    do {
-        count = 0;
-
-        for (fd = SOCKET_FD_BASE; fd < nfds && fd < SOCKET_FD_BASE + MAX_SOCKETS; fd++) {
-            sock = get_socket(fd);
-            if (!sock) continue;
-
-            /* Check for events */
-            OTLook(sock->ep);
-
-            if (readfds && FD_ISSET(fd, readfds)) {
-                if (sock->readable || sock->listening) {
-                    FD_SET(fd, &readResult);
-                    count++;
-                }
-            }
-
-            if (writefds && FD_ISSET(fd, writefds)) {
-                if (sock->writable && sock->connected) {
-                    FD_SET(fd, &writeResult);
-                    count++;
-                }
-            }
-
-            if (exceptfds && FD_ISSET(fd, exceptfds)) {
-                if (sock->hasOOB) {
-                    FD_SET(fd, &exceptResult);
-                    count++;
-                }
-            }
-        }
-
-        if (count > 0) break;
-
-        /* Give time to other processes */
-        SystemTask();
-
-        now = TickCount();
-    } while (now < endTime);
-
-    /* Copy results back */
-    if (readfds) *readfds = readResult;
-    if (writefds) *writefds = writeResult;
-    if (exceptfds) *exceptfds = exceptResult;
-
-    return count;
-}
-
 /* ============================================================
  * DNS Functions
  * ============================================================ */
@@ -936,7 +1942,8 @@ struct hostent *gethostbyname(const char *name)
     }
 
     /* Fill in hostent structure */
-    strncpy(dns_name, hostInfo.name, sizeof(dns_name) - 1);
+    memcpy(dns_name, hostInfo.name, sizeof(dns_name) - 1);
+    dns_name[sizeof(dns_name) - 1] = '\0';
     dns_result.h_name = dns_name;
     dns_result.h_aliases = dns_aliases;
     dns_result.h_addrtype = AF_INET;
@@ -950,7 +1957,6 @@ struct hostent *gethostbyname(const char *name)
 
 struct hostent *gethostbyaddr(const void *addr, socklen_t len, int type)
 {
-    InetHostInfo hostInfo;
     InetHost host;
     OSStatus err;
 
@@ -1066,15 +2072,22 @@ int sethostname(const char *name, size_t len)
 }
 
 /* ============================================================
- * Close socket (called from posix9_file.c close())
+ * Descriptor Operations (dispatched from posix9_fd.c)
  * ============================================================ */
 
-int posix9_close_socket(int fd)
+static ssize_t socket_fd_read(void *obj, void *buf, size_t count)
 {
-    posix9_socket_entry *sock;
+    return sock_recv((posix9_socket_entry *)obj, buf, count, 0);
+}
 
-    sock = get_socket(fd);
-    if (!sock) return -1;
+static ssize_t socket_fd_write(void *obj, const void *buf, size_t count)
+{
+    return sock_send((posix9_socket_entry *)obj, buf, count, 0);
+}
+
+static int socket_fd_close(void *obj)
+{
+    posix9_socket_entry *sock = (posix9_socket_entry *)obj;
 
     if (sock->ep != kOTInvalidEndpointRef) {
         /* Send disconnect if connected */
@@ -1084,16 +2097,44 @@ int posix9_close_socket(int fd)
         OTCloseProvider(sock->ep);
     }
 
-    free_socket(fd);
+    /* No more events: the sets watching it can let it go */
+    posix9_epoll_forget(&sock->interest);
+
+    release_socket(sock);
     return 0;
 }
 
+/* State the notifier keeps; nothing here calls Open Transport */
+static int socket_fd_poll(void *obj)
+{
+    posix9_socket_entry *sock = (posix9_socket_entry *)obj;
+    int ready = 0;
+
+    if (sock->readable) ready |= POSIX9_FD_READABLE;
+    if (sock->writable && (sock->connected || sock->connectState == CONNECT_ANSWERED)) {
+        ready |= POSIX9_FD_WRITABLE;
+    }
+    if (sock->hasOOB) ready |= POSIX9_FD_EXCEPT;
+    if (sock->hungUp) ready |= POSIX9_FD_READABLE | POSIX9_FD_HANGUP;
+
+    return ready;
+}
+
+static const posix9_fd_ops socket_fd_ops = {
+    S_IFSOCK,
+    socket_fd_read,
+    socket_fd_write,
+    socket_fd_close,
+    socket_fd_poll
+};
+
 /* ============================================================
  * fcntl() - File control for sockets
  *
  * Critical for SSH: Dropbear uses fcntl(fd, F_SETFL, O_NONBLOCK)
- * to put sockets into non-blocking mode for multiplexed I/O.
- * Maps to OTSetNonBlocking/OTSetBlocking on the OT endpoint.
+ * to put sockets into non-blocking mode for multiplexed I/O. The OT
+ * endpoint is non-blocking either way; the flag decides whether a call
+ * that cannot finish fails with EAGAIN or parks the thread.
  * ============================================================ */
 
 /* fcntl constants - define here since we can't include fcntl.h
@@ -1134,21 +2175,14 @@ int fcntl(int fd, int cmd, ...)
     case F_SETFL:
         {
             /* Extract flags from varargs - we only care about O_NONBLOCK */
-            /* On PPC calling convention the 3rd arg is in the stack frame;
-             * use a simple pointer trick since va_list pulls in headers */
-            int flags = *((int *)(&cmd) + 1);
-
-            if (flags & O_NONBLOCK) {
-                if (!sock->nonblocking) {
-                    OTSetNonBlocking(sock->ep);
-                    sock->nonblocking = true;
-                }
-            } else {
-                if (sock->nonblocking) {
-                    OTSetBlocking(sock->ep);
-                    sock->nonblocking = false;
-                }
-            }
+            va_list ap;
+            int flags;
+
+            va_start(ap, cmd);
+            flags = va_arg(ap, int);
+            va_end(ap);
+
+            sock->nonblocking = (flags & O_NONBLOCK) != 0;
             return 0;
         }
 
@@ -1170,7 +2204,7 @@ int fcntl(int fd, int cmd, ...)
  * ioctl() - I/O control for sockets
  *
  * Dropbear needs FIONBIO (non-blocking) and TIOCGWINSZ (terminal
- * size). FIONBIO maps to OTSetNonBlocking. Terminal ioctls are
+ * size). FIONBIO sets the same flag as O_NONBLOCK. Terminal ioctls are
  * stubbed since Mac OS 9 PTY support requires Terminal Manager.
  * ============================================================ */
 
@@ -1197,6 +2231,7 @@ struct winsize {
 int ioctl(int fd, unsigned long request, ...)
 {
     posix9_socket_entry *sock;
+    va_list ap;
     void *argp;
 
     sock = get_socket(fd);
@@ -1206,19 +2241,15 @@ int ioctl(int fd, unsigned long request, ...)
     }
 
     /* Get the argp pointer from varargs */
-    argp = *((void **)(&request) + 1);
+    va_start(ap, request);
+    argp = va_arg(ap, void *);
+    va_end(ap);
 
     switch (request) {
     case FIONBIO:
         {
             int *val = (int *)argp;
-            if (val && *val) {
-                OTSetNonBlocking(sock->ep);
-                sock->nonblocking = true;
-            } else {
-                OTSetBlocking(sock->ep);
-                sock->nonblocking = false;
-            }
+            sock->nonblocking = val && *val;
             return 0;
         }
 
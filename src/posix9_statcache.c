@@ -0,0 +1,356 @@
+/*
+ * posix9_statcache.c - Catalog metadata cache for stat() and fstat()
+ *
+ * Every stat() and fstat() needs a PBGetCatInfoSync, which walks the
+ * catalog B-tree. Tools that stat every file in a tree (make, find, ls
+ * -l, rsync) ask for the same entries over and over, so the results are
+ * kept in a small LRU table keyed by (vRefNum, parent dirID, name):
+ *   hash chains  -> find an entry in one or two compares
+ *   LRU list     -> the least recently used entry is recycled when full
+ *
+ * HFS names compare case-insensitively, so keys fold ASCII case. Only
+ * successful lookups are cached. The File Manager cannot tell us when
+ * a file changes, so the POSIX calls that change one invalidate it:
+ * write/ftruncate/close (posix9_file.c), unlink, rename, mkdir and
+ * rmdir. Changes made behind our back (the Finder, other applications)
+ * are seen after the entry ages out or posix9_statcache_flush().
+ * readdir() enters what it fetched for each entry, at the cold end.
+ */
+
+#include "posix9.h"
+
+/* Mac OS headers */
+#include <Multiverse.h>
+#include "MacCompat.h"      /* Missing definitions for Retro68 */
+#include <string.h>
+
+/* ============================================================
+ * Cache Table
+ * ============================================================ */
+
+typedef struct {
+    short       vRefNum;        /* Key: volume */
+    long        parID;          /* Key: parent directory ID */
+    Str63       name;           /* Key: leaf name (Pascal) */
+    unsigned long hash;         /* Hash of the key */
+    CInfoPBRec  info;           /* Cached PBGetCatInfoSync result */
+    short       hashNext;       /* Next entry in the bucket, -1 = end */
+    short       lruPrev;        /* Towards most recently used, -1 = head */
+    short       lruNext;        /* Towards least recently used, -1 = tail */
+    Boolean     inUse;
+} posix9_stat_entry;
+
+#define STATCACHE_BUCKETS   64      /* Power of two */
+
+static posix9_stat_entry    stat_table[POSIX9_STATCACHE_SIZE];
+static short                stat_buckets[STATCACHE_BUCKETS];
+static short                stat_lru_head = -1;     /* Most recently used */
+static short                stat_lru_tail = -1;     /* Next to recycle */
+static short                stat_count = 0;
+static unsigned long        stat_hits = 0;
+static unsigned long        stat_misses = 0;
+static unsigned long        stat_evictions = 0;
+static Boolean              stat_initialized = false;
+
+/* ============================================================
+ * Internal Helpers
+ * ============================================================ */
+
+static void init_stat_table(void)
+{
+    int i;
+
+    if (stat_initialized) return;
+
+    for (i = 0; i < STATCACHE_BUCKETS; i++) {
+        stat_buckets[i] = -1;
+    }
+    for (i = 0; i < POSIX9_STATCACHE_SIZE; i++) {
+        stat_table[i].inUse = false;
+    }
+    stat_lru_head = stat_lru_tail = -1;
+    stat_count = 0;
+
+    stat_initialized = true;
+}
+
+static unsigned char fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static unsigned long key_hash(short vRefNum, long parID, ConstStr255Param name)
+{
+    unsigned long h = 2166136261UL;     /* FNV-1a */
+    int i;
+
+    h = (h ^ (unsigned short)vRefNum) * 16777619UL;
+    h = (h ^ (unsigned long)parID) * 16777619UL;
+    for (i = 1; i <= name[0]; i++) {
+        h = (h ^ fold(name[i])) * 16777619UL;
+    }
+
+    return h;
+}
+
+static Boolean key_equal(const posix9_stat_entry *e, short vRefNum, long parID,
+                         ConstStr255Param name)
+{
+    int i;
+
+    if (e->vRefNum != vRefNum || e->parID != parID || e->name[0] != name[0]) {
+        return false;
+    }
+    for (i = 1; i <= name[0]; i++) {
+        if (fold(e->name[i]) != fold(name[i])) return false;
+    }
+
+    return true;
+}
+
+static int find_entry(short vRefNum, long parID, ConstStr255Param name,
+                      unsigned long hash)
+{
+    int i;
+
+    for (i = stat_buckets[hash & (STATCACHE_BUCKETS - 1)]; i >= 0;
+         i = stat_table[i].hashNext) {
+        if (stat_table[i].hash == hash &&
+            key_equal(&stat_table[i], vRefNum, parID, name)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void lru_unlink(int i)
+{
+    posix9_stat_entry *e = &stat_table[i];
+
+    if (e->lruPrev >= 0) stat_table[e->lruPrev].lruNext = e->lruNext;
+    else stat_lru_head = e->lruNext;
+    if (e->lruNext >= 0) stat_table[e->lruNext].lruPrev = e->lruPrev;
+    else stat_lru_tail = e->lruPrev;
+}
+
+static void lru_push_front(int i)
+{
+    posix9_stat_entry *e = &stat_table[i];
+
+    e->lruPrev = -1;
+    e->lruNext = stat_lru_head;
+    if (stat_lru_head >= 0) stat_table[stat_lru_head].lruPrev = i;
+    stat_lru_head = i;
+    if (stat_lru_tail < 0) stat_lru_tail = i;
+}
+
+static void lru_push_back(int i)
+{
+    posix9_stat_entry *e = &stat_table[i];
+
+    e->lruNext = -1;
+    e->lruPrev = stat_lru_tail;
+    if (stat_lru_tail >= 0) stat_table[stat_lru_tail].lruNext = i;
+    stat_lru_tail = i;
+    if (stat_lru_head < 0) stat_lru_head = i;
+}
+
+static void remove_entry(int i)
+{
+    posix9_stat_entry *e = &stat_table[i];
+    short *link;
+
+    link = &stat_buckets[e->hash & (STATCACHE_BUCKETS - 1)];
+    while (*link != i) {
+        link = &stat_table[*link].hashNext;
+    }
+    *link = e->hashNext;
+
+    lru_unlink(i);
+    e->inUse = false;
+    stat_count--;
+}
+
+/* A free entry, recycling the least recently used one if the table is full */
+static int take_entry(void)
+{
+    int i;
+
+    if (stat_count < POSIX9_STATCACHE_SIZE) {
+        for (i = 0; i < POSIX9_STATCACHE_SIZE; i++) {
+            if (!stat_table[i].inUse) return i;
+        }
+    }
+
+    i = stat_lru_tail;
+    remove_entry(i);
+    stat_evictions++;
+    return i;
+}
+
+/* A new entry for the key, in its bucket but not yet in the LRU list */
+static int new_entry(short vRefNum, long parID, ConstStr255Param name, unsigned long hash,
+                     const CInfoPBRec *pb)
+{
+    posix9_stat_entry *e;
+    int i;
+
+    i = take_entry();
+    e = &stat_table[i];
+    e->vRefNum = vRefNum;
+    e->parID = parID;
+    memcpy(e->name, name, name[0] + 1);
+    e->hash = hash;
+    e->info = *pb;
+    e->info.hFileInfo.ioNamePtr = NULL;
+    e->info.hFileInfo.ioCompletion = NULL;
+    e->inUse = true;
+
+    e->hashNext = stat_buckets[hash & (STATCACHE_BUCKETS - 1)];
+    stat_buckets[hash & (STATCACHE_BUCKETS - 1)] = i;
+    stat_count++;
+
+    return i;
+}
+
+/* ============================================================
+ * Internal Interface (posix9_file.c, posix9_dir.c)
+ * ============================================================ */
+
+/*
+ * PBGetCatInfoSync for (vRefNum, dirID, name), served from the cache
+ * when possible. pb->hFileInfo.ioNamePtr is left pointing at the
+ * caller's name; everything else is filled as the trap would.
+ */
+OSErr posix9_statcache_getcatinfo(short vRefNum, long dirID, ConstStr255Param name,
+                                  CInfoPBRec *pb)
+{
+    unsigned long hash;
+    Str63 nameCopy;
+    int i;
+    OSErr err;
+
+    init_stat_table();
+
+    /* Lookups by dirID alone, or names too long for HFS, go straight through */
+    if (name == NULL || name[0] == 0 || name[0] > 63) {
+        memset(pb, 0, sizeof(*pb));
+        pb->hFileInfo.ioVRefNum = vRefNum;
+        pb->hFileInfo.ioDirID = dirID;
+        pb->hFileInfo.ioNamePtr = (StringPtr)name;
+        return PBGetCatInfoSync(pb);
+    }
+
+    hash = key_hash(vRefNum, dirID, name);
+    i = find_entry(vRefNum, dirID, name, hash);
+    if (i >= 0) {
+        stat_hits++;
+        lru_unlink(i);
+        lru_push_front(i);
+        *pb = stat_table[i].info;
+        pb->hFileInfo.ioNamePtr = (StringPtr)name;
+        return noErr;
+    }
+
+    stat_misses++;
+
+    /* The trap may rewrite the name it is given - keep the key intact */
+    memcpy(nameCopy, name, name[0] + 1);
+    memset(pb, 0, sizeof(*pb));
+    pb->hFileInfo.ioVRefNum = vRefNum;
+    pb->hFileInfo.ioDirID = dirID;
+    pb->hFileInfo.ioNamePtr = nameCopy;
+    pb->hFileInfo.ioFDirIndex = 0;
+
+    err = PBGetCatInfoSync(pb);
+    pb->hFileInfo.ioNamePtr = (StringPtr)name;
+    if (err != noErr) return err;
+
+    i = new_entry(vRefNum, dirID, name, hash, pb);
+    lru_push_front(i);
+
+    return noErr;
+}
+
+/*
+ * Remember catalog info fetched some other way - readdir() has it for
+ * every entry it returns. It goes in as the least recently used entry,
+ * so the next stat() of the name is a hit, but listing a big folder
+ * recycles one entry over and over instead of flushing the cache.
+ */
+void posix9_statcache_enter(short vRefNum, long dirID, ConstStr255Param name,
+                            const CInfoPBRec *pb)
+{
+    unsigned long hash;
+    int i;
+
+    if (name == NULL || name[0] == 0 || name[0] > 63) return;
+
+    init_stat_table();
+
+    hash = key_hash(vRefNum, dirID, name);
+    i = find_entry(vRefNum, dirID, name, hash);
+    if (i >= 0) {
+        stat_table[i].info = *pb;
+        stat_table[i].info.hFileInfo.ioNamePtr = NULL;
+        return;
+    }
+
+    i = new_entry(vRefNum, dirID, name, hash, pb);
+    lru_push_back(i);
+}
+
+/* Forget the entry for one name */
+void posix9_statcache_invalidate(short vRefNum, long dirID, ConstStr255Param name)
+{
+    int i;
+
+    if (!stat_initialized || stat_count == 0) return;
+    if (name == NULL || name[0] == 0 || name[0] > 63) return;
+
+    i = find_entry(vRefNum, dirID, name, key_hash(vRefNum, dirID, name));
+    if (i >= 0) remove_entry(i);
+}
+
+/*
+ * Forget the entry describing directory dirID itself - its valence and
+ * modification date change whenever something is created or deleted in
+ * it. Directories are cached under their parent, so this is a scan.
+ */
+void posix9_statcache_invalidate_dir(short vRefNum, long dirID)
+{
+    int i;
+
+    if (!stat_initialized || stat_count == 0) return;
+
+    for (i = 0; i < POSIX9_STATCACHE_SIZE; i++) {
+        if (stat_table[i].inUse && stat_table[i].vRefNum == vRefNum &&
+            (stat_table[i].info.hFileInfo.ioFlAttrib & ioDirMask) &&
+            stat_table[i].info.dirInfo.ioDrDirID == dirID) {
+            remove_entry(i);
+        }
+    }
+}
+
+/* ============================================================
+ * Public Interface
+ * ============================================================ */
+
+void posix9_statcache_stats(posix9_cache_stats *stats)
+{
+    if (!stats) return;
+
+    stats->hits = stat_hits;
+    stats->misses = stat_misses;
+    stats->evictions = stat_evictions;
+    stats->entries = stat_count;
+    stats->capacity = POSIX9_STATCACHE_SIZE;
+}
+
+/* Drop every entry; the counters keep running */
+void posix9_statcache_flush(void)
+{
+    stat_initialized = false;
+    init_stat_table();
+}
@@ -0,0 +1,232 @@
+/*
+ * bench_aio.c - Host benchmark for the asynchronous I/O engine
+ *
+ * Runs posix9_aio.c against the simulated asynchronous File Manager
+ * and Thread Manager. Reads a 1 MB file in 64 KB pieces three ways -
+ * read(), one aio_read() at a time, and all pieces queued at once -
+ * and reports how often a second "thread" got the CPU while the
+ * caller waited, how often the caller parked, and how often the
+ * completion routine woke it. Also checks aio_write() results,
+ * write-past-EOF, coherence with read() and a timeout too long for the
+ * Time Manager.
+ *
+ * Build and run with: test/build-host-bench.sh aio
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "posix9.h"
+#include "fm_sim.h"
+#include "tm_sim.h"
+
+#define FILE_PATH   "/aio.dat"
+#define FILE_SIZE   (1024L * 1024L)
+#define PIECE       (64L * 1024L)
+#define PIECES      (FILE_SIZE / PIECE)
+
+static char data[FILE_SIZE];
+static char back[FILE_SIZE];
+static unsigned long other_runs;
+
+static void other_thread(void)
+{
+    other_runs++;
+}
+
+static int make_file(void)
+{
+    long i;
+    int fd;
+
+    for (i = 0; i < FILE_SIZE; i++) {
+        data[i] = (char)(i * 13 + 5);
+    }
+
+    fd = open(FILE_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    if (write(fd, data, FILE_SIZE) != FILE_SIZE) return -1;
+    return close(fd);
+}
+
+static void report(const char *how, unsigned long traps, int ok)
+{
+    printf("  %-26s %4lu traps  %4lu parks  %4lu wakes  %4lu other-thread runs  %s\n",
+           how, traps, tmsim_parks(), tmsim_wakes(), other_runs,
+           ok ? "ok" : "MISMATCH");
+}
+
+static void start(void)
+{
+    memset(back, 0, sizeof(back));
+    tmsim_reset();
+    fmsim_zero_traps();
+    other_runs = 0;
+}
+
+static int run_sync(void)
+{
+    long i;
+    int fd, ok;
+
+    fd = open(FILE_PATH, O_RDONLY);
+    if (fd < 0) return -1;
+
+    start();
+    for (i = 0; i < PIECES; i++) {
+        if (read(fd, back + i * PIECE, PIECE) != PIECE) return -1;
+    }
+    ok = memcmp(back, data, FILE_SIZE) == 0;
+    report("read()", fmsim_traps(), ok);
+
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+static int run_aio(Boolean queued)
+{
+    static struct aiocb cbs[PIECES];
+    const struct aiocb *list[1];
+    long i, j;
+    int fd, ok = 1;
+
+    fd = open(FILE_PATH, O_RDONLY);
+    if (fd < 0) return -1;
+
+    start();
+    for (i = 0; i < PIECES; i++) {
+        memset(&cbs[i], 0, sizeof(cbs[i]));
+        cbs[i].aio_fildes = fd;
+        cbs[i].aio_offset = i * PIECE;
+        cbs[i].aio_buf = back + i * PIECE;
+        cbs[i].aio_nbytes = PIECE;
+
+        if (aio_read(&cbs[i]) != 0) return -1;
+        if (aio_error(&cbs[i]) != EINPROGRESS) ok = 0;
+
+        if (!queued) {
+            list[0] = &cbs[i];
+            if (aio_suspend(list, 1, NULL) != 0) return -1;
+            if (aio_return(&cbs[i]) != PIECE) ok = 0;
+        }
+    }
+
+    if (queued) {
+        for (i = 0; i < PIECES; i++) {
+            list[0] = &cbs[i];
+            while (aio_error(&cbs[i]) == EINPROGRESS) {
+                if (aio_suspend(list, 1, NULL) != 0) return -1;
+            }
+            if (aio_return(&cbs[i]) != PIECE) ok = 0;
+        }
+    }
+
+    /* Each result may only be collected once */
+    for (j = 0; j < PIECES; j++) {
+        if (aio_return(&cbs[j]) != -1) ok = 0;
+    }
+
+    ok = ok && memcmp(back, data, FILE_SIZE) == 0;
+    report(queued ? "aio_read() x16 queued" : "aio_read() one at a time",
+           fmsim_traps(), ok);
+
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+static int check_writes(void)
+{
+    static const struct timespec zero = { 0, 0 };
+    static const struct timespec forever = { 3000000, 0 };
+    const struct aiocb *list[2];
+    struct aiocb w, r;
+    char buf[16];
+    int fd;
+
+    fd = open(FILE_PATH, O_RDWR);
+    if (fd < 0) return -1;
+
+    /* Prime read-ahead, then overwrite under it asynchronously */
+    if (read(fd, buf, 4) != 4) return -1;
+
+    memset(&w, 0, sizeof(w));
+    w.aio_fildes = fd;
+    w.aio_offset = 2;
+    w.aio_buf = "ZZZZ";
+    w.aio_nbytes = 4;
+    if (aio_write(&w) != 0) return -1;
+
+    /* Nothing has run yet: a zero timeout must not wait */
+    list[0] = &w;
+    if (aio_suspend(list, 1, &zero) != -1 || errno != EAGAIN) return -1;
+    if (aio_cancel(fd, &w) != AIO_NOTCANCELED) return -1;
+
+    /* A deadline past what the Time Manager counts waits for the write */
+    if (aio_suspend(list, 1, &forever) != 0) return -1;
+    if (aio_error(&w) != 0 || aio_return(&w) != 4) return -1;
+    if (aio_cancel(fd, NULL) != AIO_ALLDONE) return -1;
+
+    if (lseek(fd, 0, SEEK_SET) != 0) return -1;
+    if (read(fd, buf, 8) != 8 || memcmp(buf + 2, "ZZZZ", 4) != 0) return -1;
+
+    /* Write past EOF, then read it back asynchronously */
+    memset(&w, 0, sizeof(w));
+    w.aio_fildes = fd;
+    w.aio_offset = FILE_SIZE + 100;
+    w.aio_buf = "tail";
+    w.aio_nbytes = 4;
+    memset(&r, 0, sizeof(r));
+    r.aio_fildes = fd;
+    r.aio_offset = FILE_SIZE + 100;
+    r.aio_buf = buf;
+    r.aio_nbytes = sizeof(buf);
+    if (aio_write(&w) != 0 || aio_read(&r) != 0) return -1;
+
+    /* Drop each request from the list once it is done, as POSIX expects */
+    list[0] = &w;
+    list[1] = &r;
+    while (list[0] || list[1]) {
+        if (aio_suspend(list, 2, NULL) != 0) return -1;
+        if (list[0] && aio_error(&w) != EINPROGRESS) list[0] = NULL;
+        if (list[1] && aio_error(&r) != EINPROGRESS) list[1] = NULL;
+    }
+    if (aio_return(&w) != 4) return -1;
+    if (aio_return(&r) != 4 || memcmp(buf, "tail", 4) != 0) return -1;
+    if (lseek(fd, 0, SEEK_END) != FILE_SIZE + 104) return -1;
+
+    /* Bad descriptor is refused at submission */
+    r.aio_fildes = 999;
+    if (aio_read(&r) != -1 || errno != EBADF) return -1;
+
+    return close(fd);
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+    tmsim_reset();
+    posix9_init();
+    tmsim_set_idle(other_thread);
+
+    if (make_file() != 0) {
+        printf("could not create %s\n", FILE_PATH);
+        return 1;
+    }
+
+    printf("%ld KB in %ld KB pieces, simulated async File Manager:\n",
+           FILE_SIZE / 1024, PIECE / 1024);
+    if (run_sync() != 0) failed++;
+    if (run_aio(false) != 0) failed++;
+    if (run_aio(true) != 0) failed++;
+
+    if (check_writes() != 0) {
+        printf("aio_write/coherence check: FAILED\n");
+        failed++;
+    } else {
+        printf("aio_write/coherence check: ok\n");
+    }
+
+    posix9_cleanup();
+    return failed ? 1 : 0;
+}
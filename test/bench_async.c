@@ -0,0 +1,277 @@
+/*
+ * bench_async.c - Host benchmark for asynchronous Open Transport endpoints
+ *
+ * accept() takes a connection whose peer finishes the handshake some
+ * rounds later, two ways: on a synchronous endpoint, where OTAccept
+ * holds the caller inside OT and nothing but the network runs, and on
+ * an asynchronous one, where the thread parks until T_ACCEPTCOMPLETE
+ * and the other threads carry on. Reports the rounds the other threads
+ * got and the parks made per accept(). Then checks, in both modes, a
+ * non-blocking connect() (EINPROGRESS, EALREADY, POLLOUT, EISCONN, and
+ * SO_ERROR for a refused one), a blocking connect() to a slow peer,
+ * the peer's orderly release, and listen() and accept() parking.
+ *
+ * Build and run with: test/build-host-bench.sh async
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <Multiverse.h>
+#include "MacCompat.h"
+#include "Threads.h"
+#include "posix9.h"
+#include "posix9/socket.h"
+#include "fm_sim.h"
+#include "ot_sim.h"
+#include "tm_sim.h"
+
+/* Not in the POSIX9 headers; implemented in posix9_socket.c */
+#ifndef F_SETFL
+#define F_SETFL     4
+#endif
+#ifndef O_NONBLOCK
+#define O_NONBLOCK  0x0004
+#endif
+extern int fcntl(int fd, int cmd, ...);
+
+#define ACCEPTS     200
+#define LATENCY     50          /* Rounds the peer takes to answer */
+
+/* The other threads count their rounds and may ring the listener */
+static unsigned long other_rounds;
+static int call_in = -1;
+static int call_on;
+
+static void other_threads(void)
+{
+    other_rounds++;
+    if (call_in >= 0 && --call_in <= 0) {
+        call_in = -1;
+        otsim_incoming(call_on);
+    }
+}
+
+static void set_address(struct sockaddr_in *sin, unsigned long host, int port)
+{
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    sin->sin_addr.s_addr = htonl(host);
+}
+
+/* A TCP socket in the given mode */
+static int new_socket(int async)
+{
+    int s;
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    if (posix9_set_socket_async(s, async) != 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+/* A listening socket, endpoint 0 of a fresh network */
+static int new_listener(int async)
+{
+    struct sockaddr_in sin;
+    int s;
+
+    otsim_reset();
+    set_address(&sin, 0, 22);
+
+    s = new_socket(async);
+    if (s < 0) return -1;
+    if (bind(s, (struct sockaddr *)&sin, sizeof(sin)) != 0 || listen(s, 5) != 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+static int run(const char *label, int async)
+{
+    int i, s, c, ok = 1;
+
+    s = new_listener(async);
+    if (s < 0) return -1;
+    otsim_set_latency(LATENCY);
+    tmsim_set_idle(other_threads);
+    tmsim_reset();
+    other_rounds = 0;
+
+    for (i = 0; i < ACCEPTS; i++) {
+        if (otsim_incoming(0) != 0 || (c = accept(s, NULL, NULL)) < 0) {
+            ok = 0;
+            break;
+        }
+        close(c);
+    }
+    tmsim_set_idle(NULL);
+
+    /* Held inside OT, nothing else ran; parked, everything else did */
+    if (ok && (async ? other_rounds < (unsigned long)ACCEPTS * LATENCY : other_rounds != 0)) ok = 0;
+
+    printf("  %-24s %6.1f rounds for other threads/accept  %4.1f parks/accept  %s\n",
+           label, (double)other_rounds / ACCEPTS, (double)tmsim_parks() / ACCEPTS,
+           ok ? "ok" : "MISMATCH");
+
+    close(s);
+    return ok ? 0 : -1;
+}
+
+/* ============================================================
+ * Semantics
+ * ============================================================ */
+
+static int check_connect(int async)
+{
+    struct sockaddr_in sin, peer;
+    struct pollfd pfd;
+    socklen_t len;
+    int s, err, ok = -1;
+
+    otsim_reset();
+    set_address(&sin, 0x0A000001, 22);
+
+    /* Non-blocking: in progress until the notifier hears the answer */
+    s = new_socket(async);
+    if (s < 0 || fcntl(s, F_SETFL, O_NONBLOCK) != 0) return -1;
+    if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) != -1 || errno != EINPROGRESS) goto out;
+    if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) != -1 || errno != EALREADY) goto out;
+    len = sizeof(peer);
+    if (getpeername(s, (struct sockaddr *)&peer, &len) != -1 || errno != ENOTCONN) goto out;
+    pfd.fd = s;
+    pfd.events = POLLOUT;
+    if (poll(&pfd, 1, 1000) != 1 || pfd.revents != POLLOUT) goto out;
+    len = sizeof(err);
+    if (getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) goto out;
+    len = sizeof(peer);
+    if (getpeername(s, (struct sockaddr *)&peer, &len) != 0 || peer.sin_port != htons(22)) goto out;
+    if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) != -1 || errno != EISCONN) goto out;
+    if (send(s, "hi", 2, 0) != 2) goto out;
+    close(s);
+
+    /* Refused: hangup, and SO_ERROR says why, once */
+    otsim_set_refuse(1);
+    s = new_socket(async);
+    if (s < 0 || fcntl(s, F_SETFL, O_NONBLOCK) != 0) return -1;
+    if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) != -1 || errno != EINPROGRESS) goto out;
+    pfd.fd = s;
+    pfd.events = POLLOUT;
+    if (poll(&pfd, 1, 1000) != 1 || !(pfd.revents & POLLHUP)) goto out;
+    len = sizeof(err);
+    if (getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != ECONNREFUSED) goto out;
+    if (getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) goto out;
+    close(s);
+
+    s = new_socket(async);
+    if (s < 0) return -1;
+    if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) != -1 || errno != ECONNREFUSED) goto out;
+    close(s);
+    otsim_set_refuse(0);
+
+    /* Blocking, to a slow peer: parks until the answer */
+    otsim_set_latency(LATENCY);
+    s = new_socket(async);
+    if (s < 0) return -1;
+    tmsim_reset();
+    if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) != 0 || tmsim_parks() != 1) goto out;
+    ok = 0;
+
+out:
+    close(s);
+    otsim_set_refuse(0);
+    return ok;
+}
+
+static int check_release(int async)
+{
+    struct sockaddr_in sin;
+    struct pollfd pfd;
+    char buf[8];
+    int s, ok = -1;
+
+    otsim_reset();
+    set_address(&sin, 0x0A000001, 22);
+    s = new_socket(async);
+    if (s < 0) return -1;
+    if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) != 0) goto out;
+
+    /* Data, then the peer is done: the data, then the end, for good */
+    if (otsim_receive(0, "ab", 2) != 0 || otsim_release(0) != 0) goto out;
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 0) != 1 || pfd.revents != POLLIN) goto out;
+    if (recv(s, buf, sizeof(buf), 0) != 2 || memcmp(buf, "ab", 2) != 0) goto out;
+    if (recv(s, buf, sizeof(buf), 0) != 0 || recv(s, buf, sizeof(buf), 0) != 0) goto out;
+    ok = 0;
+
+out:
+    close(s);
+    return ok;
+}
+
+static int check_accept(int async)
+{
+    struct sockaddr_in peer;
+    socklen_t len;
+    char c;
+    int s, a, ok = -1;
+
+    /* An asynchronous endpoint parks in bind(), and in listen() to
+     * unbind and bind again with a queue */
+    tmsim_reset();
+    s = new_listener(async);
+    if (s < 0 || tmsim_parks() != (async ? 3 : 0)) return -1;
+
+    /* A blocking accept() parks until the call, and for the handshake */
+    otsim_set_latency(10);
+    tmsim_set_idle(other_threads);
+    call_on = 0;
+    call_in = 5;
+    tmsim_reset();
+    len = sizeof(peer);
+    a = accept(s, (struct sockaddr *)&peer, &len);
+    if (a < 0 || tmsim_parks() != (async ? 2 : 1) || peer.sin_port != htons(49152)) goto out;
+
+    /* The new socket works, in the listener's mode */
+    if (otsim_receive(1, "z", 1) != 0 || recv(a, &c, 1, 0) != 1 || c != 'z') goto out;
+    close(a);
+
+    /* Non-blocking, nothing waiting */
+    if (fcntl(s, F_SETFL, O_NONBLOCK) != 0) goto out;
+    if (accept(s, NULL, NULL) != -1 || errno != EAGAIN) goto out;
+    ok = 0;
+
+out:
+    tmsim_set_idle(NULL);
+    close(s);
+    return ok;
+}
+
+int main(void)
+{
+    int failed = 0, async;
+
+    fmsim_reset();
+
+    printf("accept() x %d, the peer's handshake %d rounds away, simulated Open Transport:\n",
+           ACCEPTS, LATENCY);
+    if (run("synchronous endpoint", 0) != 0) failed++;
+    if (run("asynchronous endpoint", 1) != 0) failed++;
+
+    for (async = 0; async <= 1; async++) {
+        if (check_connect(async) != 0 || check_release(async) != 0 ||
+            check_accept(async) != 0) {
+            printf("async check (%s): FAILED\n", async ? "asynchronous" : "synchronous");
+            failed++;
+        } else {
+            printf("async check (%s): ok\n", async ? "asynchronous" : "synchronous");
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * bench_at.c - Host benchmark for the directory-relative *at() calls
+ *
+ * Builds a directory six levels deep, then stats and removes the files
+ * in it by full path and by name under an open directory descriptor,
+ * with the stat and path caches flushed, and reports File Manager calls
+ * and catalog name searches per call. Also checks openat() with O_CREAT
+ * and O_EXCL, mkdirat(), renameat() across directories, unlinkat() of a
+ * directory, fdopendir(), open() of a directory, and the EBADF/ENOTDIR
+ * cases.
+ *
+ * Build and run with: test/build-host-bench.sh at
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "posix9.h"
+#include "fm_sim.h"
+
+#define DEEP_DIR    "a/b/c/d/e/f"
+#define NFILES      50
+
+static int make_file(int dfd, const char *name)
+{
+    int fd;
+
+    fd = openat(dfd, name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, name, strlen(name)) < 0 || close(fd) != 0) return -1;
+
+    return 0;
+}
+
+static int make_tree(void)
+{
+    char path[64];
+    int i, dfd;
+
+    if (mkdir("a", 0755) != 0 || mkdir("a/b", 0755) != 0 ||
+        mkdir("a/b/c", 0755) != 0 || mkdir("a/b/c/d", 0755) != 0 ||
+        mkdir("a/b/c/d/e", 0755) != 0 || mkdir(DEEP_DIR, 0755) != 0) return -1;
+
+    dfd = open(DEEP_DIR, O_RDONLY | O_DIRECTORY);
+    if (dfd < 0) return -1;
+    for (i = 0; i < NFILES; i++) {
+        sprintf(path, "file%02d", i);
+        if (make_file(dfd, path) != 0) return -1;
+    }
+    close(dfd);
+
+    return 0;
+}
+
+static void flush_caches(void)
+{
+    posix9_statcache_flush();
+    posix9_pathcache_flush();
+    fmsim_zero_traps();
+}
+
+static void report(const char *label, unsigned long traps, unsigned long lookups, int ok)
+{
+    printf("  %-28s %5.2f traps/call  %5.2f catalog searches/call  %s\n",
+           label, (double)traps / NFILES, (double)lookups / NFILES, ok ? "ok" : "MISMATCH");
+}
+
+static int run(void)
+{
+    char path[64], name[16];
+    struct stat st;
+    int i, dfd, ok = 1, failed = 0;
+
+    dfd = open(DEEP_DIR, O_RDONLY | O_DIRECTORY);
+    if (dfd < 0) return -1;
+
+    flush_caches();
+    for (i = 0; i < NFILES; i++) {
+        sprintf(path, DEEP_DIR "/file%02d", i);
+        if (stat(path, &st) != 0 || st.st_size != 6) ok = 0;
+    }
+    report("stat(full path)", fmsim_traps(), fmsim_lookups(), ok);
+    failed += !ok;
+
+    ok = 1;
+    flush_caches();
+    for (i = 0; i < NFILES; i++) {
+        sprintf(name, "file%02d", i);
+        if (fstatat(dfd, name, &st, 0) != 0 || st.st_size != 6) ok = 0;
+    }
+    report("fstatat(dirfd, name)", fmsim_traps(), fmsim_lookups(), ok);
+    failed += !ok;
+
+    ok = 1;
+    flush_caches();
+    for (i = 0; i < NFILES; i += 2) {
+        sprintf(path, DEEP_DIR "/file%02d", i);
+        if (unlink(path) != 0) ok = 0;
+    }
+    report("unlink(full path) x 1/2", fmsim_traps() * 2, fmsim_lookups() * 2, ok);
+    failed += !ok;
+
+    ok = 1;
+    flush_caches();
+    for (i = 1; i < NFILES; i += 2) {
+        sprintf(name, "file%02d", i);
+        if (unlinkat(dfd, name, 0) != 0) ok = 0;
+    }
+    report("unlinkat(dirfd, name) x 1/2", fmsim_traps() * 2, fmsim_lookups() * 2, ok);
+    failed += !ok;
+
+    close(dfd);
+    return failed ? -1 : 0;
+}
+
+static int check_semantics(void)
+{
+    struct dirent *de;
+    struct stat st;
+    DIR *dir;
+    int dfd, fd, seen = 0;
+
+    dfd = open("a/b", O_RDONLY | O_DIRECTORY);
+    if (dfd < 0) return -1;
+
+    /* openat() creates; O_EXCL refuses an existing name */
+    fd = openat(dfd, "new", O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 || write(fd, "hello", 5) != 5 || close(fd) != 0) return -1;
+    if (openat(dfd, "new", O_WRONLY | O_CREAT | O_EXCL, 0644) != -1 || errno != EEXIST) return -1;
+    if (open("a/b/new", O_WRONLY | O_CREAT | O_EXCL, 0644) != -1 || errno != EEXIST) return -1;
+    if (fstatat(AT_FDCWD, "a/b/new", &st, AT_SYMLINK_NOFOLLOW) != 0 || st.st_size != 5) return -1;
+
+    /* Relative paths with several components, "." and ".." */
+    if (fstatat(dfd, "c/d/../../new", &st, 0) != 0 || st.st_size != 5) return -1;
+    if (fstatat(dfd, "./c/d", &st, 0) != 0 || !S_ISDIR(st.st_mode)) return -1;
+    if (fstatat(dfd, "..", &st, 0) != 0 || !S_ISDIR(st.st_mode)) return -1;
+    if (fstatat(dfd, "missing", &st, 0) != -1 || errno != ENOENT) return -1;
+
+    /* mkdirat(), then renameat() into it from another directory */
+    if (mkdirat(dfd, "sub", 0755) != 0) return -1;
+    if (mkdirat(dfd, "sub", 0755) != -1 || errno != EEXIST) return -1;
+    if (mkdirat(dfd, "sub/inner", 0755) != 0) return -1;
+    if (renameat(dfd, "new", dfd, "sub/inner/moved") != 0) return -1;
+    if (fstatat(dfd, "new", &st, 0) != -1 || errno != ENOENT) return -1;
+    if (stat("a/b/sub/inner/moved", &st) != 0 || st.st_size != 5) return -1;
+
+    /* rename() moves between directories too */
+    if (rename("a/b/sub/inner/moved", "a/kept") != 0) return -1;
+    if (stat("a/kept", &st) != 0 || st.st_size != 5) return -1;
+
+    /* unlinkat(AT_REMOVEDIR) removes only empty directories */
+    if (unlinkat(dfd, "sub", AT_REMOVEDIR) != -1 || errno != ENOTEMPTY) return -1;
+    if (unlinkat(dfd, "sub/inner", AT_REMOVEDIR) != 0) return -1;
+    if (unlinkat(dfd, "sub", AT_REMOVEDIR) != 0) return -1;
+    if (fstatat(dfd, "sub", &st, 0) != -1 || errno != ENOENT) return -1;
+
+    /* fdopendir() lists the directory the descriptor names */
+    dir = fdopendir(dfd);
+    if (!dir) return -1;
+    while ((de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, "c") == 0) seen++;
+    }
+    if (seen != 1 || dirfd(dir) != dfd || closedir(dir) != 0) return -1;
+
+    /* Directories open read-only; a file is not a dirfd */
+    if (open("a/b", O_RDWR) != -1 || errno != EISDIR) return -1;
+    if (open("a/kept", O_RDONLY | O_DIRECTORY) != -1 || errno != ENOTDIR) return -1;
+    fd = open("a/kept", O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstatat(fd, "x", &st, 0) != -1 || errno != ENOTDIR) return -1;
+    if (fdopendir(fd) != NULL || errno != ENOTDIR) return -1;
+    close(fd);
+    if (fstatat(dfd, "x", &st, 0) != -1 || errno != EBADF) return -1;
+    if (openat(99, "x", O_RDONLY) != -1 || errno != EBADF) return -1;
+
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+    if (make_tree() != 0) {
+        printf("setup failed\n");
+        return 1;
+    }
+
+    printf("%d files in %s, caches flushed, simulated File Manager:\n", NFILES, DEEP_DIR);
+    if (run() != 0) failed++;
+
+    if (check_semantics() != 0) {
+        printf("semantics check: FAILED\n");
+        failed++;
+    } else {
+        printf("semantics check: ok\n");
+    }
+
+    return failed ? 1 : 0;
+}
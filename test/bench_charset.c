@@ -0,0 +1,198 @@
+/*
+ * bench_charset.c - Host benchmark for the UTF-8 <-> Mac filename transcoder
+ *
+ * Converts an ASCII and a non-ASCII POSIX path to a Mac path and back
+ * over and over, and reports MB/s of input for each direction next to
+ * a verbatim copy with the separators swapped, which is all the
+ * conversion did before names were transcoded. Also checks that every
+ * byte of every Mac encoding survives a round trip, the '/' and ':'
+ * swap, unmappable characters and bytes that are not UTF-8, that files
+ * created, listed, stat()ed and chdir()ed into by UTF-8 name have Mac
+ * names in the catalog, and the Script Manager default.
+ *
+ * Build and run with: test/build-host-bench.sh charset
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <Multiverse.h>
+#include "MacCompat.h"
+#include "posix9.h"
+#include "fm_sim.h"
+
+#define CALLS       200000
+
+static const char ascii_path[] = "/Users/scott/Documents/Projects/posix9/src/posix9_path.c";
+static const char utf8_path[] = "/Users/fran\xc3\xa7ois/B\xc3\xbc" "cher/\xc3\x9c" "bersicht f\xc3\xbcr "
+                                "M\xc3\xa4rz/Caf\xc3\xa9 cr\xc3\xa8me \xe2\x80\x93 \xe2\x84\xa2.txt";
+
+static char mac[POSIX9_PATH_MAX];
+static char back[POSIX9_PATH_MAX];
+
+/* The conversion before transcoding: bytes copied, separators swapped */
+static char *verbatim(const char *src, char *dst, char from, char to)
+{
+    char *d = dst;
+
+    while (*src) {
+        *d++ = (*src == from) ? to : *src;
+        src++;
+    }
+    *d = '\0';
+
+    return dst;
+}
+
+static void run(const char *label, const char *path)
+{
+    double t0, t1, t2, t3, mb;
+    long i;
+    int ok;
+
+    /* "/x" comes back as "/Volumes/Macintosh HD/x" */
+    posix9_path_to_mac(path, mac, sizeof(mac));
+    posix9_path_from_mac(mac, back, sizeof(back));
+    ok = strcmp(back + strlen("/Volumes/Macintosh HD"), path) == 0;
+
+    t0 = fmsim_now();
+    for (i = 0; i < CALLS; i++) {
+        posix9_path_to_mac(path, mac, sizeof(mac));
+    }
+    t1 = fmsim_now();
+    for (i = 0; i < CALLS; i++) {
+        posix9_path_from_mac(mac, back, sizeof(back));
+    }
+    t2 = fmsim_now();
+    for (i = 0; i < CALLS; i++) {
+        verbatim(path, back, '/', ':');
+    }
+    t3 = fmsim_now();
+
+    mb = (double)strlen(path) * CALLS / (1024.0 * 1024.0);
+    printf("  %-10s %3d bytes  to_mac %7.1f MB/s  from_mac %7.1f MB/s  verbatim %7.1f MB/s  %s\n",
+           label, (int)strlen(path), mb / (t1 - t0),
+           (double)strlen(mac) * CALLS / (1024.0 * 1024.0) / (t2 - t1), mb / (t3 - t2),
+           ok ? "ok" : "MISMATCH");
+}
+
+/* Every byte 0x80-0xFF of every encoding comes back as itself */
+static int check_round_trips(void)
+{
+    static const int encodings[] = {
+        POSIX9_ENCODING_MACROMAN, POSIX9_ENCODING_MACGREEK, POSIX9_ENCODING_MACCYRILLIC,
+        POSIX9_ENCODING_MACCENTRALEUR, POSIX9_ENCODING_MACTURKISH,
+        POSIX9_ENCODING_MACCROATIAN, POSIX9_ENCODING_MACICELANDIC,
+        POSIX9_ENCODING_MACROMANIAN
+    };
+    char path[2 + 128 + 1];
+    int e, c;
+
+    for (e = 0; e < (int)(sizeof(encodings) / sizeof(encodings[0])); e++) {
+        if (posix9_set_filename_encoding(encodings[e]) != 0) return -1;
+        path[0] = ':';
+        for (c = 0x80; c <= 0xFF; c++) path[1 + c - 0x80] = (char)c;
+        path[1 + 128] = '\0';
+
+        posix9_path_from_mac(path, back, sizeof(back));
+        posix9_path_to_mac(back, mac, sizeof(mac));
+        if (strcmp(mac, path) != 0) return -1;
+    }
+
+    return posix9_set_filename_encoding(POSIX9_ENCODING_MACROMAN);
+}
+
+static int check_names(void)
+{
+    /* UTF-8 in, MacRoman out; ':' and '/' swap inside names */
+    if (strcmp(posix9_path_to_mac("caf\xc3\xa9/a:b", mac, sizeof(mac)), ":caf\216:a/b") != 0) return -1;
+    if (strcmp(posix9_path_from_mac(":caf\216:a/b", back, sizeof(back)), "./caf\xc3\xa9/a:b") != 0) return -1;
+
+    /* No MacRoman character: '?'; not UTF-8: the byte itself */
+    if (strcmp(posix9_path_to_mac("\xe6\x97\xa5", mac, sizeof(mac)), ":?") != 0) return -1;
+    if (strcmp(posix9_path_to_mac("caf\216", mac, sizeof(mac)), ":caf\216") != 0) return -1;
+    if (strcmp(posix9_path_to_mac("\xc3(", mac, sizeof(mac)), ":\xc3(") != 0) return -1;
+
+    /* Cyrillic names need the Cyrillic encoding */
+    if (posix9_set_filename_encoding(POSIX9_ENCODING_MACCYRILLIC) != 0) return -1;
+    if (strcmp(posix9_path_to_mac("\xd0\x9f\xd1\x80\xd0\xb8", mac, sizeof(mac)), ":\217\360\350") != 0) return -1;
+    if (posix9_set_filename_encoding(POSIX9_ENCODING_MACROMAN) != 0) return -1;
+    if (strcmp(posix9_path_to_mac("\xd0\x9f\xd1\x80\xd0\xb8", mac, sizeof(mac)), ":???") != 0) return -1;
+
+    if (posix9_set_filename_encoding(12345) != -1 || errno != EINVAL) return -1;
+
+    return 0;
+}
+
+static int check_files(void)
+{
+    struct dirent *de;
+    struct stat st;
+    FSSpec spec;
+    DIR *dir;
+    int fd, seen = 0;
+
+    /* The catalog holds the MacRoman name */
+    fd = open("caf\xc3\xa9.txt", O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 || write(fd, "x", 1) != 1 || close(fd) != 0) return -1;
+    if (FSMakeFSSpec(0, 0, (ConstStr255Param)"\011:caf\216.txt", &spec) != noErr) return -1;
+    if (stat("caf\xc3\xa9.txt", &st) != 0 || st.st_size != 1) return -1;
+
+    /* readdir() gives it back in UTF-8 */
+    dir = opendir(".");
+    if (!dir) return -1;
+    while ((de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, "caf\xc3\xa9.txt") == 0) seen++;
+    }
+    if (seen != 1 || closedir(dir) != 0) return -1;
+
+    /* A character MacRoman lacks makes the name invalid */
+    if (open("\xe6\x97\xa5.txt", O_WRONLY | O_CREAT, 0644) != -1 || errno != EINVAL) return -1;
+
+    /* getcwd() is UTF-8 too */
+    if (mkdir("/\xc3\x9c" "bersicht", 0755) != 0 || chdir("/\xc3\x9c" "bersicht") != 0) return -1;
+    if (getcwd(back, sizeof(back)) == NULL || strcmp(back, "/\xc3\x9c" "bersicht") != 0) return -1;
+    if (chdir("/") != 0) return -1;
+
+    return 0;
+}
+
+/* With none set, the system script's encoding is used */
+static int check_default(void)
+{
+    fmsim_set_script(smCyrillic, verUS);
+    if (posix9_set_filename_encoding(POSIX9_ENCODING_SYSTEM) != 0 ||
+        posix9_get_filename_encoding() != POSIX9_ENCODING_MACCYRILLIC) return -1;
+    fmsim_set_script(smRoman, verTurkey);
+    if (posix9_set_filename_encoding(POSIX9_ENCODING_SYSTEM) != 0 ||
+        posix9_get_filename_encoding() != POSIX9_ENCODING_MACTURKISH) return -1;
+    fmsim_set_script(smRoman, verUS);
+    if (posix9_set_filename_encoding(POSIX9_ENCODING_SYSTEM) != 0 ||
+        posix9_get_filename_encoding() != POSIX9_ENCODING_MACROMAN) return -1;
+
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+    if (posix9_get_filename_encoding() != POSIX9_ENCODING_MACROMAN) {
+        printf("default encoding: FAILED\n");
+        return 1;
+    }
+
+    printf("POSIX <-> Mac path conversion x %d, MacRoman:\n", CALLS);
+    run("ASCII", ascii_path);
+    run("non-ASCII", utf8_path);
+
+    if (check_round_trips() != 0 || check_names() != 0 || check_files() != 0 ||
+        check_default() != 0) {
+        printf("encoding check: FAILED\n");
+        failed++;
+    } else {
+        printf("encoding check: ok\n");
+    }
+
+    return failed ? 1 : 0;
+}
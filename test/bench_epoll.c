@@ -0,0 +1,370 @@
+/*
+ * bench_epoll.c - Host benchmark for posix9_epoll over Open Transport
+ *
+ * Waits for one byte to arrive on one of 1, 30 or 120 connected
+ * sockets, the rest idle, with select() and poll(), which are handed
+ * every socket on each call, and with posix9_epoll_wait() on a set the
+ * sockets were registered in once. Reports waits per second. Also
+ * checks level- and edge-triggered and one-shot reporting, readiness
+ * at registration, turns when more are ready than maxevents, a socket
+ * in two sets, hang-ups, removal and close while events are queued,
+ * poll() waiting on a set, the errors of each call, and that closing a
+ * set frees everything.
+ *
+ * Build and run with: test/build-host-bench.sh epoll
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "posix9.h"
+#include "posix9/socket.h"
+#include "fm_sim.h"
+#include "ot_sim.h"
+#include "tm_sim.h"
+
+#define MAX_SOCKS   120
+#define WAITS       3000
+#define IDLE_ROUNDS 20          /* Yields before the byte arrives */
+
+static int socks[MAX_SOCKS];
+static int nsocks;
+
+/* The byte the idle hook delivers after a few rounds */
+static int arrive_on = -1;
+static int arrive_in;
+
+static void deliver(void)
+{
+    if (arrive_on >= 0 && --arrive_in <= 0) {
+        otsim_receive(arrive_on, "x", 1);
+        arrive_on = -1;
+    }
+}
+
+static void arrive(int endpoint, int rounds)
+{
+    arrive_on = endpoint;
+    arrive_in = rounds;
+}
+
+static void close_sockets(void)
+{
+    while (nsocks > 0) close(socks[--nsocks]);
+}
+
+/* n connected sockets on a fresh network; socks[i] is endpoint i */
+static int open_sockets(int n)
+{
+    struct sockaddr_in sin;
+    int s;
+
+    close_sockets();
+    otsim_reset();
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(22);
+    sin.sin_addr.s_addr = htonl(0x0A000001);
+
+    while (nsocks < n) {
+        s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s < 0 || connect(s, (struct sockaddr *)&sin, sizeof(sin)) != 0) return -1;
+        socks[nsocks++] = s;
+    }
+
+    return 0;
+}
+
+/* Add socks[i] to set ep with events, tagged i */
+static int add(int ep, int i, unsigned int events)
+{
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.u64 = 0;
+    ev.data.u32 = i;
+    return posix9_epoll_ctl(ep, EPOLL_CTL_ADD, socks[i], &ev);
+}
+
+/* ============================================================
+ * Waits
+ * ============================================================ */
+
+static int ep_set;
+
+static int wait_select(int n)
+{
+    fd_set rset;
+    int i;
+
+    FD_ZERO(&rset);
+    for (i = 0; i < n; i++) FD_SET(socks[i], &rset);
+    if (select(socks[n - 1] + 1, &rset, NULL, NULL, NULL) != 1) return -1;
+    for (i = 0; i < n; i++) {
+        if (FD_ISSET(socks[i], &rset)) return i;
+    }
+    return -1;
+}
+
+static int wait_poll(int n)
+{
+    static struct pollfd fds[MAX_SOCKS];
+    int i, found = -1;
+
+    for (i = 0; i < n; i++) {
+        fds[i].fd = socks[i];
+        fds[i].events = POLLIN;
+    }
+    if (poll(fds, n, -1) != 1) return -1;
+    for (i = 0; i < n; i++) {
+        if (fds[i].revents == POLLIN) found = i;
+    }
+    return found;
+}
+
+static int wait_epoll(int n)
+{
+    struct epoll_event ev[4];
+
+    (void)n;
+
+    if (posix9_epoll_wait(ep_set, ev, 4, -1) != 1 || ev[0].events != EPOLLIN) return -1;
+    return (int)ev[0].data.u32;
+}
+
+static int run(const char *label, int n, int (*wait)(int))
+{
+    double t0, t1;
+    char c;
+    int i, target, ok = 1;
+
+    if (open_sockets(n) != 0) return -1;
+    ep_set = posix9_epoll_create(n);
+    for (i = 0; i < n; i++) {
+        if (add(ep_set, i, EPOLLIN) != 0) return -1;
+    }
+    tmsim_set_idle(deliver);
+
+    t0 = fmsim_now();
+    for (i = 0; i < WAITS; i++) {
+        target = (i * 7) % n;
+        arrive(target, IDLE_ROUNDS);
+        if (wait(n) != target || recv(socks[target], &c, 1, 0) != 1 || c != 'x') {
+            ok = 0;
+            break;
+        }
+    }
+    t1 = fmsim_now();
+    tmsim_set_idle(NULL);
+    close(ep_set);
+
+    printf("  %-22s %3d sockets %9.0f waits/s  %s\n",
+           label, n, WAITS / (t1 - t0), ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+/* ============================================================
+ * Semantics
+ * ============================================================ */
+
+/* Bit i set for each socket i reported */
+static unsigned long reported(int ep, int maxevents, int timeout, int *count)
+{
+    struct epoll_event ev[16];
+    unsigned long bits = 0;
+    int i;
+
+    *count = posix9_epoll_wait(ep, ev, maxevents, timeout);
+    for (i = 0; i < *count; i++) bits |= 1UL << ev[i].data.u32;
+    return bits;
+}
+
+static int check_triggers(int ep)
+{
+    struct epoll_event ev[4];
+    char buf[8];
+    int n;
+
+    /* Level: reported until read */
+    if (add(ep, 0, EPOLLIN) != 0) return -1;
+    if (posix9_epoll_wait(ep, ev, 4, 0) != 0) return -1;
+    arrive(0, IDLE_ROUNDS);
+    if (reported(ep, 4, -1, &n) != 0x1 || n != 1) return -1;
+    if (reported(ep, 4, 0, &n) != 0x1 || n != 1) return -1;
+    if (recv(socks[0], buf, sizeof(buf), 0) != 1) return -1;
+    if (posix9_epoll_wait(ep, ev, 4, 0) != 0) return -1;
+
+    /* Edge: once each time data comes to an empty socket; OT says
+     * nothing of more behind it until that has been read */
+    if (add(ep, 1, EPOLLIN | EPOLLET) != 0) return -1;
+    if (otsim_receive(1, "a", 1) != 0) return -1;
+    if (reported(ep, 4, 0, &n) != 0x2 || n != 1) return -1;
+    if (posix9_epoll_wait(ep, ev, 4, 0) != 0) return -1;
+    if (otsim_receive(1, "b", 1) != 0) return -1;
+    if (posix9_epoll_wait(ep, ev, 4, 0) != 0) return -1;
+    if (recv(socks[1], buf, sizeof(buf), 0) != 2) return -1;
+    arrive(1, IDLE_ROUNDS);
+    if (reported(ep, 4, 1000, &n) != 0x2 || n != 1) return -1;
+    if (recv(socks[1], buf, sizeof(buf), 0) != 1) return -1;
+
+    /* One-shot: nothing more until EPOLL_CTL_MOD */
+    if (add(ep, 2, EPOLLIN | EPOLLONESHOT) != 0) return -1;
+    if (otsim_receive(2, "a", 1) != 0) return -1;
+    if (reported(ep, 4, 0, &n) != 0x4 || n != 1) return -1;
+    if (otsim_receive(2, "b", 1) != 0) return -1;
+    if (posix9_epoll_wait(ep, ev, 4, 0) != 0) return -1;
+    ev[0].events = EPOLLIN;
+    ev[0].data.u32 = 2;
+    if (posix9_epoll_ctl(ep, EPOLL_CTL_MOD, socks[2], &ev[0]) != 0) return -1;
+    if (reported(ep, 4, 0, &n) != 0x4 || n != 1) return -1;
+    if (recv(socks[2], buf, sizeof(buf), 0) != 2) return -1;
+
+    /* Ready before it was added; writable at once */
+    if (otsim_receive(3, "a", 1) != 0) return -1;
+    if (add(ep, 3, EPOLLIN) != 0) return -1;
+    if (reported(ep, 4, 0, &n) != 0x8 || n != 1) return -1;
+    if (recv(socks[3], buf, sizeof(buf), 0) != 1) return -1;
+    if (add(ep, 4, EPOLLOUT) != 0) return -1;
+    if (posix9_epoll_wait(ep, ev, 4, 0) != 1 || ev[0].events != EPOLLOUT) return -1;
+    if (posix9_epoll_ctl(ep, EPOLL_CTL_DEL, socks[4], NULL) != 0) return -1;
+
+    /* A broken connection */
+    if (otsim_disconnect(0) != 0) return -1;
+    if (posix9_epoll_wait(ep, ev, 4, 0) != 1 || ev[0].events != (EPOLLIN | EPOLLHUP)) return -1;
+    if (posix9_epoll_ctl(ep, EPOLL_CTL_DEL, socks[0], NULL) != 0) return -1;
+
+    return 0;
+}
+
+static int check_sets(void)
+{
+    struct epoll_event ev[4];
+    unsigned long seen;
+    int ep, ep2, i, n, fd;
+
+    ep = posix9_epoll_create(8);
+    ep2 = posix9_epoll_create(8);
+    if (ep < 0 || ep2 < 0) return -1;
+
+    /* Five ready, two at a time: every one within three waits */
+    for (i = 0; i < 5; i++) {
+        if (add(ep, i, EPOLLIN) != 0 || otsim_receive(i, "a", 1) != 0) return -1;
+    }
+    seen = 0;
+    for (i = 0; i < 3; i++) {
+        seen |= reported(ep, 2, 0, &n);
+        if (n != 2) return -1;
+    }
+    if (seen != 0x1F) return -1;
+
+    /* One socket in two sets */
+    if (add(ep2, 2, EPOLLIN) != 0) return -1;
+    if (reported(ep2, 4, 0, &n) != 0x4 || n != 1) return -1;
+
+    /* Removed, and closed, with events queued: no longer reported */
+    for (i = 0; i < 5; i++) {
+        if (recv(socks[i], ev, 1, 0) != 1) return -1;
+    }
+    if (posix9_epoll_wait(ep, ev, 4, 0) != 0) return -1;
+    if (otsim_receive(0, "a", 1) != 0 || otsim_receive(1, "a", 1) != 0 ||
+        otsim_receive(2, "a", 1) != 0) return -1;
+    if (posix9_epoll_ctl(ep, EPOLL_CTL_DEL, socks[0], NULL) != 0) return -1;
+    fd = socks[2];
+    if (close(fd) != 0) return -1;
+    if (reported(ep, 4, 0, &n) != 0x2 || n != 1) return -1;
+    if (posix9_epoll_wait(ep2, ev, 4, 0) != 0) return -1;
+
+    /* The number is free to add again once a new socket has it */
+    socks[2] = socket(AF_INET, SOCK_STREAM, 0);
+    if (socks[2] != fd || add(ep, 2, EPOLLIN) != 0) return -1;
+
+    /* Errors */
+    fd = open("/epoll.txt", O_RDWR | O_CREAT, 0644);
+    ev[0].events = EPOLLIN;
+    if (posix9_epoll_create(0) != -1 || errno != EINVAL) return -1;
+    if (posix9_epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev[0]) != -1 || errno != EPERM) return -1;
+    if (posix9_epoll_ctl(ep, EPOLL_CTL_ADD, 99, &ev[0]) != -1 || errno != EBADF) return -1;
+    if (posix9_epoll_ctl(ep, EPOLL_CTL_ADD, socks[1], &ev[0]) != -1 || errno != EEXIST) return -1;
+    if (posix9_epoll_ctl(ep, EPOLL_CTL_MOD, socks[0], &ev[0]) != -1 || errno != ENOENT) return -1;
+    if (posix9_epoll_ctl(ep, EPOLL_CTL_DEL, socks[0], NULL) != -1 || errno != ENOENT) return -1;
+    if (posix9_epoll_ctl(ep, EPOLL_CTL_ADD, ep, &ev[0]) != -1 || errno != EINVAL) return -1;
+    if (posix9_epoll_ctl(fd, EPOLL_CTL_ADD, socks[0], &ev[0]) != -1 || errno != EINVAL) return -1;
+    if (posix9_epoll_wait(ep, ev, 0, 0) != -1 || errno != EINVAL) return -1;
+    if (close(fd) != 0) return -1;
+
+    /* Closing the sets with items queued and ready frees them all */
+    if (otsim_receive(3, "a", 1) != 0 || add(ep2, 3, EPOLLIN) != 0) return -1;
+    if (close(ep) != 0 || close(ep2) != 0) return -1;
+
+    return 0;
+}
+
+static int check_semantics(void)
+{
+    double t0, t1;
+    struct epoll_event ev;
+    struct pollfd pfd;
+    char c;
+    long ptrs;
+    int ep;
+
+    if (open_sockets(8) != 0) return -1;
+    tmsim_set_idle(deliver);
+    ptrs = fmsim_ptrs();
+
+    ep = posix9_epoll_create(8);
+    if (ep < 0 || check_triggers(ep) != 0) return -1;
+
+    /* The whole timeout with nothing ready */
+    t0 = fmsim_now();
+    if (posix9_epoll_wait(ep, &ev, 1, 100) != 0) return -1;
+    t1 = fmsim_now();
+    if (t1 - t0 < 0.08 || t1 - t0 > 1.0) return -1;
+
+    /* poll() on the set wakes when a socket in it gets data */
+    pfd.fd = ep;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 0) != 0) return -1;
+    arrive(3, IDLE_ROUNDS);
+    if (poll(&pfd, 1, -1) != 1 || pfd.revents != POLLIN) return -1;
+    if (recv(socks[3], &c, 1, 0) != 1 || poll(&pfd, 1, 0) != 0) return -1;
+
+    /* Closed while listed for poll(): the next poll() finds nothing of it */
+    if (otsim_receive(3, "a", 1) != 0) return -1;
+    if (close(ep) != 0 || poll(&pfd, 0, 0) != 0) return -1;
+    if (recv(socks[3], &c, 1, 0) != 1) return -1;
+
+    if (open_sockets(8) != 0 || check_sets() != 0) return -1;
+    if (fmsim_ptrs() != ptrs) return -1;
+
+    tmsim_set_idle(NULL);
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+
+    printf("Wait for 1 byte on one of n sockets x %d, %d rounds later, simulated Open Transport:\n",
+           WAITS, IDLE_ROUNDS);
+    if (run("select()", 30, wait_select) != 0) failed++;
+    if (run("select()", MAX_SOCKS, wait_select) != 0) failed++;
+    if (run("poll()", 30, wait_poll) != 0) failed++;
+    if (run("poll()", MAX_SOCKS, wait_poll) != 0) failed++;
+    if (run("posix9_epoll_wait()", 1, wait_epoll) != 0) failed++;
+    if (run("posix9_epoll_wait()", 30, wait_epoll) != 0) failed++;
+    if (run("posix9_epoll_wait()", MAX_SOCKS, wait_epoll) != 0) failed++;
+
+    if (check_semantics() != 0) {
+        printf("epoll check: FAILED\n");
+        failed++;
+    } else {
+        printf("epoll check: ok\n");
+    }
+
+    close_sockets();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * bench_fdtable.c - Host benchmark for the unified descriptor table
+ *
+ * Fills the table with a mix of files and directory streams, checks
+ * that descriptors are handed out lowest-first, that read(), close()
+ * and select() dispatch on any descriptor kind, that dup2() can
+ * replace one kind with another, and that duplicates share one open
+ * file description (offset, refNum) until the last close. Then times open()/close() churn with
+ * the table nearly full, where the old linear slot scan was slowest.
+ *
+ * Build and run with: test/build-host-bench.sh fdtable
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "posix9.h"
+#include "fm_sim.h"
+
+#define CHURN   200000L
+
+static int check_dispatch(void)
+{
+    struct timeval zero = { 0, 0 };
+    fd_set rset, wset;
+    DIR *d;
+    char c;
+    int fd, dfd, n;
+
+    fd = open("/a.txt", O_RDWR | O_CREAT, 0644);
+    if (fd != 3) return -1;
+    if (write(fd, "x", 1) != 1) return -1;
+
+    if (mkdir("d", 0755) != 0) return -1;
+    d = opendir("d");
+    if (!d) return -1;
+    dfd = dirfd(d);
+    if (dfd != 4) return -1;
+
+    /* A directory descriptor refuses byte I/O */
+    if (read(dfd, &c, 1) != -1 || errno != EISDIR) return -1;
+
+    /* Files and directories are always ready */
+    FD_ZERO(&rset);
+    FD_ZERO(&wset);
+    FD_SET(fd, &rset);
+    FD_SET(dfd, &rset);
+    FD_SET(fd, &wset);
+    n = select(dfd + 1, &rset, &wset, NULL, &zero);
+    if (n != 3 || !FD_ISSET(fd, &rset) || !FD_ISSET(dfd, &rset)) return -1;
+
+    /* Closed descriptors in a set are an error */
+    FD_ZERO(&rset);
+    FD_SET(9, &rset);
+    if (select(10, &rset, NULL, NULL, &zero) != -1 || errno != EBADF) return -1;
+
+    /* dup2 over a directory stream turns its number into a file */
+    if (dup2(fd, dfd) != dfd) return -1;
+    if (lseek(dfd, 0, SEEK_SET) != 0 || read(dfd, &c, 1) != 1 || c != 'x') return -1;
+    if (closedir(d) != -1) return -1;
+
+    /* Freed numbers are reused lowest-first */
+    if (close(dfd) != 0) return -1;
+    if (close(fd) != 0) return -1;
+    if (close(dfd) != -1 || errno != EBADF) return -1;
+    if (open("/a.txt", O_RDONLY) != 3) return -1;
+    if (close(3) != 0) return -1;
+
+    return 0;
+}
+
+static int check_dup(void)
+{
+    char buf[8];
+    int fd, fd2, fd3;
+
+    fd = open("/dup.txt", O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    fd2 = dup(fd);
+    if (fd2 != fd + 1) return -1;
+
+    /* One offset: a write through either moves both */
+    if (write(fd, "abc", 3) != 3 || write(fd2, "def", 3) != 3) return -1;
+    if (lseek(fd, 0, SEEK_CUR) != 6 || lseek(fd2, 0, SEEK_CUR) != 6) return -1;
+
+    /* One refNum: closing a duplicate leaves the file open */
+    if (close(fd) != 0) return -1;
+    if (lseek(fd2, 0, SEEK_SET) != 0 || read(fd2, buf, 6) != 6) return -1;
+    if (memcmp(buf, "abcdef", 6) != 0) return -1;
+
+    /* dup2 onto itself is a no-op, onto an open number replaces it */
+    if (dup2(fd2, fd2) != fd2) return -1;
+    fd3 = open("/other.txt", O_RDWR | O_CREAT, 0644);
+    if (fd3 < 0) return -1;
+    if (dup2(fd2, fd3) != fd3) return -1;
+    if (close(fd2) != 0) return -1;
+    if (lseek(fd3, 0, SEEK_CUR) != 6) return -1;
+    if (close(fd3) != 0) return -1;
+    if (close(fd2) != -1 || errno != EBADF) return -1;
+
+    return 0;
+}
+
+static int churn(void)
+{
+    static int fds[POSIX9_OPEN_MAX];
+    double t0, t1;
+    char name[16];
+    long i;
+    int n = 0, fd;
+
+    /* Fill all but the last few slots with open files */
+    for (;;) {
+        sprintf(name, "/f%d", n);
+        fd = open(name, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) break;
+        fds[n++] = fd;
+    }
+    if (errno != EMFILE) return -1;
+    printf("  table full at %d descriptors (EMFILE)\n", n + 3);
+
+    close(fds[n - 1]);
+    close(fds[n - 2]);
+    n -= 2;
+
+    t0 = fmsim_now();
+    for (i = 0; i < CHURN; i++) {
+        fd = open("/f0", O_RDONLY);
+        if (fd != fds[n - 1] + 1) return -1;
+        close(fd);
+    }
+    t1 = fmsim_now();
+    printf("  open()/close() with %d descriptors in use: %.0f pairs/s\n",
+           n + 3, CHURN / (t1 - t0 > 0 ? t1 - t0 : 1e-9));
+
+    while (n > 0) close(fds[--n]);
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+    posix9_init();
+
+    if (check_dispatch() != 0) {
+        printf("dispatch check: FAILED\n");
+        failed++;
+    } else {
+        printf("dispatch check: ok\n");
+    }
+
+    if (check_dup() != 0) {
+        printf("dup check: FAILED\n");
+        failed++;
+    } else {
+        printf("dup check: ok\n");
+    }
+
+    if (churn() != 0) {
+        printf("churn: FAILED\n");
+        failed++;
+    }
+
+    posix9_cleanup();
+    return failed ? 1 : 0;
+}
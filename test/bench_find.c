@@ -0,0 +1,308 @@
+/*
+ * bench_find.c - Host benchmark for posix9_find()
+ *
+ * Looks for the 10 files named main.c in a tree of 111 folders and
+ * 2,000 files, next to another 50 outside it, three ways: with nftw()
+ * and a name check in the callback, with posix9_find() on PBCatSearch,
+ * and with posix9_find() on a volume without CatSearch, where it walks
+ * the tree instead. Reports File Manager calls and searches per second
+ * with the caches flushed. Also checks that both kinds of search find
+ * the same entries for names, globs, folders, sizes, dates and Finder
+ * types, that matches outside the path searched are left out, and that
+ * a catalog changed part way through neither repeats nor loses one.
+ *
+ * Build and run with: test/build-host-bench.sh find
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <Multiverse.h>
+#include "MacCompat.h"
+#include "posix9.h"
+#include "posix9/ftw.h"
+#include "fm_sim.h"
+
+#define TOP_DIRS    10
+#define SUB_DIRS    10
+#define FILES       20
+#define OUTSIDE     50
+#define PASSES      20
+
+static long found, sum;
+
+/* An order-free digest of the paths found */
+static long digest(const char *path)
+{
+    long h = 5381;
+
+    while (*path) h = h * 33 + (unsigned char)*path++;
+    return h;
+}
+
+static int make_tree(void)
+{
+    char path[64];
+    int d, s, f, fd;
+
+    if (mkdir("t", 0755) != 0 || mkdir("other", 0755) != 0) return -1;
+    for (d = 0; d < TOP_DIRS; d++) {
+        sprintf(path, "t/d%d", d);
+        if (mkdir(path, 0755) != 0) return -1;
+        for (s = 0; s < SUB_DIRS; s++) {
+            sprintf(path, "t/d%d/s%d", d, s);
+            if (mkdir(path, 0755) != 0) return -1;
+            for (f = 0; f < FILES; f++) {
+                if (f == 0 && s == d) sprintf(path, "t/d%d/s%d/main.c", d, s);
+                else sprintf(path, "t/d%d/s%d/f%02d.txt", d, s, f);
+                fd = open(path, O_WRONLY | O_CREAT, 0644);
+                if (fd < 0 || write(fd, "xxxxxxxxxx", f % 11) != f % 11 || close(fd) != 0) {
+                    return -1;
+                }
+            }
+        }
+    }
+    for (f = 0; f < OUTSIDE; f++) {
+        sprintf(path, "other/o%02d", f);
+        if (mkdir(path, 0755) != 0) return -1;
+        sprintf(path, "other/o%02d/main.c", f);
+        if (close(open(path, O_WRONLY | O_CREAT, 0644)) != 0) return -1;
+    }
+
+    return 0;
+}
+
+static int count_main(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    (void)sb;
+
+    if (type == FTW_F && strcmp(path + ftw->base, "main.c") == 0) {
+        found++;
+        sum += digest(path);
+    }
+    return 0;
+}
+
+static int count_match(const char *path, const struct stat *sb, void *arg)
+{
+    (void)sb;
+    (void)arg;
+
+    found++;
+    sum += digest(path);
+    return 0;
+}
+
+static int search_nftw(void)
+{
+    return nftw("t", count_main, 20, FTW_PHYS);
+}
+
+static int search_find(void)
+{
+    posix9_find_spec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.name = "main.c";
+    return posix9_find("t", &spec, count_match, NULL);
+}
+
+static int run(const char *label, int (*search)(void), int catsearch, long expect)
+{
+    unsigned long traps;
+    double t0, t1;
+    int pass, ok = 1;
+
+    fmsim_set_catsearch(catsearch);
+    fmsim_zero_traps();
+    t0 = fmsim_now();
+    for (pass = 0; pass < PASSES; pass++) {
+        posix9_statcache_flush();
+        posix9_pathcache_flush();
+        found = sum = 0;
+        if (search() != 0 || found != TOP_DIRS || sum != expect) ok = 0;
+    }
+    t1 = fmsim_now();
+    traps = fmsim_traps();
+
+    printf("  %-34s %7.1f traps/search  %8.0f searches/s  %s\n", label,
+           (double)traps / PASSES, PASSES / (t1 - t0), ok ? "ok" : "MISMATCH");
+
+    fmsim_set_catsearch(1);
+    return ok ? 0 : -1;
+}
+
+/* ============================================================
+ * Criteria
+ * ============================================================ */
+
+/* Found and digest of a search; the same with CatSearch and without */
+static int both(const char *path, const posix9_find_spec *spec, long *count)
+{
+    long catFound, catSum;
+    int on;
+
+    for (on = 1; on >= 0; on--) {
+        fmsim_set_catsearch(on);
+        found = sum = 0;
+        if (posix9_find(path, spec, count_match, NULL) != 0) return -1;
+        if (on) {
+            catFound = found;
+            catSum = sum;
+        }
+    }
+    fmsim_set_catsearch(1);
+
+    *count = found;
+    return (found == catFound && sum == catSum) ? 0 : -1;
+}
+
+static int check_criteria(void)
+{
+    posix9_find_spec spec;
+    struct stat st;
+    FSSpec fs;
+    long n;
+
+    /* Names: ASCII case does not matter; globs */
+    memset(&spec, 0, sizeof(spec));
+    spec.name = "MAIN.C";
+    if (both("t", &spec, &n) != 0 || n != TOP_DIRS) return -1;
+    spec.name = "f1?.txt";
+    if (both("t", &spec, &n) != 0 || n != TOP_DIRS * SUB_DIRS * 10) return -1;
+    spec.name = "f[0-1][!0-8].t*t";
+    if (both("t/d3", &spec, &n) != 0 || n != SUB_DIRS * 2) return -1;
+    spec.name = "*";
+    if (both("t", &spec, &n) != 0 || n != TOP_DIRS + TOP_DIRS * SUB_DIRS * (1 + FILES)) return -1;
+    spec.name = "nothing*here";
+    if (both("t", &spec, &n) != 0 || n != 0) return -1;
+
+    /* Below the path searched only: not other/, not t/d1 itself */
+    spec.name = "main.c";
+    if (both("/", &spec, &n) != 0 || n != TOP_DIRS + OUTSIDE) return -1;
+    spec.name = "d1";
+    if (both("t/d1", &spec, &n) != 0 || n != 0) return -1;
+
+    /* Folders; files of 9 or 10 bytes */
+    spec.name = "s*";
+    spec.types = POSIX9_FIND_DIRS;
+    if (both("t", &spec, &n) != 0 || n != TOP_DIRS * SUB_DIRS) return -1;
+    memset(&spec, 0, sizeof(spec));
+    spec.minSize = 9;
+    spec.maxSize = 10;
+    if (both("t", &spec, &n) != 0 || n != TOP_DIRS * SUB_DIRS * 2) return -1;
+
+    /* Dates either side of the tree's */
+    if (stat("t/d0/s0/main.c", &st) != 0) return -1;
+    memset(&spec, 0, sizeof(spec));
+    spec.types = POSIX9_FIND_FILES;
+    spec.olderThan = st.st_mtime + 100000;
+    if (both("t", &spec, &n) != 0 || n != TOP_DIRS * SUB_DIRS * FILES) return -1;
+    spec.newerThan = st.st_mtime + 100000;
+    if (both("t", &spec, &n) != 0 || n != 0) return -1;
+
+    /* Finder type and creator, of files made the Toolbox way */
+    if (FSMakeFSSpec(0, 0, (ConstStr255Param)"\012:t:d2:app1", &fs) != fnfErr ||
+        FSpCreate(&fs, 'ttxt', 'APPL', smSystemScript) != noErr) return -1;
+    if (FSMakeFSSpec(0, 0, (ConstStr255Param)"\015:t:d2:s4:app2", &fs) != fnfErr ||
+        FSpCreate(&fs, 'MSWD', 'APPL', smSystemScript) != noErr) return -1;
+    memset(&spec, 0, sizeof(spec));
+    spec.fileType = 'APPL';
+    if (both("t", &spec, &n) != 0 || n != 2) return -1;
+    spec.creator = 'MSWD';
+    if (both("t", &spec, &n) != 0 || n != 1) return -1;
+
+    return 0;
+}
+
+/* ============================================================
+ * Semantics
+ * ============================================================ */
+
+static int stop_at_third(const char *path, const struct stat *sb, void *arg)
+{
+    (void)path;
+    (void)sb;
+
+    return ++*(int *)arg == 3 ? 7 : 0;
+}
+
+static int check_semantics(void)
+{
+    static char seen[TOP_DIRS * SUB_DIRS][24];
+    posix9_find_spec spec;
+    POSIX9_FIND *f;
+    const char *path;
+    struct stat st;
+    int n = 0, i, calls = 0;
+
+    /* Each of 100 matches once, while files come and go part way */
+    memset(&spec, 0, sizeof(spec));
+    spec.name = "f05.txt";
+    f = posix9_find_open("t", &spec);
+    if (!f) return -1;
+    while ((path = posix9_find_next(f, &st)) != NULL) {
+        if (st.st_size != 5 || strlen(path) >= sizeof(seen[0])) return -1;
+        for (i = 0; i < n; i++) {
+            if (strcmp(seen[i], path) == 0) return -1;
+        }
+        strcpy(seen[n++], path);
+        if (n == 30 && close(open("t/new.txt", O_WRONLY | O_CREAT, 0644)) != 0) return -1;
+        if (n == 60 && unlink("t/new.txt") != 0) return -1;
+    }
+    if (errno != 0 || posix9_find_close(f) != 0 || n != TOP_DIRS * SUB_DIRS) return -1;
+
+    /* Deleting the last match starts over: the rest still come */
+    f = posix9_find_open("t", &spec);
+    if (!f) return -1;
+    n = 0;
+    while ((path = posix9_find_next(f, NULL)) != NULL) {
+        if (++n == 50) {
+            strcpy(seen[0], path);
+            if (unlink(seen[0]) != 0) return -1;
+        }
+        if (n > 2 * TOP_DIRS * SUB_DIRS) return -1;
+    }
+    if (errno != 0 || posix9_find_close(f) != 0 || n < TOP_DIRS * SUB_DIRS) return -1;
+
+    /* A non-zero result stops the search and comes back */
+    spec.name = "*.txt";
+    if (posix9_find("t", &spec, stop_at_third, &calls) != 7 || calls != 3) return -1;
+
+    /* A missing path, or a file */
+    if (posix9_find_open("no/such/dir", &spec) != NULL || errno != ENOENT) return -1;
+    if (posix9_find_open("t/d0/s0/main.c", &spec) != NULL || errno != ENOTDIR) return -1;
+
+    return 0;
+}
+
+int main(void)
+{
+    long expect = 0;
+    char path[64];
+    int d, failed = 0;
+
+    fmsim_reset();
+    if (make_tree() != 0) {
+        printf("setup failed\n");
+        return 1;
+    }
+    for (d = 0; d < TOP_DIRS; d++) {
+        sprintf(path, "t/d%d/s%d/main.c", d, d);
+        expect += digest(path);
+    }
+
+    printf("Find %d main.c among %d entries x %d passes, caches flushed, simulated File Manager:\n",
+           TOP_DIRS, 1 + TOP_DIRS + TOP_DIRS * SUB_DIRS * (1 + FILES) + 2 * OUTSIDE, PASSES);
+    if (run("nftw + name check", search_nftw, 1, expect) != 0) failed++;
+    if (run("posix9_find, PBCatSearch", search_find, 1, expect) != 0) failed++;
+    if (run("posix9_find, no CatSearch (walk)", search_find, 0, expect) != 0) failed++;
+
+    if (check_criteria() != 0 || check_semantics() != 0) {
+        printf("find check: FAILED\n");
+        failed++;
+    } else {
+        printf("find check: ok\n");
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,275 @@
+/*
+ * bench_ftw.c - Host benchmark for the nftw()/fts tree walker
+ *
+ * Walks a tree of 111 folders and 2,000 files three ways: recursively
+ * with opendir(), readdir() and stat() of every full path, the way the
+ * backup job did, with nftw(), and with fts_read(). Reports File
+ * Manager calls per entry and entries per second, with the bulk calls
+ * and without them. Also checks that all three see the same entries
+ * and sizes, pre- and post-order, pruning with fts_set(FTS_SKIP) and
+ * FTW_ACTIONRETVAL, stopping early, a file or a missing path as the
+ * root, and that a walk leaves no iterator or buffer behind.
+ *
+ * Build and run with: test/build-host-bench.sh ftw
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "posix9.h"
+#include "fm_sim.h"
+
+#define TOP_DIRS    10
+#define SUB_DIRS    10
+#define FILES       20
+#define ENTRIES     (1 + TOP_DIRS + TOP_DIRS * SUB_DIRS * (1 + FILES))
+#define PASSES      20
+
+static long entries, bytes;
+
+static int make_tree(void)
+{
+    char path[64];
+    int d, s, f, fd;
+
+    if (mkdir("t", 0755) != 0) return -1;
+    for (d = 0; d < TOP_DIRS; d++) {
+        sprintf(path, "t/d%d", d);
+        if (mkdir(path, 0755) != 0) return -1;
+        for (s = 0; s < SUB_DIRS; s++) {
+            sprintf(path, "t/d%d/s%d", d, s);
+            if (mkdir(path, 0755) != 0) return -1;
+            for (f = 0; f < FILES; f++) {
+                sprintf(path, "t/d%d/s%d/f%02d", d, s, f);
+                fd = open(path, O_WRONLY | O_CREAT, 0644);
+                if (fd < 0 || write(fd, "xxxxxxxxxx", f % 11) != f % 11 || close(fd) != 0) {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* What the backup job did: opendir() and stat() by full path */
+static int walk_paths(const char *path)
+{
+    char child[POSIX9_PATH_MAX];
+    struct dirent *de;
+    struct stat st;
+    DIR *dir;
+
+    if (stat(path, &st) != 0) return -1;
+    entries++;
+    if (!S_ISDIR(st.st_mode)) {
+        bytes += st.st_size;
+        return 0;
+    }
+
+    dir = opendir(path);
+    if (!dir) return -1;
+    while ((de = readdir(dir)) != NULL) {
+        sprintf(child, "%s/%s", path, de->d_name);
+        if (walk_paths(child) != 0) {
+            closedir(dir);
+            return -1;
+        }
+    }
+
+    return closedir(dir);
+}
+
+static int count_entry(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    (void)path;
+    (void)ftw;
+
+    entries++;
+    if (type == FTW_F) bytes += sb->st_size;
+    return 0;
+}
+
+static int walk_nftw(const char *path)
+{
+    return nftw(path, count_entry, 20, FTW_PHYS);
+}
+
+static int walk_fts(const char *path)
+{
+    char *paths[2];
+    FTSENT *ent;
+    FTS *fts;
+
+    paths[0] = (char *)path;
+    paths[1] = NULL;
+    fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+    if (!fts) return -1;
+    while ((ent = fts_read(fts)) != NULL) {
+        if (ent->fts_info == FTS_DP) continue;
+        entries++;
+        if (ent->fts_info == FTS_F) bytes += ent->fts_statp->st_size;
+    }
+
+    return fts_close(fts);
+}
+
+static int run(const char *label, int (*walk)(const char *), int bulk)
+{
+    double t0, t1;
+    long expectBytes = TOP_DIRS * SUB_DIRS * (FILES / 11 * 55 + (FILES % 11) * (FILES % 11 - 1) / 2);
+    int pass, ok = 1;
+
+    fmsim_set_hfsplus(bulk);
+    posix9_cleanup();       /* Forget the Gestalt answer */
+
+    fmsim_zero_traps();
+    t0 = fmsim_now();
+    for (pass = 0; pass < PASSES; pass++) {
+        posix9_statcache_flush();
+        posix9_pathcache_flush();
+        entries = bytes = 0;
+        if (walk("t") != 0 || entries != ENTRIES || bytes != expectBytes) ok = 0;
+    }
+    t1 = fmsim_now();
+
+    printf("  %-30s %6.3f traps/entry  %9.0f entries/s  %s\n", label,
+           (double)fmsim_traps() / ((double)ENTRIES * PASSES),
+           (double)ENTRIES * PASSES / (t1 - t0), ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+/* ============================================================
+ * Order and Pruning
+ * ============================================================ */
+
+static char order[64][32];
+static int visits;
+
+static int record(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    (void)sb;
+
+    if (visits < 64) {
+        sprintf(order[visits], "%c%d:%s", type == FTW_DP ? '<' : type == FTW_D ? '>' : ' ',
+                ftw->level, path + ftw->base);
+    }
+    visits++;
+    return 0;
+}
+
+static int prune(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    record(path, sb, type, ftw);
+    if (strcmp(path + ftw->base, "d1") == 0) return FTW_SKIP_SUBTREE;
+    if (strcmp(path + ftw->base, "f01") == 0) return FTW_SKIP_SIBLINGS;
+    return FTW_CONTINUE;
+}
+
+static int stop_at_f02(const char *path, const struct stat *sb, int type, struct FTW *ftw)
+{
+    (void)sb;
+    (void)type;
+
+    return strcmp(path + ftw->base, "f02") == 0 ? 42 : 0;
+}
+
+static int check_order(void)
+{
+    posix9_dir_usage usage;
+    char *paths[3];
+    FTSENT *ent;
+    FTS *fts;
+    int n;
+
+    fmsim_set_hfsplus(1);
+    posix9_cleanup();
+
+    if (mkdir("o", 0755) != 0 || mkdir("o/d0", 0755) != 0 || mkdir("o/d1", 0755) != 0 ||
+        close(open("o/d0/f00", O_WRONLY | O_CREAT, 0644)) != 0 ||
+        close(open("o/d0/f01", O_WRONLY | O_CREAT, 0644)) != 0 ||
+        close(open("o/d0/f02", O_WRONLY | O_CREAT, 0644)) != 0 ||
+        close(open("o/d1/f00", O_WRONLY | O_CREAT, 0644)) != 0) return -1;
+
+    /* Pre-order: a directory before its contents, in name order */
+    visits = 0;
+    if (nftw("o", record, 4, FTW_PHYS) != 0 || visits != 7) return -1;
+    if (strcmp(order[0], ">0:o") != 0 || strcmp(order[1], ">1:d0") != 0 ||
+        strcmp(order[2], " 2:f00") != 0 || strcmp(order[5], ">1:d1") != 0 ||
+        strcmp(order[6], " 2:f00") != 0) return -1;
+
+    /* Post-order: after */
+    visits = 0;
+    if (nftw("o", record, 4, FTW_DEPTH) != 0 || visits != 7) return -1;
+    if (strcmp(order[3], "<1:d0") != 0 || strcmp(order[6], "<0:o") != 0) return -1;
+
+    /* FTW_SKIP_SUBTREE on d1, FTW_SKIP_SIBLINGS on f01 */
+    visits = 0;
+    if (nftw("o", prune, 4, FTW_ACTIONRETVAL) != 0 || visits != 5) return -1;
+    if (strcmp(order[3], " 2:f01") != 0 || strcmp(order[4], ">1:d1") != 0) return -1;
+
+    /* A non-zero result stops the walk and comes back */
+    if (nftw("o", stop_at_f02, 4, 0) != 42) return -1;
+
+    /* fts_set(FTS_SKIP): FTS_DP straight after FTS_D */
+    paths[0] = "o";
+    paths[1] = "o/d1/f00";      /* A file as a root */
+    paths[2] = NULL;
+    fts = fts_open(paths, FTS_PHYSICAL, NULL);
+    if (!fts) return -1;
+    n = 0;
+    while ((ent = fts_read(fts)) != NULL) {
+        if (ent->fts_info == FTS_D && ent->fts_level == 1) {
+            if (fts_set(fts, ent, FTS_SKIP) != 0) return -1;
+            ent = fts_read(fts);
+            if (!ent || ent->fts_info != FTS_DP || ent->fts_level != 1) return -1;
+        }
+        if (ent->fts_level == 1 && ent->fts_parent->fts_info != FTS_D) return -1;
+        n++;
+    }
+    if (errno != 0 || fts_close(fts) != 0) return -1;
+    /* o, d0 and d1 (their FTS_DP read above), o's FTS_DP, the file */
+    if (n != 5) return -1;
+
+    /* A missing root; compar is not supported */
+    if (nftw("no/such/dir", count_entry, 4, 0) != -1 || errno != ENOENT) return -1;
+    if (fts_open(paths, 0, (int (*)(const FTSENT **, const FTSENT **))strcmp) != NULL ||
+        errno != EINVAL) return -1;
+
+    /* Nothing is left open */
+    posix9_dir_stats(&usage);
+    if (usage.streams != 0 || usage.heapBytes > usage.capacity * usage.streamBytes + 64) return -1;
+    fmsim_zero_traps();
+    if (nftw("o", count_entry, 4, 0) != 0 || fmsim_traps() > 20) return -1;
+
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+    if (make_tree() != 0) {
+        printf("setup failed\n");
+        return 1;
+    }
+
+    printf("Walk of %d entries x %d passes, caches flushed, simulated File Manager:\n",
+           ENTRIES, PASSES);
+    if (run("opendir + stat(path), bulk", walk_paths, 1) != 0) failed++;
+    if (run("nftw, bulk", walk_nftw, 1) != 0) failed++;
+    if (run("fts_read, bulk", walk_fts, 1) != 0) failed++;
+    if (run("opendir + stat(path), indexed", walk_paths, 0) != 0) failed++;
+    if (run("nftw, indexed", walk_nftw, 0) != 0) failed++;
+    if (run("fts_read, indexed", walk_fts, 0) != 0) failed++;
+
+    if (check_order() != 0) {
+        printf("order check: FAILED\n");
+        failed++;
+    } else {
+        printf("order check: ok\n");
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * bench_getcwd.c - Host benchmark for getcwd() from the cached chain
+ *
+ * Starts in a directory the application was launched from, changes into
+ * one ten levels deep, and reports File Manager calls and calls per
+ * second for getcwd() with the cached path and with the caches flushed
+ * before every call, which makes it walk the parent dirIDs again. Also
+ * checks that renaming or moving an ancestor, or the cwd itself, is
+ * seen but renaming a directory off the chain does not matter, that
+ * removing the cwd gives ENOENT, and the ERANGE and /Volumes cases.
+ *
+ * Build and run with: test/build-host-bench.sh getcwd
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <Multiverse.h>
+#include "MacCompat.h"
+#include "posix9.h"
+#include "fm_sim.h"
+
+#define CALLS       100000
+#define DEPTH       10
+
+static char cwd[POSIX9_PATH_MAX];
+
+static int cwd_is(const char *expected)
+{
+    return getcwd(cwd, sizeof(cwd)) != NULL && strcmp(cwd, expected) == 0;
+}
+
+static int run(const char *label, int flush, long calls)
+{
+    double t0, t1;
+    long i;
+    int ok = 1;
+
+    fmsim_zero_traps();
+    t0 = fmsim_now();
+    for (i = 0; i < calls; i++) {
+        if (flush) {
+            posix9_pathcache_flush();
+            posix9_statcache_flush();
+        }
+        if (getcwd(cwd, sizeof(cwd)) == NULL) ok = 0;
+    }
+    t1 = fmsim_now();
+
+    printf("  %-20s %5.2f traps/call  %10.0f calls/s  %s\n",
+           label, (double)fmsim_traps() / calls, calls / (t1 - t0),
+           ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+static int check_semantics(void)
+{
+    char small[4];
+
+    /* Renaming an ancestor, the cwd, or something off the chain */
+    if (chdir("/work/l0/l1/l2") != 0 || !cwd_is("/work/l0/l1/l2")) return -1;
+    if (rename("/work/l0/l1", "/work/l0/renamed") != 0) return -1;
+    if (!cwd_is("/work/l0/renamed/l2")) return -1;
+    if (rename("/work/l0/renamed/l2", "/work/l0/renamed/here") != 0) return -1;
+    if (!cwd_is("/work/l0/renamed/here")) return -1;
+    if (mkdir("/work/l0/sibling", 0755) != 0 ||
+        rename("/work/l0/sibling", "/work/l0/other") != 0) return -1;
+    if (!cwd_is("/work/l0/renamed/here")) return -1;
+
+    /* Moving an ancestor to another parent */
+    if (rename("/work/l0/renamed", "/work/moved") != 0) return -1;
+    if (!cwd_is("/work/moved/here")) return -1;
+
+    /* Relative chdir, "..", and the default volume under /Volumes */
+    if (chdir("..") != 0 || !cwd_is("/work/moved")) return -1;
+    if (chdir("/Volumes/Macintosh HD/work") != 0 || !cwd_is("/work")) return -1;
+    if (getcwd(small, sizeof(small)) != NULL || errno != ERANGE) return -1;
+    if (chdir("/") != 0 || !cwd_is("/")) return -1;
+
+    /* A removed cwd */
+    if (mkdir("/gone", 0755) != 0 || chdir("/gone") != 0 || rmdir("/gone") != 0) return -1;
+    if (getcwd(cwd, sizeof(cwd)) != NULL || errno != ENOENT) return -1;
+    if (chdir("/") != 0) return -1;
+
+    return 0;
+}
+
+int main(void)
+{
+    char path[POSIX9_PATH_MAX];
+    long launchDir;
+    int i, failed = 0;
+
+    /* Launched from a folder: the first getcwd() must name it */
+    fmsim_reset();
+    if (DirCreate(0, fsRtDirID, (ConstStr255Param)"\004Apps", &launchDir) != noErr ||
+        HSetVol(NULL, 0, launchDir) != noErr) return 1;
+    if (!cwd_is("/Apps")) {
+        printf("startup cwd: FAILED (%s)\n", cwd);
+        return 1;
+    }
+
+    strcpy(path, "/work");
+    if (mkdir(path, 0755) != 0) return 1;
+    for (i = 0; i < DEPTH; i++) {
+        sprintf(path + strlen(path), "/l%d", i);
+        if (mkdir(path, 0755) != 0) return 1;
+    }
+    if (chdir(path) != 0 || !cwd_is(path)) {
+        printf("setup failed\n");
+        return 1;
+    }
+
+    printf("getcwd() %d levels deep, simulated File Manager:\n", DEPTH + 1);
+    if (run("cached chain", 0, CALLS) != 0) failed++;
+    if (run("caches flushed", 1, CALLS / 100) != 0) failed++;
+
+    if (check_semantics() != 0) {
+        printf("semantics check: FAILED\n");
+        failed++;
+    } else {
+        printf("semantics check: ok\n");
+    }
+
+    return failed ? 1 : 0;
+}
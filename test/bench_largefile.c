@@ -0,0 +1,245 @@
+/*
+ * bench_largefile.c - Host check for 64-bit offsets through the fork calls
+ *
+ * Writes a few blocks beyond 3 GB with lseek64()/pwrite64(), reads them
+ * back with pread64() and read(), and checks fstat64(), stat64() and
+ * ftruncate64() see the full size - the simulated volume is sparse, so
+ * nothing near 3 GB is allocated. Then turns the HFS Plus APIs off, as
+ * on Mac OS 8.x, and checks that the classic fallback still works below
+ * 2 GB and fails with EFBIG beyond it. Reports File Manager calls per
+ * transfer both ways. Built in POSIX9_LARGEFILE mode, so it also checks
+ * that the plain names taking struct stat or off_t fill the 64-bit ones.
+ *
+ * Build and run with: test/build-host-bench.sh largefile
+ */
+
+#include <stdio.h>
+#include <string.h>
+#define POSIX9_LARGEFILE
+#include "posix9.h"
+#include "posix9/mman.h"
+#include "fm_sim.h"
+
+#define FILE_PATH   "/large.dat"
+#define GB          (1024LL * 1024LL * 1024LL)
+#define BLOCKS      64
+
+static char block[4096];
+static char back[4096];
+
+static void fill(long seed)
+{
+    long i;
+
+    for (i = 0; i < (long)sizeof(block); i++) {
+        block[i] = (char)(i * 13 + seed);
+    }
+}
+
+/* Write and read back BLOCKS blocks starting at base; returns traps per block */
+static double transfer(int fd, off64_t base, int *ok)
+{
+    unsigned long traps;
+    int i;
+
+    fmsim_zero_traps();
+    for (i = 0; i < BLOCKS; i++) {
+        fill(i);
+        if (pwrite64(fd, block, sizeof(block), base + i * (off64_t)sizeof(block)) !=
+            (ssize_t)sizeof(block)) *ok = 0;
+    }
+    for (i = 0; i < BLOCKS; i++) {
+        fill(i);
+        if (pread64(fd, back, sizeof(back), base + i * (off64_t)sizeof(back)) !=
+            (ssize_t)sizeof(back) || memcmp(block, back, sizeof(back)) != 0) *ok = 0;
+    }
+    traps = fmsim_traps();
+
+    return (double)traps / (2 * BLOCKS);
+}
+
+static int check_fork_apis(void)
+{
+    struct stat64 st;
+    off64_t base = 3 * GB;
+    double traps;
+    int fd, ok = 1;
+
+    fd = open(FILE_PATH, O_RDWR | O_CREAT | O_TRUNC | O_LARGEFILE, 0644);
+    if (fd < 0) return -1;
+
+    traps = transfer(fd, base, &ok);
+    printf("  HFS Plus APIs:   %4.1f traps/4 KB at 3 GB  %s\n", traps, ok ? "ok" : "MISMATCH");
+    if (!ok) return -1;
+
+    /* The descriptor offset is 64-bit too */
+    if (lseek64(fd, base, SEEK_SET) != base) return -1;
+    if (read(fd, back, sizeof(back)) != (ssize_t)sizeof(back)) return -1;
+    fill(0);
+    if (memcmp(block, back, sizeof(back)) != 0) return -1;
+    if (lseek64(fd, 0, SEEK_END) != base + BLOCKS * (off64_t)sizeof(block)) return -1;
+
+    /* Sizes past the catalog's 32-bit ioFlLgLen */
+    if (fstat64(fd, &st) != 0 || st.st_size != base + BLOCKS * (off64_t)sizeof(block)) return -1;
+    if (ftruncate64(fd, base + 1) != 0) return -1;
+    if (fstat64(fd, &st) != 0 || st.st_size != base + 1) return -1;
+    if (close(fd) != 0) return -1;
+    if (stat64(FILE_PATH, &st) != 0 || st.st_size != base + 1) return -1;
+
+    /* Shrinking back below 2 GB */
+    fd = open(FILE_PATH, O_RDWR);
+    if (fd < 0 || ftruncate64(fd, 4096) != 0 || close(fd) != 0) return -1;
+    if (stat64(FILE_PATH, &st) != 0 || st.st_size != 4096) return -1;
+
+    return 0;
+}
+
+static struct stat64 want;
+static int walked;
+
+static int visit(const char *fpath, const struct stat *sb, int type, struct FTW *ftw)
+{
+    (void)ftw;
+    if (type == FTW_F && strcmp(fpath, FILE_PATH) == 0 &&
+        memcmp(sb, &want, sizeof(want)) == 0) walked++;
+    return 0;
+}
+
+static int matched(const char *path, const struct stat *sb, void *arg)
+{
+    (void)arg;
+    if (strcmp(path, FILE_PATH) == 0 && memcmp(sb, &want, sizeof(want)) == 0) walked++;
+    return 0;
+}
+
+/* The plain names, which POSIX9_LARGEFILE makes the 64-bit ones */
+static int check_large_mode(void)
+{
+    char *paths[] = { "/", NULL };
+    posix9_find_spec spec;
+    POSIX9_FIND *find;
+    const char *path;
+    struct stat st;             /* struct stat64 */
+    FTSENT *ent;
+    FTS *fts;
+    off_t size = 3 * GB + 1;    /* off64_t */
+    struct dirent *de;
+    off_t offset;
+    DIR *dir;
+    char *map;
+    int fd, out, found = 0;
+
+    fd = open(FILE_PATH, O_RDWR);
+    if (fd < 0 || ftruncate(fd, size) != 0 || close(fd) != 0) return -1;
+    if (stat64(FILE_PATH, &want) != 0 || want.st_size != size) return -1;
+
+    memset(&st, 0xFF, sizeof(st));
+    if (fstatat(AT_FDCWD, FILE_PATH, &st, 0) != 0 || memcmp(&st, &want, sizeof(st)) != 0) return -1;
+
+    dir = opendir("/");
+    if (!dir) return -1;
+    while ((de = posix9_readdir_plus(dir, &st)) != NULL) {
+        if (strcmp(de->d_name, FILE_PATH + 1) == 0 && memcmp(&st, &want, sizeof(st)) == 0) found++;
+    }
+    closedir(dir);
+    if (found != 1) return -1;
+
+    fts = fts_open(paths, FTS_PHYSICAL, NULL);
+    if (!fts) return -1;
+    while ((ent = fts_read(fts)) != NULL) {
+        if (ent->fts_info == FTS_F && strcmp(ent->fts_path, FILE_PATH) == 0 &&
+            memcmp(ent->fts_statp, &want, sizeof(want)) == 0) found++;
+    }
+    fts_close(fts);
+    if (found != 2) return -1;
+
+    walked = 0;
+    if (nftw("/", visit, 4, FTW_PHYS) != 0 || walked != 1) return -1;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.name = FILE_PATH + 1;
+    find = posix9_find_open("/", &spec);
+    if (!find) return -1;
+    path = posix9_find_next(find, &st);
+    if (!path || strcmp(path, FILE_PATH) != 0 || memcmp(&st, &want, sizeof(st)) != 0) return -1;
+    if (posix9_find_next(find, &st) != NULL || errno != 0) return -1;
+    posix9_find_close(find);
+    if (posix9_find("/", &spec, matched, NULL) != 0 || walked != 2) return -1;
+
+    /* mmap() maps from a 64-bit offset */
+    fd = open(FILE_PATH, O_RDWR);
+    if (fd < 0 || pwrite(fd, "mapped", 6, 3 * GB - 4096) != 6) return -1;
+    map = mmap(NULL, 4096, PROT_READ, MAP_PRIVATE, fd, 3 * GB - 4096);
+    if (map == MAP_FAILED || memcmp(map, "mapped", 6) != 0) return -1;
+    if (munmap(map, 4096) != 0 || close(fd) != 0) return -1;
+
+    /* sendfile() moves a 64-bit offset; a file destination needs no network */
+    fd = open(FILE_PATH, O_RDONLY);
+    out = open("/copy.dat", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || out < 0) return -1;
+    offset = size - 1;
+    if (sendfile(out, fd, &offset, 100) != 1 || offset != size) return -1;
+    if (close(out) != 0 || close(fd) != 0 || unlink("/copy.dat") != 0) return -1;
+
+    return 0;
+}
+
+static int check_classic(void)
+{
+    struct stat64 st;
+    double traps;
+    int fd, ok = 1;
+
+    fmsim_set_hfsplus(0);
+    posix9_cleanup();       /* Forget the Gestalt answer */
+
+    fd = open(FILE_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    traps = transfer(fd, GB, &ok);
+    printf("  classic calls:   %4.1f traps/4 KB at 1 GB  %s\n", traps, ok ? "ok" : "MISMATCH");
+    if (!ok) return -1;
+
+    /* A classic EOF is a long: files stop at 2 GB - 1 bytes */
+    if (pwrite64(fd, "x", 1, 2 * GB - 2) != 1) return -1;
+    if (pwrite64(fd, "x", 1, 2 * GB - 1) != -1 || errno != EFBIG) return -1;
+    if (ftruncate64(fd, 2 * GB) != -1 || errno != EFBIG) return -1;
+    if (fstat64(fd, &st) != 0 || st.st_size != 2 * GB - 1) return -1;
+    if (close(fd) != 0) return -1;
+
+    fmsim_set_hfsplus(1);
+    posix9_cleanup();
+
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+
+    printf("64-bit offsets, %d x 4 KB pwrite64 + pread64, simulated File Manager:\n", BLOCKS);
+    if (check_fork_apis() != 0) {
+        printf("fork API check: FAILED\n");
+        failed++;
+    } else {
+        printf("fork API check: ok\n");
+    }
+
+    if (check_large_mode() != 0) {
+        printf("POSIX9_LARGEFILE check: FAILED\n");
+        failed++;
+    } else {
+        printf("POSIX9_LARGEFILE check: ok\n");
+    }
+
+    if (check_classic() != 0) {
+        printf("classic fallback check: FAILED\n");
+        failed++;
+    } else {
+        printf("classic fallback check: ok\n");
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * bench_mmap.c - Host benchmark for file-backed mmap()
+ *
+ * Maps a 1 MB file eagerly and with MAP_POSIX9_LAZY, touches a few
+ * scattered pages through posix9_mmap_access(), and reports File
+ * Manager calls for mapping, touching and writing back. Also checks
+ * MAP_SHARED write-back through msync() and munmap(), that MAP_PRIVATE
+ * changes stay private, that a mapping outlives close(fd), and that
+ * MS_INVALIDATE picks up changes made through write().
+ *
+ * Build and run with: test/build-host-bench.sh mmap
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "posix9.h"
+#include "posix9/mman.h"
+#include "fm_sim.h"
+
+#define FILE_PATH   "/map.dat"
+#define FILE_SIZE   (1024L * 1024L)
+#define TOUCHES     8
+
+static char chunk[4096];
+
+static char expected(long offset)
+{
+    return (char)(offset * 7 + offset / 4096);
+}
+
+static int make_file(void)
+{
+    long i, j;
+    int fd;
+
+    fd = open(FILE_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    for (i = 0; i < FILE_SIZE; i += sizeof(chunk)) {
+        for (j = 0; j < (long)sizeof(chunk); j++) {
+            chunk[j] = expected(i + j);
+        }
+        if (write(fd, chunk, sizeof(chunk)) != (ssize_t)sizeof(chunk)) return -1;
+    }
+
+    return fd;
+}
+
+/* Offset of the i'th touched byte - one per page, spread over the file */
+static long touch_offset(long i)
+{
+    return (i * 37 + 3) % (FILE_SIZE / POSIX9_PAGE_SIZE) * POSIX9_PAGE_SIZE + 100;
+}
+
+/* Check the touched bytes read as mask ^ the file's pattern, then flip them */
+static int touch(char *p, int lazy, char mask)
+{
+    long i, off;
+
+    for (i = 0; i < TOUCHES; i++) {
+        off = touch_offset(i);
+        if (lazy && posix9_mmap_access(p + off, 1, PROT_READ | PROT_WRITE) != 0) return -1;
+        if (p[off] != (char)(expected(off) ^ mask)) return -1;
+        p[off] ^= 0x5A;
+    }
+
+    return 0;
+}
+
+/* Do the touched bytes in the file read as mask ^ the pattern? */
+static int file_matches(int fd, char mask)
+{
+    long i, off;
+    char c;
+
+    for (i = 0; i < TOUCHES; i++) {
+        off = touch_offset(i);
+        if (pread(fd, &c, 1, off) != 1 || c != (char)(expected(off) ^ mask)) return -1;
+    }
+
+    return 0;
+}
+
+static int run(const char *label, int fd, int flags)
+{
+    unsigned long mapTraps, touchTraps, syncTraps;
+    char *p;
+    int ok;
+
+    fmsim_zero_traps();
+    p = mmap(NULL, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | flags, fd, 0);
+    mapTraps = fmsim_traps();
+    if (p == MAP_FAILED) return -1;
+
+    fmsim_zero_traps();
+    ok = touch(p, (flags & MAP_POSIX9_LAZY) != 0, 0) == 0;
+    touchTraps = fmsim_traps();
+
+    fmsim_zero_traps();
+    if (msync(p, FILE_SIZE, MS_ASYNC) != 0) ok = 0;
+    syncTraps = fmsim_traps();
+    if (file_matches(fd, 0x5A) != 0) ok = 0;
+
+    /* Put the bytes back through the mapping; munmap() writes them */
+    if (touch(p, (flags & MAP_POSIX9_LAZY) != 0, 0x5A) != 0) ok = 0;
+    if (munmap(p, FILE_SIZE) != 0) ok = 0;
+    if (file_matches(fd, 0) != 0) ok = 0;
+
+    printf("  %-22s mmap %4lu traps  %d pages touched %4lu traps  msync %4lu traps  %s\n",
+           label, mapTraps, TOUCHES, touchTraps, syncTraps, ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+static int check_coherence(int fd)
+{
+    char *p;
+    char c;
+    int fd2;
+
+    /* MAP_SHARED: msync() writes back, read() sees it */
+    p = mmap(NULL, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return -1;
+    p[5000] = 'S';
+    if (msync(p, POSIX9_PAGE_SIZE * 2, MS_SYNC) != 0) return -1;
+    if (pread(fd, &c, 1, 5000) != 1 || c != 'S') return -1;
+    if (munmap(p, FILE_SIZE) != 0) return -1;
+
+    /* MAP_PRIVATE: nothing reaches the file */
+    p = mmap(NULL, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) return -1;
+    p[6000] = 'P';
+    if (msync(p, FILE_SIZE, MS_SYNC) != 0 || munmap(p, FILE_SIZE) != 0) return -1;
+    if (pread(fd, &c, 1, 6000) != 1 || c != expected(6000)) return -1;
+
+    /* The mapping holds its own reference to the file */
+    fd2 = dup(fd);
+    if (fd2 < 0) return -1;
+    p = mmap(NULL, POSIX9_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd2,
+             POSIX9_PAGE_SIZE);
+    if (p == MAP_FAILED || close(fd2) != 0) return -1;
+    if (p[0] != expected(POSIX9_PAGE_SIZE)) return -1;
+    p[1] = 'C';
+    if (munmap(p, POSIX9_PAGE_SIZE) != 0) return -1;
+    if (pread(fd, &c, 1, POSIX9_PAGE_SIZE + 1) != 1 || c != 'C') return -1;
+
+    /* MS_INVALIDATE re-reads clean lazy pages */
+    p = mmap(NULL, FILE_SIZE, PROT_READ, MAP_SHARED | MAP_POSIX9_LAZY, fd, 0);
+    if (p == MAP_FAILED) return -1;
+    if (posix9_mmap_access(p + 7000, 1, PROT_READ) != 0 || p[7000] != expected(7000)) return -1;
+    if (pwrite(fd, "I", 1, 7000) != 1) return -1;
+    if (msync(p, FILE_SIZE, MS_INVALIDATE) != 0) return -1;
+    if (posix9_mmap_access(p + 7000, 1, PROT_READ) != 0 || p[7000] != 'I') return -1;
+    if (posix9_mmap_access(p, 1, PROT_WRITE) != -1 || errno != EACCES) return -1;
+    if (munmap(p, FILE_SIZE) != 0) return -1;
+
+    /* Argument checks */
+    if (mmap(NULL, 4096, PROT_READ, MAP_SHARED, fd, 100) != MAP_FAILED || errno != EINVAL) return -1;
+    if (mmap(NULL, 4096, PROT_READ, MAP_SHARED | MAP_PRIVATE, fd, 0) != MAP_FAILED) return -1;
+    if (munmap(chunk, 4096) != -1 || errno != EINVAL) return -1;
+
+    /* Anonymous memory starts zeroed */
+    p = mmap(NULL, 10000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED || p[0] != 0 || p[9999] != 0) return -1;
+    if (munmap(p, 10000) != 0) return -1;
+
+    return 0;
+}
+
+int main(void)
+{
+    int fd, failed = 0;
+
+    fmsim_reset();
+    fd = make_file();
+    if (fd < 0) {
+        printf("setup failed\n");
+        return 1;
+    }
+
+    printf("mmap() of a %ld KB file, simulated File Manager:\n", FILE_SIZE / 1024);
+    if (run("read whole range", fd, 0) != 0) failed++;
+    if (run("MAP_POSIX9_LAZY", fd, MAP_POSIX9_LAZY) != 0) failed++;
+
+    if (check_coherence(fd) != 0) {
+        printf("coherence check: FAILED\n");
+        failed++;
+    } else {
+        printf("coherence check: ok\n");
+    }
+
+    close(fd);
+    return failed ? 1 : 0;
+}
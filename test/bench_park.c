@@ -0,0 +1,470 @@
+/*
+ * bench_park.c - Host benchmark for blocking socket calls that park the thread
+ *
+ * A blocking recv() waits for one byte that arrives a few rounds later,
+ * two ways: recv() itself, which stops the thread until the notifier
+ * readies it, and a loop of non-blocking recv() and YieldToAnyThread(),
+ * as the SystemTask() busy-waits did. Reports waits per second and the
+ * passes (yields) and parks the waiting thread made per wait. Then
+ * times poll(), select() and posix9_epoll_wait() on idle sockets, which
+ * end to the microsecond rather than on a 1/60 s tick, and counts the
+ * passes they made. Also checks EOF on a broken connection, EAGAIN for
+ * non-blocking sockets, MSG_DONTWAIT and SO_RCVTIMEO, a blocking send()
+ * through a full window, accept() and connect() parking until the
+ * notifier answers, that an event on one socket does not wake a
+ * thread waiting on another, and that a second thread waiting on the
+ * same socket does not take the first one's wake-ups.
+ *
+ * Build and run with: test/build-host-bench.sh park
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <Multiverse.h>
+#include "MacCompat.h"
+#include "Threads.h"
+#include "posix9.h"
+#include "posix9/socket.h"
+#include "fm_sim.h"
+#include "ot_sim.h"
+#include "tm_sim.h"
+
+/* Not in the POSIX9 headers; implemented in posix9_socket.c */
+#ifndef F_SETFL
+#define F_SETFL     4
+#endif
+#ifndef O_NONBLOCK
+#define O_NONBLOCK  0x0004
+#endif
+extern int fcntl(int fd, int cmd, ...);
+
+#define MAX_SOCKS   30
+#define WAITS       3000
+#define IDLE_ROUNDS 20          /* Rounds before the byte arrives */
+#define TRIES       5           /* Timed waits per timeout checked */
+
+static int socks[MAX_SOCKS];
+static int nsocks;
+
+/* ============================================================
+ * Other threads: the idle hook delivers what was planned
+ * ============================================================ */
+
+#define MAX_PLANS   4
+
+enum { PLAN_DATA, PLAN_HANGUP, PLAN_CALL };
+
+static struct {
+    int what, endpoint, rounds;
+} plans[MAX_PLANS];
+static int nplans;
+
+static void other_threads(void)
+{
+    int i;
+
+    for (i = 0; i < nplans; i++) {
+        if (plans[i].rounds < 0 || --plans[i].rounds > 0) continue;
+        plans[i].rounds = -1;
+        switch (plans[i].what) {
+        case PLAN_DATA:   otsim_receive(plans[i].endpoint, "x", 1); break;
+        case PLAN_HANGUP: otsim_disconnect(plans[i].endpoint); break;
+        case PLAN_CALL:   otsim_incoming(plans[i].endpoint); break;
+        }
+    }
+}
+
+static void plan(int what, int endpoint, int rounds)
+{
+    int i;
+
+    /* Reuse a slot that has been carried out */
+    for (i = 0; i < nplans; i++) {
+        if (plans[i].rounds < 0) break;
+    }
+    if (i == nplans) {
+        if (nplans == MAX_PLANS) return;
+        nplans++;
+    }
+    plans[i].what = what;
+    plans[i].endpoint = endpoint;
+    plans[i].rounds = rounds;
+}
+
+static void close_sockets(void)
+{
+    while (nsocks > 0) close(socks[--nsocks]);
+}
+
+static void set_address(struct sockaddr_in *sin, unsigned long host, int port)
+{
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    sin->sin_addr.s_addr = htonl(host);
+}
+
+/* n connected sockets on a fresh network; socks[i] is endpoint i */
+static int open_sockets(int n)
+{
+    struct sockaddr_in sin;
+    int s;
+
+    close_sockets();
+    otsim_reset();
+    nplans = 0;
+    set_address(&sin, 0x0A000001, 22);
+
+    while (nsocks < n) {
+        s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s < 0 || connect(s, (struct sockaddr *)&sin, sizeof(sin)) != 0) return -1;
+        socks[nsocks++] = s;
+    }
+
+    return 0;
+}
+
+/* ============================================================
+ * Waits
+ * ============================================================ */
+
+static int wait_parked(int s, char *c)
+{
+    return (int)recv(s, c, 1, 0);
+}
+
+static int wait_spinning(int s, char *c)
+{
+    ssize_t n;
+
+    while ((n = recv(s, c, 1, MSG_DONTWAIT)) < 0 && errno == EAGAIN) {
+        SystemTask();
+        YieldToAnyThread();
+    }
+    return (int)n;
+}
+
+static int run(const char *label, int (*wait)(int, char *))
+{
+    double t0, t1;
+    char c;
+    int i, target, ok = 1;
+
+    if (open_sockets(MAX_SOCKS) != 0) return -1;
+    tmsim_set_idle(other_threads);
+    tmsim_reset();
+
+    t0 = fmsim_now();
+    for (i = 0; i < WAITS; i++) {
+        target = (i * 7) % MAX_SOCKS;
+        plan(PLAN_DATA, target, IDLE_ROUNDS);
+        if (wait(socks[target], &c) != 1 || c != 'x') {
+            ok = 0;
+            break;
+        }
+    }
+    t1 = fmsim_now();
+    tmsim_set_idle(NULL);
+
+    printf("  %-34s %9.0f waits/s  %5.1f yields/wait  %4.1f parks/wait  %s\n",
+           label, WAITS / (t1 - t0), (double)tmsim_yields() / WAITS,
+           (double)tmsim_parks() / WAITS, ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+/* ============================================================
+ * Timeouts
+ * ============================================================ */
+
+static int ep_set;
+
+static void wait_poll(long usec)
+{
+    static struct pollfd fds[MAX_SOCKS];
+    int i;
+
+    for (i = 0; i < MAX_SOCKS; i++) {
+        fds[i].fd = socks[i];
+        fds[i].events = POLLIN;
+    }
+    poll(fds, MAX_SOCKS, (int)(usec / 1000));
+}
+
+static void wait_select(long usec)
+{
+    struct timeval tv;
+    fd_set rset;
+    int i;
+
+    FD_ZERO(&rset);
+    for (i = 0; i < MAX_SOCKS; i++) FD_SET(socks[i], &rset);
+    tv.tv_sec = 0;
+    tv.tv_usec = usec;
+    select(socks[MAX_SOCKS - 1] + 1, &rset, NULL, NULL, &tv);
+}
+
+static void wait_epoll(long usec)
+{
+    struct epoll_event ev;
+
+    posix9_epoll_wait(ep_set, &ev, 1, (int)(usec / 1000));
+}
+
+/* Each wait lasts at least usec, and the closest within a millisecond */
+static int run_timeout(const char *label, long usec, void (*wait)(long))
+{
+    double t0, elapsed, least = 1e9, most = 0;
+    int i, ok = 1;
+
+    tmsim_reset();
+    for (i = 0; i < TRIES; i++) {
+        t0 = fmsim_now();
+        wait(usec);
+        elapsed = (fmsim_now() - t0) * 1e6;
+        if (elapsed < least) least = elapsed;
+        if (elapsed > most) most = elapsed;
+    }
+    if (least < usec || least > usec + 1000) ok = 0;
+    if (tmsim_yields() != 0 || tmsim_parks() != TRIES) ok = 0;
+
+    printf("  %-22s %6ld us  took %6.0f-%6.0f us  %3lu yields  %2lu parks  %s\n",
+           label, usec, least, most, tmsim_yields(), tmsim_parks(),
+           ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+static int run_timeouts(void)
+{
+    struct epoll_event ev;
+    int i, failed = 0;
+
+    if (open_sockets(MAX_SOCKS) != 0) return -1;
+    tmsim_set_idle(other_threads);
+
+    ep_set = posix9_epoll_create(MAX_SOCKS);
+    for (i = 0; i < MAX_SOCKS; i++) {
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        if (posix9_epoll_ctl(ep_set, EPOLL_CTL_ADD, socks[i], &ev) != 0) return -1;
+    }
+
+    if (run_timeout("select()", 2500, wait_select) != 0) failed++;
+    if (run_timeout("poll()", 5000, wait_poll) != 0) failed++;
+    if (run_timeout("posix9_epoll_wait()", 3000, wait_epoll) != 0) failed++;
+
+    close(ep_set);
+    tmsim_set_idle(NULL);
+    return failed ? -1 : 0;
+}
+
+/* ============================================================
+ * Semantics
+ * ============================================================ */
+
+static int check_recv(void)
+{
+    struct timeval tv;
+    socklen_t len;
+    double t0;
+    char buf[8];
+
+    if (open_sockets(4) != 0) return -1;
+    tmsim_set_idle(other_threads);
+
+    /* Parks once, woken once, by the byte's own notifier */
+    tmsim_reset();
+    plan(PLAN_DATA, 1, IDLE_ROUNDS);
+    if (recv(socks[1], buf, sizeof(buf), 0) != 1) return -1;
+    if (tmsim_parks() != 1 || tmsim_wakes() != 1 || tmsim_yields() != 0) return -1;
+
+    /* Data already there: no park */
+    if (otsim_receive(2, "ab", 2) != 0) return -1;
+    if (recv(socks[2], buf, sizeof(buf), 0) != 2 || tmsim_parks() != 1) return -1;
+
+    /* A broken connection ends the wait with EOF */
+    plan(PLAN_HANGUP, 3, IDLE_ROUNDS);
+    if (recv(socks[3], buf, sizeof(buf), 0) != 0) return -1;
+
+    /* Non-blocking, or asked not to wait */
+    if (recv(socks[0], buf, sizeof(buf), MSG_DONTWAIT) != -1 || errno != EAGAIN) return -1;
+    if (fcntl(socks[0], F_SETFL, O_NONBLOCK) != 0) return -1;
+    if (recv(socks[0], buf, sizeof(buf), 0) != -1 || errno != EAGAIN) return -1;
+    if (fcntl(socks[0], F_SETFL, 0) != 0) return -1;
+
+    /* SO_RCVTIMEO: the whole 3 ms, then EAGAIN */
+    tv.tv_sec = 0;
+    tv.tv_usec = 3000;
+    if (setsockopt(socks[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0) return -1;
+    t0 = fmsim_now();
+    if (recv(socks[0], buf, sizeof(buf), 0) != -1 || errno != EAGAIN) return -1;
+    if (fmsim_now() - t0 < 0.003) return -1;
+    memset(&tv, 0, sizeof(tv));
+    len = sizeof(tv);
+    if (getsockopt(socks[0], SOL_SOCKET, SO_RCVTIMEO, &tv, &len) != 0 ||
+        tv.tv_usec != 3000 || len != sizeof(tv)) return -1;
+    tv.tv_usec = 1000000;
+    if (setsockopt(socks[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != -1 || errno != EINVAL) return -1;
+
+    /* Still delivered when it comes within the timeout */
+    plan(PLAN_DATA, 0, IDLE_ROUNDS);
+    if (recv(socks[0], buf, sizeof(buf), 0) != 1) return -1;
+
+    tmsim_set_idle(NULL);
+    return 0;
+}
+
+static int check_send(void)
+{
+    static char data[20000];
+    const char *out;
+    long before;
+    int i;
+
+    if (open_sockets(1) != 0) return -1;
+    tmsim_set_idle(other_threads);
+    otsim_set_window(4096);
+    for (i = 0; i < (int)sizeof(data); i++) data[i] = (char)(i * 13);
+
+    /* All of it, parking while the window is full */
+    tmsim_reset();
+    before = otsim_delivered(&out);
+    if (send(socks[0], data, sizeof(data), 0) != (ssize_t)sizeof(data)) return -1;
+    if (tmsim_parks() < 4 || tmsim_yields() != 0) return -1;
+    while (otsim_run()) ;
+    if (otsim_delivered(&out) - before != (long)sizeof(data) ||
+        memcmp(out + before, data, sizeof(data)) != 0) return -1;
+
+    /* Non-blocking: what fits, then EAGAIN */
+    if (fcntl(socks[0], F_SETFL, O_NONBLOCK) != 0) return -1;
+    if (send(socks[0], data, sizeof(data), 0) != 4096) return -1;
+    if (send(socks[0], data, sizeof(data), 0) != -1 || errno != EAGAIN) return -1;
+
+    tmsim_set_idle(NULL);
+    return 0;
+}
+
+static int check_connections(void)
+{
+    struct sockaddr_in sin, peer;
+    struct pollfd pfd;
+    socklen_t len;
+    char buf[8];
+    int s, c;
+
+    tmsim_set_idle(other_threads);
+
+    /* connect() parks until T_CONNECT */
+    tmsim_reset();
+    if (open_sockets(1) != 0 || tmsim_parks() != 1) return -1;
+
+    /* A listener is readable only with a connection waiting */
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    set_address(&sin, 0, 2222);
+    if (s < 0 || bind(s, (struct sockaddr *)&sin, sizeof(sin)) != 0 || listen(s, 5) != 0) return -1;
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 0) != 0) return -1;
+
+    /* accept() parks until T_LISTEN; the new connection is endpoint 2 */
+    plan(PLAN_CALL, 1, IDLE_ROUNDS);
+    len = sizeof(peer);
+    c = accept(s, (struct sockaddr *)&peer, &len);
+    if (c < 0 || ntohl(peer.sin_addr.s_addr) != 0x0A000002) return -1;
+    if (otsim_receive(2, "hi", 2) != 0 || recv(c, buf, sizeof(buf), 0) != 2) return -1;
+
+    /* One already waiting: poll() says so, accept() does not park */
+    if (otsim_incoming(1) != 0 || poll(&pfd, 1, 0) != 1 || pfd.revents != POLLIN) return -1;
+    tmsim_reset();
+    if ((socks[nsocks++] = accept(s, NULL, NULL)) < 0 || tmsim_parks() != 0) return -1;
+    if (fcntl(s, F_SETFL, O_NONBLOCK) != 0) return -1;
+    if (accept(s, NULL, NULL) != -1 || errno != EAGAIN) return -1;
+
+    close(c);
+    close(s);
+    tmsim_set_idle(NULL);
+    return 0;
+}
+
+/* An event on a socket nobody waits on readies nobody */
+static int check_wake_target(void)
+{
+    struct pollfd pfd;
+
+    if (open_sockets(2) != 0) return -1;
+    tmsim_set_idle(other_threads);
+
+    pfd.fd = socks[0];
+    pfd.events = POLLIN;
+    tmsim_reset();
+    plan(PLAN_DATA, 1, 3);
+    plan(PLAN_DATA, 0, IDLE_ROUNDS);
+    if (poll(&pfd, 1, 1000) != 1 || pfd.revents != POLLIN) return -1;
+    if (tmsim_wakes() != 1 || tmsim_parks() != 1) return -1;
+
+    tmsim_set_idle(NULL);
+    return 0;
+}
+
+/*
+ * The other thread sends through a full window while the main thread's
+ * recv() is parked on the same socket, then the byte recv() wants comes
+ */
+static int second_sent;
+
+static void second_waiter(void)
+{
+    static char data[8192];
+
+    if (second_sent == 0) {
+        second_sent = -1;
+        if (send(socks[0], data, sizeof(data), 0) == (ssize_t)sizeof(data)) second_sent = 1;
+        plan(PLAN_DATA, 0, IDLE_ROUNDS);
+    }
+    other_threads();
+}
+
+static int check_second_waiter(void)
+{
+    char c;
+
+    if (open_sockets(1) != 0) return -1;
+    otsim_set_window(4096);
+    second_sent = 0;
+    tmsim_set_idle(second_waiter);
+
+    tmsim_reset();
+    if (recv(socks[0], &c, 1, 0) != 1 || c != 'x' || second_sent != 1) return -1;
+    if (tmsim_yields() == 0) return -1;
+
+    tmsim_set_idle(NULL);
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+
+    printf("Blocking recv() of 1 byte on one of %d sockets x %d, %d rounds later, simulated Open Transport:\n",
+           MAX_SOCKS, WAITS, IDLE_ROUNDS);
+    if (run("non-blocking recv() + yield (spin)", wait_spinning) != 0) failed++;
+    if (run("blocking recv() (parked)", wait_parked) != 0) failed++;
+
+    printf("Timeouts on %d idle sockets, best of %d:\n", MAX_SOCKS, TRIES);
+    if (run_timeouts() != 0) failed++;
+
+    if (check_recv() != 0 || check_send() != 0 ||
+        check_connections() != 0 || check_wake_target() != 0 ||
+        check_second_waiter() != 0) {
+        printf("park check: FAILED\n");
+        failed++;
+    } else {
+        printf("park check: ok\n");
+    }
+
+    close_sockets();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * bench_pathcache.c - Host benchmark for the directory entry cache
+ *
+ * Resolves the same few configuration paths over and over, the way an
+ * SSH server does for every connection, with stat() and open()/close(),
+ * and reports File Manager calls and catalog searches per call and the
+ * cache hit rate with the directory cache flushed before every pass and
+ * left warm. The stat cache is flushed before every pass, so the leaf
+ * lookups are always counted. Also checks absolute, "/Volumes", ".."
+ * and longer than 255 byte paths, and that rename() of files and
+ * directories, unlink(), rmdir(), mkdir() and chdir() never leave a
+ * stale resolution behind.
+ *
+ * Build and run with: test/build-host-bench.sh pathcache
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "posix9.h"
+#include "fm_sim.h"
+
+#define PASSES      100
+
+static const char *config_paths[] = {
+    "etc/ssh/sshd_config",
+    "etc/ssh/host_rsa_key",
+    "etc/ssh/host_ed25519_key",
+    "etc/passwd",
+    "etc/shells",
+    "home/scott/.ssh/authorized_keys",
+    "home/scott/.profile",
+    "var/log/auth.log",
+    "usr/local/share/doc/posix9/README"
+};
+
+#define NPATHS  (int)(sizeof(config_paths) / sizeof(config_paths[0]))
+
+static int make_file(const char *path)
+{
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, path, strlen(path)) < 0 || close(fd) != 0) return -1;
+
+    return 0;
+}
+
+static int make_tree(void)
+{
+    int i;
+
+    if (mkdir("etc", 0755) != 0 || mkdir("etc/ssh", 0755) != 0 ||
+        mkdir("home", 0755) != 0 || mkdir("home/scott", 0755) != 0 ||
+        mkdir("home/scott/.ssh", 0755) != 0 || mkdir("var", 0755) != 0 ||
+        mkdir("var/log", 0755) != 0 || mkdir("usr", 0755) != 0 ||
+        mkdir("usr/local", 0755) != 0 || mkdir("usr/local/share", 0755) != 0 ||
+        mkdir("usr/local/share/doc", 0755) != 0 ||
+        mkdir("usr/local/share/doc/posix9", 0755) != 0) return -1;
+
+    for (i = 0; i < NPATHS; i++) {
+        if (make_file(config_paths[i]) != 0) return -1;
+    }
+
+    return 0;
+}
+
+static int run(const char *label, int cold)
+{
+    posix9_cache_stats before, after;
+    struct stat st;
+    unsigned long statTraps = 0, statLookups = 0, openTraps = 0, hits, misses;
+    int pass, i, fd, ok = 1;
+
+    posix9_pathcache_flush();
+    posix9_statcache_flush();
+    posix9_pathcache_stats(&before);
+
+    for (pass = 0; pass < PASSES; pass++) {
+        if (cold) posix9_pathcache_flush();
+        posix9_statcache_flush();
+        for (i = 0; i < NPATHS; i++) {
+            fmsim_zero_traps();
+            if (stat(config_paths[i], &st) != 0 ||
+                st.st_size != (off_t)strlen(config_paths[i])) ok = 0;
+            statTraps += fmsim_traps();
+            statLookups += fmsim_lookups();
+
+            fmsim_zero_traps();
+            fd = open(config_paths[i], O_RDONLY);
+            openTraps += fmsim_traps();
+            if (fd < 0 || close(fd) != 0) ok = 0;
+        }
+    }
+
+    posix9_pathcache_stats(&after);
+    hits = after.hits - before.hits;
+    misses = after.misses - before.misses;
+
+    printf("  %-20s %4.2f traps/stat  %4.2f catalog searches/stat  %4.2f traps/open  "
+           "hits %5lu  misses %4lu  hit rate %5.1f%%  %s\n",
+           label, (double)statTraps / (PASSES * NPATHS),
+           (double)statLookups / (PASSES * NPATHS),
+           (double)openTraps / (PASSES * NPATHS), hits, misses,
+           100.0 * hits / (hits + misses), ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+static int check_paths(void)
+{
+    static const char name[] = "a_directory_name_thirty_chars_";
+    char path[POSIX9_PATH_MAX];
+    struct dirent *de;
+    struct stat st;
+    DIR *dir;
+    int i, seen = 0;
+
+    /* Absolute paths start at the default volume's root */
+    if (stat("/", &st) != 0 || !S_ISDIR(st.st_mode)) return -1;
+    if (stat("/etc/passwd", &st) != 0 || st.st_size != 10) return -1;
+    if (stat("/Volumes/Macintosh HD/etc/passwd", &st) != 0 || st.st_size != 10) return -1;
+    if (stat("/Volumes/No Such Disk/etc", &st) != -1 || errno != ENOENT) return -1;
+
+    dir = opendir("/");
+    if (!dir) return -1;
+    while ((de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, "etc") == 0) seen++;
+    }
+    if (seen != 1 || closedir(dir) != 0) return -1;
+
+    /* ".." is the real parent; the root is its own parent */
+    if (stat("etc/ssh/../../etc/./passwd", &st) != 0 || st.st_size != 10) return -1;
+    if (stat("/../../etc/passwd", &st) != 0) return -1;
+    if (stat("etc/ssh/..", &st) != 0 || !S_ISDIR(st.st_mode)) return -1;
+    if (stat("etc/passwd/x", &st) != -1 || errno != ENOENT) return -1;
+
+    /* More than 255 bytes: ten nested 30 character names */
+    path[0] = '\0';
+    for (i = 0; i < 10; i++) {
+        if (i > 0) strcat(path, "/");
+        strcat(path, name);
+        if (mkdir(path, 0755) != 0) return -1;
+    }
+    strcat(path, "/deep");
+    if (strlen(path) <= 255 || make_file(path) != 0) return -1;
+    if (stat(path, &st) != 0 || st.st_size != (off_t)strlen(path)) return -1;
+
+    return 0;
+}
+
+static int check_invalidation(void)
+{
+    struct stat st;
+
+    /* Warm entries for everything touched below */
+    if (make_file("d/f") != 0 || make_file("d/sub/g") != 0) return -1;
+    if (stat("d/f", &st) != 0 || stat("d/sub/g", &st) != 0) return -1;
+
+    /* rename() of a file drops its path; case folds as HFS does */
+    if (stat("D/F", &st) != 0) return -1;
+    if (rename("d/f", "d/h") != 0) return -1;
+    if (stat("d/f", &st) != -1 || errno != ENOENT) return -1;
+    if (stat("D/F", &st) != -1 || errno != ENOENT) return -1;
+    if (stat("d/h", &st) != 0) return -1;
+
+    /* rename() of a directory drops every path through it */
+    if (rename("d/sub", "d/moved") != 0) return -1;
+    if (stat("d/sub/g", &st) != -1 || errno != ENOENT) return -1;
+    if (stat("d/moved/g", &st) != 0) return -1;
+
+    /* unlink() */
+    if (unlink("d/h") != 0) return -1;
+    if (stat("d/h", &st) != -1 || errno != ENOENT) return -1;
+
+    /* rmdir() then mkdir() of the same name: a new, empty directory */
+    if (unlink("d/moved/g") != 0 || rmdir("d/moved") != 0) return -1;
+    if (stat("d/moved", &st) != -1 || errno != ENOENT) return -1;
+    if (mkdir("d/moved", 0755) != 0) return -1;
+    if (stat("d/moved", &st) != 0 || !S_ISDIR(st.st_mode)) return -1;
+    if (stat("d/moved/g", &st) != -1 || errno != ENOENT) return -1;
+
+    /* Partial paths follow chdir() */
+    if (make_file("d/moved/x") != 0 || make_file("x") != 0) return -1;
+    if (stat("x", &st) != 0 || st.st_size != 1) return -1;
+    if (chdir("d/moved") != 0) return -1;
+    if (stat("x", &st) != 0 || st.st_size != (off_t)strlen("d/moved/x")) return -1;
+
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+    if (make_tree() != 0 || mkdir("d", 0755) != 0 || mkdir("d/sub", 0755) != 0) {
+        printf("setup failed\n");
+        return 1;
+    }
+
+    printf("stat() + open() of %d config paths x %d passes, simulated File Manager:\n",
+           NPATHS, PASSES);
+    if (run("path cache flushed", 1) != 0) failed++;
+    if (run("path cache warm", 0) != 0) failed++;
+
+    if (check_paths() != 0) {
+        printf("path check: FAILED\n");
+        failed++;
+    } else {
+        printf("path check: ok\n");
+    }
+
+    if (check_invalidation() != 0) {
+        printf("invalidation check: FAILED\n");
+        failed++;
+    } else {
+        printf("invalidation check: ok\n");
+    }
+
+    return failed ? 1 : 0;
+}
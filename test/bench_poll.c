@@ -0,0 +1,316 @@
+/*
+ * bench_poll.c - Host benchmark for poll() and select() over Open Transport
+ *
+ * Waits for one byte to arrive on one of 1, 30 or 120 connected
+ * sockets, the rest idle, two ways: poll() with a timeout, which looks
+ * only at the sockets the notifier listed while it waits, and a loop
+ * of poll() with no timeout and a yield, which looks at every socket
+ * in every pass as select() used to - less the OTLook it made for each
+ * one, which no longer happens. Reports waits per second, yields per
+ * wait and OTLook calls. Also checks timeouts, level-triggered
+ * readiness, data left by a short read, POLLNVAL and EBADF, POLLHUP
+ * on a broken connection, a descriptor listed twice, files alongside
+ * sockets, and select() on the same sockets.
+ *
+ * Build and run with: test/build-host-bench.sh poll
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <Multiverse.h>
+#include "MacCompat.h"
+#include "Threads.h"
+#include "posix9.h"
+#include "posix9/socket.h"
+#include "fm_sim.h"
+#include "ot_sim.h"
+#include "tm_sim.h"
+
+#define MAX_SOCKS   120
+#define WAITS       3000
+#define IDLE_ROUNDS 20          /* Yields before the byte arrives */
+
+static int socks[MAX_SOCKS];
+static int nsocks;
+
+/* The byte the idle hook delivers after a few rounds */
+static int arrive_on = -1;
+static int arrive_in;
+
+static void deliver(void)
+{
+    if (arrive_on >= 0 && --arrive_in <= 0) {
+        otsim_receive(arrive_on, "x", 1);
+        arrive_on = -1;
+    }
+}
+
+static void arrive(int endpoint, int rounds)
+{
+    arrive_on = endpoint;
+    arrive_in = rounds;
+}
+
+static void close_sockets(void)
+{
+    while (nsocks > 0) close(socks[--nsocks]);
+}
+
+/* n connected sockets on a fresh network; socks[i] is endpoint i */
+static int open_sockets(int n)
+{
+    struct sockaddr_in sin;
+    int s;
+
+    close_sockets();
+    otsim_reset();
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(22);
+    sin.sin_addr.s_addr = htonl(0x0A000001);
+
+    while (nsocks < n) {
+        s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s < 0 || connect(s, (struct sockaddr *)&sin, sizeof(sin)) != 0) return -1;
+        socks[nsocks++] = s;
+    }
+
+    return 0;
+}
+
+static void watch_all(struct pollfd *fds, short events)
+{
+    int i;
+
+    for (i = 0; i < nsocks; i++) {
+        fds[i].fd = socks[i];
+        fds[i].events = events;
+        fds[i].revents = 0;
+    }
+}
+
+/* The one entry ready for reading, or -1 */
+static int only_ready(struct pollfd *fds, int n)
+{
+    int i, found = -1;
+
+    for (i = 0; i < n; i++) {
+        if (fds[i].revents == 0) continue;
+        if (fds[i].revents != POLLIN || found >= 0) return -1;
+        found = i;
+    }
+
+    return found;
+}
+
+/* Wait in poll() itself */
+static int wait_event(struct pollfd *fds, int n)
+{
+    return poll(fds, n, 10000);
+}
+
+/* Look at everything, yield, look again */
+static int wait_scan(struct pollfd *fds, int n)
+{
+    int count;
+
+    while ((count = poll(fds, n, 0)) == 0) {
+        YieldToAnyThread();
+    }
+    return count;
+}
+
+static int run(const char *label, int n, int (*wait)(struct pollfd *, int))
+{
+    static struct pollfd fds[MAX_SOCKS];
+    double t0, t1;
+    char c;
+    int i, target, ok = 1;
+
+    if (open_sockets(n) != 0) return -1;
+    watch_all(fds, POLLIN);
+    tmsim_set_idle(deliver);
+    tmsim_reset();
+
+    t0 = fmsim_now();
+    for (i = 0; i < WAITS; i++) {
+        target = (i * 7) % n;
+        arrive(target, IDLE_ROUNDS);
+        if (wait(fds, n) != 1 || only_ready(fds, n) != target ||
+            recv(socks[target], &c, 1, 0) != 1 || c != 'x') {
+            ok = 0;
+            break;
+        }
+    }
+    t1 = fmsim_now();
+    tmsim_set_idle(NULL);
+
+    printf("  %-30s %3d sockets %9.0f waits/s  %4.1f yields/wait  %6lu OTLook  %s\n",
+           label, n, WAITS / (t1 - t0), (double)tmsim_yields() / WAITS, otsim_looks(),
+           ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+/* ============================================================
+ * Semantics
+ * ============================================================ */
+
+static int check_poll(void)
+{
+    struct pollfd fds[8];
+    double t0, t1;
+    char buf[8];
+    int fd, dupfd;
+
+    if (open_sockets(4) != 0) return -1;
+    tmsim_set_idle(deliver);
+
+    /* Nothing to read: no wait with 0, the whole timeout with 100 ms */
+    watch_all(fds, POLLIN);
+    if (poll(fds, 4, 0) != 0 || fds[0].revents != 0) return -1;
+    t0 = fmsim_now();
+    if (poll(fds, 4, 100) != 0) return -1;
+    t1 = fmsim_now();
+    if (t1 - t0 < 0.08 || t1 - t0 > 1.0) return -1;
+
+    /* Connected sockets can be written to */
+    watch_all(fds, POLLIN | POLLOUT);
+    if (poll(fds, 4, 0) != 4 || fds[2].revents != POLLOUT) return -1;
+
+    /* Level-triggered: data not yet read is reported again */
+    watch_all(fds, POLLIN);
+    arrive(2, IDLE_ROUNDS);
+    if (poll(fds, 4, -1) != 1 || fds[2].revents != POLLIN) return -1;
+    if (poll(fds, 4, 0) != 1 || fds[2].revents != POLLIN) return -1;
+    if (recv(socks[2], buf, sizeof(buf), 0) != 1) return -1;
+    if (poll(fds, 4, 0) != 0) return -1;
+
+    /* Data that came while nobody was waiting */
+    if (otsim_receive(1, "ab", 2) != 0 || otsim_receive(3, "c", 1) != 0) return -1;
+    if (poll(fds, 4, 1000) != 2 || fds[1].revents != POLLIN || fds[3].revents != POLLIN) return -1;
+    if (recv(socks[1], buf, sizeof(buf), 0) != 2 || recv(socks[3], buf, sizeof(buf), 0) != 1) return -1;
+
+    /* A short read leaves the rest readable, with no T_DATA to say so */
+    if (otsim_receive(2, "abc", 3) != 0 || otsim_receive(2, "d", 1) != 0) return -1;
+    if (recv(socks[2], buf, 2, 0) != 2) return -1;
+    if (poll(fds, 4, 0) != 1 || fds[2].revents != POLLIN) return -1;
+    if (recv(socks[2], buf, sizeof(buf), 0) != 2 || poll(fds, 4, 0) != 0) return -1;
+
+    /* Closed descriptors get POLLNVAL, negative ones are skipped */
+    fds[0].fd = -1;
+    fds[1].fd = 99;
+    if (poll(fds, 4, -1) != 1 || fds[0].revents != 0 || fds[1].revents != POLLNVAL) return -1;
+    if (poll(fds, POSIX9_OPEN_MAX + 1, 0) != -1 || errno != EINVAL) return -1;
+
+    /* A descriptor listed twice, via dup(), and a file alongside */
+    dupfd = dup(socks[0]);
+    if (dupfd < 0) return -1;
+    watch_all(fds, POLLIN);
+    fds[3].fd = dupfd;
+    arrive(0, IDLE_ROUNDS);
+    if (poll(fds, 4, -1) != 2 || fds[0].revents != POLLIN || fds[3].revents != POLLIN) return -1;
+    if (recv(dupfd, buf, sizeof(buf), 0) != 1 || close(dupfd) != 0) return -1;
+    fd = open("/poll.txt", O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+    fds[3].fd = fd;
+    if (poll(fds, 4, -1) != 1 || fds[3].revents != POLLIN) return -1;
+    if (close(fd) != 0) return -1;
+
+    /* A broken connection: POLLHUP whatever was asked, and readable */
+    watch_all(fds, POLLOUT);
+    fds[1].events = 0;
+    if (otsim_disconnect(1) != 0) return -1;
+    if (poll(fds, 4, 0) != 4 || fds[1].revents != POLLHUP) return -1;
+
+    /* Reading it acknowledges the disconnect and sees the end, as often
+     * as asked */
+    if (recv(socks[1], buf, sizeof(buf), 0) != 0 || recv(socks[1], buf, sizeof(buf), 0) != 0) return -1;
+
+    /* So does a release behind the last of it */
+    watch_all(fds, POLLIN);
+    fds[1].fd = -1;
+    if (otsim_receive(2, "abc", 3) != 0 || recv(socks[2], buf, 2, 0) != 2) return -1;
+    if (otsim_release(2) != 0 || recv(socks[2], buf, sizeof(buf), 0) != 1) return -1;
+    if (poll(fds, 4, 0) != 1 || fds[2].revents != POLLIN) return -1;
+    if (recv(socks[2], buf, sizeof(buf), 0) != 0) return -1;
+
+    tmsim_set_idle(NULL);
+    return 0;
+}
+
+static int check_select(void)
+{
+    struct timeval tv;
+    fd_set rset, wset;
+    char c;
+    int maxfd, i;
+
+    if (open_sockets(MAX_SOCKS) != 0) return -1;
+    tmsim_set_idle(deliver);
+    maxfd = socks[MAX_SOCKS - 1] + 1;
+
+    /* Times out with every set cleared */
+    FD_ZERO(&rset);
+    for (i = 0; i < MAX_SOCKS; i++) FD_SET(socks[i], &rset);
+    tv.tv_sec = 0;
+    tv.tv_usec = 50000;
+    if (select(maxfd, &rset, NULL, NULL, &tv) != 0 || FD_ISSET(socks[0], &rset)) return -1;
+
+    /* One arrives while select() waits */
+    for (i = 0; i < MAX_SOCKS; i++) FD_SET(socks[i], &rset);
+    arrive(77, IDLE_ROUNDS);
+    if (select(maxfd, &rset, NULL, NULL, NULL) != 1 || !FD_ISSET(socks[77], &rset) ||
+        FD_ISSET(socks[76], &rset)) return -1;
+    if (recv(socks[77], &c, 1, 0) != 1) return -1;
+
+    /* Writable, and a broken connection in both sets */
+    if (otsim_disconnect(5) != 0) return -1;
+    FD_ZERO(&rset);
+    FD_ZERO(&wset);
+    FD_SET(socks[5], &rset);
+    FD_SET(socks[5], &wset);
+    FD_SET(socks[6], &wset);
+    tv.tv_sec = tv.tv_usec = 0;
+    if (select(maxfd, &rset, &wset, NULL, &tv) != 3 || !FD_ISSET(socks[5], &rset) ||
+        !FD_ISSET(socks[5], &wset) || !FD_ISSET(socks[6], &wset)) return -1;
+
+    /* A closed descriptor fails the call and leaves the sets alone */
+    close(socks[9]);
+    FD_ZERO(&rset);
+    FD_SET(socks[8], &rset);
+    FD_SET(socks[9], &rset);
+    if (select(maxfd, &rset, NULL, NULL, &tv) != -1 || errno != EBADF ||
+        !FD_ISSET(socks[9], &rset)) return -1;
+    socks[9] = socket(AF_INET, SOCK_STREAM, 0);
+
+    tmsim_set_idle(NULL);
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+
+    printf("Wait for 1 byte on one of n sockets x %d, %d rounds later, simulated Open Transport:\n",
+           WAITS, IDLE_ROUNDS);
+    if (run("poll() every pass (scan)", 1, wait_scan) != 0) failed++;
+    if (run("poll() every pass (scan)", 30, wait_scan) != 0) failed++;
+    if (run("poll() every pass (scan)", MAX_SOCKS, wait_scan) != 0) failed++;
+    if (run("poll() waiting (event list)", 1, wait_event) != 0) failed++;
+    if (run("poll() waiting (event list)", 30, wait_event) != 0) failed++;
+    if (run("poll() waiting (event list)", MAX_SOCKS, wait_event) != 0) failed++;
+
+    if (check_poll() != 0 || check_select() != 0) {
+        printf("poll check: FAILED\n");
+        failed++;
+    } else {
+        printf("poll check: ok\n");
+    }
+
+    close_sockets();
+    return failed ? 1 : 0;
+}
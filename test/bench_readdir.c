@@ -0,0 +1,244 @@
+/*
+ * bench_readdir.c - Host benchmark for bulk directory enumeration
+ *
+ * Lists folders of 100, 1,000 and 5,000 files with readdir(), once
+ * through FSGetCatalogInfoBulk and once with the HFS Plus calls turned
+ * off, where every entry is an indexed PBGetCatInfoSync that scans the
+ * folder from its start, and reports File Manager calls per entry and
+ * entries per second. Then stats every entry of the 1,000 file folder
+ * the way ls -l does, with readdir() and stat() and with
+ * posix9_readdir_plus(). Also checks that both list the same names,
+ * inode numbers and d_type, that the stat() results match a cold
+ * stat(), and rewinddir(), fdopendir(), empty folders and reading past
+ * the end. Finally holds 100 streams open at once, past the 32 the old
+ * fixed pool allowed, and reports the memory a stream takes.
+ *
+ * Build and run with: test/build-host-bench.sh readdir
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "posix9.h"
+#include "fm_sim.h"
+
+#define MAX_FILES   5000
+#define MAX_OPEN    100
+
+static const int sizes[] = { 100, 1000, 5000 };
+
+static ino_t inodes[MAX_FILES];
+static char seen[MAX_FILES];
+
+static int make_folder(int files)
+{
+    char path[64];
+    int i, fd;
+
+    sprintf(path, "d%d", files);
+    if (mkdir(path, 0755) != 0) return -1;
+    for (i = 0; i < files; i++) {
+        sprintf(path, "d%d/f%04d", files, i);
+        fd = open(path, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0 || write(fd, "xxxxxx", i % 7) != i % 7 || close(fd) != 0) return -1;
+    }
+
+    return 0;
+}
+
+/* List a folder; every name must be there once, with the inode in inodes[] */
+static int list(const char *path, int files, int record)
+{
+    struct dirent *de;
+    DIR *dir;
+    int count = 0, i;
+
+    memset(seen, 0, sizeof(seen));
+    dir = opendir(path);
+    if (!dir) return -1;
+    while ((de = readdir(dir)) != NULL) {
+        if (sscanf(de->d_name, "f%d", &i) != 1 || i < 0 || i >= files || seen[i] ||
+            de->d_type != DT_REG) break;
+        seen[i] = 1;
+        if (record) inodes[i] = de->d_ino;
+        else if (inodes[i] != de->d_ino) break;
+        count++;
+    }
+    if (readdir(dir) != NULL || closedir(dir) != 0) count = -1;
+
+    return (count == files) ? 0 : -1;
+}
+
+static int run(const char *label, int files, int bulk)
+{
+    char path[16];
+    double t0, t1;
+    int ok;
+
+    fmsim_set_hfsplus(bulk);
+    posix9_cleanup();       /* Forget the Gestalt answer */
+
+    sprintf(path, "d%d", files);
+    fmsim_zero_traps();
+    t0 = fmsim_now();
+    ok = list(path, files, bulk) == 0;
+    t1 = fmsim_now();
+
+    printf("  %5d files  %-26s %7.3f traps/entry  %10.0f entries/s  %s\n",
+           files, label, (double)fmsim_traps() / files, files / (t1 - t0),
+           ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+/* ls -l: every entry's stat(), with the stat cache flushed first */
+static int run_stat(const char *label, int plus)
+{
+    struct dirent *de;
+    struct stat st, cold;
+    char path[32];
+    DIR *dir;
+    int i, n = 0, ok = 1;
+
+    posix9_statcache_flush();
+    posix9_pathcache_flush();
+    fmsim_zero_traps();
+
+    dir = opendir("d1000");
+    if (!dir) return -1;
+    for (;;) {
+        if (plus) {
+            de = posix9_readdir_plus(dir, &st);
+        } else {
+            de = readdir(dir);
+            if (de && fstatat(dirfd(dir), de->d_name, &st, 0) != 0) ok = 0;
+        }
+        if (!de) break;
+        if (sscanf(de->d_name, "f%d", &i) != 1 || st.st_size != i % 7) ok = 0;
+        n++;
+    }
+    closedir(dir);
+    printf("  %5d files  %-26s %7.3f traps/entry  %s\n", n, label,
+           (double)fmsim_traps() / n, ok ? "ok" : "MISMATCH");
+
+    /* The same as a stat() that reaches the catalog */
+    posix9_statcache_flush();
+    sprintf(path, "d1000/f%04d", 999);
+    if (stat(path, &cold) != 0 || cold.st_mode != st.st_mode ||
+        cold.st_mtime != st.st_mtime || cold.st_size != st.st_size) ok = 0;
+
+    return (ok && n == 1000) ? 0 : -1;
+}
+
+static int check_semantics(void)
+{
+    struct dirent *de;
+    DIR *dir;
+    int fd, n = 0, again = 0;
+
+    fmsim_set_hfsplus(1);
+    posix9_cleanup();
+
+    /* An empty folder lists nothing, and stays at its end */
+    if (mkdir("empty", 0755) != 0) return -1;
+    dir = opendir("empty");
+    if (!dir || readdir(dir) != NULL || readdir(dir) != NULL || closedir(dir) != 0) return -1;
+
+    /* rewinddir() starts over part way through a bulk batch */
+    dir = opendir("d100");
+    if (!dir) return -1;
+    while (n < 40 && readdir(dir) != NULL) n++;
+    rewinddir(dir);
+    while ((de = readdir(dir)) != NULL) again++;
+    if (n != 40 || again != 100 || closedir(dir) != 0) return -1;
+
+    /* fdopendir() of an open()ed directory, with a folder inside */
+    if (mkdir("d100/sub", 0755) != 0) return -1;
+    fd = open("d100", O_RDONLY | O_DIRECTORY);
+    dir = fdopendir(fd);
+    if (!dir) return -1;
+    n = 0;
+    while ((de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, "sub") == 0) n++;
+    }
+    if (n != 1 || closedir(dir) != 0) return -1;
+
+    /* closedir() part way through gives the iterator back */
+    for (n = 0; n < 200; n++) {
+        dir = opendir("d1000");
+        if (!dir || !readdir(dir) || closedir(dir) != 0) return -1;
+    }
+    fmsim_zero_traps();
+    if (list("d1000", 1000, 1) != 0 || fmsim_traps() > 1000 / 10) return -1;
+
+    return 0;
+}
+
+/* More streams than the old pool had, each part way through a listing */
+static int run_streams(void)
+{
+    static DIR *dirs[MAX_OPEN];
+    posix9_dir_usage before, open, after;
+    int i, ok = 1;
+
+    fmsim_set_hfsplus(1);
+    posix9_cleanup();
+    posix9_dir_stats(&before);
+    for (i = 0; i < MAX_OPEN; i++) {
+        dirs[i] = opendir((i & 1) ? "d100" : "d1000");
+        if (!dirs[i] || !readdir(dirs[i])) ok = 0;
+    }
+    posix9_dir_stats(&open);
+    for (i = 0; i < MAX_OPEN; i++) {
+        if (dirs[i] && closedir(dirs[i]) != 0) ok = 0;
+    }
+    posix9_dir_stats(&after);
+
+    if (open.streams != before.streams + MAX_OPEN || after.streams != before.streams ||
+        after.capacity > POSIX9_DIR_BLOCK) ok = 0;
+
+    printf("  %d streams open: %ld bytes each + %ld bulk buffer while read, "
+           "%ld bytes held; %ld bytes after closing  %s\n",
+           MAX_OPEN, open.streamBytes, open.bulkBytes, open.heapBytes, after.heapBytes,
+           ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+int main(void)
+{
+    int i, failed = 0;
+
+    fmsim_reset();
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        if (make_folder(sizes[i]) != 0) {
+            printf("setup failed\n");
+            return 1;
+        }
+    }
+
+    printf("readdir() of a whole folder, simulated File Manager:\n");
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        if (run("FSGetCatalogInfoBulk", sizes[i], 1) != 0) failed++;
+        if (run("indexed PBGetCatInfoSync", sizes[i], 0) != 0) failed++;
+    }
+
+    printf("readdir() + stat() of every entry, stat cache flushed:\n");
+    for (i = 1; i >= 0; i--) {
+        fmsim_set_hfsplus(i);
+        posix9_cleanup();
+        if (run_stat(i ? "readdir + fstatat, bulk" : "readdir + fstatat, indexed", 0) != 0) failed++;
+        if (run_stat(i ? "readdir_plus, bulk" : "readdir_plus, indexed", 1) != 0) failed++;
+    }
+
+    printf("directory streams:\n");
+    if (run_streams() != 0) failed++;
+
+    if (check_semantics() != 0) {
+        printf("semantics check: FAILED\n");
+        failed++;
+    } else {
+        printf("semantics check: ok\n");
+    }
+
+    return failed ? 1 : 0;
+}
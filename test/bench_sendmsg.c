@@ -0,0 +1,287 @@
+/*
+ * bench_sendmsg.c - Host benchmark for gather sends and scatter receives on sockets
+ *
+ * Sends packets built from a header, a payload and a MAC, as SSH does,
+ * three ways: copied together into one buffer and sent with send(),
+ * sent a piece at a time with send(), and handed over as they are with
+ * sendmsg(), which gives OT all three as one OTData chain. Reports
+ * packets per second, OTSnd calls per packet and the bytes copied to
+ * gather them. Also checks writev(), a chain split by a full window on
+ * blocking and non-blocking sockets, empty pieces, and recvmsg() and
+ * readv() scattering what arrived.
+ *
+ * Build and run with: test/build-host-bench.sh sendmsg
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <Multiverse.h>
+#include "MacCompat.h"
+#include "Threads.h"
+#include "posix9.h"
+#include "posix9/socket.h"
+#include "fm_sim.h"
+#include "ot_sim.h"
+#include "tm_sim.h"
+
+/* Not in the POSIX9 headers; implemented in posix9_socket.c */
+#ifndef F_SETFL
+#define F_SETFL     4
+#endif
+#ifndef O_NONBLOCK
+#define O_NONBLOCK  0x0004
+#endif
+extern int fcntl(int fd, int cmd, ...);
+
+#define PACKETS     20000
+#define HEADER      5           /* Length and padding length */
+#define PAYLOAD     1024
+#define MAC         20          /* HMAC-SHA1 */
+#define PACKET      (HEADER + PAYLOAD + MAC)
+
+static char header[HEADER], payload[PAYLOAD], mac[MAC];
+
+/* One connected socket, endpoint 0 of a fresh network */
+static int open_socket(void)
+{
+    struct sockaddr_in sin;
+    int s;
+
+    otsim_reset();
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(22);
+    sin.sin_addr.s_addr = htonl(0x0A000001);
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) != 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+static void set_iov(struct iovec *iov)
+{
+    iov[0].iov_base = header;
+    iov[0].iov_len = HEADER;
+    iov[1].iov_base = payload;
+    iov[1].iov_len = PAYLOAD;
+    iov[2].iov_base = mac;
+    iov[2].iov_len = MAC;
+}
+
+/* Copy the pieces together, send once */
+static int send_gathered(int s, unsigned long *copied)
+{
+    static char packet[PACKET];
+
+    memcpy(packet, header, HEADER);
+    memcpy(packet + HEADER, payload, PAYLOAD);
+    memcpy(packet + HEADER + PAYLOAD, mac, MAC);
+    *copied += PACKET;
+    return send(s, packet, PACKET, 0) == PACKET ? 0 : -1;
+}
+
+/* One send() per piece */
+static int send_pieces(int s, unsigned long *copied)
+{
+    (void)copied;
+    if (send(s, header, HEADER, 0) != HEADER) return -1;
+    if (send(s, payload, PAYLOAD, 0) != PAYLOAD) return -1;
+    return send(s, mac, MAC, 0) == MAC ? 0 : -1;
+}
+
+/* The pieces as they are, one call */
+static int send_message(int s, unsigned long *copied)
+{
+    struct iovec iov[3];
+    struct msghdr msg;
+
+    (void)copied;
+    set_iov(iov);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    return sendmsg(s, &msg, 0) == PACKET ? 0 : -1;
+}
+
+/* Everything delivered is the packet, over and over */
+static int check_delivered(long packets)
+{
+    const char *data;
+    long len, i;
+
+    len = otsim_delivered(&data);
+    if (len != packets * PACKET) return -1;
+    for (i = 0; i < len; i += PACKET) {
+        if (memcmp(data + i, header, HEADER) != 0 ||
+            memcmp(data + i + HEADER, payload, PAYLOAD) != 0 ||
+            memcmp(data + i + HEADER + PAYLOAD, mac, MAC) != 0) return -1;
+    }
+    return 0;
+}
+
+static int run(const char *label, int (*send_one)(int, unsigned long *))
+{
+    unsigned long copied = 0;
+    double t0, t1;
+    int i, s, ok = 1;
+
+    s = open_socket();
+    if (s < 0) return -1;
+
+    t0 = fmsim_now();
+    for (i = 0; i < PACKETS; i++) {
+        if (send_one(s, &copied) != 0) {
+            ok = 0;
+            break;
+        }
+    }
+    while (otsim_run()) ;
+    t1 = fmsim_now();
+
+    if (ok && check_delivered(PACKETS) != 0) ok = 0;
+
+    printf("  %-36s %8.0f packets/s  %4.1f OTSnd/packet  %9lu bytes gathered  %s\n",
+           label, PACKETS / (t1 - t0), (double)otsim_sends() / PACKETS, copied,
+           ok ? "ok" : "MISMATCH");
+
+    close(s);
+    return ok ? 0 : -1;
+}
+
+/* ============================================================
+ * Semantics
+ * ============================================================ */
+
+static int check_send(void)
+{
+    struct iovec iov[5];
+    struct msghdr msg;
+    const char *data;
+    int s, ok = -1;
+
+    s = open_socket();
+    if (s < 0) return -1;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+
+    /* writev() on a socket: one OTSnd, no gather */
+    set_iov(iov);
+    if (writev(s, iov, 3) != PACKET || otsim_sends() != 1) goto out;
+    while (otsim_run()) ;
+    if (check_delivered(1) != 0) goto out;
+
+    /* Empty pieces are left out; nothing at all sends nothing */
+    close(s);
+    s = open_socket();
+    iov[0].iov_base = "ab";
+    iov[0].iov_len = 2;
+    iov[1].iov_base = "";
+    iov[1].iov_len = 0;
+    iov[2].iov_base = "cd";
+    iov[2].iov_len = 2;
+    msg.msg_iovlen = 3;
+    if (sendmsg(s, &msg, 0) != 4 || otsim_sends() != 1) goto out;
+    msg.msg_iovlen = 1;
+    iov[0].iov_len = 0;
+    if (sendmsg(s, &msg, 0) != 0) goto out;
+    msg.msg_iovlen = 0;
+    if (sendmsg(s, &msg, 0) != -1 || errno != EINVAL) goto out;
+    while (otsim_run()) ;
+    if (otsim_delivered(&data) != 4 || memcmp(data, "abcd", 4) != 0) goto out;
+
+    /* A window of 10 splits the chain inside its second piece: a
+     * non-blocking socket sends what fits, a blocking one the rest */
+    close(s);
+    s = open_socket();
+    otsim_set_window(10);
+    iov[0].iov_base = "01234567";
+    iov[1].iov_base = "89abcdef";
+    iov[2].iov_base = "ghijklmn";
+    iov[0].iov_len = iov[1].iov_len = iov[2].iov_len = 8;
+    msg.msg_iovlen = 3;
+    if (fcntl(s, F_SETFL, O_NONBLOCK) != 0) goto out;
+    if (sendmsg(s, &msg, 0) != 10) goto out;
+    if (sendmsg(s, &msg, 0) != -1 || errno != EAGAIN) goto out;
+    while (otsim_run()) ;
+    if (fcntl(s, F_SETFL, 0) != 0) goto out;
+    if (sendmsg(s, &msg, 0) != 24) goto out;
+    while (otsim_run()) ;
+    if (otsim_delivered(&data) != 34 ||
+        memcmp(data, "0123456789" "0123456789abcdefghijklmn", 34) != 0) goto out;
+    ok = 0;
+
+out:
+    close(s);
+    return ok;
+}
+
+static int check_recv(void)
+{
+    struct iovec iov[3];
+    struct msghdr msg;
+    char a[3], b[3], c[10];
+    int s, ok = -1;
+
+    s = open_socket();
+    if (s < 0) return -1;
+
+    iov[0].iov_base = a;
+    iov[0].iov_len = sizeof(a);
+    iov[1].iov_base = b;
+    iov[1].iov_len = sizeof(b);
+    iov[2].iov_base = c;
+    iov[2].iov_len = sizeof(c);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+    msg.msg_controllen = 99;
+    msg.msg_flags = 99;
+
+    /* Two arrivals scattered over three pieces */
+    if (otsim_receive(0, "abcd", 4) != 0 || otsim_receive(0, "efgh", 4) != 0) goto out;
+    if (recvmsg(s, &msg, 0) != 8 || msg.msg_flags != 0 || msg.msg_controllen != 0) goto out;
+    if (memcmp(a, "abc", 3) != 0 || memcmp(b, "def", 3) != 0 || memcmp(c, "gh", 2) != 0) goto out;
+
+    /* readv() the same way; less than asked is fine, none is EAGAIN */
+    if (otsim_receive(0, "xyz1", 4) != 0) goto out;
+    if (readv(s, iov, 3) != 4 || memcmp(a, "xyz", 3) != 0 || b[0] != '1') goto out;
+    if (fcntl(s, F_SETFL, O_NONBLOCK) != 0) goto out;
+    if (readv(s, iov, 3) != -1 || errno != EAGAIN) goto out;
+
+    /* The end of the stream */
+    if (otsim_release(0) != 0 || recvmsg(s, &msg, 0) != 0) goto out;
+    ok = 0;
+
+out:
+    close(s);
+    return ok;
+}
+
+int main(void)
+{
+    int failed = 0, i;
+
+    fmsim_reset();
+    for (i = 0; i < HEADER; i++) header[i] = (char)(0xA0 + i);
+    for (i = 0; i < PAYLOAD; i++) payload[i] = (char)(i * 13);
+    for (i = 0; i < MAC; i++) mac[i] = (char)(0x50 + i);
+
+    printf("Send %d packets of %d + %d + %d bytes, simulated Open Transport:\n",
+           PACKETS, HEADER, PAYLOAD, MAC);
+    if (run("gathered into one buffer, send()", send_gathered) != 0) failed++;
+    if (run("send() per piece", send_pieces) != 0) failed++;
+    if (run("sendmsg() (one OTData chain)", send_message) != 0) failed++;
+
+    if (check_send() != 0 || check_recv() != 0) {
+        printf("sendmsg check: FAILED\n");
+        failed++;
+    } else {
+        printf("sendmsg check: ok\n");
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * bench_statcache.c - Host benchmark for the stat()/fstat() metadata cache
+ *
+ * Stats every file in a directory several times over, the way make or
+ * ls -l does, and reports File Manager calls per pass with the cache
+ * flushed before every pass and left warm, then with a working set
+ * larger than the cache. Path resolution looks the leaf up through the
+ * same cache, so stat() itself always hits the entry resolving just
+ * made. Also checks that write(), ftruncate(), rename(), unlink(),
+ * mkdir() and rmdir() invalidate what they change.
+ *
+ * Build and run with: test/build-host-bench.sh statcache
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "posix9.h"
+#include "fm_sim.h"
+
+#define PASSES      10
+
+static int make_tree(int files)
+{
+    char name[32];
+    int i, fd;
+
+    if (mkdir("t", 0755) != 0) return -1;
+    for (i = 0; i < files; i++) {
+        sprintf(name, "t/f%d", i);
+        fd = open(name, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0 || write(fd, name, strlen(name)) < 0 || close(fd) != 0) return -1;
+    }
+
+    return 0;
+}
+
+static int run(const char *label, int files, int cold)
+{
+    posix9_cache_stats before, after;
+    struct stat st;
+    char name[32];
+    unsigned long traps;
+    int pass, i, ok = 1;
+
+    posix9_statcache_flush();
+    posix9_statcache_stats(&before);
+    fmsim_zero_traps();
+
+    for (pass = 0; pass < PASSES; pass++) {
+        if (cold) posix9_statcache_flush();
+        for (i = 0; i < files; i++) {
+            sprintf(name, "t/f%d", i);
+            if (stat(name, &st) != 0 || st.st_size != (off_t)strlen(name)) ok = 0;
+        }
+    }
+
+    traps = fmsim_traps();
+    posix9_statcache_stats(&after);
+
+    printf("  %-24s %3d files  %5.1f traps/stat  hits %5lu  misses %5lu  evictions %5lu  %s\n",
+           label, files, (double)traps / (PASSES * files),
+           after.hits - before.hits, after.misses - before.misses,
+           after.evictions - before.evictions, ok ? "ok" : "MISMATCH");
+
+    return ok ? 0 : -1;
+}
+
+static int check_invalidation(void)
+{
+    struct stat st;
+    int fd;
+
+    posix9_statcache_flush();
+
+    /* write() and close() */
+    fd = open("t/w", O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+    if (stat("t/w", &st) != 0 || st.st_size != 0) return -1;
+    if (write(fd, "hello", 5) != 5 || fsync(fd) != 0) return -1;
+    if (stat("t/w", &st) != 0 || st.st_size != 5) return -1;
+    if (fstat(fd, &st) != 0 || st.st_size != 5) return -1;
+
+    /* ftruncate() */
+    if (ftruncate(fd, 2) != 0) return -1;
+    if (stat("t/w", &st) != 0 || st.st_size != 2) return -1;
+    if (close(fd) != 0) return -1;
+
+    /* O_TRUNC */
+    fd = open("t/w", O_WRONLY | O_TRUNC);
+    if (fd < 0 || close(fd) != 0) return -1;
+    if (stat("t/w", &st) != 0 || st.st_size != 0) return -1;
+
+    /* rename() - HFS names are case-insensitive, so is the cache */
+    if (stat("t/W", &st) != 0) return -1;
+    if (rename("t/w", "t/v") != 0) return -1;
+    if (stat("t/w", &st) != -1 || errno != ENOENT) return -1;
+    if (stat("t/W", &st) != -1 || errno != ENOENT) return -1;
+    if (stat("t/v", &st) != 0) return -1;
+
+    /* unlink() */
+    if (unlink("t/v") != 0) return -1;
+    if (stat("t/v", &st) != -1 || errno != ENOENT) return -1;
+
+    /* mkdir() / rmdir() */
+    if (mkdir("t/sub", 0755) != 0) return -1;
+    if (stat("t/sub", &st) != 0 || !S_ISDIR(st.st_mode)) return -1;
+    if (rmdir("t/sub") != 0) return -1;
+    if (stat("t/sub", &st) != -1 || errno != ENOENT) return -1;
+
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    fmsim_reset();
+    if (make_tree(2 * POSIX9_STATCACHE_SIZE) != 0) {
+        printf("setup failed\n");
+        return 1;
+    }
+
+    printf("stat() x %d passes over one directory, simulated File Manager:\n", PASSES);
+    if (run("cache flushed each pass", POSIX9_STATCACHE_SIZE / 2, 1) != 0) failed++;
+    if (run("cache warm", POSIX9_STATCACHE_SIZE / 2, 0) != 0) failed++;
+    if (run("working set > cache", 2 * POSIX9_STATCACHE_SIZE, 0) != 0) failed++;
+
+    if (check_invalidation() != 0) {
+        printf("invalidation check: FAILED\n");
+        failed++;
+    } else {
+        printf("invalidation check: ok\n");
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+#!/bin/bash
+# Build and run POSIX9 host-side benchmarks on Linux
+#
+# The library sources are compiled against the stand-in Toolbox headers
+# in test/host/ and linked with the simulated File Manager, Thread
+# Manager and Open Transport, so trap counts and throughput can be measured without a Mac.
+#
+# Usage:
+#   test/build-host-bench.sh              # build and run every bench_*.c
+#   test/build-host-bench.sh readahead    # build and run bench_readahead.c
+
+HOST_CC="${HOST_CC:-gcc}"
+
+TEST_DIR="$(cd "$(dirname "$0")" && pwd)"
+POSIX9_DIR="$TEST_DIR/.."
+OUT_DIR="$POSIX9_DIR/build-host"
+
+CFLAGS="-std=gnu99 -O2 -Wall -Wextra -Wno-multichar -I$TEST_DIR/host -I$POSIX9_DIR/include -I$POSIX9_DIR/include/mac_stubs"
+
+LIB_SRCS="$POSIX9_DIR/src/posix9_fd.c \
+          $POSIX9_DIR/src/posix9_file.c \
+          $POSIX9_DIR/src/posix9_dir.c \
+          $POSIX9_DIR/src/posix9_find.c \
+          $POSIX9_DIR/src/posix9_path.c \
+          $POSIX9_DIR/src/posix9_socket.c \
+          $POSIX9_DIR/src/posix9_epoll.c \
+          $POSIX9_DIR/src/posix9_aio.c \
+          $POSIX9_DIR/src/posix9_statcache.c \
+          $POSIX9_DIR/src/posix9_pathcache.c \
+          $POSIX9_DIR/src/posix9_mmap.c \
+          $TEST_DIR/host/fm_sim.c \
+          $TEST_DIR/host/tm_sim.c \
+          $TEST_DIR/host/ot_sim.c"
+
+mkdir -p "$OUT_DIR"
+
+if [ $# -gt 0 ]; then
+    BENCHES="$*"
+else
+    BENCHES=$(cd "$TEST_DIR" && ls bench_*.c | sed 's/^bench_//; s/\.c$//')
+fi
+
+FAILED=0
+for name in $BENCHES; do
+    echo "=== bench_$name ==="
+    if ! $HOST_CC $CFLAGS "$TEST_DIR/bench_$name.c" $LIB_SRCS -o "$OUT_DIR/bench_$name"; then
+        echo "ERROR: bench_$name failed to build"
+        FAILED=$((FAILED + 1))
+        continue
+    fi
+    if ! "$OUT_DIR/bench_$name"; then
+        FAILED=$((FAILED + 1))
+    fi
+    echo ""
+done
+
+exit $FAILED
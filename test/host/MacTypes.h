@@ -0,0 +1,63 @@
+/*
+ * MacTypes.h - Host stand-in for the Mac OS base types
+ *
+ * Lets the POSIX9 sources compile on a Linux host so the benchmark
+ * harnesses in test/ can run them against a simulated Toolbox.
+ * Only what the library actually touches is declared here. Like the
+ * Retro68 header it stands in for, it pulls in the full Toolbox
+ * declarations so posix9.h can name FSSpec.
+ */
+#ifndef __MACTYPES__
+#define __MACTYPES__
+
+#include <stddef.h>
+
+/* No Pascal calling convention on the host */
+#define pascal
+
+typedef unsigned char   UInt8;
+typedef signed char     SInt8;
+typedef unsigned short  UInt16;
+typedef signed short    SInt16;
+typedef unsigned int    UInt32;
+typedef signed int      SInt32;
+typedef unsigned long long UInt64;
+typedef signed long long SInt64;
+typedef UInt16          UniChar;
+typedef UInt32          UniCharCount;
+typedef UInt32          ItemCount;
+typedef UInt32          TextEncoding;
+
+typedef unsigned char   Boolean;
+typedef short           OSErr;
+typedef SInt32          OSStatus;
+typedef UInt32          OSType;
+typedef SInt16          ScriptCode;
+typedef char *          Ptr;
+typedef Ptr *           Handle;
+typedef long            Size;
+
+typedef unsigned char   Str255[256];
+typedef unsigned char   Str63[64];
+typedef unsigned char   Str31[32];
+typedef unsigned char * StringPtr;
+typedef const unsigned char * ConstStr255Param;
+typedef const unsigned char * ConstStr63Param;
+typedef const unsigned char * ConstStr31Param;
+
+#ifndef true
+#define true    1
+#define false   0
+#endif
+
+#ifndef NULL
+#define NULL    ((void *)0)
+#endif
+
+enum {
+    noErr       = 0
+};
+
+#include "Multiverse.h"
+
+#endif /* __MACTYPES__ */
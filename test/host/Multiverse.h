@@ -0,0 +1,295 @@
+/*
+ * Multiverse.h - Host stand-in for the Retro68 Toolbox interfaces
+ *
+ * Declares the subset of the File Manager, Memory Manager and OS
+ * Utilities that POSIX9 calls. Struct layouts follow Inside Macintosh
+ * closely enough that the library's CInfoPBRec/ParamBlockRec aliasing
+ * (e.g. reading dirInfo.ioDrDirID after filling hFileInfo) behaves as
+ * it does on a real Mac. The calls themselves are implemented by the
+ * simulated File Manager in fm_sim.c.
+ */
+#ifndef __MULTIVERSE__
+#define __MULTIVERSE__
+
+#include "MacTypes.h"
+
+/* ============================================================
+ * Result Codes
+ * ============================================================ */
+
+enum {
+    dirFulErr       = -33,
+    dskFulErr       = -34,
+    nsvErr          = -35,
+    ioErr           = -36,
+    bdNamErr        = -37,
+    fnOpnErr        = -38,
+    eofErr          = -39,
+    posErr          = -40,
+    tmfoErr         = -42,
+    fnfErr          = -43,
+    wPrErr          = -44,
+    fLckdErr        = -45,
+    vLckdErr        = -46,
+    fBsyErr         = -47,
+    dupFNErr        = -48,
+    opWrErr         = -49,
+    paramErr        = -50,
+    rfNumErr        = -51,
+    permErr         = -54,
+    wrPermErr       = -61,
+    memFullErr      = -108,
+    dirNFErr        = -120
+};
+
+/* ============================================================
+ * File Manager Constants
+ * ============================================================ */
+
+enum {
+    fsCurPerm       = 0,
+    fsRdPerm        = 1,
+    fsWrPerm        = 2,
+    fsRdWrPerm      = 3
+};
+
+enum {
+    fsAtMark        = 0,
+    fsFromStart     = 1,
+    fsFromLEOF      = 2,
+    fsFromMark      = 3
+};
+
+enum {
+    smSystemScript  = -1
+};
+
+/* Script Manager: scripts, regions, and GetScriptManagerVariable() selectors */
+enum {
+    smRoman             = 0,
+    smGreek             = 6,
+    smCyrillic          = 7,
+    smCentralEuroRoman  = 29
+};
+
+enum {
+    verUS               = 0,
+    verIceland          = 21,
+    verTurkey           = 24,
+    verYugoCroatian     = 25,
+    verRomania          = 39,
+    verCroatia          = 68
+};
+
+enum {
+    smSysScript         = 18,
+    smRegionCode        = 40
+};
+
+/* ============================================================
+ * File Manager Types
+ * ============================================================ */
+
+typedef struct FSSpec {
+    short       vRefNum;
+    long        parID;
+    Str63       name;
+} FSSpec;
+
+typedef struct FInfo {
+    OSType      fdType;
+    OSType      fdCreator;
+    UInt16      fdFlags;
+    short       fdLocation[2];
+    short       fdFldr;
+} FInfo;
+
+typedef struct DInfo {
+    short       frRect[4];
+    UInt16      frFlags;
+    short       frLocation[2];
+    short       frView;
+} DInfo;
+
+typedef struct FXInfo {
+    short       fdReserved[8];
+} FXInfo;
+
+typedef struct DXInfo {
+    short       frReserved[8];
+} DXInfo;
+
+typedef union ParamBlockRec *ParmBlkPtr;
+typedef void (*IOCompletionProcPtr)(ParmBlkPtr paramBlock);
+typedef IOCompletionProcPtr IOCompletionUPP;
+
+#define NewIOCompletionUPP(proc)        ((IOCompletionUPP)(proc))
+#define DisposeIOCompletionUPP(upp)     /* no-op */
+
+#define PARAM_BLOCK_HEADER              \
+    void *          qLink;              \
+    short           qType;              \
+    short           ioTrap;             \
+    Ptr             ioCmdAddr;          \
+    IOCompletionUPP ioCompletion;       \
+    volatile OSErr  ioResult;           \
+    StringPtr       ioNamePtr;          \
+    short           ioVRefNum;
+
+typedef struct IOParam {
+    PARAM_BLOCK_HEADER
+    short       ioRefNum;
+    SInt8       ioVersNum;
+    SInt8       ioPermssn;
+    Ptr         ioMisc;
+    Ptr         ioBuffer;
+    long        ioReqCount;
+    long        ioActCount;
+    short       ioPosMode;
+    long        ioPosOffset;
+} IOParam;
+
+typedef union ParamBlockRec {
+    IOParam     ioParam;
+} ParamBlockRec;
+
+typedef struct HFileInfo {
+    PARAM_BLOCK_HEADER
+    short       ioFRefNum;
+    SInt8       ioFVersNum;
+    SInt8       filler1;
+    short       ioFDirIndex;
+    SInt8       ioFlAttrib;
+    SInt8       ioACUser;
+    FInfo       ioFlFndrInfo;
+    long        ioDirID;
+    unsigned short ioFlStBlk;
+    long        ioFlLgLen;
+    long        ioFlPyLen;
+    unsigned short ioFlRStBlk;
+    long        ioFlRLgLen;
+    long        ioFlRPyLen;
+    unsigned long ioFlCrDat;
+    unsigned long ioFlMdDat;
+    unsigned long ioFlBkDat;
+    FXInfo      ioFlXFndrInfo;
+    long        ioFlParID;
+    long        ioFlClpSiz;
+} HFileInfo;
+
+typedef struct DirInfo {
+    PARAM_BLOCK_HEADER
+    short       ioFRefNum;
+    SInt8       ioFVersNum;
+    SInt8       filler1;
+    short       ioFDirIndex;
+    SInt8       ioFlAttrib;
+    SInt8       ioACUser;
+    DInfo       ioDrUsrWds;
+    long        ioDrDirID;
+    unsigned short ioDrNmFls;
+    short       filler3[9];
+    unsigned long ioDrCrDat;
+    unsigned long ioDrMdDat;
+    unsigned long ioDrBkDat;
+    DXInfo      ioDrFndrInfo;
+    long        ioDrParID;
+} DirInfo;
+
+typedef union CInfoPBRec {
+    HFileInfo   hFileInfo;
+    DirInfo     dirInfo;
+} CInfoPBRec, *CInfoPBPtr;
+
+typedef struct FCBPBRec {
+    PARAM_BLOCK_HEADER
+    short       ioRefNum;
+    short       filler;
+    short       ioFCBIndx;
+    short       filler1;
+    long        ioFCBFlNm;
+    short       ioFCBFlags;
+    unsigned short ioFCBStBlk;
+    long        ioFCBEOF;
+    long        ioFCBPLen;
+    long        ioFCBCrPs;
+    short       ioFCBVRefNum;
+    long        ioFCBClpSiz;
+    long        ioFCBParID;
+} FCBPBRec, *FCBPBPtr;
+
+/* ============================================================
+ * File Manager Calls
+ * ============================================================ */
+
+pascal OSErr FSMakeFSSpec(short vRefNum, long dirID, ConstStr255Param fileName, FSSpec *spec);
+pascal OSErr FSpCreate(const FSSpec *spec, OSType creator, OSType fileType, ScriptCode scriptTag);
+pascal OSErr FSpOpenDF(const FSSpec *spec, SInt8 permission, short *refNum);
+pascal OSErr FSpDelete(const FSSpec *spec);
+pascal OSErr FSpRename(const FSSpec *spec, ConstStr255Param newName);
+pascal OSErr FSpCatMove(const FSSpec *source, const FSSpec *dest);
+pascal OSErr FSClose(short refNum);
+pascal OSErr FSRead(short refNum, long *count, void *buffPtr);
+pascal OSErr FSWrite(short refNum, long *count, const void *buffPtr);
+pascal OSErr GetFPos(short refNum, long *filePos);
+pascal OSErr SetFPos(short refNum, short posMode, long posOff);
+pascal OSErr GetEOF(short refNum, long *logEOF);
+pascal OSErr SetEOF(short refNum, long logEOF);
+
+pascal OSErr PBReadSync(ParmBlkPtr paramBlock);
+pascal OSErr PBWriteSync(ParmBlkPtr paramBlock);
+pascal OSErr PBReadAsync(ParmBlkPtr paramBlock);
+pascal OSErr PBWriteAsync(ParmBlkPtr paramBlock);
+pascal OSErr PBFlushFileSync(ParmBlkPtr paramBlock);
+pascal OSErr PBFlushVolSync(ParmBlkPtr paramBlock);
+pascal OSErr PBGetCatInfoSync(CInfoPBPtr paramBlock);
+pascal OSErr PBGetFCBInfoSync(FCBPBPtr paramBlock);
+
+/* ============================================================
+ * Time Manager
+ * ============================================================ */
+
+typedef struct QElem {
+    struct QElem *  qLink;
+    short           qType;
+    short           qData[1];
+} QElem, *QElemPtr;
+
+typedef struct TMTask {
+    QElemPtr        qLink;
+    short           qType;
+    void *          tmAddr;         /* TimerUPP, see MacCompat.h */
+    long            tmCount;
+    long            tmWakeUp;
+    long            tmReserved;
+} TMTask, *TMTaskPtr;
+
+void         InsTime(QElemPtr tmTaskPtr);
+void         PrimeTime(QElemPtr tmTaskPtr, long count);
+void         RmvTime(QElemPtr tmTaskPtr);
+
+/* ============================================================
+ * Memory Manager / OS Utilities
+ * ============================================================ */
+
+Ptr          NewPtr(Size byteCount);
+Ptr          NewPtrClear(Size byteCount);
+void         DisposePtr(Ptr p);
+OSErr        MemError(void);
+void         BlockMoveData(const void *srcPtr, void *destPtr, Size byteCount);
+unsigned long TickCount(void);
+void         SystemTask(void);
+long         GetScriptManagerVariable(short selector);
+
+/* Time zone: gmtDelta's low 3 bytes are seconds east of UTC */
+typedef struct MachineLocation {
+    long        latitude;
+    long        longitude;
+    union {
+        long    gmtDelta;
+    } u;
+} MachineLocation;
+
+void         ReadLocation(MachineLocation *loc);
+
+#endif /* __MULTIVERSE__ */
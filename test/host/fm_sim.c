@@ -0,0 +1,1381 @@
+/*
+ * fm_sim.c - Simulated File Manager for host-side benchmarks
+ *
+ * A single in-memory volume ("Macintosh HD", vRefNum -1) with an
+ * HFS-style catalog: every node has a parent dirID and a name, files
+ * carry a data fork, and indexed catalog lookups scan the parent's
+ * children in order just as the real B-tree walk does, while an
+ * FSIterator resumes where its last FSGetCatalogInfoBulk left off.
+ * Each public File Manager entry point counts as one trap.
+ *
+ * Fork data is kept in sparse 64 KB pages so tests can write past the
+ * 2 GB mark through the HFS Plus fork calls without the memory to back
+ * it. As on a real Mac, the classic calls stop at 2 GB - 1 and report
+ * larger lengths pinned to that value.
+ */
+
+#include "Multiverse.h"
+#include "MacCompat.h"
+#include "fm_sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_VREFNUM     (-1)
+#define SIM_VOLNAME     "Macintosh HD"
+#define SIM_MAX_FCBS    348
+#define SIM_REFNUM_BASE 100
+#define SIM_PAGE        65536L
+#define SIM_CLASSIC_MAX 0x7FFFFFFFLL    /* Reach of the 32-bit calls */
+
+typedef struct {
+    Boolean         inUse;
+    Boolean         isDir;
+    long            id;             /* dirID for folders, file number for files */
+    long            parID;
+    char            name[64];
+    char **         pages;          /* Sparse data fork, SIM_PAGE bytes each */
+    long            npages;         /* Entries in pages[] */
+    SInt64          len;            /* Logical EOF */
+    unsigned long   crDat;
+    unsigned long   mdDat;
+    OSType          fdType;         /* Files only */
+    OSType          fdCreator;
+} sim_node;
+
+typedef struct {
+    Boolean         inUse;
+    int             node;
+    SInt64          mark;
+    SInt8           perm;
+    Boolean         isFork;         /* Opened with FSOpenFork */
+} sim_fcb;
+
+static sim_node *       nodes = NULL;
+static int              node_count = 0;
+static int              node_cap = 0;
+static long             next_id = 16;
+static sim_fcb          fcbs[SIM_MAX_FCBS];
+static long             default_dir = fsRtDirID;
+static unsigned long    trap_count = 0;
+static unsigned long    lookup_count = 0;
+static OSErr            mem_error = noErr;
+static long             live_ptrs = 0;
+static long             largest_ptr = 0;
+static Boolean          hfsplus_apis = true;
+static long             sys_script = smRoman;
+static long             sys_region = verUS;
+static Boolean          catsearch = true;
+static long             catalog_gen = 1;    /* Bumped by every catalog change */
+
+/* Nodes PBCatSearch gets through per tick of ioSearchTime */
+#define SIM_CATSEARCH_PER_TICK  500
+
+/* An FSIterator resumes its folder's scan at the next node */
+#define SIM_MAX_ITERATORS   64
+
+struct OpaqueFSIterator {
+    Boolean         inUse;
+    long            dirID;
+    int             next;
+};
+
+static struct OpaqueFSIterator iterators[SIM_MAX_ITERATORS];
+
+/* Async parameter blocks waiting for the simulated drive, FIFO */
+#define SIM_MAX_ASYNC   64
+static struct {
+    ParmBlkPtr      pb;
+    Boolean         isWrite;
+}                       async_queue[SIM_MAX_ASYNC];
+static int              async_head = 0;
+static int              async_count = 0;
+
+/* ============================================================
+ * Harness API
+ * ============================================================ */
+
+static unsigned long mac_now(void)
+{
+    return (unsigned long)time(NULL) + 2082844800UL;
+}
+
+/* Release every page from index first on */
+static void free_pages(sim_node *n, long first)
+{
+    long i;
+
+    for (i = first; i < n->npages; i++) {
+        free(n->pages[i]);
+        n->pages[i] = NULL;
+    }
+    if (first == 0) {
+        free(n->pages);
+        n->pages = NULL;
+        n->npages = 0;
+    }
+}
+
+void fmsim_reset(void)
+{
+    int i;
+
+    for (i = 0; i < node_count; i++) {
+        free_pages(&nodes[i], 0);
+    }
+    node_count = 0;
+    memset(fcbs, 0, sizeof(fcbs));
+    next_id = 16;
+    default_dir = fsRtDirID;
+    trap_count = 0;
+    lookup_count = 0;
+    largest_ptr = 0;
+    hfsplus_apis = true;
+    catsearch = true;
+    catalog_gen++;
+    memset(iterators, 0, sizeof(iterators));
+    sys_script = smRoman;
+    sys_region = verUS;
+    async_head = async_count = 0;
+
+    /* The root folder is node 0 */
+    if (node_cap == 0) {
+        node_cap = 256;
+        nodes = calloc(node_cap, sizeof(sim_node));
+    }
+    memset(&nodes[0], 0, sizeof(nodes[0]));
+    nodes[0].inUse = true;
+    nodes[0].isDir = true;
+    nodes[0].id = fsRtDirID;
+    nodes[0].parID = fsRtParID;
+    strcpy(nodes[0].name, SIM_VOLNAME);
+    nodes[0].crDat = nodes[0].mdDat = mac_now();
+    node_count = 1;
+}
+
+void fmsim_set_hfsplus(int enabled)
+{
+    hfsplus_apis = enabled ? true : false;
+}
+
+void fmsim_set_catsearch(int enabled)
+{
+    catsearch = enabled ? true : false;
+}
+
+unsigned long fmsim_traps(void)
+{
+    return trap_count;
+}
+
+void fmsim_zero_traps(void)
+{
+    trap_count = 0;
+    lookup_count = 0;
+}
+
+unsigned long fmsim_lookups(void)
+{
+    return lookup_count;
+}
+
+double fmsim_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ============================================================
+ * Catalog Helpers
+ * ============================================================ */
+
+static void ensure_init(void)
+{
+    if (node_count == 0) fmsim_reset();
+}
+
+static int find_dir(long dirID)
+{
+    int i;
+
+    for (i = 0; i < node_count; i++) {
+        if (nodes[i].inUse && nodes[i].isDir && nodes[i].id == dirID) return i;
+    }
+    return -1;
+}
+
+static int find_child_uncounted(long parID, const char *name, size_t len)
+{
+    int i;
+
+    for (i = 0; i < node_count; i++) {
+        if (nodes[i].inUse && i != 0 && nodes[i].parID == parID &&
+            strlen(nodes[i].name) == len &&
+            strncasecmp(nodes[i].name, name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* One catalog B-tree search by name */
+static int find_child(long parID, const char *name, size_t len)
+{
+    lookup_count++;
+    return find_child_uncounted(parID, name, len);
+}
+
+static int new_node(long parID, const char *name, size_t len, Boolean isDir)
+{
+    int i;
+
+    if (node_count == node_cap) {
+        node_cap *= 2;
+        nodes = realloc(nodes, node_cap * sizeof(sim_node));
+    }
+    i = node_count++;
+    memset(&nodes[i], 0, sizeof(nodes[i]));
+    nodes[i].inUse = true;
+    nodes[i].isDir = isDir;
+    nodes[i].id = next_id++;
+    nodes[i].parID = parID;
+    if (len > 63) len = 63;
+    memcpy(nodes[i].name, name, len);
+    nodes[i].crDat = nodes[i].mdDat = mac_now();
+    catalog_gen++;
+    return i;
+}
+
+static long parent_of(long dirID)
+{
+    int d = find_dir(dirID);
+    return (d < 0) ? fsRtParID : nodes[d].parID;
+}
+
+/*
+ * Resolve a Mac pathname against (vRefNum, dirID) the way FSMakeFSSpec
+ * does: full paths start with the volume name, partial paths start with
+ * ':', and each extra ':' climbs one level.
+ */
+static OSErr resolve(long dirID, ConstStr255Param pname, FSSpec *spec)
+{
+    char path[256];
+    size_t len = pname ? pname[0] : 0;
+    const char *p, *end, *sep;
+    long cur;
+
+    memcpy(path, pname ? pname + 1 : (const unsigned char *)"", len);
+    path[len] = '\0';
+
+    spec->vRefNum = SIM_VREFNUM;
+    cur = dirID ? dirID : default_dir;
+    p = path;
+    end = path + len;
+
+    if (len == 0) {
+        /* Empty name: the directory itself */
+        int d = find_dir(cur);
+        if (d < 0) return dirNFErr;
+        spec->parID = nodes[d].parID;
+        spec->name[0] = (unsigned char)strlen(nodes[d].name);
+        memcpy(spec->name + 1, nodes[d].name, spec->name[0]);
+        return noErr;
+    }
+
+    sep = memchr(p, ':', len);
+    if (sep && sep != p) {
+        /* Full pathname: first component is the volume */
+        if ((size_t)(sep - p) != strlen(SIM_VOLNAME) ||
+            strncasecmp(p, SIM_VOLNAME, sep - p) != 0) {
+            return nsvErr;
+        }
+        cur = fsRtDirID;
+        p = sep + 1;
+        if (p == end) {
+            spec->parID = fsRtParID;
+            spec->name[0] = (unsigned char)strlen(SIM_VOLNAME);
+            memcpy(spec->name + 1, SIM_VOLNAME, spec->name[0]);
+            return noErr;
+        }
+    } else if (*p == ':') {
+        p++;
+    } else if (cur == fsRtParID && !sep) {
+        /* The root's FSSpec: the volume name in fsRtParID */
+        if (len != strlen(SIM_VOLNAME) || strncasecmp(p, SIM_VOLNAME, len) != 0) {
+            return fnfErr;
+        }
+        spec->parID = fsRtParID;
+        memcpy(spec->name, pname, len + 1);
+        return noErr;
+    }
+
+    for (;;) {
+        const char *comp = p;
+        int child;
+
+        /* Extra colons climb to the parent */
+        while (p < end && *p == ':') {
+            cur = parent_of(cur);
+            p++;
+            comp = p;
+        }
+
+        sep = memchr(p, ':', end - p);
+        if (!sep) sep = end;
+
+        if (sep == end) {
+            /* Leaf component */
+            if (comp == end) {
+                /* Path ended at a directory */
+                int d = find_dir(cur);
+                if (d < 0) return dirNFErr;
+                spec->parID = nodes[d].parID;
+                spec->name[0] = (unsigned char)strlen(nodes[d].name);
+                memcpy(spec->name + 1, nodes[d].name, spec->name[0]);
+                return noErr;
+            }
+            if (find_dir(cur) < 0) return dirNFErr;
+            spec->parID = cur;
+            spec->name[0] = (unsigned char)(sep - comp);
+            memcpy(spec->name + 1, comp, sep - comp);
+            return find_child(cur, comp, sep - comp) >= 0 ? noErr : fnfErr;
+        }
+
+        child = find_child(cur, comp, sep - comp);
+        if (child < 0 || !nodes[child].isDir) return dirNFErr;
+        cur = nodes[child].id;
+        p = sep + 1;
+        if (p == end) {
+            spec->parID = nodes[child].parID;
+            spec->name[0] = (unsigned char)strlen(nodes[child].name);
+            memcpy(spec->name + 1, nodes[child].name, spec->name[0]);
+            return noErr;
+        }
+    }
+}
+
+static int spec_node(const FSSpec *spec)
+{
+    if (spec->parID == fsRtParID) return 0;
+    return find_child(spec->parID, (const char *)spec->name + 1, spec->name[0]);
+}
+
+static sim_fcb *get_fcb(short refNum)
+{
+    int i = refNum - SIM_REFNUM_BASE;
+
+    if (i < 0 || i >= SIM_MAX_FCBS || !fcbs[i].inUse) return NULL;
+    return &fcbs[i];
+}
+
+/* The page holding offset pos, allocated (zeroed) if create is set */
+static char *page_at(sim_node *n, SInt64 pos, Boolean create)
+{
+    long idx = (long)(pos / SIM_PAGE);
+
+    if (idx >= n->npages) {
+        long count;
+        char **pages;
+
+        if (!create) return NULL;
+        count = n->npages ? n->npages : 16;
+        while (count <= idx) count *= 2;
+        pages = realloc(n->pages, count * sizeof(char *));
+        if (!pages) return NULL;
+        memset(pages + n->npages, 0, (count - n->npages) * sizeof(char *));
+        n->pages = pages;
+        n->npages = count;
+    }
+    if (!n->pages[idx] && create) {
+        n->pages[idx] = calloc(1, SIM_PAGE);
+    }
+
+    return n->pages[idx];
+}
+
+/* Set the logical EOF; bytes beyond it read back as zeros if it grows again */
+static void set_len(sim_node *n, SInt64 len)
+{
+    char *page;
+    long keep;
+
+    if (len < n->len) {
+        keep = (long)((len + SIM_PAGE - 1) / SIM_PAGE);
+        if (keep < n->npages) free_pages(n, keep);
+        page = (len % SIM_PAGE) ? page_at(n, len, false) : NULL;
+        if (page) memset(page + len % SIM_PAGE, 0, SIM_PAGE - len % SIM_PAGE);
+    }
+    n->len = len;
+}
+
+/* wide: an HFS Plus fork call with a 64-bit offset */
+static OSErr position(sim_fcb *fcb, short posMode, SInt64 posOff, Boolean wide, SInt64 *pos)
+{
+    sim_node *n = &nodes[fcb->node];
+
+    switch (posMode & 0x03) {
+        case fsAtMark:      *pos = fcb->mark; break;
+        case fsFromStart:   *pos = posOff; break;
+        case fsFromLEOF:    *pos = n->len + posOff; break;
+        case fsFromMark:    *pos = fcb->mark + posOff; break;
+    }
+    if (*pos < 0) return posErr;
+    if (!wide && *pos > SIM_CLASSIC_MAX) return posErr;
+    return noErr;
+}
+
+static void do_read(sim_fcb *fcb, SInt64 pos, long *count, void *buf)
+{
+    sim_node *n = &nodes[fcb->node];
+    SInt64 avail = n->len - pos;
+    long want = *count, done = 0, chunk;
+    char *page;
+
+    if (avail < 0) avail = 0;
+    if (want > avail) want = (long)avail;
+    while (done < want) {
+        chunk = SIM_PAGE - (long)((pos + done) % SIM_PAGE);
+        if (chunk > want - done) chunk = want - done;
+        page = page_at(n, pos + done, false);
+        if (page) memcpy((char *)buf + done, page + (pos + done) % SIM_PAGE, chunk);
+        else memset((char *)buf + done, 0, chunk);
+        done += chunk;
+    }
+    fcb->mark = pos + want;
+    *count = want;
+}
+
+static OSErr do_write(sim_fcb *fcb, SInt64 pos, long *count, const void *buf, Boolean wide)
+{
+    sim_node *n = &nodes[fcb->node];
+    long want = *count, done = 0, chunk;
+    char *page;
+
+    if (!(fcb->perm & fsWrPerm)) return wrPermErr;
+    if (!wide && pos + want > SIM_CLASSIC_MAX + 1) {
+        *count = 0;
+        return fsDataTooBigErr;
+    }
+    while (done < want) {
+        chunk = SIM_PAGE - (long)((pos + done) % SIM_PAGE);
+        if (chunk > want - done) chunk = want - done;
+        page = page_at(n, pos + done, true);
+        if (!page) {
+            *count = done;
+            return dskFulErr;
+        }
+        memcpy(page + (pos + done) % SIM_PAGE, (const char *)buf + done, chunk);
+        done += chunk;
+    }
+    if (pos + want > n->len) n->len = pos + want;
+    fcb->mark = pos + want;
+    n->mdDat = mac_now();
+    return noErr;
+}
+
+static OSErr set_eof(sim_fcb *fcb, SInt64 logEOF, Boolean wide)
+{
+    sim_node *n = &nodes[fcb->node];
+
+    if (!(fcb->perm & fsWrPerm)) return wrPermErr;
+    if (logEOF < 0) return posErr;
+    if (!wide && logEOF > SIM_CLASSIC_MAX) return fsDataTooBigErr;
+    set_len(n, logEOF);
+    if (fcb->mark > logEOF) fcb->mark = logEOF;
+    n->mdDat = mac_now();
+    return noErr;
+}
+
+/* Classic calls see at most 2 GB - 1 */
+static long classic_len(SInt64 len)
+{
+    return (long)(len > SIM_CLASSIC_MAX ? SIM_CLASSIC_MAX : len);
+}
+
+/* ============================================================
+ * File Manager Entry Points
+ * ============================================================ */
+
+pascal OSErr FSMakeFSSpec(short vRefNum, long dirID, ConstStr255Param fileName, FSSpec *spec)
+{
+    (void)vRefNum;
+    ensure_init();
+    trap_count++;
+    return resolve(dirID, fileName, spec);
+}
+
+pascal OSErr FSpCreate(const FSSpec *spec, OSType creator, OSType fileType, ScriptCode scriptTag)
+{
+    int n;
+
+    (void)scriptTag;
+    ensure_init();
+    trap_count++;
+    if (find_dir(spec->parID) < 0) return dirNFErr;
+    if (spec_node(spec) >= 0) return dupFNErr;
+    n = new_node(spec->parID, (const char *)spec->name + 1, spec->name[0], false);
+    nodes[n].fdType = fileType;
+    nodes[n].fdCreator = creator;
+    return noErr;
+}
+
+pascal OSErr DirCreate(short vRefNum, long parentDirID, ConstStr255Param name, long *createdDirID)
+{
+    int n;
+
+    (void)vRefNum;
+    ensure_init();
+    trap_count++;
+    if (parentDirID == 0) parentDirID = default_dir;
+    if (find_dir(parentDirID) < 0) return dirNFErr;
+    if (find_child(parentDirID, (const char *)name + 1, name[0]) >= 0) return dupFNErr;
+    n = new_node(parentDirID, (const char *)name + 1, name[0], true);
+    if (createdDirID) *createdDirID = nodes[n].id;
+    return noErr;
+}
+
+/* Give node n's data fork an FCB */
+static OSErr open_node(int n, SInt8 permission, Boolean isFork, short *refNum)
+{
+    int i;
+
+    /* One writer per fork, as on HFS */
+    if (permission & fsWrPerm) {
+        for (i = 0; i < SIM_MAX_FCBS; i++) {
+            if (fcbs[i].inUse && fcbs[i].node == n && (fcbs[i].perm & fsWrPerm)) {
+                *refNum = SIM_REFNUM_BASE + i;
+                return opWrErr;
+            }
+        }
+    }
+
+    for (i = 0; i < SIM_MAX_FCBS; i++) {
+        if (!fcbs[i].inUse) {
+            fcbs[i].inUse = true;
+            fcbs[i].node = n;
+            fcbs[i].mark = 0;
+            fcbs[i].perm = permission ? permission : fsRdWrPerm;
+            fcbs[i].isFork = isFork;
+            *refNum = SIM_REFNUM_BASE + i;
+            return noErr;
+        }
+    }
+    return tmfoErr;
+}
+
+pascal OSErr FSpOpenDF(const FSSpec *spec, SInt8 permission, short *refNum)
+{
+    int n;
+
+    ensure_init();
+    trap_count++;
+    n = spec_node(spec);
+    if (n < 0) return fnfErr;
+    if (nodes[n].isDir) return fnfErr;
+    return open_node(n, permission, false, refNum);
+}
+
+pascal OSErr FSpDelete(const FSSpec *spec)
+{
+    int n, i;
+
+    ensure_init();
+    trap_count++;
+    n = spec_node(spec);
+    if (n <= 0) return fnfErr;
+    for (i = 0; i < SIM_MAX_FCBS; i++) {
+        if (fcbs[i].inUse && fcbs[i].node == n) return fBsyErr;
+    }
+    if (nodes[n].isDir) {
+        for (i = 1; i < node_count; i++) {
+            if (nodes[i].inUse && nodes[i].parID == nodes[n].id) return fBsyErr;
+        }
+    }
+    free_pages(&nodes[n], 0);
+    nodes[n].inUse = false;
+    catalog_gen++;
+    return noErr;
+}
+
+pascal OSErr FSpRename(const FSSpec *spec, ConstStr255Param newName)
+{
+    int n;
+
+    ensure_init();
+    trap_count++;
+    n = spec_node(spec);
+    if (n <= 0) return fnfErr;
+    if (find_child(spec->parID, (const char *)newName + 1, newName[0]) >= 0) return dupFNErr;
+    memset(nodes[n].name, 0, sizeof(nodes[n].name));
+    memcpy(nodes[n].name, newName + 1, newName[0] > 63 ? 63 : newName[0]);
+    catalog_gen++;
+    return noErr;
+}
+
+pascal OSErr FSpCatMove(const FSSpec *source, const FSSpec *dest)
+{
+    int n, d;
+
+    ensure_init();
+    trap_count++;
+    n = spec_node(source);
+    if (n <= 0) return fnfErr;
+    d = dest->name[0] ? spec_node(dest) : find_dir(dest->parID);
+    if (d < 0 || !nodes[d].isDir) return dirNFErr;
+    if (find_child(nodes[d].id, nodes[n].name, strlen(nodes[n].name)) >= 0) return dupFNErr;
+    nodes[n].parID = nodes[d].id;
+    catalog_gen++;
+    return noErr;
+}
+
+pascal OSErr FSClose(short refNum)
+{
+    sim_fcb *fcb;
+
+    trap_count++;
+    fcb = get_fcb(refNum);
+    if (!fcb) return rfNumErr;
+    fcb->inUse = false;
+    return noErr;
+}
+
+pascal OSErr FSRead(short refNum, long *count, void *buffPtr)
+{
+    sim_fcb *fcb;
+    long want = *count;
+
+    trap_count++;
+    fcb = get_fcb(refNum);
+    if (!fcb) return rfNumErr;
+    do_read(fcb, fcb->mark, count, buffPtr);
+    return (*count < want) ? eofErr : noErr;
+}
+
+pascal OSErr FSWrite(short refNum, long *count, const void *buffPtr)
+{
+    sim_fcb *fcb;
+
+    trap_count++;
+    fcb = get_fcb(refNum);
+    if (!fcb) return rfNumErr;
+    return do_write(fcb, fcb->mark, count, buffPtr, false);
+}
+
+pascal OSErr GetFPos(short refNum, long *filePos)
+{
+    sim_fcb *fcb;
+
+    trap_count++;
+    fcb = get_fcb(refNum);
+    if (!fcb) return rfNumErr;
+    *filePos = classic_len(fcb->mark);
+    return noErr;
+}
+
+pascal OSErr SetFPos(short refNum, short posMode, long posOff)
+{
+    sim_fcb *fcb;
+    SInt64 pos;
+    OSErr err;
+
+    trap_count++;
+    fcb = get_fcb(refNum);
+    if (!fcb) return rfNumErr;
+    err = position(fcb, posMode, posOff, false, &pos);
+    if (err != noErr) return err;
+    if (pos > nodes[fcb->node].len) {
+        fcb->mark = nodes[fcb->node].len;
+        return eofErr;
+    }
+    fcb->mark = pos;
+    return noErr;
+}
+
+pascal OSErr GetEOF(short refNum, long *logEOF)
+{
+    sim_fcb *fcb;
+
+    trap_count++;
+    fcb = get_fcb(refNum);
+    if (!fcb) return rfNumErr;
+    *logEOF = classic_len(nodes[fcb->node].len);
+    return noErr;
+}
+
+pascal OSErr SetEOF(short refNum, long logEOF)
+{
+    sim_fcb *fcb;
+
+    trap_count++;
+    fcb = get_fcb(refNum);
+    if (!fcb) return rfNumErr;
+    return set_eof(fcb, logEOF, false);
+}
+
+static OSErr sim_read(ParmBlkPtr pb)
+{
+    sim_fcb *fcb;
+    SInt64 pos;
+    OSErr err;
+
+    fcb = get_fcb(pb->ioParam.ioRefNum);
+    if (!fcb) return pb->ioParam.ioResult = rfNumErr;
+    err = position(fcb, pb->ioParam.ioPosMode, pb->ioParam.ioPosOffset, false, &pos);
+    if (err != noErr) return pb->ioParam.ioResult = err;
+    pb->ioParam.ioActCount = pb->ioParam.ioReqCount;
+    do_read(fcb, pos, &pb->ioParam.ioActCount, pb->ioParam.ioBuffer);
+    pb->ioParam.ioPosOffset = classic_len(fcb->mark);
+    err = (pb->ioParam.ioActCount < pb->ioParam.ioReqCount) ? eofErr : noErr;
+    return pb->ioParam.ioResult = err;
+}
+
+static OSErr sim_write(ParmBlkPtr pb)
+{
+    sim_fcb *fcb;
+    SInt64 pos;
+    OSErr err;
+
+    fcb = get_fcb(pb->ioParam.ioRefNum);
+    if (!fcb) return pb->ioParam.ioResult = rfNumErr;
+    err = position(fcb, pb->ioParam.ioPosMode, pb->ioParam.ioPosOffset, false, &pos);
+    if (err != noErr) return pb->ioParam.ioResult = err;
+    pb->ioParam.ioActCount = pb->ioParam.ioReqCount;
+    err = do_write(fcb, pos, &pb->ioParam.ioActCount, pb->ioParam.ioBuffer, false);
+    pb->ioParam.ioPosOffset = classic_len(fcb->mark);
+    return pb->ioParam.ioResult = err;
+}
+
+pascal OSErr PBReadSync(ParmBlkPtr pb)
+{
+    trap_count++;
+    fmsim_run_async(-1);
+    return sim_read(pb);
+}
+
+pascal OSErr PBWriteSync(ParmBlkPtr pb)
+{
+    trap_count++;
+    fmsim_run_async(-1);
+    return sim_write(pb);
+}
+
+/* Async calls only queue the block; the "drive" runs in fmsim_run_async() */
+static OSErr queue_async(ParmBlkPtr pb, Boolean isWrite)
+{
+    trap_count++;
+    if (async_count == SIM_MAX_ASYNC) {
+        pb->ioParam.ioResult = isWrite ? sim_write(pb) : sim_read(pb);
+        if (pb->ioParam.ioCompletion) pb->ioParam.ioCompletion(pb);
+        return noErr;
+    }
+    pb->ioParam.ioResult = 1;
+    async_queue[(async_head + async_count) % SIM_MAX_ASYNC].pb = pb;
+    async_queue[(async_head + async_count) % SIM_MAX_ASYNC].isWrite = isWrite;
+    async_count++;
+    return noErr;
+}
+
+pascal OSErr PBReadAsync(ParmBlkPtr pb)
+{
+    return queue_async(pb, false);
+}
+
+pascal OSErr PBWriteAsync(ParmBlkPtr pb)
+{
+    return queue_async(pb, true);
+}
+
+int fmsim_async_pending(void)
+{
+    return async_count;
+}
+
+int fmsim_run_async(int max)
+{
+    ParmBlkPtr pb;
+    Boolean isWrite;
+    int done = 0;
+
+    while (async_count > 0 && (max < 0 || done < max)) {
+        pb = async_queue[async_head].pb;
+        isWrite = async_queue[async_head].isWrite;
+        async_head = (async_head + 1) % SIM_MAX_ASYNC;
+        async_count--;
+
+        if (isWrite) {
+            sim_write(pb);
+        } else {
+            sim_read(pb);
+        }
+
+        /* On the Mac this is interrupt time */
+        if (pb->ioParam.ioCompletion) {
+            pb->ioParam.ioCompletion(pb);
+        }
+        done++;
+    }
+
+    return done;
+}
+
+/* ============================================================
+ * HFS Plus Fork Calls
+ * ============================================================ */
+
+#define SIM_FSREF_MAGIC 0x46535246L     /* 'FSRF' */
+
+pascal OSErr Gestalt(OSType selector, long *response)
+{
+    trap_count++;
+    if (selector != gestaltFSAttr) return -5551;    /* gestaltUndefSelectorErr */
+    *response = hfsplus_apis ? (1L << gestaltHasHFSPlusAPIs) : 0;
+    return noErr;
+}
+
+/* An FSRef here is the node index behind a magic number */
+static int ref_node(const FSRef *ref)
+{
+    long magic, n;
+
+    memcpy(&magic, ref->hidden, sizeof(magic));
+    memcpy(&n, ref->hidden + sizeof(magic), sizeof(n));
+    if (magic != SIM_FSREF_MAGIC || n < 0 || n >= node_count || !nodes[n].inUse) return -1;
+    return (int)n;
+}
+
+pascal OSErr FSpMakeFSRef(const FSSpec *source, FSRef *newRef)
+{
+    long magic = SIM_FSREF_MAGIC, n;
+
+    ensure_init();
+    trap_count++;
+    if (!hfsplus_apis) return paramErr;
+    /* An empty name is the directory parID itself */
+    n = source->name[0] ? spec_node(source) : find_dir(source->parID);
+    if (n < 0) return fnfErr;
+    memset(newRef, 0, sizeof(*newRef));
+    memcpy(newRef->hidden, &magic, sizeof(magic));
+    memcpy(newRef->hidden + sizeof(magic), &n, sizeof(n));
+    return noErr;
+}
+
+pascal OSErr FSGetDataForkName(HFSUniStr255 *dataForkName)
+{
+    trap_count++;
+    if (!hfsplus_apis) return paramErr;
+    dataForkName->length = 0;
+    return noErr;
+}
+
+pascal OSErr FSOpenFork(const FSRef *ref, UniCharCount forkNameLength,
+                        const UniChar *forkName, SInt8 permissions, SInt16 *forkRefNum)
+{
+    int n;
+
+    (void)forkName;
+    trap_count++;
+    if (!hfsplus_apis) return paramErr;
+    n = ref_node(ref);
+    if (n < 0) return fnfErr;
+    if (nodes[n].isDir) return notAFileErr;
+    if (forkNameLength != 0) return errFSForkNotFound;
+    return open_node(n, permissions, true, forkRefNum);
+}
+
+pascal OSErr FSCloseFork(SInt16 forkRefNum)
+{
+    return FSClose(forkRefNum);
+}
+
+pascal OSErr FSGetForkSize(SInt16 forkRefNum, SInt64 *forkSize)
+{
+    sim_fcb *fcb;
+
+    trap_count++;
+    fcb = get_fcb(forkRefNum);
+    if (!fcb) return rfNumErr;
+    *forkSize = nodes[fcb->node].len;
+    return noErr;
+}
+
+pascal OSErr FSSetForkSize(SInt16 forkRefNum, UInt16 positionMode, SInt64 positionOffset)
+{
+    sim_fcb *fcb;
+    SInt64 pos;
+    OSErr err;
+
+    trap_count++;
+    fcb = get_fcb(forkRefNum);
+    if (!fcb) return rfNumErr;
+    err = position(fcb, positionMode, positionOffset, true, &pos);
+    if (err != noErr) return err;
+    return set_eof(fcb, pos, true);
+}
+
+pascal OSErr PBReadForkSync(FSForkIOParam *pb)
+{
+    sim_fcb *fcb;
+    SInt64 pos;
+    long count;
+    OSErr err;
+
+    trap_count++;
+    fmsim_run_async(-1);
+    fcb = get_fcb(pb->forkRefNum);
+    if (!fcb) return pb->ioResult = rfNumErr;
+    err = position(fcb, pb->positionMode, pb->positionOffset, true, &pos);
+    if (err != noErr) return pb->ioResult = err;
+    count = pb->requestCount;
+    do_read(fcb, pos, &count, pb->buffer);
+    pb->actualCount = count;
+    pb->positionOffset = fcb->mark;
+    return pb->ioResult = (pb->actualCount < pb->requestCount) ? eofErr : noErr;
+}
+
+pascal OSErr PBWriteForkSync(FSForkIOParam *pb)
+{
+    sim_fcb *fcb;
+    SInt64 pos;
+    long count;
+    OSErr err;
+
+    trap_count++;
+    fmsim_run_async(-1);
+    fcb = get_fcb(pb->forkRefNum);
+    if (!fcb) return pb->ioResult = rfNumErr;
+    err = position(fcb, pb->positionMode, pb->positionOffset, true, &pos);
+    if (err != noErr) return pb->ioResult = err;
+    count = pb->requestCount;
+    err = do_write(fcb, pos, &count, pb->buffer, true);
+    pb->actualCount = count;
+    pb->positionOffset = fcb->mark;
+    return pb->ioResult = err;
+}
+
+pascal OSErr PBFlushFileSync(ParmBlkPtr pb)
+{
+    trap_count++;
+    if (!get_fcb(pb->ioParam.ioRefNum)) return rfNumErr;
+    return noErr;
+}
+
+pascal OSErr PBFlushVolSync(ParmBlkPtr pb)
+{
+    (void)pb;
+    trap_count++;
+    return noErr;
+}
+
+pascal OSErr PBGetFCBInfoSync(FCBPBPtr pb)
+{
+    sim_fcb *fcb;
+    sim_node *n;
+
+    trap_count++;
+    fcb = get_fcb(pb->ioRefNum);
+    if (!fcb) return pb->ioResult = rfNumErr;
+    n = &nodes[fcb->node];
+    if (pb->ioNamePtr) {
+        pb->ioNamePtr[0] = (unsigned char)strlen(n->name);
+        memcpy(pb->ioNamePtr + 1, n->name, pb->ioNamePtr[0]);
+    }
+    pb->ioFCBFlNm = n->id;
+    pb->ioFCBEOF = classic_len(n->len);
+    pb->ioFCBPLen = classic_len((n->len + 511) & ~511LL);
+    pb->ioFCBCrPs = fcb->mark;
+    pb->ioFCBVRefNum = SIM_VREFNUM;
+    pb->ioFCBParID = n->parID;
+    return pb->ioResult = noErr;
+}
+
+static void fill_catinfo(CInfoPBPtr pb, int i)
+{
+    sim_node *n = &nodes[i];
+
+    if (n->isDir) {
+        int k;
+        unsigned short count = 0;
+
+        for (k = 1; k < node_count; k++) {
+            if (nodes[k].inUse && nodes[k].parID == n->id) count++;
+        }
+        pb->dirInfo.ioFlAttrib = ioDirMask;
+        pb->dirInfo.ioDrDirID = n->id;
+        pb->dirInfo.ioDrParID = n->parID;
+        pb->dirInfo.ioDrNmFls = count;
+        pb->dirInfo.ioDrCrDat = n->crDat;
+        pb->dirInfo.ioDrMdDat = n->mdDat;
+    } else {
+        pb->hFileInfo.ioFlAttrib = 0;
+        pb->hFileInfo.ioDirID = n->id;
+        pb->hFileInfo.ioFlParID = n->parID;
+        pb->hFileInfo.ioFlLgLen = classic_len(n->len);
+        pb->hFileInfo.ioFlPyLen = classic_len((n->len + 511) & ~511LL);
+        pb->hFileInfo.ioFlCrDat = n->crDat;
+        pb->hFileInfo.ioFlMdDat = n->mdDat;
+        pb->hFileInfo.ioFlFndrInfo.fdType = n->fdType;
+        pb->hFileInfo.ioFlFndrInfo.fdCreator = n->fdCreator;
+    }
+    pb->hFileInfo.ioVRefNum = SIM_VREFNUM;
+}
+
+pascal OSErr PBGetCatInfoSync(CInfoPBPtr pb)
+{
+    long dirID = pb->hFileInfo.ioDirID;
+    short index = pb->hFileInfo.ioFDirIndex;
+    int i;
+
+    ensure_init();
+    trap_count++;
+    if (dirID == 0) dirID = default_dir;
+
+    if (index > 0) {
+        /* Indexed lookup walks the folder's entries in catalog order */
+        short seen = 0;
+        for (i = 1; i < node_count; i++) {
+            if (nodes[i].inUse && nodes[i].parID == dirID && ++seen == index) {
+                if (pb->hFileInfo.ioNamePtr) {
+                    pb->hFileInfo.ioNamePtr[0] = (unsigned char)strlen(nodes[i].name);
+                    memcpy(pb->hFileInfo.ioNamePtr + 1, nodes[i].name,
+                           pb->hFileInfo.ioNamePtr[0]);
+                }
+                fill_catinfo(pb, i);
+                return pb->hFileInfo.ioResult = noErr;
+            }
+        }
+        return pb->hFileInfo.ioResult = fnfErr;
+    }
+
+    if (index < 0 || !pb->hFileInfo.ioNamePtr || pb->hFileInfo.ioNamePtr[0] == 0) {
+        i = find_dir(dirID);
+        if (i < 0) return pb->hFileInfo.ioResult = dirNFErr;
+        if (index < 0 && pb->hFileInfo.ioNamePtr) {
+            /* The directory's own name comes back */
+            pb->hFileInfo.ioNamePtr[0] = (unsigned char)strlen(nodes[i].name);
+            memcpy(pb->hFileInfo.ioNamePtr + 1, nodes[i].name, pb->hFileInfo.ioNamePtr[0]);
+        }
+    } else {
+        FSSpec spec;
+        OSErr err = resolve(dirID, pb->hFileInfo.ioNamePtr, &spec);
+        if (err != noErr) return pb->hFileInfo.ioResult = err;
+        /* resolve() already searched for the leaf */
+        i = (spec.parID == fsRtParID) ? 0 :
+            find_child_uncounted(spec.parID, (const char *)spec.name + 1, spec.name[0]);
+        if (i < 0) return pb->hFileInfo.ioResult = fnfErr;
+    }
+    fill_catinfo(pb, i);
+    return pb->hFileInfo.ioResult = noErr;
+}
+
+pascal OSErr PBHGetVolParmsSync(HParmBlkPtr pb)
+{
+    GetVolParmsInfoBuffer parms;
+
+    ensure_init();
+    trap_count++;
+    memset(&parms, 0, sizeof(parms));
+    parms.vMVersion = 1;
+    parms.vMAttrib = catsearch ? (1L << bHasCatSearch) : 0;
+    pb->ioParam.ioActCount = pb->ioParam.ioReqCount < (long)sizeof(parms) ?
+                             pb->ioParam.ioReqCount : (long)sizeof(parms);
+    memcpy(pb->ioParam.ioBuffer, &parms, pb->ioParam.ioActCount);
+    return pb->ioParam.ioResult = noErr;
+}
+
+/* Whether node n meets a PBCatSearch's criteria */
+static Boolean cs_match(const sim_node *n, long bits, CInfoPBPtr info1, CInfoPBPtr info2)
+{
+    const unsigned char *want;
+    size_t len, k;
+    Boolean named = true;
+    SInt8 attrib = n->isDir ? ioDirMask : 0;
+
+    /* Criteria only files have rule folders out */
+    if (n->isDir && (bits & (fsSBFlFndrInfo | fsSBFlLgLen))) return false;
+
+    if (bits & (fsSBPartialName | fsSBFullName)) {
+        want = info1->hFileInfo.ioNamePtr;
+        len = strlen(n->name);
+        if (bits & fsSBFullName) {
+            named = want[0] == len && strncasecmp(n->name, (const char *)want + 1, len) == 0;
+        } else {
+            named = false;
+            for (k = 0; k + want[0] <= len && !named; k++) {
+                named = strncasecmp(n->name + k, (const char *)want + 1, want[0]) == 0;
+            }
+        }
+        if (bits & fsSBNegate) named = !named;
+        if (!named) return false;
+    }
+    if ((bits & fsSBFlAttrib) &&
+        ((attrib ^ info1->hFileInfo.ioFlAttrib) & info2->hFileInfo.ioFlAttrib)) return false;
+    if ((bits & fsSBFlFndrInfo) &&
+        (((n->fdType ^ info1->hFileInfo.ioFlFndrInfo.fdType) &
+          info2->hFileInfo.ioFlFndrInfo.fdType) ||
+         ((n->fdCreator ^ info1->hFileInfo.ioFlFndrInfo.fdCreator) &
+          info2->hFileInfo.ioFlFndrInfo.fdCreator))) return false;
+    if ((bits & fsSBFlLgLen) &&
+        (classic_len(n->len) < info1->hFileInfo.ioFlLgLen ||
+         classic_len(n->len) > info2->hFileInfo.ioFlLgLen)) return false;
+    if ((bits & fsSBFlMdDat) &&
+        (n->mdDat < info1->hFileInfo.ioFlMdDat || n->mdDat > info2->hFileInfo.ioFlMdDat)) return false;
+
+    return true;
+}
+
+/*
+ * Scan the catalog in node order from ioCatPosition, which holds the
+ * catalog generation and the next node. A change since the position
+ * was handed out is catChangedErr; the end of the catalog, eofErr.
+ */
+pascal OSErr PBCatSearchSync(CSParamPtr pb)
+{
+    long budget, i;
+    sim_node *n;
+
+    ensure_init();
+    trap_count++;
+    if (!catsearch) return pb->ioResult = paramErr;
+    pb->ioActMatchCount = 0;
+
+    if (pb->ioCatPosition.initialize == 0) {
+        i = 0;
+    } else if (pb->ioCatPosition.initialize != catalog_gen) {
+        pb->ioCatPosition.initialize = 0;
+        return pb->ioResult = catChangedErr;
+    } else {
+        i = ((long)(unsigned short)pb->ioCatPosition.priv[0] << 16) |
+            (unsigned short)pb->ioCatPosition.priv[1];
+    }
+
+    budget = pb->ioSearchTime > 0 ? pb->ioSearchTime * SIM_CATSEARCH_PER_TICK : -1;
+    for (; i < node_count && budget != 0; i++, budget--) {
+        n = &nodes[i];
+        if (!n->inUse || !cs_match(n, pb->ioSearchBits, pb->ioSearchInfo1, pb->ioSearchInfo2)) {
+            continue;
+        }
+        pb->ioMatchPtr[pb->ioActMatchCount].vRefNum = SIM_VREFNUM;
+        pb->ioMatchPtr[pb->ioActMatchCount].parID = n->parID;
+        pb->ioMatchPtr[pb->ioActMatchCount].name[0] = (unsigned char)strlen(n->name);
+        memcpy(pb->ioMatchPtr[pb->ioActMatchCount].name + 1, n->name, strlen(n->name));
+        if (++pb->ioActMatchCount == pb->ioReqMatchCount) {
+            i++;
+            break;
+        }
+    }
+
+    pb->ioCatPosition.initialize = catalog_gen;
+    pb->ioCatPosition.priv[0] = (short)(i >> 16);
+    pb->ioCatPosition.priv[1] = (short)(i & 0xFFFF);
+    return pb->ioResult = (i < node_count) ? noErr : eofErr;
+}
+
+pascal OSErr HGetVol(StringPtr volName, short *vRefNum, long *dirID)
+{
+    ensure_init();
+    trap_count++;
+    if (volName) {
+        volName[0] = (unsigned char)strlen(SIM_VOLNAME);
+        memcpy(volName + 1, SIM_VOLNAME, volName[0]);
+    }
+    *vRefNum = SIM_VREFNUM;
+    *dirID = default_dir;
+    return noErr;
+}
+
+pascal OSErr HSetVol(ConstStr255Param volName, short vRefNum, long dirID)
+{
+    (void)volName; (void)vRefNum;
+    ensure_init();
+    trap_count++;
+    if (find_dir(dirID) < 0) return dirNFErr;
+    default_dir = dirID;
+    return noErr;
+}
+
+/* ============================================================
+ * HFS Plus Catalog Iteration
+ * ============================================================ */
+
+pascal OSErr FSOpenIterator(const FSRef *container, FSIteratorFlags iteratorFlags,
+                            FSIterator *iterator)
+{
+    int n, i;
+
+    ensure_init();
+    trap_count++;
+    if (!hfsplus_apis || iteratorFlags != kFSIterateFlat) return paramErr;
+    n = ref_node(container);
+    if (n < 0) return fnfErr;
+    if (!nodes[n].isDir) return dirNFErr;
+
+    for (i = 0; i < SIM_MAX_ITERATORS; i++) {
+        if (!iterators[i].inUse) {
+            iterators[i].inUse = true;
+            iterators[i].dirID = nodes[n].id;
+            iterators[i].next = 1;
+            *iterator = &iterators[i];
+            return noErr;
+        }
+    }
+    return tmfoErr;
+}
+
+pascal OSErr FSCloseIterator(FSIterator iterator)
+{
+    trap_count++;
+    if (!iterator || !iterator->inUse) return paramErr;
+    iterator->inUse = false;
+    return noErr;
+}
+
+/* One call: up to maximumObjects children, in the indexed calls' order */
+pascal OSErr FSGetCatalogInfoBulk(FSIterator iterator, ItemCount maximumObjects,
+                                  ItemCount *actualObjects, Boolean *containerChanged,
+                                  FSCatalogInfoBitmap whichInfo, FSCatalogInfo *catalogInfos,
+                                  FSRef *refs, FSSpec *specs, HFSUniStr255 *names)
+{
+    ItemCount count = 0;
+    sim_node *n;
+    long magic = SIM_FSREF_MAGIC, idx;
+    size_t k;
+    int i;
+
+    (void)whichInfo;
+    ensure_init();
+    trap_count++;
+    if (!iterator || !iterator->inUse) return paramErr;
+    if (containerChanged) *containerChanged = false;
+
+    for (i = iterator->next; i < node_count && count < maximumObjects; i++) {
+        n = &nodes[i];
+        if (!n->inUse || n->parID != iterator->dirID) continue;
+
+        if (catalogInfos) {
+            FSCatalogInfo *info = &catalogInfos[count];
+
+            memset(info, 0, sizeof(*info));
+            info->nodeFlags = n->isDir ? kFSNodeIsDirectoryMask : 0;
+            info->volume = SIM_VREFNUM;
+            info->parentDirID = n->parID;
+            info->nodeID = n->id;
+            info->createDate.lowSeconds = n->crDat;
+            info->contentModDate.lowSeconds = n->mdDat;
+            if (n->isDir) {
+                for (k = 1; k < (size_t)node_count; k++) {
+                    if (nodes[k].inUse && nodes[k].parID == n->id) info->valence++;
+                }
+            } else {
+                info->dataLogicalSize = n->len;
+                info->dataPhysicalSize = (n->len + 511) & ~511LL;
+                FInfo fndr;
+
+                memset(&fndr, 0, sizeof(fndr));
+                fndr.fdType = n->fdType;
+                fndr.fdCreator = n->fdCreator;
+                memcpy(info->finderInfo, &fndr, sizeof(fndr));
+            }
+        }
+        if (refs) {
+            idx = i;
+            memset(&refs[count], 0, sizeof(FSRef));
+            memcpy(refs[count].hidden, &magic, sizeof(magic));
+            memcpy(refs[count].hidden + sizeof(magic), &idx, sizeof(idx));
+        }
+        if (specs) {
+            specs[count].vRefNum = SIM_VREFNUM;
+            specs[count].parID = n->parID;
+            specs[count].name[0] = (unsigned char)strlen(n->name);
+            memcpy(specs[count].name + 1, n->name, specs[count].name[0]);
+        }
+        if (names) {
+            names[count].length = (UInt16)strlen(n->name);
+            for (k = 0; k < names[count].length; k++) {
+                names[count].unicode[k] = (unsigned char)n->name[k];
+            }
+        }
+        count++;
+    }
+    iterator->next = i;
+
+    *actualObjects = count;
+    return count ? noErr : errFSNoMoreItems;
+}
+
+/* ============================================================
+ * Memory Manager / OS Utilities
+ * ============================================================ */
+
+Ptr NewPtr(Size byteCount)
+{
+    Ptr p = malloc(byteCount > 0 ? byteCount : 1);
+    mem_error = p ? noErr : memFullErr;
+    if (p) live_ptrs++;
+    if (byteCount > largest_ptr) largest_ptr = byteCount;
+    return p;
+}
+
+Ptr NewPtrClear(Size byteCount)
+{
+    Ptr p = calloc(1, byteCount > 0 ? byteCount : 1);
+    mem_error = p ? noErr : memFullErr;
+    if (p) live_ptrs++;
+    if (byteCount > largest_ptr) largest_ptr = byteCount;
+    return p;
+}
+
+void DisposePtr(Ptr p)
+{
+    if (p) live_ptrs--;
+    free(p);
+}
+
+long fmsim_ptrs(void)
+{
+    return live_ptrs;
+}
+
+long fmsim_largest_ptr(void)
+{
+    return largest_ptr;
+}
+
+OSErr MemError(void)
+{
+    return mem_error;
+}
+
+void BlockMoveData(const void *srcPtr, void *destPtr, Size byteCount)
+{
+    memmove(destPtr, srcPtr, byteCount);
+}
+
+unsigned long TickCount(void)
+{
+    return (unsigned long)(fmsim_now() * 60.0);
+}
+
+void SystemTask(void)
+{
+}
+
+long GetScriptManagerVariable(short selector)
+{
+    if (selector == smSysScript) return sys_script;
+    if (selector == smRegionCode) return sys_region;
+    return 0;
+}
+
+/* The simulated Mac keeps UTC */
+void ReadLocation(MachineLocation *loc)
+{
+    memset(loc, 0, sizeof(*loc));
+}
+
+void fmsim_set_script(long script, long region)
+{
+    sys_script = script;
+    sys_region = region;
+}
@@ -0,0 +1,67 @@
+/*
+ * fm_sim.h - Simulated File Manager for host-side benchmarks
+ *
+ * The simulator keeps a single in-memory HFS-like volume and counts
+ * every File Manager entry point as one "trap", which is the unit the
+ * benchmarks report. It deliberately includes no POSIX9 headers so
+ * benchmark drivers can use it alongside posix9.h.
+ */
+#ifndef FM_SIM_H
+#define FM_SIM_H
+
+/* Reset the volume to an empty root directory and zero all counters */
+void            fmsim_reset(void);
+
+/* Number of File Manager calls made since the last reset/zero */
+unsigned long   fmsim_traps(void);
+void            fmsim_zero_traps(void);
+
+/*
+ * Catalog B-tree searches by name since the last reset/zero: one per
+ * path component FSMakeFSSpec or PBGetCatInfoSync walks, so a deep
+ * path costs more than a name looked up in a known directory.
+ */
+unsigned long   fmsim_lookups(void);
+
+/* Memory Manager pointers allocated and not yet disposed of */
+long            fmsim_ptrs(void);
+
+/* Largest Memory Manager pointer asked for since the last reset */
+long            fmsim_largest_ptr(void);
+
+/*
+ * Asynchronous calls (PBReadAsync/PBWriteAsync) are queued until the
+ * simulated drive runs. fmsim_run_async() completes up to max queued
+ * requests in order (max < 0: all of them), calling each ioCompletion
+ * routine as the interrupt handler would, and returns how many ran.
+ * Synchronous calls drain the queue first, as the real File Manager
+ * queue does.
+ */
+int             fmsim_async_pending(void);
+int             fmsim_run_async(int max);
+
+/*
+ * Whether Gestalt reports the HFS Plus APIs (FSOpenFork and friends).
+ * On by default; off simulates Mac OS 8.x, where only the classic
+ * 32-bit calls exist. fmsim_reset() turns it back on.
+ */
+void            fmsim_set_hfsplus(int enabled);
+
+/*
+ * Whether PBHGetVolParms reports bHasCatSearch for the volume. On by
+ * default; fmsim_reset() turns it back on. PBCatSearch gets through
+ * 500 catalog nodes per tick of ioSearchTime, and any catalog change
+ * makes a saved ioCatPosition fail with catChangedErr.
+ */
+void            fmsim_set_catsearch(int enabled);
+
+/*
+ * The system script and region GetScriptManagerVariable() reports for
+ * smSysScript and smRegionCode. fmsim_reset() sets Roman, US.
+ */
+void            fmsim_set_script(long script, long region);
+
+/* Wall-clock seconds, for bytes/sec figures */
+double          fmsim_now(void);
+
+#endif /* FM_SIM_H */
@@ -0,0 +1,795 @@
+/*
+ * ot_sim.c - Open Transport stand-in for host-side benchmarks
+ *
+ * See ot_sim.h. TCP endpoints open and connect to a network that
+ * records every byte sent and delivers what otsim_receive() is given;
+ * connections come from otsim_incoming(); UDP is not simulated and
+ * fails with kOTNotSupportedErr. Notifiers are called
+ * from otsim_run(), which is where deferred tasks would run on a Mac:
+ * between the main thread's own calls, while it parks or yields.
+ */
+
+#include "Multiverse.h"
+#include "MacCompat.h"
+#include "OpenTransport.h"
+#include "OpenTransportProviders.h"
+#include "Threads.h"
+#include "ot_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_MAX_ENDPOINTS   128
+#define SIM_MAX_SENDS       64      /* Queued OTSnd calls per endpoint */
+#define SIM_MAX_PIECES      8       /* OTData pieces per call */
+#define SIM_INBOX           65536   /* Received bytes waiting for OTRcv */
+
+/* One accepted OTSnd call waiting for the network */
+typedef struct {
+    void *          cookie;         /* Buffer passed to OTSnd */
+    Boolean         acked;          /* Report T_MEMORYRELEASED when delivered */
+    char *          copy;           /* Our copy when not acked */
+    int             npieces;
+    const char *    piece[SIM_MAX_PIECES];
+    long            len[SIM_MAX_PIECES];
+} sim_send;
+
+typedef struct sim_endpoint {
+    Boolean         inUse;
+    Boolean         connected;
+    Boolean         connecting;     /* Owes a T_CONNECT */
+    int             answerIn;       /* Rounds until it comes */
+    Boolean         listening;      /* Bound with a queue length */
+    int             calls;          /* Connections waiting for OTListen */
+    struct sim_endpoint *acceptor;  /* Owes a T_ACCEPTCOMPLETE for it */
+    int             acceptIn;       /* Rounds until the handshake is done */
+    OTEventCode     completion;     /* Owes T_BINDCOMPLETE or T_UNBINDCOMPLETE */
+    Boolean         peerReleased;   /* T_ORDREL sent */
+    Boolean         releaseAcked;   /* OTRcvOrderlyDisconnect called */
+    Boolean         peerAborted;    /* T_DISCONNECT sent */
+    Boolean         abortAcked;     /* OTRcvDisconnect called */
+    Boolean         nonblocking;
+    Boolean         async;
+    Boolean         ackSends;
+    Boolean         flowBlocked;    /* Owes a T_GODATA */
+    OTNotifyUPP     notifier;
+    void *          context;
+    long            queued;         /* Bytes accepted, not yet delivered */
+    sim_send        sends[SIM_MAX_SENDS];
+    int             nsends;
+    OTBuffer *      inbox;          /* One buffer per otsim_receive() */
+    OTBuffer *      inboxLast;
+    long            inboxLen;
+} sim_endpoint;
+
+static sim_endpoint     endpoints[SIM_MAX_ENDPOINTS];
+static long             window = 32768;
+static int              latency = 0;
+static Boolean          refuse = false;
+static char *           delivered = NULL;
+static long             delivered_len = 0;
+static long             delivered_cap = 0;
+static unsigned long    snd_calls = 0;
+static unsigned long    copied = 0;
+static unsigned long    rcv_copied = 0;
+static long             lent = 0;       /* Buffers out with no-copy OTRcv */
+static unsigned long    flow_errors = 0;
+static unsigned long    looks = 0;
+static int              config_token;
+
+/* ============================================================
+ * Simulator Control
+ * ============================================================ */
+
+static void drop_sends(sim_endpoint *ep)
+{
+    int i;
+
+    for (i = 0; i < ep->nsends; i++) {
+        free(ep->sends[i].copy);
+    }
+    ep->nsends = 0;
+    ep->queued = 0;
+}
+
+static void drop_inbox(sim_endpoint *ep)
+{
+    OTBuffer *b, *next;
+
+    for (b = ep->inbox; b; b = next) {
+        next = b->fNext;
+        free(b);
+    }
+    ep->inbox = ep->inboxLast = NULL;
+    ep->inboxLen = 0;
+}
+
+void otsim_reset(void)
+{
+    int i;
+
+    for (i = 0; i < SIM_MAX_ENDPOINTS; i++) {
+        drop_sends(&endpoints[i]);
+        drop_inbox(&endpoints[i]);
+        memset(&endpoints[i], 0, sizeof(endpoints[i]));
+    }
+    free(delivered);
+    delivered = NULL;
+    delivered_len = delivered_cap = 0;
+    window = 32768;
+    latency = 0;
+    refuse = false;
+    snd_calls = copied = rcv_copied = flow_errors = looks = 0;
+    lent = 0;
+}
+
+void otsim_set_window(long bytes)
+{
+    window = bytes;
+}
+
+void otsim_set_latency(int rounds)
+{
+    latency = rounds;
+}
+
+void otsim_set_refuse(int on)
+{
+    refuse = on != 0;
+}
+
+long otsim_delivered(const char **data)
+{
+    *data = delivered;
+    return delivered_len;
+}
+
+unsigned long otsim_sends(void)         { return snd_calls; }
+unsigned long otsim_copied(void)        { return copied; }
+unsigned long otsim_rcv_copied(void)    { return rcv_copied; }
+long otsim_buffers_lent(void)           { return lent; }
+unsigned long otsim_flow_errors(void)   { return flow_errors; }
+unsigned long otsim_looks(void)         { return looks; }
+
+static void record(const char *data, long len)
+{
+    if (delivered_len + len > delivered_cap) {
+        delivered_cap = (delivered_len + len) * 2;
+        delivered = realloc(delivered, delivered_cap);
+    }
+    memcpy(delivered + delivered_len, data, len);
+    delivered_len += len;
+}
+
+static void notify(sim_endpoint *ep, OTEventCode event, OTResult result, void *cookie)
+{
+    if (ep->notifier) ep->notifier(ep->context, event, result, cookie);
+}
+
+int otsim_receive(int endpoint, const char *data, long len)
+{
+    sim_endpoint *ep;
+    OTBuffer *b;
+
+    if (endpoint < 0 || endpoint >= SIM_MAX_ENDPOINTS) return -1;
+    ep = &endpoints[endpoint];
+    if (!ep->inUse || !ep->connected || ep->peerReleased ||
+        ep->inboxLen + len > SIM_INBOX) return -1;
+
+    /* The driver's buffer, header and data in one block */
+    b = (OTBuffer *)malloc(sizeof(OTBuffer) + len);
+    memset(b, 0, sizeof(*b));
+    b->fData = (UInt8 *)(b + 1);
+    b->fLen = len;
+    memcpy(b->fData, data, len);
+    if (ep->inboxLast) ep->inboxLast->fNext = b;
+    else ep->inbox = b;
+    ep->inboxLast = b;
+
+    /* Like OT, T_DATA only when the endpoint goes from empty to having
+     * data; the next comes after a read has drained it */
+    if (ep->inboxLen == 0) {
+        ep->inboxLen = len;
+        notify(ep, T_DATA, kOTNoError, NULL);
+    } else {
+        ep->inboxLen += len;
+    }
+    return 0;
+}
+
+int otsim_disconnect(int endpoint)
+{
+    sim_endpoint *ep;
+
+    if (endpoint < 0 || endpoint >= SIM_MAX_ENDPOINTS) return -1;
+    ep = &endpoints[endpoint];
+    if (!ep->inUse || !ep->connected) return -1;
+
+    ep->connected = false;
+    ep->peerAborted = true;
+    notify(ep, T_DISCONNECT, kOTNoError, NULL);
+    return 0;
+}
+
+int otsim_release(int endpoint)
+{
+    sim_endpoint *ep;
+
+    if (endpoint < 0 || endpoint >= SIM_MAX_ENDPOINTS) return -1;
+    ep = &endpoints[endpoint];
+    if (!ep->inUse || !ep->connected || ep->peerReleased) return -1;
+
+    ep->peerReleased = true;
+    notify(ep, T_ORDREL, kOTNoError, NULL);
+    return 0;
+}
+
+int otsim_incoming(int endpoint)
+{
+    sim_endpoint *ep;
+
+    if (endpoint < 0 || endpoint >= SIM_MAX_ENDPOINTS) return -1;
+    ep = &endpoints[endpoint];
+    if (!ep->inUse || !ep->listening) return -1;
+
+    ep->calls++;
+    notify(ep, T_LISTEN, kOTNoError, NULL);
+    return 0;
+}
+
+int otsim_run(void)
+{
+    sim_endpoint *ep, *res;
+    OTEventCode event;
+    sim_send *snd;
+    int i, j, k, busy = 0;
+
+    for (i = 0; i < SIM_MAX_ENDPOINTS; i++) {
+        ep = &endpoints[i];
+        if (!ep->inUse) continue;
+
+        /* The peer answers, or refuses with a T_DISCONNECT */
+        if (ep->connecting && ep->answerIn-- == 0) {
+            ep->connecting = false;
+            ep->connected = !refuse;
+            ep->peerAborted = refuse;
+            notify(ep, refuse ? T_DISCONNECT : T_CONNECT, kOTNoError, NULL);
+            busy = 1;
+        }
+        if (ep->connecting) busy = 1;
+
+        if (ep->completion) {
+            event = ep->completion;
+            ep->completion = 0;
+            notify(ep, event, kOTNoError, NULL);
+            busy = 1;
+        }
+
+        /* An asynchronous OTAccept's handshake is done */
+        if (ep->acceptor && ep->acceptIn-- == 0) {
+            res = ep->acceptor;
+            ep->acceptor = NULL;
+            res->connected = true;
+            notify(res, T_PASSCON, kOTNoError, NULL);
+            notify(ep, T_ACCEPTCOMPLETE, kOTNoError, NULL);
+            busy = 1;
+        }
+        if (ep->acceptor) busy = 1;
+
+        /* Deliver in order; acked buffers are read only now */
+        for (j = 0; j < ep->nsends; j++) {
+            snd = &ep->sends[j];
+            if (snd->copy) {
+                record(snd->copy, snd->len[0]);
+                free(snd->copy);
+            } else {
+                for (k = 0; k < snd->npieces; k++) {
+                    record(snd->piece[k], snd->len[k]);
+                }
+            }
+            busy = 1;
+        }
+        ep->queued = 0;
+
+        for (j = 0; j < ep->nsends; j++) {
+            if (ep->sends[j].acked) {
+                notify(ep, T_MEMORYRELEASED, kOTNoError, ep->sends[j].cookie);
+            }
+        }
+        ep->nsends = 0;
+
+        if (ep->flowBlocked) {
+            ep->flowBlocked = false;
+            notify(ep, T_GODATA, kOTNoError, NULL);
+            busy = 1;
+        }
+    }
+
+    return busy;
+}
+
+/* ============================================================
+ * Open Transport
+ * ============================================================ */
+
+OSStatus InitOpenTransportPriv(OTOpenFlags flags)
+{
+    (void)flags;
+    return kOTNoError;
+}
+
+void CloseOpenTransportPriv(OTClientContextPtr context)
+{
+    (void)context;
+}
+
+OTConfigurationRef OTCreateConfiguration(const char *path)
+{
+    /* Only TCP is simulated */
+    if (strcmp(path, kTCPName) != 0) return kOTInvalidConfigurationRef;
+    return (OTConfigurationRef)&config_token;
+}
+
+InetSvcRef OTOpenInternetServices(OTConfigurationRef config, OTOpenFlags flags, OSStatus *err)
+{
+    (void)config; (void)flags;
+    if (err) *err = kOTNotSupportedErr;
+    return NULL;
+}
+
+EndpointRef OTOpenEndpointPriv(OTConfigurationRef config, OTOpenFlags flags,
+                               TEndpointInfo *info, OSStatus *err)
+{
+    int i;
+
+    (void)flags;
+
+    if (config == kOTInvalidConfigurationRef) {
+        if (err) *err = kOTBadNameErr;
+        return kOTInvalidEndpointRef;
+    }
+
+    for (i = 0; i < SIM_MAX_ENDPOINTS; i++) {
+        if (!endpoints[i].inUse) {
+            memset(&endpoints[i], 0, sizeof(endpoints[i]));
+            endpoints[i].inUse = true;
+            if (info) memset(info, 0, sizeof(*info));
+            if (err) *err = kOTNoError;
+            return (EndpointRef)&endpoints[i];
+        }
+    }
+
+    if (err) *err = kOTOutOfMemoryErr;
+    return kOTInvalidEndpointRef;
+}
+
+OSStatus OTCloseProviderPriv(ProviderRef ref)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+
+    /* Whatever was still queued is lost, as on a real abortive close */
+    drop_sends(ep);
+    drop_inbox(ep);
+    ep->inUse = false;
+    return kOTNoError;
+}
+
+OSStatus OTBind(EndpointRef ref, TBind *reqAddr, TBind *retAddr)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+
+    ep->listening = reqAddr && reqAddr->qlen > 0;
+    if (reqAddr && retAddr && retAddr->addr.buf && reqAddr->addr.buf) {
+        memcpy(retAddr->addr.buf, reqAddr->addr.buf, reqAddr->addr.len);
+        retAddr->addr.len = reqAddr->addr.len;
+    }
+    if (ep->async) ep->completion = T_BINDCOMPLETE;
+    return kOTNoError;
+}
+
+OSStatus OTUnbind(EndpointRef ref)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+
+    ep->listening = false;
+    ep->calls = 0;
+    if (ep->async) ep->completion = T_UNBINDCOMPLETE;
+    return kOTNoError;
+}
+
+OSStatus OTConnect(EndpointRef ref, TCall *sndCall, TCall *rcvCall)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+
+    (void)sndCall; (void)rcvCall;
+
+    /* A non-blocking or asynchronous endpoint hears with T_CONNECT
+     * once the peer answers */
+    if (ep->nonblocking || ep->async) {
+        ep->connecting = true;
+        ep->answerIn = latency;
+        return kOTNoDataErr;
+    }
+    ep->connected = true;
+    return kOTNoError;
+}
+
+OSStatus OTRcvConnect(EndpointRef ref, TCall *call)
+{
+    (void)call;
+    return ((sim_endpoint *)ref)->connected ? kOTNoError : kOTNoDataErr;
+}
+
+OSStatus OTListen(EndpointRef ref, TCall *call)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+    InetAddress peer;
+
+    if (!ep->listening) return kOTOutStateErr;
+
+    /* A blocking endpoint spins inside OT, yielding, until a peer calls */
+    while (!ep->nonblocking && ep->calls == 0) {
+        YieldToAnyThread();
+    }
+    if (ep->calls == 0) return kOTNoDataErr;
+
+    OTInitInetAddress(&peer, 49152, 0x0A000002);
+    if (call && call->addr.buf && call->addr.maxlen >= sizeof(peer)) {
+        memcpy(call->addr.buf, &peer, sizeof(peer));
+        call->addr.len = sizeof(peer);
+    }
+    return kOTNoError;
+}
+
+OSStatus OTAccept(EndpointRef ref, EndpointRef resRef, TCall *call)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+    int n;
+
+    (void)call;
+    if (ep->calls == 0) return kOTNoDataErr;
+    ep->calls--;
+
+    /* An asynchronous endpoint hears with T_ACCEPTCOMPLETE once the
+     * handshake is done */
+    if (ep->async) {
+        ep->acceptor = (sim_endpoint *)resRef;
+        ep->acceptIn = latency;
+        return kOTNoError;
+    }
+
+    /* A synchronous one holds the caller inside OT until then: the
+     * network runs, but no other thread */
+    for (n = latency; n > 0; n--) {
+        otsim_run();
+    }
+    ((sim_endpoint *)resRef)->connected = true;
+    return kOTNoError;
+}
+
+OTResult OTSnd(EndpointRef ref, void *buf, OTByteCount nbytes, OTFlags flags)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+    sim_send *snd;
+    OTData *piece;
+    long total, room, take;
+
+    (void)flags;
+    snd_calls++;
+
+    if (!ep->connected) return kOTOutStateErr;
+
+    /* A blocking endpoint spins inside OT, yielding, until the window opens */
+    while (!ep->nonblocking && (ep->queued >= window || ep->nsends == SIM_MAX_SENDS)) {
+        YieldToAnyThread();
+    }
+
+    room = window - ep->queued;
+    if (room <= 0 || ep->nsends == SIM_MAX_SENDS) {
+        ep->flowBlocked = true;
+        flow_errors++;
+        return kOTFlowErr;
+    }
+
+    snd = &ep->sends[ep->nsends];
+    memset(snd, 0, sizeof(*snd));
+    snd->cookie = buf;
+    snd->acked = ep->ackSends;
+
+    /* Take as much of the data as fits in the window */
+    total = 0;
+    if (nbytes == kNetbufDataIsOTData) {
+        for (piece = (OTData *)buf; piece && total < room &&
+             snd->npieces < SIM_MAX_PIECES; piece = (OTData *)piece->fNext) {
+            take = piece->fLen;
+            if (take > room - total) take = room - total;
+            snd->piece[snd->npieces] = (const char *)piece->fData;
+            snd->len[snd->npieces] = take;
+            snd->npieces++;
+            total += take;
+        }
+    } else {
+        take = nbytes;
+        if (take > room) take = room;
+        snd->piece[0] = (const char *)buf;
+        snd->len[0] = take;
+        snd->npieces = 1;
+        total = take;
+    }
+
+    /* Without OTAckSends OT copies the data before returning */
+    if (!snd->acked) {
+        long k, at = 0;
+
+        snd->copy = malloc(total > 0 ? total : 1);
+        for (k = 0; k < snd->npieces; k++) {
+            memcpy(snd->copy + at, snd->piece[k], snd->len[k]);
+            at += snd->len[k];
+        }
+        snd->len[0] = total;
+        copied += total;
+    }
+
+    ep->nsends++;
+    ep->queued += total;
+    return total;
+}
+
+OTResult OTRcv(EndpointRef ref, void *buf, OTByteCount nbytes, OTFlags *flags)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+    OTBuffer *b;
+    long total = ep->inboxLen, take, done = 0;
+
+    if (flags) *flags = 0;
+
+    /* A disconnect waits to be acknowledged before anything else */
+    if (ep->peerAborted && !ep->abortAcked) return kOTLookErr;
+
+    /* Past the last data, a release waits to be acknowledged */
+    if (total == 0) return ep->peerReleased && !ep->releaseAcked ? kOTLookErr : kOTNoDataErr;
+
+    /* No-copy: the caller takes the whole chain */
+    if (nbytes == kOTNetbufDataIsOTBufferStar) {
+        *(OTBuffer **)buf = ep->inbox;
+        for (b = ep->inbox; b; b = b->fNext) {
+            lent++;
+        }
+        ep->inbox = ep->inboxLast = NULL;
+        ep->inboxLen = 0;
+        return total;
+    }
+
+    while (ep->inbox && done < (long)nbytes) {
+        b = ep->inbox;
+        take = b->fLen;
+        if (take > (long)nbytes - done) take = nbytes - done;
+        memcpy((char *)buf + done, b->fData, take);
+        b->fData += take;
+        b->fLen -= take;
+        done += take;
+        if (b->fLen == 0) {
+            ep->inbox = b->fNext;
+            if (!ep->inbox) ep->inboxLast = NULL;
+            free(b);
+        }
+    }
+    ep->inboxLen -= done;
+    rcv_copied += done;
+    return done;
+}
+
+OSStatus OTCountDataBytes(EndpointRef ref, OTByteCount *countPtr)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+
+    *countPtr = ep->inboxLen;
+    return ep->inboxLen ? kOTNoError : kOTNoDataErr;
+}
+
+Boolean OTReadBuffer(OTBufferInfo *buffer, void *dest, OTByteCount *len)
+{
+    OTByteCount want = *len, take;
+    OTBuffer *b = buffer->fBuffer;
+
+    *len = 0;
+    while (b && *len < want) {
+        take = b->fLen - buffer->fOffset;
+        if (take > want - *len) take = want - *len;
+        memcpy((char *)dest + *len, b->fData + buffer->fOffset, take);
+        *len += take;
+        buffer->fOffset += take;
+        if (buffer->fOffset == b->fLen) {
+            b = b->fNext;
+            buffer->fBuffer = b;
+            buffer->fOffset = 0;
+        }
+    }
+    return *len == want;
+}
+
+void OTReleaseBuffer(OTBuffer *buffer)
+{
+    OTBuffer *next;
+
+    for (; buffer; buffer = next) {
+        next = buffer->fNext;
+        free(buffer);
+        lent--;
+    }
+}
+
+OSStatus OTSndUData(EndpointRef ref, TUnitData *udata)
+{
+    (void)ref; (void)udata;
+    return kOTNotSupportedErr;
+}
+
+OSStatus OTRcvUData(EndpointRef ref, TUnitData *udata, OTFlags *flags)
+{
+    (void)ref; (void)udata; (void)flags;
+    return kOTNotSupportedErr;
+}
+
+OSStatus OTSndDisconnect(EndpointRef ref, TCall *call)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+
+    (void)call;
+    ep->connected = false;
+    return kOTNoError;
+}
+
+OSStatus OTRcvDisconnect(EndpointRef ref, TDiscon *discon)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+
+    (void)discon;
+    if (!ep->peerAborted || ep->abortAcked) return kOTNoDisconnectErr;
+    ep->abortAcked = true;
+    return kOTNoError;
+}
+
+OSStatus OTSndOrderlyDisconnect(EndpointRef ref)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+
+    ep->connected = false;
+    return kOTNoError;
+}
+
+OSStatus OTRcvOrderlyDisconnect(EndpointRef ref)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+
+    if (!ep->peerReleased) return kOTNoReleaseErr;
+    ep->releaseAcked = true;
+    return kOTNoError;
+}
+
+OSStatus OTSetNonBlocking(EndpointRef ref)
+{
+    ((sim_endpoint *)ref)->nonblocking = true;
+    return kOTNoError;
+}
+
+OSStatus OTSetBlocking(EndpointRef ref)
+{
+    ((sim_endpoint *)ref)->nonblocking = false;
+    return kOTNoError;
+}
+
+OSStatus OTSetSynchronous(EndpointRef ref)
+{
+    ((sim_endpoint *)ref)->async = false;
+    return kOTNoError;
+}
+
+OSStatus OTSetAsynchronous(EndpointRef ref)
+{
+    ((sim_endpoint *)ref)->async = true;
+    return kOTNoError;
+}
+
+OSStatus OTAckSends(EndpointRef ref)
+{
+    ((sim_endpoint *)ref)->ackSends = true;
+    return kOTNoError;
+}
+
+OSStatus OTDontAckSends(EndpointRef ref)
+{
+    ((sim_endpoint *)ref)->ackSends = false;
+    return kOTNoError;
+}
+
+void *OTAllocMem(OTByteCount size)
+{
+    return malloc(size);
+}
+
+void OTFreeMem(void *mem)
+{
+    free(mem);
+}
+
+OTResult OTLook(EndpointRef ref)
+{
+    (void)ref;
+    looks++;
+    return 0;
+}
+
+/* One host thread plays every context, so nothing here need be atomic */
+void OTLIFOEnqueue(OTLIFO *list, OTLink *link)
+{
+    link->fNext = list->fHead;
+    list->fHead = link;
+}
+
+OTLink *OTLIFOStealList(OTLIFO *list)
+{
+    OTLink *head = list->fHead;
+
+    list->fHead = NULL;
+    return head;
+}
+
+
+OSStatus OTInstallNotifier(ProviderRef ref, OTNotifyUPP proc, void *context)
+{
+    sim_endpoint *ep = (sim_endpoint *)ref;
+
+    ep->notifier = proc;
+    ep->context = context;
+    return kOTNoError;
+}
+
+/* Notifiers never interrupt the library here: nothing to hold off */
+Boolean OTEnterNotifier(ProviderRef ref)
+{
+    (void)ref;
+    return true;
+}
+
+void OTLeaveNotifier(ProviderRef ref)
+{
+    (void)ref;
+}
+
+OSStatus OTInetStringToAddress(void *services, char *name, InetHostInfo *hinfo)
+{
+    (void)services; (void)name; (void)hinfo;
+    return kOTNotSupportedErr;
+}
+
+OSStatus OTInetStringToHost(const char *str, InetHost *host)
+{
+    unsigned int a, b, c, d;
+
+    if (sscanf(str, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) return kOTBadAddressErr;
+    *host = (a << 24) | (b << 16) | (c << 8) | d;
+    return kOTNoError;
+}
+
+void OTInetHostToString(InetHost host, char *str)
+{
+    sprintf(str, "%u.%u.%u.%u", (unsigned)(host >> 24) & 0xFF,
+            (unsigned)(host >> 16) & 0xFF, (unsigned)(host >> 8) & 0xFF,
+            (unsigned)host & 0xFF);
+}
+
+OSStatus OTInetAddressToName(void *services, InetHost host, char *name)
+{
+    (void)services; (void)host; (void)name;
+    return kOTNotSupportedErr;
+}
+
+void OTInitInetAddress(InetAddress *addr, UInt16 port, UInt32 host)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->fAddressType = 2;
+    addr->fPort = port;
+    addr->fHost = host;
+}
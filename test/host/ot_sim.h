@@ -0,0 +1,72 @@
+/*
+ * ot_sim.h - Simulated Open Transport for host-side benchmarks
+ *
+ * Endpoints open, bind and connect to a simulated network that swallows
+ * whatever is sent and passes data given to otsim_receive() to OTRcv,
+ * with a T_DATA to the endpoint's notifier. A non-blocking or
+ * asynchronous OTConnect answers with T_CONNECT on the next round, or
+ * later with otsim_set_latency(); endpoints bound with a queue length
+ * take connections from otsim_incoming(). A synchronous OTAccept runs
+ * the network, and nothing else, until the handshake is done; an
+ * asynchronous one, OTBind and OTUnbind report their completion events
+ * from the next round that is due. OTSnd accepts data until
+ * the endpoint's send window is full; then a non-blocking endpoint fails with kOTFlowErr and a
+ * blocking one spins in YieldToAnyThread(). The network runs when the
+ * main thread parks or yields (see tm_sim.h), or on otsim_run(): each
+ * round delivers everything queued, reports T_MEMORYRELEASED for
+ * OTAckSends buffers and T_GODATA to flow-controlled endpoints through
+ * their notifiers. Like fm_sim.h it includes no POSIX9 headers.
+ */
+#ifndef OT_SIM_H
+#define OT_SIM_H
+
+/* Close every endpoint, drop delivered data and zero the counters */
+void            otsim_reset(void);
+
+/* Bytes an endpoint may have queued before OTSnd fails with kOTFlowErr */
+void            otsim_set_window(long bytes);
+
+/* Data arriving for the endpoint in slot n: the n-th opened since the
+ * reset, counting from 0, while none has closed. Returns -1 if that
+ * endpoint is not connected or its 64 KB inbox would overflow. Each
+ * call's data is one OTBuffer, which OTRcv copies out of or, given
+ * kOTNetbufDataIsOTBufferStar, lends out until OTReleaseBuffer */
+int             otsim_receive(int endpoint, const char *data, long len);
+
+/* The peer breaks the connection: a T_DISCONNECT to the notifier */
+int             otsim_disconnect(int endpoint);
+
+/* The peer is done sending: a T_ORDREL to the notifier. OTRcv fails
+ * with kOTLookErr past the last data until OTRcvOrderlyDisconnect */
+int             otsim_release(int endpoint);
+
+/* Rounds a peer takes to answer OTConnect or finish OTAccept's
+ * handshake (default 0: the next round) */
+void            otsim_set_latency(int rounds);
+
+/* Whether peers refuse connections: T_DISCONNECT instead of T_CONNECT */
+void            otsim_set_refuse(int on);
+
+/* A peer connects to the listening endpoint: a T_LISTEN to the notifier.
+ * Returns -1 if that endpoint was not bound with a queue length */
+int             otsim_incoming(int endpoint);
+
+/* One network round; returns non-zero if anything happened */
+int             otsim_run(void);
+
+/* Everything delivered since the reset, in order; returns the length */
+long            otsim_delivered(const char **data);
+
+/* OTSnd calls, bytes OT had to copy (sends without OTAckSends), flow errors */
+unsigned long   otsim_sends(void);
+unsigned long   otsim_copied(void);
+
+/* Bytes OTRcv copied out to callers; OTBuffers lent and not released */
+unsigned long   otsim_rcv_copied(void);
+long            otsim_buffers_lent(void);
+unsigned long   otsim_flow_errors(void);
+
+/* OTLook calls */
+unsigned long   otsim_looks(void);
+
+#endif /* OT_SIM_H */
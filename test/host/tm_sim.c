@@ -0,0 +1,204 @@
+/*
+ * tm_sim.c - Thread Manager and Time Manager stand-in for host benchmarks
+ *
+ * See tm_sim.h. Completion routines, Open Transport notifiers and Time
+ * Manager tasks are invoked from inside the stop/yield calls, which is
+ * where the real main thread would observe them: only between its own
+ * trap calls.
+ */
+
+#include "Multiverse.h"
+#include "MacCompat.h"
+#include "Threads.h"
+#include "fm_sim.h"
+#include "ot_sim.h"
+#include "tm_sim.h"
+
+#include <stddef.h>
+
+#define SIM_MAIN_THREAD     2
+#define SIM_MAX_TIMERS      16
+
+static void             (*idle_hook)(void) = NULL;
+static volatile Boolean main_stopped = false;
+static int              critical = 0;
+static unsigned long    parks = 0;
+static unsigned long    wakes = 0;
+static unsigned long    yields = 0;
+static TMTask *         timers[SIM_MAX_TIMERS];
+static double           due[SIM_MAX_TIMERS];    /* fmsim_now() to fire at */
+
+void tmsim_set_idle(void (*hook)(void))
+{
+    idle_hook = hook;
+}
+
+unsigned long tmsim_parks(void)  { return parks; }
+unsigned long tmsim_wakes(void)  { return wakes; }
+unsigned long tmsim_yields(void) { return yields; }
+
+void tmsim_reset(void)
+{
+    int i;
+
+    parks = wakes = yields = 0;
+    critical = 0;
+    main_stopped = false;
+    for (i = 0; i < SIM_MAX_TIMERS; i++) timers[i] = NULL;
+}
+
+/* The armed Time Manager task due first, or -1 */
+static int next_timer(void)
+{
+    int i, best = -1;
+
+    for (i = 0; i < SIM_MAX_TIMERS; i++) {
+        if (timers[i] && timers[i]->tmWakeUp && (best < 0 || due[i] < due[best])) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+/* Fire the armed Time Manager task due first, once its time has come */
+static Boolean fire_timer(void)
+{
+    TMTask *t;
+    int best = next_timer();
+
+    if (best < 0 || due[best] > fmsim_now()) return false;
+
+    t = timers[best];
+    t->tmWakeUp = 0;
+    t->tmCount = 0;
+    ((void (*)(TMTaskPtr))t->tmAddr)(t);
+    return true;
+}
+
+/*
+ * One scheduling round of "everything except the main thread". Returns
+ * false when nothing happened and nothing could: no idle hook standing
+ * in for other threads, and no Time Manager task still to fire.
+ */
+static Boolean run_others(void)
+{
+    if (idle_hook) idle_hook();
+    if (fmsim_run_async(1) > 0) return true;
+    if (otsim_run()) return true;
+    if (fire_timer()) return true;
+    return idle_hook != NULL || next_timer() >= 0;
+}
+
+/* ============================================================
+ * Thread Manager
+ * ============================================================ */
+
+OSErr GetCurrentThread(ThreadID *currentThreadID)
+{
+    *currentThreadID = SIM_MAIN_THREAD;
+    return noErr;
+}
+
+OSErr GetThreadCurrentTaskRef(ThreadTaskRef *threadTRef)
+{
+    *threadTRef = (ThreadTaskRef)&main_stopped;
+    return noErr;
+}
+
+OSErr ThreadBeginCritical(void)
+{
+    critical++;
+    return noErr;
+}
+
+OSErr ThreadEndCritical(void)
+{
+    if (critical > 0) critical--;
+    return noErr;
+}
+
+OSErr SetThreadStateEndCritical(ThreadID threadToSet, ThreadState newState,
+                                ThreadID suggestedThread)
+{
+    (void)suggestedThread;
+
+    ThreadEndCritical();
+
+    if (threadToSet != kCurrentThreadID && threadToSet != SIM_MAIN_THREAD) {
+        return threadNotFoundErr;
+    }
+    if (newState != kStoppedThreadState) return noErr;
+
+    parks++;
+    main_stopped = true;
+    while (main_stopped) {
+        if (!run_others()) {
+            /* Nothing left that could ever ready us */
+            main_stopped = false;
+            return threadProtocolErr;
+        }
+    }
+
+    return noErr;
+}
+
+OSErr SetThreadReadyGivenTaskRef(ThreadTaskRef threadTRef, ThreadID threadToSet)
+{
+    (void)threadTRef;
+
+    if (threadToSet != SIM_MAIN_THREAD) return threadNotFoundErr;
+    if (!main_stopped) return threadProtocolErr;
+
+    main_stopped = false;
+    wakes++;
+    return noErr;
+}
+
+OSErr YieldToAnyThread(void)
+{
+    yields++;
+    run_others();
+    return noErr;
+}
+
+/* ============================================================
+ * Time Manager
+ * ============================================================ */
+
+void InsTime(QElemPtr tmTaskPtr)
+{
+    TMTask *t = (TMTask *)tmTaskPtr;
+    int i;
+
+    t->tmWakeUp = 0;
+    for (i = 0; i < SIM_MAX_TIMERS; i++) {
+        if (timers[i] == NULL) {
+            timers[i] = t;
+            return;
+        }
+    }
+}
+
+void PrimeTime(QElemPtr tmTaskPtr, long count)
+{
+    TMTask *t = (TMTask *)tmTaskPtr;
+    int i;
+
+    /* Negative counts are microseconds, positive milliseconds */
+    t->tmCount = count < 0 ? -count : count * 1000;
+    t->tmWakeUp = 1;
+    for (i = 0; i < SIM_MAX_TIMERS; i++) {
+        if (timers[i] == t) due[i] = fmsim_now() + t->tmCount / 1e6;
+    }
+}
+
+void RmvTime(QElemPtr tmTaskPtr)
+{
+    int i;
+
+    for (i = 0; i < SIM_MAX_TIMERS; i++) {
+        if (timers[i] == (TMTask *)tmTaskPtr) {
+            timers[i] = NULL;
+        }
+    }
+}
@@ -0,0 +1,26 @@
+/*
+ * tm_sim.h - Simulated Thread Manager and Time Manager for host benchmarks
+ *
+ * The host process has one real thread, which plays the Mac's main
+ * thread. When it stops itself (SetThreadStateEndCritical with
+ * kStoppedThreadState) the simulator "runs the other threads": it calls
+ * the idle hook, lets the simulated drive finish one queued request,
+ * runs a round of the simulated network, and fires Time Manager tasks
+ * whose time has come, until something readies the
+ * stopped thread with SetThreadReadyGivenTaskRef(). If nothing ever
+ * could - no idle hook, no task still to fire - the stop fails with
+ * threadProtocolErr instead of hanging.
+ */
+#ifndef TM_SIM_H
+#define TM_SIM_H
+
+/* Work done by "other threads" while the caller is parked or yielding */
+void            tmsim_set_idle(void (*hook)(void));
+
+/* Times the main thread stopped, and was readied by interrupt-level code */
+unsigned long   tmsim_parks(void);
+unsigned long   tmsim_wakes(void);
+unsigned long   tmsim_yields(void);
+void            tmsim_reset(void);
+
+#endif /* TM_SIM_H */